@@ -17,7 +17,26 @@ using std::endl;
 namespace gltw { }
 
 #include "gltw_util.hpp"
+#include "gltw_trace.hpp"
+#include "gltw_memory.hpp"
+#include "gltw_matrix.hpp"
 #include "gltw_shader.hpp"
+#include "gltw_bvh.hpp"
 #include "gltw_batch.hpp"
+#include "gltw_mesh.hpp"
+#include "gltw_static.hpp"
+#include "gltw_occlusion.hpp"
+#include "gltw_loader.hpp"
+#include "gltw_upload.hpp"
+#include "gltw_texture.hpp"
+#include "gltw_atlas.hpp"
+#include "gltw_offscreen.hpp"
+#include "gltw_debug.hpp"
+#include "gltw_stream.hpp"
+#include "gltw_pointcloud.hpp"
+#include "gltw_terrain.hpp"
+#include "gltw_reload.hpp"
+#include "gltw_soft.hpp"
+#include "gltw_particles.hpp"
 
 #endif
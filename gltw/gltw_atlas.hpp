@@ -0,0 +1,181 @@
+#ifndef __gltw_atlas_hpp
+#define __gltw_atlas_hpp
+
+#include <vector>
+
+namespace gltw {
+
+	/** How a TextureAtlas stores its pages */
+	enum AtlasMode {
+		/** Each page is a separate GL_TEXTURE_2D texture, drawn with ::FEATURE_TEXTURE */
+		ATLAS_2D,
+		/** The pages are the layers of one GL_TEXTURE_2D_ARRAY texture, drawn with ::FEATURE_TEXTURE_ARRAY */
+		ATLAS_ARRAY
+	};
+
+	/** Where an image was placed in a TextureAtlas */
+	struct AtlasRegion {
+		/** The page (texture or layer) holding the image, or -1 if it could not be placed */
+		int page;
+		/** The position and size of the image on the page, in pixels */
+		GLsizei x, y, width, height;
+		/** The texture coordinates of the corners of the image on the page */
+		GLfloat s0, t0, s1, t1;
+	};
+
+	/** The packing efficiency of a TextureAtlas, see TextureAtlas::stats */
+	struct AtlasStats {
+		/** The number of images placed */
+		size_t images;
+		/** The number of pages */
+		size_t pages;
+		/** The pixels of the images */
+		size_t usedPixels;
+		/** The pixels of the pages */
+		size_t totalPixels;
+		/** usedPixels / totalPixels */
+		float efficiency;
+		/** The bytes of GPU memory, including mipmaps, not covered by any image */
+		size_t wastedBytes;
+	};
+
+	/**
+	 * <p>Packs many small RGBA8 images into a few large textures, so that meshes using
+	 * different images can be drawn without binding a texture between them.  The images are
+	 * placed with the skyline bottom-left heuristic, tallest first, into pages of a fixed
+	 * width.  The pages are separate 2D textures, or the layers of one array texture (see
+	 * ::AtlasMode), which lets every mesh share a single bind.</p>
+	 *
+	 * <p>Texture coordinates in [0,1] over an image are remapped to its place in the atlas
+	 * by remapTexCoords, or while creating a mesh with createMesh.  Coordinates outside
+	 * [0,1] would reach neighbouring images, so images that repeat cannot share an atlas.
+	 * Each image is surrounded by padding that repeats its edge pixels, which keeps
+	 * filtering and the first few mipmap levels from mixing in the neighbours.</p>
+	 *
+	 * <p><code>
+	 *    gltw::TextureAtlas atlas( 1024, 1024, gltw::ATLAS_ARRAY );<br />
+	 *    int brick = atlas.add( std::move( brickPixels ), 64, 64 );<br />
+	 *    int grass = atlas.add( std::move( grassPixels ), 128, 32 );<br />
+	 *    atlas.build();<br />
+	 *    gltw::TriangleMeshPtr wall( atlas.createMesh( wallData, brick ) );<br />
+	 *    <br />
+	 *    // Within the draw function<br />
+	 *    gltw::useShaderVariant( gltw::shaderKey( gltw::FEATURE_LIGHTING | gltw::FEATURE_TEXTURE_ARRAY ) );<br />
+	 *    atlas.texture( 0 ).bind();<br />
+	 *    wall->draw();<br />
+	 *    lawn->draw();<br />
+	 * </code></p>
+	 */
+	class TextureAtlas : public NonCopyable {
+	public:
+		/**
+		 * Constructs an empty atlas.  This makes no OpenGL calls.
+		 *
+		 * @param pageWidth the width of each page, in pixels
+		 * @param pageHeight the maximum height of each page, in pixels.  In ::ATLAS_2D mode the
+		 *    last page is cut down to the height it uses.
+		 * @param mode whether the pages are separate textures or the layers of an array texture
+		 * @param padding the pixels around each image, filled with its edge pixels
+		 * @param mipmaps whether to generate mipmaps for the pages
+		 */
+		TextureAtlas( GLsizei pageWidth = 2048, GLsizei pageHeight = 2048, AtlasMode mode = ATLAS_2D,
+			int padding = 2, bool mipmaps = true );
+
+		/**
+		 * Add an image to be packed by build(), which must not have been called yet.  Pass
+		 * the pixels with std::move to avoid a copy; their memory is freed by build().
+		 *
+		 * @param pixels the image, 4 bytes per pixel (r,g,b,a), rows from the bottom up
+		 * @param width the width of the image, in pixels
+		 * @param height the height of the image, in pixels
+		 * @return the index of the image, or -1 if the pixels do not match the size or the
+		 *    atlas has been built
+		 */
+		int add( std::vector<unsigned char> pixels, GLsizei width, GLsizei height );
+
+		/**
+		 * Pack the images and create the textures.  This is done once, after all of the
+		 * images have been added.  Images larger than a page are reported and left unplaced.
+		 *
+		 * @return the number of pages
+		 */
+		size_t build();
+
+		/** @return where an image was placed.  Valid after build(). */
+		const AtlasRegion & region( int image ) const { return regions[image]; }
+
+		/** @return the number of images added */
+		size_t numImages() const { return regions.size(); }
+
+		/** @return the number of textures: the pages in ::ATLAS_2D mode, or one in ::ATLAS_ARRAY mode */
+		size_t numTextures() const { return textures.size(); }
+
+		/**
+		 * @return a texture of the atlas.  In ::ATLAS_2D mode this is the page of that
+		 *    index, and in ::ATLAS_ARRAY mode index 0 is the array.
+		 */
+		Texture & texture( size_t index ) { return *textures[index]; }
+
+		/** @return the texture holding an image, to be bound before drawing it */
+		Texture & textureOf( int image ) { return *textures[mode == ATLAS_ARRAY ? 0 : regions[image].page]; }
+
+		/**
+		 * Remap texture coordinates from [0,1] over an image to its place in the atlas.  In
+		 * ::ATLAS_ARRAY mode the layer is also encoded in t, as ::FEATURE_TEXTURE_ARRAY expects.
+		 *
+		 * @param texCoords the coordinates (s,t), replaced with the remapped ones
+		 * @param numVerts the number of vertices
+		 * @param image the index of the image
+		 */
+		void remapTexCoords( GLfloat * texCoords, size_t numVerts, int image ) const;
+
+		/** Remap the texture coordinates of a MeshData in place, as above */
+		void remapTexCoords( MeshData & data, int image ) const;
+
+		/**
+		 * Create a TriangleMesh from mesh data, remapping its texture coordinates to an image
+		 * of the atlas as they are copied.  The data is not modified.  It is the caller's
+		 * responsibility to delete the mesh.
+		 *
+		 * @param data the mesh data, which must include texture coordinates
+		 * @param image the index of the image
+		 * @param usage the buffer usage specifer to be used, defaults to GL_STATIC_DRAW.
+		 */
+		TriangleMesh * createMesh( const MeshData & data, int image, GLenum usage = GL_STATIC_DRAW ) const;
+
+		/** @return the packing efficiency of the pages built so far */
+		AtlasStats stats() const;
+
+	private:
+		struct Image {
+			std::vector<unsigned char> pixels;
+			int index;
+		};
+		// A run of the top edge of the packed area, from x to x + width at height y
+		struct Segment {
+			GLsizei x, y, width;
+		};
+		struct Page {
+			std::vector<Segment> skyline;
+			std::vector<unsigned char> pixels;
+			GLsizei height;
+		};
+
+		bool place( Page & page, GLsizei w, GLsizei h, GLsizei & x, GLsizei & y );
+		void blit( Page & page, const Image & image, const AtlasRegion & r );
+
+		GLsizei pageWidth, pageHeight;
+		AtlasMode mode;
+		int padding;
+		bool mipmaps;
+		std::vector<AtlasRegion> regions;
+		std::vector<Image> added;
+		std::vector<Page> pages;
+		std::vector<TexturePtr> textures;
+		bool built;
+	};
+}
+
+#include "gltw_atlas.inl"
+
+#endif
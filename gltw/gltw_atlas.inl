@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace gltw {
+
+	inline TextureAtlas::TextureAtlas( GLsizei width, GLsizei height, AtlasMode m, int pad, bool mips ) :
+		pageWidth(width), pageHeight(height), mode(m), padding(std::max( pad, 0 )), mipmaps(mips), built(false)
+	{ }
+
+	inline int TextureAtlas::add( std::vector<unsigned char> pixels, GLsizei width, GLsizei height )
+	{
+		if( built ) {
+			cerr << "Error in TextureAtlas.add: images cannot be added after build()." << endl;
+			return -1;
+		}
+		if( width <= 0 || height <= 0 || pixels.size() != 4 * (size_t)width * height ) {
+			cerr << "Error in TextureAtlas.add: the image must hold 4 bytes for each of its pixels." << endl;
+			return -1;
+		}
+		Image image;
+		image.pixels = std::move( pixels );
+		image.index = (int)regions.size();
+		added.push_back( std::move( image ) );
+		AtlasRegion r = { -1, 0, 0, width, height, 0.0f, 0.0f, 0.0f, 0.0f };
+		regions.push_back( r );
+		return (int)regions.size() - 1;
+	}
+
+	inline bool TextureAtlas::place( Page & page, GLsizei w, GLsizei h, GLsizei & x, GLsizei & y )
+	{
+		// Skyline bottom-left: the position along the skyline where the rectangle's top is lowest
+		std::vector<Segment> & sky = page.skyline;
+		size_t best = sky.size();
+		GLsizei bestTop = INT_MAX, bestWidth = INT_MAX, bestY = 0;
+		for( size_t i = 0; i < sky.size(); i++ ) {
+			if( sky[i].x + w > pageWidth ) break;
+			GLsizei top = 0, covered = 0;
+			for( size_t j = i; covered < w; j++ ) {
+				top = std::max( top, sky[j].y );
+				covered += sky[j].width;
+			}
+			if( top + h > pageHeight ) continue;
+			if( top + h < bestTop || (top + h == bestTop && sky[i].width < bestWidth) ) {
+				best = i;
+				bestTop = top + h;
+				bestWidth = sky[i].width;
+				bestY = top;
+			}
+		}
+		if( best == sky.size() ) return false;
+		x = sky[best].x;
+		y = bestY;
+
+		// Raise the skyline over the rectangle, trimming the segments it covers
+		Segment raised = { x, y + h, w };
+		sky.insert( sky.begin() + best, raised );
+		size_t i = best + 1;
+		while( i < sky.size() && sky[i].x < x + w ) {
+			GLsizei overlap = x + w - sky[i].x;
+			if( overlap >= sky[i].width ) {
+				sky.erase( sky.begin() + i );
+			} else {
+				sky[i].x += overlap;
+				sky[i].width -= overlap;
+				break;
+			}
+		}
+		// Merge neighbours of the same height
+		for( size_t j = 0; j + 1 < sky.size(); ) {
+			if( sky[j].y == sky[j + 1].y ) {
+				sky[j].width += sky[j + 1].width;
+				sky.erase( sky.begin() + j + 1 );
+			} else {
+				j++;
+			}
+		}
+		page.height = std::max( page.height, y + h );
+		return true;
+	}
+
+	inline void TextureAtlas::blit( Page & page, const Image & image, const AtlasRegion & r )
+	{
+		// Copy the image into the middle of its padded rectangle, and repeat its edge pixels into the padding
+		const unsigned char * src = image.pixels.data();
+		for( GLsizei py = -padding; py < r.height + padding; py++ ) {
+			GLsizei sy = std::min( std::max( py, 0 ), r.height - 1 );
+			const unsigned char * srcRow = src + 4 * (size_t)r.width * sy;
+			unsigned char * dest = &page.pixels[4 * ((size_t)pageWidth * (r.y + py) + r.x)];
+			memcpy( dest, srcRow, 4 * (size_t)r.width );
+			for( GLsizei px = 1; px <= padding; px++ ) {
+				memcpy( dest - 4 * px, srcRow, 4 );
+				memcpy( dest + 4 * (r.width - 1 + px), srcRow + 4 * (r.width - 1), 4 );
+			}
+		}
+	}
+
+	inline size_t TextureAtlas::build()
+	{
+		if( built ) {
+			cerr << "Error in TextureAtlas.build: the atlas has already been built." << endl;
+			return pages.size();
+		}
+		GLTW_TRACE_INTERNAL( "TextureAtlas::build" );
+		built = true;
+
+		// Tallest first, then widest
+		std::vector<size_t> order( added.size() );
+		for( size_t i = 0; i < order.size(); i++ ) order[i] = i;
+		std::stable_sort( order.begin(), order.end(), [&]( size_t a, size_t b ) {
+			const AtlasRegion & ra = regions[added[a].index], & rb = regions[added[b].index];
+			if( ra.height != rb.height ) return ra.height > rb.height;
+			return ra.width > rb.width;
+		} );
+
+		for( size_t k = 0; k < order.size(); k++ ) {
+			AtlasRegion & r = regions[added[order[k]].index];
+			const GLsizei w = r.width + 2 * padding, h = r.height + 2 * padding;
+			if( w > pageWidth || h > pageHeight ) {
+				cerr << "Error in TextureAtlas.build: image " << added[order[k]].index << " (" << r.width << "x"
+					<< r.height << ") does not fit in a page." << endl;
+				continue;
+			}
+			GLsizei x = 0, y = 0;
+			size_t p = 0;
+			while( p < pages.size() && !place( pages[p], w, h, x, y ) ) p++;
+			if( p == pages.size() ) {
+				Page page;
+				Segment all = { 0, 0, pageWidth };
+				page.skyline.push_back( all );
+				page.height = 0;
+				pages.push_back( page );
+				place( pages[p], w, h, x, y );
+			}
+			r.page = (int)p;
+			r.x = x + padding;
+			r.y = y + padding;
+		}
+
+		// Each page is cut down to the height it uses; the layers of an array share the tallest
+		GLsizei arrayHeight = 1;
+		for( size_t p = 0; p < pages.size(); p++ ) arrayHeight = std::max( arrayHeight, pages[p].height );
+		if( mode == ATLAS_ARRAY ) {
+			for( size_t p = 0; p < pages.size(); p++ ) pages[p].height = arrayHeight;
+		}
+		for( size_t i = 0; i < regions.size(); i++ ) {
+			AtlasRegion & r = regions[i];
+			if( r.page < 0 ) continue;
+			const GLfloat h = (GLfloat)pages[r.page].height;
+			r.s0 = r.x / (GLfloat)pageWidth;
+			r.s1 = (r.x + r.width) / (GLfloat)pageWidth;
+			r.t0 = r.y / h;
+			r.t1 = (r.y + r.height) / h;
+		}
+
+		std::vector<std::vector<size_t> > onPage( pages.size() );
+		for( size_t i = 0; i < added.size(); i++ ) {
+			int p = regions[added[i].index].page;
+			if( p >= 0 ) onPage[p].push_back( i );
+		}
+		if( mode == ATLAS_ARRAY && !pages.empty() ) {
+			textures.push_back( TexturePtr( new Texture( pageWidth, arrayHeight, mipmaps ? 0 : 1, GL_RGBA8, (int)pages.size() ) ) );
+		}
+		for( size_t p = 0; p < pages.size(); p++ ) {
+			Page & page = pages[p];
+			page.pixels.assign( 4 * (size_t)pageWidth * page.height, 0 );
+			for( size_t i = 0; i < onPage[p].size(); i++ ) {
+				const Image & image = added[onPage[p][i]];
+				blit( page, image, regions[image.index] );
+			}
+			if( mode == ATLAS_ARRAY ) {
+				textures[0]->copyLayerData( (int)p, 0, page.pixels.data() );
+			} else {
+				textures.push_back( TexturePtr( new Texture( pageWidth, page.height, mipmaps ? 0 : 1 ) ) );
+				textures.back()->copyImageData( 0, page.pixels.data() );
+				if( mipmaps ) textures.back()->generateMipmaps();
+			}
+			std::vector<unsigned char>().swap( page.pixels );
+		}
+		if( mode == ATLAS_ARRAY && mipmaps && !textures.empty() ) textures[0]->generateMipmaps();
+
+		std::vector<Image>().swap( added );
+		return pages.size();
+	}
+
+	inline void TextureAtlas::remapTexCoords( GLfloat * texCoords, size_t numVerts, int image ) const
+	{
+		const AtlasRegion & r = regions[image];
+		if( r.page < 0 ) {
+			cerr << "Error in TextureAtlas.remapTexCoords: image " << image << " has not been placed." << endl;
+			return;
+		}
+		const GLfloat ds = r.s1 - r.s0, dt = r.t1 - r.t0;
+		const GLfloat t0 = r.t0 + (mode == ATLAS_ARRAY ? 2.0f * r.page : 0.0f);
+		for( size_t i = 0; i < numVerts; i++ ) {
+			texCoords[2 * i] = r.s0 + texCoords[2 * i] * ds;
+			texCoords[2 * i + 1] = t0 + texCoords[2 * i + 1] * dt;
+		}
+	}
+
+	inline void TextureAtlas::remapTexCoords( MeshData & data, int image ) const
+	{
+		remapTexCoords( data.texCoords.data(), data.texCoords.size() / 2, image );
+	}
+
+	inline TriangleMesh * TextureAtlas::createMesh( const MeshData & data, int image, GLenum usage ) const
+	{
+		if( data.texCoords.size() != 2 * (size_t)data.numVerts() ) {
+			cerr << "Error in TextureAtlas.createMesh: the mesh must include texture coordinates." << endl;
+			return NULL;
+		}
+		TriangleMesh * mesh = new TriangleMesh( data.numVerts(), data.numElements(), data.attributes(), usage );
+		mesh->copyPositionData( data.positions.data() );
+		if( !data.normals.empty() ) mesh->copyNormalData( data.normals.data() );
+		if( !data.colors.empty() ) mesh->copyColorData( data.colors.data() );
+		std::vector<GLfloat> texCoords( data.texCoords );
+		remapTexCoords( texCoords.data(), data.numVerts(), image );
+		mesh->copyTexCoordData( texCoords.data() );
+		mesh->copyElementData( data.elements.data() );
+		return mesh;
+	}
+
+	inline AtlasStats TextureAtlas::stats() const
+	{
+		AtlasStats stats;
+		stats.images = 0;
+		stats.pages = pages.size();
+		stats.usedPixels = stats.totalPixels = 0;
+		for( size_t i = 0; i < regions.size(); i++ ) {
+			if( regions[i].page < 0 ) continue;
+			stats.images++;
+			stats.usedPixels += (size_t)regions[i].width * regions[i].height;
+		}
+		size_t bytes = 0;
+		for( size_t p = 0; p < pages.size(); p++ ) stats.totalPixels += (size_t)pageWidth * pages[p].height;
+		for( size_t i = 0; i < textures.size(); i++ ) bytes += textures[i]->gpuBytes();
+		stats.efficiency = stats.totalPixels > 0 ? (float)stats.usedPixels / stats.totalPixels : 0.0f;
+		stats.wastedBytes = stats.totalPixels > 0 ?
+			(size_t)((double)bytes * (stats.totalPixels - stats.usedPixels) / stats.totalPixels) : 0;
+		return stats;
+	}
+}
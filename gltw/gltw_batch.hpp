@@ -1,18 +1,101 @@
 #ifndef __gltw_batch_hpp
 #define __gltw_batch_hpp
 
+#include <cstdio>
+#include <memory>
+#include <vector>
+
 namespace gltw {
 
-	/** Inheriting from this should disallow copying via copy constructor or
-	 assignment operator. */
-	class NonCopyable {
-	private:
-		NonCopyable(const NonCopyable& other );
-		NonCopyable & operator = (const NonCopyable & other );
-	public:
-		NonCopyable() { }
+	/**
+	 * Vertex and element data for a mesh, held in CPU memory.  Positions and normals are
+	 * 3 values per vertex, colors are 4 values per vertex, texture coordinates are 2 values
+	 * per vertex, and elements are triangle indices.  The normal, color and texture coordinate
+	 * arrays may be empty.
+	 *
+	 * <p>MeshData can be reused: resize() only allocates when the arrays grow beyond
+	 * their previous capacity, so rebuilding a mesh of the same size into the
+	 * same MeshData does not touch the heap.</p>
+	 */
+	struct MeshData {
+		/** The vertex positions (x,y,z) */
+		std::vector<GLfloat> positions;
+		/** The vertex normals (x,y,z) */
+		std::vector<GLfloat> normals;
+		/** The vertex colors (r,g,b,a) */
+		std::vector<GLfloat> colors;
+		/** The vertex texture coordinates (s,t) */
+		std::vector<GLfloat> texCoords;
+		/** The element indices, three per triangle */
+		std::vector<GLuint> elements;
+
+		/** @return the number of vertices */
+		GLuint numVerts() const { return (GLuint)(positions.size() / 3); }
+		/** @return the number of element indices */
+		GLuint numElements() const { return (GLuint)elements.size(); }
+		/** @return the attributes present in this data, as a bitwise OR of ::Attribute entries */
+		int attributes() const {
+			return ATTRIB_POSITION | (normals.empty() ? 0 : ATTRIB_NORMAL) | (colors.empty() ? 0 : ATTRIB_COLOR) |
+				(texCoords.empty() ? 0 : ATTRIB_TEXCOORD);
+		}
+
+		/**
+		 * Set the size of the position, normal and element arrays, and clear the color and
+		 * texture coordinate arrays.  Existing capacity is reused.
+		 */
+		void resize( GLuint numVerts, GLuint numElements ) {
+			positions.resize( 3 * (size_t)numVerts );
+			normals.resize( 3 * (size_t)numVerts );
+			colors.clear();
+			texCoords.clear();
+			elements.resize( numElements );
+		}
+
+		/** Empty all arrays, keeping their capacity */
+		void clear() {
+			positions.clear();
+			normals.clear();
+			colors.clear();
+			texCoords.clear();
+			elements.clear();
+		}
+	};
+
+	/**
+	 * Everything needed to draw a prepared VertexBatch or TriangleMesh, in a plain struct
+	 * that can be stored in arrays and sorted.  Obtain one with VertexBatch::drawCommand,
+	 * and draw it with ::executeDrawCommand or ::executeDrawCommands.  The command remains
+	 * valid until the batch it came from is destroyed or moved.
+	 */
+	struct DrawCommand {
+		/** The vertex array object */
+		GLuint vertexArray;
+		/** The OpenGL primitive type */
+		GLenum mode;
+		/** The number of vertices (or element indices) to draw */
+		GLsizei count;
+		/** The type of the element indices, or GL_NONE to draw the vertices in order */
+		GLenum indexType;
 	};
 
+	/**
+	 * Draw a single DrawCommand.  This binds the command's vertex array object and issues the
+	 * draw call, with no other checks.  Unlike VertexBatch::draw, the vertex array object is
+	 * left bound.
+	 *
+	 * @param cmd the command, which must come from a prepared VertexBatch or TriangleMesh
+	 */
+	void executeDrawCommand( const DrawCommand &cmd );
+
+	/**
+	 * Draw a sequence of DrawCommands, binding each vertex array object only when it differs
+	 * from the previous command's.  The vertex array binding is reset to zero afterwards.
+	 *
+	 * @param cmds a pointer to the commands
+	 * @param count the number of commands
+	 */
+	void executeDrawCommands( const DrawCommand *cmds, size_t count );
+
 	/**
 	 * <p>The VertexBatch is a class that manages a set of buffer object containing
 	 * vertex data.  A VertexBatch contains one buffer for each attribute.  The
@@ -34,8 +117,21 @@ namespace gltw {
 	 *  
 	 *  <p> Data can be copied into the VertexBatch at any time, but must be done at
 	 *   least once before drawing.</p>
+	 *
+	 *  <p> The first draw (or an explicit call to prepare()) checks that all of the
+	 *   data is present and builds the vertex array object.  Later draws skip those
+	 *   checks.  For the lowest overhead, use drawCommand() and ::executeDrawCommands.</p>
+	 *
+	 *  <p> The bytes of the buffers are counted against the GPU memory budget (see
+	 *   ::setMemoryBudget).  A VertexBatch given an ::EvictionBacking by setEviction() may
+	 *   be evicted when the budget is exceeded, and is restored when next drawn.  A
+	 *   DrawCommand does not restore it, so obtain the commands of evictable objects each
+	 *   frame.  drawCommand() restores an evicted object without enforcing the budget, so
+	 *   collecting commands never evicts anything.  The budget is enforced by draw() and
+	 *   by ::enforceMemoryBudget, which may evict objects whose commands were already
+	 *   collected, so execute the collected commands before calling either.</p>
 	 */
-	class VertexBatch : public NonCopyable {
+	class VertexBatch : public NonCopyable, public EvictableResource {
 	public:
 		/**
 		 * Constructs a new VertexBatch object.  This constructor does not call any 
@@ -51,6 +147,18 @@ namespace gltw {
 		 */
 		VertexBatch( GLenum primitiveType, GLuint numVerts, int attributes = ATTRIB_POSITION, GLenum usage = GL_DYNAMIC_DRAW );
 
+		/**
+		 * Moves the OpenGL buffer objects of another VertexBatch into a new one.  The other
+		 * VertexBatch is left without buffers.
+		 */
+		VertexBatch( VertexBatch && other );
+
+		/**
+		 * Deletes the OpenGL buffer objects of this VertexBatch, and moves the buffer objects
+		 * of another VertexBatch into this one.  The other VertexBatch is left without buffers.
+		 */
+		VertexBatch & operator = ( VertexBatch && other );
+
 		/** Deletes the OpenGL buffer objects for this VertexBatch */
 		virtual ~VertexBatch();
 
@@ -62,6 +170,25 @@ namespace gltw {
 		 */
 		bool isReady();
 
+		/**
+		 * Check once that this object is ready to be drawn, and build its vertex array object.
+		 * This is done automatically by the first call to draw(), but it may be called ahead of
+		 * time to keep the work out of the rendering loop.  After this succeeds, the copy*Data
+		 * functions may still be used to update the data.
+		 *
+		 * @return true if the object is ready to draw.  If not, an error message is displayed.
+		 */
+		virtual bool prepare();
+
+		/**
+		 * Prepare this object (see prepare()) and return a DrawCommand for drawing it.  This
+		 * restores an evicted object but does not enforce the memory budget.  The command is
+		 * valid until this object is evicted, which only draw() or ::enforceMemoryBudget can do.
+		 *
+		 * @return the command, or a command with a count of zero if the object is not ready.
+		 */
+		virtual DrawCommand drawCommand();
+
 		/**
 		 * Copy the array of position data to the buffer contained within this VertexBatch,
 		 * creating the buffer if needed.  The position data is assumed to be 3 coordinates
@@ -69,7 +196,7 @@ namespace gltw {
 		 *
 		 * @param data a pointer to 3 * nVerts values, where nVerts is the number of vertices
 		 */
-		void copyPositionData( GLfloat * data );
+		void copyPositionData( const GLfloat * data );
 		/**
 		 * Copy the array of normal data to the buffer contained within this VertexBatch,
 		 * creating the buffer if needed.  The normal data is assumed to be 3 coordinates
@@ -77,7 +204,7 @@ namespace gltw {
 		 *
 		 * @param data a pointer to 3 * nVerts values, where nVerts is the number of vertices 
 		 */
-		void copyNormalData( GLfloat * data );
+		void copyNormalData( const GLfloat * data );
 		/**
 		 * Copy the array of color data to the buffer contained within this VertexBatch,
 		 * creating the buffer if needed.  The color data is assumed to be 4 values
@@ -85,11 +212,31 @@ namespace gltw {
 		 *
 		 * @param data a pointer to 4 * nVerts values, where nVerts is the number of vertices 
 		 */
-		void copyColorData( GLfloat * data );
+		void copyColorData( const GLfloat * data );
 		/**
-		 * Not implemented yet.
+		 * Copy position data for a range of vertices, creating the buffer if needed.  This
+		 * allows a large VertexBatch to be filled in pieces, without holding all of its data
+		 * in memory at once.
+		 *
+		 * @param data a pointer to 3 * count values
+		 * @param first the index of the first vertex to replace
+		 * @param count the number of vertices to replace
 		 */
-		void copyTexCoordData( GLfloat * data );
+		void copyPositionData( const GLfloat * data, GLuint first, GLuint count );
+		/** Copy normal data (3 values per vertex) for a range of vertices, as with copyPositionData(data, first, count) */
+		void copyNormalData( const GLfloat * data, GLuint first, GLuint count );
+		/** Copy color data (4 values per vertex) for a range of vertices, as with copyPositionData(data, first, count) */
+		void copyColorData( const GLfloat * data, GLuint first, GLuint count );
+		/**
+		 * Copy the array of texture coordinate data to the buffer contained within this
+		 * VertexBatch, creating the buffer if needed.  The texture coordinate data is assumed
+		 * to be 2 values per vertex (s,t).
+		 *
+		 * @param data a pointer to 2 * nVerts values, where nVerts is the number of vertices
+		 */
+		void copyTexCoordData( const GLfloat * data );
+		/** Copy texture coordinate data (2 values per vertex) for a range of vertices, as with copyPositionData(data, first, count) */
+		void copyTexCoordData( const GLfloat * data, GLuint first, GLuint count );
 
 		/** Draw this VertexBatch.  This will do nothing and print an error message if
 		 * the buffers are not ready.  Make sure to fill the buffers via one of the
@@ -97,17 +244,93 @@ namespace gltw {
 		 */
 		virtual void draw();
 
+		/**
+		 * Keep a CPU copy of the positions (and, for a TriangleMesh, the elements) so that
+		 * the triangles can be queried with bvh().  The copy is updated by the copy*Data
+		 * functions.  Data already copied to the buffers is read back from them.
+		 *
+		 * @param keep true to keep the copy, false to free it
+		 */
+		virtual void keepQueryData( bool keep = true );
+
+		/**
+		 * Get a bounding volume hierarchy over the triangles of this object, for picking and
+		 * other queries (see MeshBVH).  The first call builds it.  Later calls refit it if
+		 * positions have been copied since, or rebuild it if elements have.
+		 *
+		 * @param pool the threads to build with, defaults to ThreadPool::shared()
+		 * @return the BVH, valid until the next copy*Data call; or NULL if keepQueryData
+		 *    has not been called, the primitive type is not GL_TRIANGLES, or the data has not
+		 *    been copied.
+		 */
+		const MeshBVH * bvh( ThreadPool * pool = NULL );
+
+		/**
+		 * Choose whether this object may be evicted when the GPU memory budget is exceeded,
+		 * and where its data is kept while it is evicted.  With ::EVICT_NEVER, an evicted
+		 * object is restored at once.
+		 *
+		 * @param backing where to keep the data of the evicted object
+		 */
+		void setEviction( EvictionBacking backing );
+
+		/**
+		 * Read the buffers back, keep them as chosen by setEviction (in CPU memory for
+		 * ::EVICT_NEVER), and delete them and the vertex array object.  The object is restored
+		 * when it is next drawn, prepared or given new data.  This is called as needed to keep
+		 * within the memory budget, but may also be called directly.
+		 *
+		 * @return false if the object holds no buffers, or they could not be saved
+		 */
+		virtual bool evict();
+
+		/** @return whether the buffers are in GPU memory, as opposed to evicted */
+		bool resident() const { return !evicted; }
+
+		/** @return the bytes of the buffers of this object, or zero while it is evicted */
+		virtual size_t gpuBytes() const;
+
+		/** @return the bytes of the buffers of this object while it is evicted, zero otherwise */
+		virtual size_t evictedBytes() const;
+
 	protected:
 		enum Buffer { POSITION, NORMAL, COLOR, TEXCOORD, ELEMENT, NUM_BUFFERS };
 		virtual void buildVertexArray();
+		void release();
 		bool attribEnabled( Attribute attrib );
+		bool copyBufferData( Buffer buf, size_t bytesPerItem, GLuint numItems,
+			const void * data, GLuint first, GLuint count );
+		bool restore();
+		void trackBuffers( bool allocated );
+
+		/** The CPU copy kept by keepQueryData */
+		struct QueryData {
+			std::vector<GLfloat> positions;
+			std::vector<GLuint> elements;
+			MeshBVH bvh;
+			bool indexed, built, positionsChanged, topologyChanged;
+		};
+
+		/** The buffers of an evicted object, in buffer order, in memory or in a temporary file */
+		struct EvictedData {
+			std::vector<char> bytes;
+			FILE * file;
+			EvictedData() : file(NULL) { }
+			~EvictedData() { if( file ) fclose( file ); }
+		};
 
 		int attributes;
 		/** The number of vertices in this VertexBatch */
 		unsigned int nVerts;
 		GLenum bufferUsage, drawMode;
 		GLuint vaID;
+		bool prepared;
 		GLuint bufIDs[NUM_BUFFERS];
+		/** The allocated size of each buffer, kept while evicted */
+		size_t bufBytes[NUM_BUFFERS];
+		std::unique_ptr<QueryData> query;
+		EvictionBacking backing;
+		std::unique_ptr<EvictedData> evicted;
 	};
 
 	/**
@@ -131,6 +354,31 @@ namespace gltw {
 		 */
 		TriangleMesh( GLuint numVerts, GLuint numElements, int attributes = ATTRIB_POSITION | ATTRIB_NORMAL, GLenum usage = GL_STATIC_DRAW );
 
+		/**
+		 * Construct a TriangleMesh object sized for the given data, and copy the data into it.
+		 * The attributes of the mesh are those present in the data.
+		 *
+		 * @param data the vertex and element data.  It must include normals.
+		 * @param usage the buffer usage specifer to be used, defaults to GL_STATIC_DRAW.
+		 */
+		explicit TriangleMesh( const MeshData &data, GLenum usage = GL_STATIC_DRAW );
+
+		/** Moves the buffer objects of another TriangleMesh into a new one. */
+		TriangleMesh( TriangleMesh && other );
+
+		/** Deletes the buffer objects of this TriangleMesh and moves those of another into it. */
+		TriangleMesh & operator = ( TriangleMesh && other );
+
+		/**
+		 * Copy all of the arrays of a MeshData into the buffers of this TriangleMesh.
+		 * The data must have the same number of vertices and elements as this mesh.
+		 * When the buffers already exist they are updated in place, so rebuilding a
+		 * mesh every frame allocates neither CPU nor GPU memory.
+		 *
+		 * @param data the vertex and element data
+		 */
+		void copyMeshData( const MeshData &data );
+
 		/**
 		 * Copy the array of element index data to the buffer contained within this TriangleMesh,
 		 * creating the buffer if needed.  The element index data is assumed to be one GLuint
@@ -139,7 +387,16 @@ namespace gltw {
 		 * @param data a pointer to nElements values, where nElements is the number of elements
 		 *        provided at the time this object was constructed.
 		 */
-		void copyElementData( GLuint * data );
+		void copyElementData( const GLuint * data );
+
+		/**
+		 * Copy element index data for a range of elements, creating the buffer if needed.
+		 *
+		 * @param data a pointer to count values
+		 * @param first the index of the first element to replace
+		 * @param count the number of elements to replace
+		 */
+		void copyElementData( const GLuint * data, GLuint first, GLuint count );
 
 		/** Draw this TriangleMesh.  This will do nothing and print an error message if
 		 * the buffers are not ready.  Make sure to fill the buffers via one of the
@@ -147,18 +404,45 @@ namespace gltw {
 		 */
 		virtual void draw();
 
+		/** Prepare this TriangleMesh for drawing, which also requires the element data.
+		 * See VertexBatch::prepare. */
+		virtual bool prepare();
+
+		/** Prepare this TriangleMesh and return a DrawCommand for drawing it. */
+		virtual DrawCommand drawCommand();
+
+		/** Keep a CPU copy of the positions and elements.  See VertexBatch::keepQueryData. */
+		virtual void keepQueryData( bool keep = true );
+
 	private:
 		virtual void buildVertexArray();
 
 		GLuint nElements;
 	};
 
+	/** A TriangleMesh owned by a std::unique_ptr */
+	typedef std::unique_ptr<TriangleMesh> TriangleMeshPtr;
+
 	/// @defgroup 3Dshapes Functions for building 3D shapes
+	/// Each shape can be built into a new TriangleMesh, or into a caller-supplied MeshData.
+	/// The latter performs no allocations once the MeshData has grown to the size of the
+	/// shape, and the result can be used to construct a TriangleMesh by value or to update an
+	/// existing one with TriangleMesh::copyMeshData:
+	///
+	/// <code>
+	///    gltw::MeshData data;<br />
+	///    gltw::buildTorus( data, 0.7f, 0.3f, 30, 30 );<br />
+	///    gltw::TriangleMesh torus( data );<br />
+	///    std::vector<gltw::TriangleMesh> meshes;<br />
+	///    meshes.push_back( std::move(torus) );<br />
+	/// </code>
 	/// @{
 	/** 
 	 * Create a TriangleMesh that describes a torus shape.  The torus is defined centered
 	 * at the origin in the x-y plane.  It is the caller's responsibility to delete the TriangleMesh
 	 * object when finished. 
+	 * The vertices where the rings and the sides close up are shared rather than repeated,
+	 * so the mesh has nSides * nRings vertices.
 	 *
 	 * @param outerRadius the radius from the origin to the center of the "ring"
 	 * @param innerRadius the internal radius of the "ring" of the donut
@@ -166,6 +450,9 @@ namespace gltw {
 	 * @param nRings the number of rings around the donut
 	 */
 	TriangleMesh* buildTorus( GLfloat outerRadius, GLfloat innerRadius, GLint nSides, GLint nRings );
+
+	/** Build a torus into the given MeshData rather than a new TriangleMesh; the other parameters are as above. */
+	void buildTorus( MeshData &data, GLfloat outerRadius, GLfloat innerRadius, GLint nSides, GLint nRings );
 	
 	/**
 	 * Create a TriangleMesh that describes a cube.  The cube is centered at the origin,
@@ -174,10 +461,16 @@ namespace gltw {
 	 */
 	TriangleMesh* buildCube();
 
+	/** Build a cube into the given MeshData rather than a new TriangleMesh. */
+	void buildCube( MeshData &data );
+
 	/**
 	 * Create a TriangleMesh that describes a cylinder.  The cylinder is aligned along the z
 	 * axis and may have a different radius at each end.  If one of the radii is zero, the 
 	 * result is a cone.  
+	 * The triangles are wound counter-clockwise seen from outside, so they face outward.
+	 * A cylinder has 2 * slices * stacks triangles.  A cone leaves out the triangles that
+	 * would collapse at its apex, so it has slices * (2 * stacks - 1).
 	 *
 	 * @param base the radius of the base of the cylinder (at z = 0)
      * @param top the radius of the top of the cylinder (at z = height)
@@ -189,6 +482,9 @@ namespace gltw {
 	 */
 	TriangleMesh * buildCylinder( float base, float top, float height, int slices, int stacks );
 
+	/** Build a cylinder into the given MeshData rather than a new TriangleMesh; the other parameters are as above. */
+	void buildCylinder( MeshData &data, float base, float top, float height, int slices, int stacks );
+
 	/**
       * Create a TriangleMesh describing a Sphere.  The
       * sphere is oriented along the z axis.  The poles are at z = radius
@@ -202,6 +498,9 @@ namespace gltw {
       */
 	TriangleMesh * buildSphere(GLfloat radius, int slices, int stacks);
 
+	/** Build a sphere into the given MeshData rather than a new TriangleMesh; the other parameters are as above. */
+	void buildSphere( MeshData &data, GLfloat radius, int slices, int stacks );
+
 	/**
       * Create a TriangleMesh describing a rectangular portion of a plane.  The
       * plane is located in the x-z plane, centered at the origin.
@@ -214,7 +513,122 @@ namespace gltw {
 	  *                   This must be greater than or equal to one.
       */
 	TriangleMesh * buildPlane(float xsize, float zsize, int xDivisions, int zDivisions);
+
+	/** Build a plane into the given MeshData rather than a new TriangleMesh; the other parameters are as above. */
+	void buildPlane( MeshData &data, float xsize, float zsize, int xDivisions, int zDivisions );
+
+	/** Limits for the adaptive tessellation of ::buildParametric */
+	struct TessellationOptions {
+		/** The largest distance allowed between the surface and its triangles, or zero for no limit */
+		GLfloat chordError;
+		/** The largest angle in radians allowed between the normals within one cell, or zero for no limit */
+		GLfloat maxAngle;
+		/** The number of times a cell of the base grid may be split in four */
+		int maxDepth;
+
+		explicit TessellationOptions( GLfloat chordError = 0.001f, GLfloat maxAngle = 0.0f, int maxDepth = 6 ) :
+			chordError(chordError), maxAngle(maxAngle), maxDepth(maxDepth) { }
+	};
+
+	/**
+	 * <p>Build a triangle mesh of a parametric surface.  The surface is a functor that maps
+	 * (u, v) in [0, 1] x [0, 1] to a position and a unit normal:</p>
+	 *
+	 * <p><code>
+	 *    struct Surface {<br />
+	 *    &nbsp;&nbsp;static constexpr bool wrapU = ..., wrapV = ...;<br />
+	 *    &nbsp;&nbsp;void operator()( GLfloat u, GLfloat v, GLfloat * position, GLfloat * normal ) const;<br />
+	 *    };<br />
+	 * </code></p>
+	 *
+	 * <p>wrapU and wrapV say whether the surface is closed in that direction, so that u = 1
+	 * meets u = 0.  The vertices along such a seam are shared rather than duplicated.  Each
+	 * triangle is wound counter-clockwise about the normals, whatever the orientation of the
+	 * parameterization.  Triangles with two corners at exactly the same position, such as
+	 * those at the poles of a sphere, are dropped.  TorusSurface, SphereSurface and
+	 * CylinderSurface are the surfaces of the shapes above.</p>
+	 *
+	 * <p>This version samples a uniform grid, and like the shapes above, it performs no
+	 * allocations once the MeshData is large enough.</p>
+	 *
+	 * @param data (out) receives the mesh
+	 * @param surface the surface
+	 * @param uDivs the number of subdivisions in u
+	 * @param vDivs the number of subdivisions in v
+	 */
+	template<class Surface>
+	void buildParametric( MeshData &data, const Surface &surface, int uDivs, int vDivs );
+
+	/**
+	 * <p>Build a triangle mesh of a parametric surface, adapting the density of triangles to
+	 * the curvature.  Each cell of a uniform base grid is split in four until it is flat
+	 * enough: until the surface at the midpoints of its edges and its center lies within
+	 * chordError of the triangles, and the normals there lie within maxAngle of the normal
+	 * at its center.  Cells whose neighbours were split further are triangulated as a fan
+	 * around their center, so there are no cracks.  Flat regions thus get few triangles
+	 * and curved ones many.</p>
+	 *
+	 * <p>The base grid must be fine enough to show the shape of the surface, as a cell is
+	 * only judged by those few samples.</p>
+	 *
+	 * <p><code>
+	 *    gltw::MeshData data;<br />
+	 *    gltw::buildParametric( data, gltw::CylinderSurface( 1.0f, 0.5f, 2.0f ), 8, 1,<br />
+	 *    &nbsp;&nbsp;&nbsp;&nbsp;gltw::TessellationOptions( 0.001f ) );<br />
+	 * </code></p>
+	 *
+	 * @param data (out) receives the mesh
+	 * @param surface the surface, as above
+	 * @param uDivs the number of subdivisions in u of the base grid
+	 * @param vDivs the number of subdivisions in v of the base grid
+	 * @param options the flatness required of each cell, and the limit on splitting
+	 */
+	template<class Surface>
+	void buildParametric( MeshData &data, const Surface &surface, int uDivs, int vDivs, const TessellationOptions &options );
+
+	/** Build a parametric surface into a new TriangleMesh; the parameters are as above. */
+	template<class Surface>
+	TriangleMesh * buildParametric( const Surface &surface, int uDivs, int vDivs );
+
+	/** Build a parametric surface adaptively into a new TriangleMesh; the parameters are as above. */
+	template<class Surface>
+	TriangleMesh * buildParametric( const Surface &surface, int uDivs, int vDivs, const TessellationOptions &options );
+
+	/** The surface of ::buildTorus: u goes around the z axis and v around the ring */
+	struct TorusSurface {
+		static constexpr bool wrapU = true;
+		static constexpr bool wrapV = true;
+		GLfloat outerRadius, innerRadius;
+
+		TorusSurface( GLfloat outerRadius, GLfloat innerRadius ) : outerRadius(outerRadius), innerRadius(innerRadius) { }
+		void operator()( GLfloat u, GLfloat v, GLfloat * position, GLfloat * normal ) const;
+	};
+
+	/** The surface of ::buildSphere: u is the longitude and v runs from the pole at z = radius to z = -radius */
+	struct SphereSurface {
+		static constexpr bool wrapU = true;
+		static constexpr bool wrapV = false;
+		GLfloat radius;
+
+		explicit SphereSurface( GLfloat radius ) : radius(radius) { }
+		void operator()( GLfloat u, GLfloat v, GLfloat * position, GLfloat * normal ) const;
+	};
+
+	/** The surface of ::buildCylinder: u goes around the z axis and v from z = 0 to z = height */
+	struct CylinderSurface {
+		static constexpr bool wrapU = true;
+		static constexpr bool wrapV = false;
+		GLfloat base, top, height;
+
+		CylinderSurface( GLfloat base, GLfloat top, GLfloat height ) : base(base), top(top), height(height) { }
+		void operator()( GLfloat u, GLfloat v, GLfloat * position, GLfloat * normal ) const;
+	};
 	/// @}
+
+	/// @privatesection
+	MeshData & builderScratch();
+	bool orientParametricTriangle( const MeshData &data, GLuint * triangle );
+	/// @publicsection
 }
 
 #include "gltw_batch.inl"
@@ -1,70 +1,279 @@
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
 
 namespace gltw {
 
 	inline VertexBatch::VertexBatch( GLenum mode, GLuint numVerts, int attribs, GLenum hint ) :
-		attributes(attribs), nVerts(numVerts),  bufferUsage(hint), drawMode(mode), vaID(0)
+		attributes(attribs), nVerts(numVerts),  bufferUsage(hint), drawMode(mode), vaID(0), prepared(false),
+		backing(EVICT_NEVER)
 	{
-		for( int i = 0; i < NUM_BUFFERS; i++) bufIDs[i] = 0;
+		for( int i = 0; i < NUM_BUFFERS; i++) {
+			bufIDs[i] = 0;
+			bufBytes[i] = 0;
+		}
 		if( !attribEnabled(ATTRIB_POSITION) ) {
 			cerr << "Error in VertexBatch constructor:  VertexBatch must include the position attribute." << endl;
 			exit(1);
 		}
 	}
 
+	inline VertexBatch::VertexBatch( VertexBatch && other ) :
+		attributes(other.attributes), nVerts(other.nVerts), bufferUsage(other.bufferUsage),
+		drawMode(other.drawMode), vaID(other.vaID), prepared(other.prepared), query(std::move(other.query)),
+		backing(other.backing), evicted(std::move(other.evicted))
+	{
+		for( int i = 0; i < NUM_BUFFERS; i++) {
+			bufIDs[i] = other.bufIDs[i];
+			bufBytes[i] = other.bufBytes[i];
+			other.bufIDs[i] = 0;
+			other.bufBytes[i] = 0;
+		}
+		other.vaID = 0;
+		other.prepared = false;
+		other.backing = EVICT_NEVER;
+		moveEvictable( other );
+	}
+
+	inline VertexBatch & VertexBatch::operator = ( VertexBatch && other ) {
+		if( this != &other ) {
+			release();
+			attributes = other.attributes;
+			nVerts = other.nVerts;
+			bufferUsage = other.bufferUsage;
+			drawMode = other.drawMode;
+			vaID = other.vaID;
+			prepared = other.prepared;
+			query = std::move(other.query);
+			backing = other.backing;
+			evicted = std::move(other.evicted);
+			for( int i = 0; i < NUM_BUFFERS; i++) {
+				bufIDs[i] = other.bufIDs[i];
+				bufBytes[i] = other.bufBytes[i];
+				other.bufIDs[i] = 0;
+				other.bufBytes[i] = 0;
+			}
+			other.vaID = 0;
+			other.prepared = false;
+			other.backing = EVICT_NEVER;
+			moveEvictable( other );
+		}
+		return *this;
+	}
+
 	inline VertexBatch::~VertexBatch() {
+		release();
+	}
+
+	inline void VertexBatch::release() {
 		// Delete buffers/vertex arrays safely ignores 0s 
 		glDeleteBuffers(NUM_BUFFERS, bufIDs);
 		glDeleteVertexArrays(1, &vaID);
+		if( !evicted ) trackBuffers( false );
+		for( int i = 0; i < NUM_BUFFERS; i++) {
+			bufIDs[i] = 0;
+			bufBytes[i] = 0;
+		}
+		vaID = 0;
+		prepared = false;
+		evicted.reset();
+	}
+
+	inline void VertexBatch::trackBuffers( bool allocated ) {
+		for( int i = 0; i < NUM_BUFFERS; i++ ) {
+			if( bufBytes[i] == 0 ) continue;
+			long long bytes = (long long)bufBytes[i];
+			trackMemory( i == ELEMENT ? MEMORY_ELEMENTS : MEMORY_VERTICES, allocated ? bytes : -bytes );
+		}
+	}
+
+	inline size_t VertexBatch::gpuBytes() const {
+		if( evicted ) return 0;
+		size_t total = 0;
+		for( int i = 0; i < NUM_BUFFERS; i++ ) total += bufBytes[i];
+		return total;
+	}
+
+	inline size_t VertexBatch::evictedBytes() const {
+		if( !evicted ) return 0;
+		size_t total = 0;
+		for( int i = 0; i < NUM_BUFFERS; i++ ) total += bufBytes[i];
+		return total;
+	}
+
+	inline void VertexBatch::setEviction( EvictionBacking b ) {
+		backing = b;
+		registerEvictable( b != EVICT_NEVER );
+		if( b == EVICT_NEVER ) restore();
+	}
+
+	inline bool VertexBatch::evict() {
+		size_t total = gpuBytes();
+		if( total == 0 ) return false;
+
+		GLTW_TRACE_INTERNAL( "VertexBatch::evict" );
+		std::unique_ptr<EvictedData> saved( new EvictedData() );
+		std::vector<char> staging;
+		if( backing == EVICT_TO_DISK ) {
+			saved->file = std::tmpfile();
+			if( saved->file == NULL ) {
+				cerr << "Error in VertexBatch.evict: unable to create a temporary file." << endl;
+				return false;
+			}
+		} else {
+			saved->bytes.resize( total );
+		}
+
+		size_t offset = 0;
+		for( int i = 0; i < NUM_BUFFERS; i++ ) {
+			if( bufBytes[i] == 0 ) continue;
+			char * dest;
+			if( saved->file ) {
+				staging.resize( bufBytes[i] );
+				dest = staging.data();
+			} else {
+				dest = saved->bytes.data() + offset;
+			}
+			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[i] );
+			glGetBufferSubData( GL_ARRAY_BUFFER, 0, bufBytes[i], dest );
+			if( saved->file && fwrite( dest, 1, bufBytes[i], saved->file ) != bufBytes[i] ) {
+				cerr << "Error in VertexBatch.evict: unable to write the temporary file." << endl;
+				glBindBuffer( GL_ARRAY_BUFFER, 0 );
+				return false;
+			}
+			offset += bufBytes[i];
+		}
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+		glDeleteBuffers( NUM_BUFFERS, bufIDs );
+		glDeleteVertexArrays( 1, &vaID );
+		for( int i = 0; i < NUM_BUFFERS; i++ ) bufIDs[i] = 0;
+		vaID = 0;
+		prepared = false;
+		trackBuffers( false );
+		evicted = std::move( saved );
+		countEviction( false );
+		return true;
+	}
+
+	inline bool VertexBatch::restore() {
+		if( !evicted ) return true;
+
+		GLTW_TRACE_INTERNAL( "VertexBatch::restore" );
+		std::unique_ptr<EvictedData> saved( std::move(evicted) );
+		std::vector<char> staging;
+		if( saved->file ) std::rewind( saved->file );
+		size_t offset = 0;
+		for( int i = 0; i < NUM_BUFFERS; i++ ) {
+			if( bufBytes[i] == 0 ) continue;
+			const char * src;
+			if( saved->file ) {
+				staging.resize( bufBytes[i] );
+				if( fread( staging.data(), 1, bufBytes[i], saved->file ) != bufBytes[i] ) {
+					cerr << "Error in VertexBatch: unable to read the data of an evicted object back." << endl;
+					glBindBuffer( GL_ARRAY_BUFFER, 0 );
+					// Only the buffers restored so far are counted, and freed by release()
+					for( int j = i; j < NUM_BUFFERS; j++ ) bufBytes[j] = 0;
+					release();
+					return false;
+				}
+				src = staging.data();
+			} else {
+				src = saved->bytes.data() + offset;
+			}
+			glGenBuffers( 1, &bufIDs[i] );
+			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[i] );
+			glBufferData( GL_ARRAY_BUFFER, bufBytes[i], src, bufferUsage );
+			trackMemory( i == ELEMENT ? MEMORY_ELEMENTS : MEMORY_VERTICES, (long long)bufBytes[i] );
+			GLTW_TRACE_COUNT( COUNTER_BYTES_UPLOADED, bufBytes[i] );
+			offset += bufBytes[i];
+		}
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+		countEviction( true );
+		return true;
 	}
 
 	inline bool VertexBatch::attribEnabled( Attribute attrib ) {
 		return (attrib & attributes) != 0;
 	}
 
-	inline void VertexBatch::copyPositionData( GLfloat * data ) {
-		if( bufIDs[ POSITION ] == 0 ) {
-			glGenBuffers(1, &bufIDs[POSITION] );
-			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[POSITION] );
-			glBufferData( GL_ARRAY_BUFFER, 3 * sizeof(GLfloat) * nVerts, NULL, bufferUsage);			
+	inline bool VertexBatch::copyBufferData( Buffer buf, size_t bytesPerItem, GLuint numItems,
+		const void * data, GLuint first, GLuint count )
+	{
+		if( (size_t)first + count > numItems ) {
+			cerr << "Error in VertexBatch: the range of data to copy is beyond the end of the buffer." << endl;
+			return false;
+		}
+		if( evicted && !restore() ) return false;
+		if( bufIDs[ buf ] == 0 ) {
+			glGenBuffers(1, &bufIDs[buf] );
+			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[buf] );
+			glBufferData( GL_ARRAY_BUFFER, bytesPerItem * numItems, NULL, bufferUsage);
+			bufBytes[buf] = bytesPerItem * numItems;
+			trackMemory( buf == ELEMENT ? MEMORY_ELEMENTS : MEMORY_VERTICES, (long long)bufBytes[buf] );
 		}
-		glBindBuffer( GL_ARRAY_BUFFER, bufIDs[POSITION]);
-		glBufferSubData( GL_ARRAY_BUFFER, 0, 3 * sizeof(GLfloat)*nVerts, data); 
+		GLTW_TRACE_INTERNAL( "VertexBatch::copyBufferData" );
+		glBindBuffer( GL_ARRAY_BUFFER, bufIDs[buf]);
+		glBufferSubData( GL_ARRAY_BUFFER, bytesPerItem * first, bytesPerItem * count, data);
+		GLTW_TRACE_COUNT( COUNTER_BYTES_UPLOADED, bytesPerItem * count );
+		return true;
 	}
 
-	inline void VertexBatch::copyNormalData( GLfloat *data ) {
+	inline void VertexBatch::copyPositionData( const GLfloat * data ) {
+		copyPositionData( data, 0, nVerts );
+	}
+
+	inline void VertexBatch::copyPositionData( const GLfloat * data, GLuint first, GLuint count ) {
+		if( copyBufferData( POSITION, 3 * sizeof(GLfloat), nVerts, data, first, count ) && query ) {
+			std::copy( data, data + 3 * (size_t)count, query->positions.begin() + 3 * (size_t)first );
+			query->positionsChanged = true;
+		}
+	}
+
+	inline void VertexBatch::copyNormalData( const GLfloat *data ) {
+		copyNormalData( data, 0, nVerts );
+	}
+
+	inline void VertexBatch::copyNormalData( const GLfloat *data, GLuint first, GLuint count ) {
 		if( !attribEnabled(ATTRIB_NORMAL) ) {
 			cerr << "Error in VertexBatch.copyNormalData: the normal attribute was not selected for this VertexBatch." << endl;
 			return;
 		}
+		copyBufferData( NORMAL, 3 * sizeof(GLfloat), nVerts, data, first, count );
+	}
 
-		if( bufIDs[ NORMAL ] == 0 ) {
-			glGenBuffers(1, &bufIDs[NORMAL] );
-			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[NORMAL] );
-			glBufferData( GL_ARRAY_BUFFER, 3 * sizeof(GLfloat) * nVerts, NULL, bufferUsage);			
-		}
-		glBindBuffer( GL_ARRAY_BUFFER, bufIDs[NORMAL]);
-		glBufferSubData( GL_ARRAY_BUFFER, 0, 3 * sizeof(GLfloat)*nVerts, data); 
+	inline void VertexBatch::copyColorData( const GLfloat * data ) {
+		copyColorData( data, 0, nVerts );
 	}
 
-	inline void VertexBatch::copyColorData( GLfloat * data ) {
+	inline void VertexBatch::copyColorData( const GLfloat * data, GLuint first, GLuint count ) {
 		if( !attribEnabled(ATTRIB_COLOR) ) {
 			cerr << "Error in VertexBatch.copyColorData: the color attribute was not selected for this VertexBatch." << endl;
 			return;
 		}
-		if( bufIDs[ COLOR ] == 0 ) {
-			glGenBuffers(1, &bufIDs[COLOR] );
-			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[COLOR] );
-			glBufferData( GL_ARRAY_BUFFER, 4 * sizeof(GLfloat) * nVerts, NULL, bufferUsage);			
+		copyBufferData( COLOR, 4 * sizeof(GLfloat), nVerts, data, first, count );
+	}
+
+	inline void VertexBatch::copyTexCoordData( const GLfloat * data ) {
+		copyTexCoordData( data, 0, nVerts );
+	}
+
+	inline void VertexBatch::copyTexCoordData( const GLfloat * data, GLuint first, GLuint count ) {
+		if( !attribEnabled(ATTRIB_TEXCOORD) ) {
+			cerr << "Error in VertexBatch.copyTexCoordData: the texture coordinate attribute was not selected for this VertexBatch." << endl;
+			return;
 		}
-		glBindBuffer( GL_ARRAY_BUFFER, bufIDs[COLOR]);
-		glBufferSubData( GL_ARRAY_BUFFER, 0, 4 * sizeof(GLfloat)*nVerts, data); 
+		copyBufferData( TEXCOORD, 2 * sizeof(GLfloat), nVerts, data, first, count );
 	}
 
 	inline bool VertexBatch::isReady() {
+		// The sizes are kept while evicted, so an evicted object is still ready
 		return !(
-			( attribEnabled(ATTRIB_POSITION) && bufIDs[POSITION] == 0 ) ||
-			( attribEnabled(ATTRIB_COLOR) && bufIDs[COLOR] == 0 ) ||
-			( attribEnabled(ATTRIB_NORMAL) && bufIDs[NORMAL] == 0 )
+			( attribEnabled(ATTRIB_POSITION) && bufBytes[POSITION] == 0 ) ||
+			( attribEnabled(ATTRIB_COLOR) && bufBytes[COLOR] == 0 ) ||
+			( attribEnabled(ATTRIB_NORMAL) && bufBytes[NORMAL] == 0 ) ||
+			( attribEnabled(ATTRIB_TEXCOORD) && bufBytes[TEXCOORD] == 0 )
 			);
 	}
 
@@ -89,26 +298,122 @@ namespace gltw {
 			glVertexAttribPointer( GLTW_ATTRIB_IDX_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, 0 );
 			glEnableVertexAttribArray(GLTW_ATTRIB_IDX_NORMAL);
 		}
+
+		if( attribEnabled(ATTRIB_TEXCOORD) && bufIDs[TEXCOORD] != 0 ) {
+			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[TEXCOORD] );
+			glVertexAttribPointer( GLTW_ATTRIB_IDX_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 0, 0 );
+			glEnableVertexAttribArray(GLTW_ATTRIB_IDX_TEXCOORD);
+		}
 		glBindVertexArray(0);
 	}
 
-	inline void VertexBatch::draw() {
+	inline bool VertexBatch::prepare() {
+		if( prepared ) return true;
+		if( evicted && !restore() ) return false;
+
 		if( ! isReady() ) {
 			cerr << "VertexBatch is not ready to draw.  Missing some vertex data." << endl;
-			return;
+			return false;
 		}
 
 		if( vaID == 0 ) {
 			if( bufIDs[POSITION] == 0 ) {
 				cerr << "No position data available in VertexBatch!" << endl;
-				return;
+				return false;
 			}
 			buildVertexArray();
 		}
 
+		prepared = true;
+		return true;
+	}
+
+	inline DrawCommand VertexBatch::drawCommand() {
+		DrawCommand cmd = { vaID, drawMode, 0, GL_NONE };
+		if( prepare() ) {
+			cmd.vertexArray = vaID;
+			cmd.count = nVerts;
+			touch();
+		}
+		return cmd;
+	}
+
+	inline void VertexBatch::draw() {
+		if( !prepared ) {
+			// Preparing may have restored this object, so it may now be over the budget
+			if( !prepare() ) return;
+			enforceBudgetKeeping();
+		}
+
+		GLTW_TRACE_INTERNAL( "VertexBatch::draw" );
+		touch();
 		glBindVertexArray(vaID);
 		glDrawArrays( drawMode, 0, nVerts );
 		glBindVertexArray(0);
+		GLTW_TRACE_COUNT( COUNTER_DRAWS, 1 );
+		GLTW_TRACE_COUNT( COUNTER_VERTICES, nVerts );
+	}
+
+	inline void VertexBatch::keepQueryData( bool keep ) {
+		if( !keep ) {
+			query.reset();
+			return;
+		}
+		if( query ) return;
+		if( evicted ) restore();
+		query.reset( new QueryData() );
+		query->indexed = query->built = query->positionsChanged = query->topologyChanged = false;
+		query->positions.resize( 3 * (size_t)nVerts );
+		if( bufIDs[POSITION] != 0 ) {
+			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[POSITION] );
+			glGetBufferSubData( GL_ARRAY_BUFFER, 0, query->positions.size() * sizeof(GLfloat), query->positions.data() );
+		}
+	}
+
+	inline const MeshBVH * VertexBatch::bvh( ThreadPool * pool ) {
+		if( !query || drawMode != GL_TRIANGLES || bufBytes[POSITION] == 0 ||
+			(query->indexed && bufBytes[ELEMENT] == 0) ) return NULL;
+
+		if( !query->built || query->topologyChanged ) {
+			const GLuint * elements = query->indexed ? query->elements.data() : NULL;
+			size_t numTriangles = (query->indexed ? query->elements.size() : nVerts) / 3;
+			query->bvh.build( query->positions.data(), elements, numTriangles, pool );
+			query->built = true;
+		} else if( query->positionsChanged ) {
+			query->bvh.refit( pool );
+		}
+		query->positionsChanged = query->topologyChanged = false;
+		return &query->bvh;
+	}
+
+	inline void executeDrawCommand( const DrawCommand &cmd ) {
+		glBindVertexArray( cmd.vertexArray );
+		if( cmd.indexType == GL_NONE )
+			glDrawArrays( cmd.mode, 0, cmd.count );
+		else
+			glDrawElements( cmd.mode, cmd.count, cmd.indexType, 0 );
+		GLTW_TRACE_COUNT( COUNTER_DRAWS, 1 );
+		GLTW_TRACE_COUNT( COUNTER_VERTICES, cmd.count );
+	}
+
+	inline void executeDrawCommands( const DrawCommand *cmds, size_t count ) {
+		GLTW_TRACE_INTERNAL( "executeDrawCommands" );
+		GLuint bound = 0;
+		for( size_t i = 0; i < count; i++ ) {
+			const DrawCommand &cmd = cmds[i];
+			if( cmd.count == 0 ) continue;
+			if( cmd.vertexArray != bound ) {
+				glBindVertexArray( cmd.vertexArray );
+				bound = cmd.vertexArray;
+			}
+			if( cmd.indexType == GL_NONE )
+				glDrawArrays( cmd.mode, 0, cmd.count );
+			else
+				glDrawElements( cmd.mode, cmd.count, cmd.indexType, 0 );
+			GLTW_TRACE_COUNT( COUNTER_DRAWS, 1 );
+			GLTW_TRACE_COUNT( COUNTER_VERTICES, cmd.count );
+		}
+		if( bound != 0 ) glBindVertexArray(0);
 	}
 
 	inline TriangleMesh::TriangleMesh(GLuint numVerts, GLuint numElements, int attributes, GLenum usage) :
@@ -120,15 +425,63 @@ namespace gltw {
 		}
 	}
 
-	inline void TriangleMesh::copyElementData( GLuint * data )
+	inline TriangleMesh::TriangleMesh( const MeshData &data, GLenum usage ) :
+		VertexBatch(GL_TRIANGLES, data.numVerts(), data.attributes(), usage), nElements(data.numElements())
+	{
+		if( !attribEnabled(ATTRIB_NORMAL) ) {
+			cerr << "Error in TriangleMesh constructor:  TriangleMesh must include the normal attribute." << endl;
+			exit(1);
+		}
+		copyMeshData(data);
+	}
+
+	inline TriangleMesh::TriangleMesh( TriangleMesh && other ) :
+		VertexBatch(std::move(other)), nElements(other.nElements)
+	{ }
+
+	inline TriangleMesh & TriangleMesh::operator = ( TriangleMesh && other ) {
+		VertexBatch::operator=( std::move(other) );
+		nElements = other.nElements;
+		return *this;
+	}
+
+	inline void TriangleMesh::copyMeshData( const MeshData &data )
+	{
+		if( data.numVerts() != nVerts || data.numElements() != nElements ) {
+			cerr << "Error in TriangleMesh.copyMeshData: the data does not match the size of the mesh." << endl;
+			return;
+		}
+		copyPositionData( data.positions.data() );
+		if( !data.normals.empty() ) copyNormalData( data.normals.data() );
+		if( !data.colors.empty() ) copyColorData( data.colors.data() );
+		if( !data.texCoords.empty() ) copyTexCoordData( data.texCoords.data() );
+		copyElementData( data.elements.data() );
+	}
+
+	inline void TriangleMesh::copyElementData( const GLuint * data )
+	{
+		copyElementData( data, 0, nElements );
+	}
+
+	inline void TriangleMesh::copyElementData( const GLuint * data, GLuint first, GLuint count )
+	{
+		if( copyBufferData( ELEMENT, sizeof(GLuint), nElements, data, first, count ) && query ) {
+			std::copy( data, data + count, query->elements.begin() + first );
+			query->topologyChanged = true;
+		}
+	}
+
+	inline void TriangleMesh::keepQueryData( bool keep )
 	{
-		if( bufIDs[ ELEMENT ] == 0 ) {
-			glGenBuffers(1, &bufIDs[ELEMENT] );
+		bool had = query != NULL;
+		VertexBatch::keepQueryData( keep );
+		if( !query || had ) return;
+		query->indexed = true;
+		query->elements.resize( nElements );
+		if( bufIDs[ELEMENT] != 0 ) {
 			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[ELEMENT] );
-			glBufferData( GL_ARRAY_BUFFER, sizeof(GLuint) * nElements, NULL, bufferUsage);			
+			glGetBufferSubData( GL_ARRAY_BUFFER, 0, nElements * sizeof(GLuint), query->elements.data() );
 		}
-		glBindBuffer( GL_ARRAY_BUFFER, bufIDs[ELEMENT]);
-		glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof(GLuint)*nElements, data);
 	}
 
 	inline void TriangleMesh::buildVertexArray() {
@@ -141,167 +494,385 @@ namespace gltw {
 		glBindVertexArray(0);
 	}
 
-	inline void TriangleMesh::draw()
+	inline bool TriangleMesh::prepare()
 	{
-		if( ! isReady() ) {
+		if( prepared ) return true;
+		if( evicted && !restore() ) return false;
+
+		if( ! isReady() || bufIDs[ELEMENT] == 0 ) {
 			cerr << "TriangleMesh is not ready to draw.  Missing some vertex data." << endl;
-			return;
+			return false;
 		}
 
-		if( vaID == 0 ) {
-			if( bufIDs[POSITION] == 0 ) {
-				cerr << "No position data available in VertexBatch!" << endl;
-				return;
-			}
-			buildVertexArray();
+		return VertexBatch::prepare();
+	}
+
+	inline DrawCommand TriangleMesh::drawCommand() {
+		DrawCommand cmd = { vaID, drawMode, 0, GL_UNSIGNED_INT };
+		if( prepare() ) {
+			cmd.vertexArray = vaID;
+			cmd.count = nElements;
+			touch();
+		}
+		return cmd;
+	}
+
+	inline void TriangleMesh::draw()
+	{
+		if( !prepared ) {
+			if( !prepare() ) return;
+			enforceBudgetKeeping();
 		}
 
+		GLTW_TRACE_INTERNAL( "TriangleMesh::draw" );
+		touch();
 		glBindVertexArray(vaID);
 		glDrawElements(drawMode, nElements, GL_UNSIGNED_INT, 0 );
 		glBindVertexArray(0);
+		GLTW_TRACE_COUNT( COUNTER_DRAWS, 1 );
+		GLTW_TRACE_COUNT( COUNTER_VERTICES, nElements );
 	}
 
-	inline TriangleMesh * buildTorus( GLfloat outerRadius, GLfloat innerRadius, GLint nSides, GLint nRings ) {
-		GLint nVerts = nSides * (nRings+1);
-		GLint faces = nSides * nRings;
-		
-		float ringFactor  = (float)(2.0 * GLTW_PI / nRings);
-		float sideFactor = (float)(2.0 * GLTW_PI / nSides);
-		int idx = 0;
+	inline MeshData & builderScratch() {
+		static thread_local MeshData data;
+		return data;
+	}
+
+	inline bool orientParametricTriangle( const MeshData &data, GLuint * tri )
+	{
+		const GLfloat * a = &data.positions[3 * (size_t)tri[0]];
+		const GLfloat * b = &data.positions[3 * (size_t)tri[1]];
+		const GLfloat * c = &data.positions[3 * (size_t)tri[2]];
+		if( std::equal( a, a + 3, b ) || std::equal( b, b + 3, c ) || std::equal( c, c + 3, a ) ) return false;
+
+		GLfloat ab[3], ac[3], cross[3], normal[3];
+		bvhSub( b, a, ab );
+		bvhSub( c, a, ac );
+		bvhCross( ab, ac, cross );
+		if( cross[0] == 0.0f && cross[1] == 0.0f && cross[2] == 0.0f ) return false;
+		for( int j = 0; j < 3; j++ ) {
+			normal[j] = data.normals[3 * (size_t)tri[0] + j] + data.normals[3 * (size_t)tri[1] + j] + data.normals[3 * (size_t)tri[2] + j];
+		}
+		if( bvhDot( cross, normal ) < 0.0f ) std::swap( tri[1], tri[2] );
+		return true;
+	}
 
-		GLfloat *verts = new GLfloat[ nVerts * 3 ];
-		GLfloat *norms = new GLfloat[ nVerts * 3 ];
-		GLuint *el = new GLuint[faces * 6];
-
-		for( int ring = 0; ring <= nRings; ring++ ) {
-			float u = ring * ringFactor;
-			float cu = cos(u);
-			float su = sin(u);
-			for( int side = 0; side < nSides; side++ ) {
-				float v = side * sideFactor;
-				float cv = cos(v);
-				float sv = sin(v);
-				float r = (outerRadius + innerRadius * cv);
-				verts[idx] = r * cu;
-				verts[idx + 1] = r * su;
-				verts[idx + 2] = innerRadius * sv;
-				norms[idx] = cv * cu * r;
-				norms[idx + 1] = cv * su * r;
-				norms[idx + 2] = sv * r;
-				// Normalize
-				float len = sqrt( norms[idx] * norms[idx] +
-					norms[idx+1] * norms[idx+1] +
-					norms[idx+2] * norms[idx+2] );
-				norms[idx] /= len;
-				norms[idx+1] /= len;
-				norms[idx+2] /= len;
-				idx += 3;
+	template<class Surface>
+	inline void buildParametric( MeshData &data, const Surface &surface, int uDivs, int vDivs )
+	{
+		GLTW_TRACE_INTERNAL( "buildParametric" );
+		if( uDivs < 1 ) uDivs = 1;
+		if( vDivs < 1 ) vDivs = 1;
+		// A closed direction has one fewer column of vertices, the last being the first
+		const GLuint nu = Surface::wrapU ? uDivs : uDivs + 1;
+		const GLuint nv = Surface::wrapV ? vDivs : vDivs + 1;
+
+		data.resize( nu * nv, 6 * uDivs * vDivs );
+		for( GLuint i = 0; i < nu; i++ ) {
+			for( GLuint j = 0; j < nv; j++ ) {
+				size_t k = 3 * ((size_t)i * nv + j);
+				surface( (GLfloat)i / uDivs, (GLfloat)j / vDivs, &data.positions[k], &data.normals[k] );
 			}
 		}
 
-		idx = 0;
-		for( int ring = 0; ring < nRings; ring++ ) {
-			int ringStart = ring * nSides;
-			int nextRingStart = (ring + 1) * nSides;
-			for( int side = 0; side < nSides; side++ ) {
-				int nextSide = (side+1) % nSides;
-				// The quad
-				el[idx] = (ringStart + side);
-				el[idx+1] = (nextRingStart + side);
-				el[idx+2] = (nextRingStart + nextSide);
-				el[idx+3] = ringStart + side;
-				el[idx+4] = nextRingStart + nextSide;
-				el[idx+5] = (ringStart + nextSide);
-				idx += 6;
+		size_t idx = 0;
+		GLuint * el = data.elements.data();
+		for( GLuint i = 0; i < (GLuint)uDivs; i++ ) {
+			GLuint col = i * nv, nextCol = ((i + 1) % nu) * nv;
+			for( GLuint j = 0; j < (GLuint)vDivs; j++ ) {
+				GLuint next = (j + 1) % nv;
+				GLuint quad[6] = { col + j, nextCol + j, nextCol + next, col + j, nextCol + next, col + next };
+				for( int t = 0; t < 6; t += 3 ) {
+					std::copy( quad + t, quad + t + 3, el + idx );
+					if( orientParametricTriangle( data, el + idx ) ) idx += 3;
+				}
+			}
+		}
+		data.elements.resize( idx );
+	}
+
+	/// @privatesection
+	/**
+	 * The samples of a parametric surface at points of a lattice, (u, v) = (iu / nu, iv / nv).
+	 * Each is evaluated once, appended to the vertices of a MeshData.
+	 */
+	template<class Surface>
+	struct ParametricSamples {
+		static const GLuint NONE = (GLuint)-1;
+		const Surface &surface;
+		const GLuint nu, nv;
+		MeshData &data;
+		std::unordered_map<uint64_t, GLuint> index;
+
+		ParametricSamples( const Surface &surface, GLuint nu, GLuint nv, MeshData &data ) :
+			surface(surface), nu(nu), nv(nv), data(data) { }
+
+		void wrap( GLuint &iu, GLuint &iv ) const {
+			if( Surface::wrapU && iu == nu ) iu = 0;
+			if( Surface::wrapV && iv == nv ) iv = 0;
+		}
+
+		/** @return the vertex at a point, or NONE if it has not been sampled */
+		GLuint find( GLuint iu, GLuint iv ) const {
+			wrap( iu, iv );
+			std::unordered_map<uint64_t, GLuint>::const_iterator found = index.find( ((uint64_t)iu << 32) | iv );
+			if( found == index.end() ) return NONE;
+			return found->second;
+		}
+
+		/** @return the vertex at a point, sampling the surface if needed */
+		GLuint operator()( GLuint iu, GLuint iv ) {
+			wrap( iu, iv );
+			std::pair<std::unordered_map<uint64_t, GLuint>::iterator, bool> added =
+				index.insert( std::make_pair( ((uint64_t)iu << 32) | iv, data.numVerts() ) );
+			if( added.second ) {
+				size_t k = data.positions.size();
+				data.positions.resize( k + 3 );
+				data.normals.resize( k + 3 );
+				surface( (GLfloat)iu / nu, (GLfloat)iv / nv, &data.positions[k], &data.normals[k] );
+			}
+			return added.first->second;
+		}
+
+		/** Append a vertex at any (u, v), without recording it in the lattice */
+		GLuint extra( GLfloat u, GLfloat v ) {
+			size_t k = data.positions.size();
+			data.positions.resize( k + 3 );
+			data.normals.resize( k + 3 );
+			surface( u, v, &data.positions[k], &data.normals[k] );
+			return (GLuint)(k / 3);
+		}
+
+		/**
+		 * Judge a cell by its corners, the midpoints of its edges and its center.
+		 *
+		 * @return 1 if the cell should be split in u, 2 if in v, 3 if both, and 0 if it is flat enough
+		 */
+		int split( GLuint iu, GLuint iv, GLuint su, GLuint sv, GLfloat chordError, GLfloat cosMaxAngle ) {
+			const GLuint hu = su / 2, hv = sv / 2;
+			const GLuint c[4] = { (*this)( iu, iv ), (*this)( iu + su, iv ), (*this)( iu + su, iv + sv ), (*this)( iu, iv + sv ) };
+			const GLuint m[4] = { (*this)( iu + hu, iv ), (*this)( iu + su, iv + hv ), (*this)( iu + hu, iv + sv ), (*this)( iu, iv + hv ) };
+			const GLuint center = (*this)( iu + hu, iv + hv );
+
+			// Edge k runs from c[k] to c[k + 1] through m[k].  Edges 0 and 2 run along u, 1 and 3 along v.
+			int result = 0;
+			bool centerFails = false;
+			for( int k = 0; k < 5; k++ ) {
+				const GLuint a = c[k % 4], b = k < 4 ? c[(k + 1) % 4] : c[2], mid = k < 4 ? m[k] : center;
+				bool fails = false;
+				if( chordError > 0.0f ) {
+					// The distance along the normal from the sample to the edge, or diagonal, that stands in
+					// for it.  Measuring along the normal ignores samples that slide over the surface.
+					GLfloat d[3];
+					for( int j = 0; j < 3; j++ ) {
+						d[j] = data.positions[3 * (size_t)mid + j] - 0.5f * (data.positions[3 * (size_t)a + j] + data.positions[3 * (size_t)b + j]);
+					}
+					fails = std::fabs( bvhDot( d, &data.normals[3 * (size_t)mid] ) ) > chordError;
+				}
+				if( cosMaxAngle < 1.0f ) {
+					const GLfloat * n = &data.normals[3 * (size_t)mid];
+					fails = fails || bvhDot( n, &data.normals[3 * (size_t)a] ) < cosMaxAngle ||
+						bvhDot( n, &data.normals[3 * (size_t)b] ) < cosMaxAngle;
+				}
+				if( !fails ) continue;
+				if( k < 4 ) result |= (k % 2 == 0) ? 1 : 2;
+				else centerFails = true;
+			}
+			// A cell whose edges are flat but whose middle is not is twisted, so split it both ways
+			if( centerFails && result == 0 ) result = 3;
+			if( su < 2 ) result &= ~1;
+			if( sv < 2 ) result &= ~2;
+			return result;
+		}
+
+		/** Append the corners of leaf cells that lie strictly between two points, in order */
+		void collectEdge( long long u0, long long v0, long long u1, long long v1, const std::vector<char> &isCorner, std::vector<GLuint> &ring ) const {
+			if( std::abs( u1 - u0 ) + std::abs( v1 - v0 ) < 2 ) return;
+			// Neighbouring cells are aligned, so a corner anywhere along the edge implies one at its midpoint
+			const long long um = (u0 + u1) / 2, vm = (v0 + v1) / 2;
+			GLuint m = find( (GLuint)um, (GLuint)vm );
+			if( m == NONE || m >= isCorner.size() || !isCorner[m] ) return;
+			collectEdge( u0, v0, um, vm, isCorner, ring );
+			ring.push_back( m );
+			collectEdge( um, vm, u1, v1, isCorner, ring );
+		}
+	};
+	/// @publicsection
+
+	template<class Surface>
+	inline void buildParametric( MeshData &data, const Surface &surface, int uDivs, int vDivs, const TessellationOptions &options )
+	{
+		GLTW_TRACE_INTERNAL( "buildParametric" );
+		if( uDivs < 1 ) uDivs = 1;
+		if( vDivs < 1 ) vDivs = 1;
+		// The lattice of every cell at the deepest level must fit the 32-bit coordinates
+		int maxDepth = std::max( 0, options.maxDepth );
+		while( maxDepth > 0 && ((uint64_t)std::max( uDivs, vDivs ) << maxDepth) > 0x7fffffffu ) maxDepth--;
+
+		data.clear();
+		ParametricSamples<Surface> sample( surface, (GLuint)uDivs << maxDepth, (GLuint)vDivs << maxDepth, data );
+		const GLfloat cosMaxAngle = options.maxAngle > 0.0f ? std::cos( options.maxAngle ) : 2.0f;
+
+		// Split the cells of the base grid, in u, v or both, until each is flat enough.  A cell is
+		// (iu, iv, su, sv) on the lattice, and a leaf is followed by the vertices at its corners.
+		std::vector<GLuint> stack, leaves;
+		const GLuint baseSize = 1u << maxDepth;
+		for( GLuint i = 0; i < (GLuint)uDivs; i++ ) {
+			for( GLuint j = 0; j < (GLuint)vDivs; j++ ) {
+				GLuint cell[4] = { i * baseSize, j * baseSize, baseSize, baseSize };
+				stack.insert( stack.end(), cell, cell + 4 );
+			}
+		}
+		while( !stack.empty() ) {
+			const GLuint iu = stack[stack.size() - 4], iv = stack[stack.size() - 3];
+			const GLuint su = stack[stack.size() - 2], sv = stack[stack.size() - 1];
+			stack.resize( stack.size() - 4 );
+			const int split = sample.split( iu, iv, su, sv, options.chordError, cosMaxAngle );
+			if( split != 0 ) {
+				const GLuint hu = (split & 1) ? su / 2 : su, hv = (split & 2) ? sv / 2 : sv;
+				for( GLuint u = iu; u < iu + su; u += hu ) {
+					for( GLuint v = iv; v < iv + sv; v += hv ) {
+						GLuint cell[4] = { u, v, hu, hv };
+						stack.insert( stack.end(), cell, cell + 4 );
+					}
+				}
+			} else {
+				GLuint leaf[8] = { iu, iv, su, sv, sample( iu, iv ), sample( iu + su, iv ), sample( iu + su, iv + sv ), sample( iu, iv + sv ) };
+				leaves.insert( leaves.end(), leaf, leaf + 8 );
 			}
 		}
 
-		TriangleMesh *mesh = new TriangleMesh(nVerts, 6 * faces);
-		mesh->copyPositionData(verts);
-		mesh->copyNormalData(norms);
-		mesh->copyElementData(el);
+		std::vector<char> isCorner( data.numVerts(), 0 );
+		for( size_t l = 0; l < leaves.size(); l += 8 ) {
+			for( int k = 4; k < 8; k++ ) isCorner[leaves[l + k]] = 1;
+		}
+
+		// Each leaf is two triangles, or a fan around its center if its edges hold the corners of smaller neighbours
+		std::vector<GLuint> ring;
+		for( size_t l = 0; l < leaves.size(); l += 8 ) {
+			const long long iu = leaves[l], iv = leaves[l + 1], su = leaves[l + 2], sv = leaves[l + 3];
+			const long long u[5] = { iu, iu + su, iu + su, iu, iu }, v[5] = { iv, iv, iv + sv, iv + sv, iv };
+			ring.clear();
+			for( int k = 0; k < 4; k++ ) {
+				ring.push_back( leaves[l + 4 + k] );
+				sample.collectEdge( u[k], v[k], u[k + 1], v[k + 1], isCorner, ring );
+			}
 
-		delete [] verts;
-		delete [] norms;
-		delete [] el;
+			GLuint tri[3];
+			if( ring.size() == 4 ) {
+				for( int t = 0; t < 2; t++ ) {
+					tri[0] = ring[0]; tri[1] = ring[1 + t]; tri[2] = ring[2 + t];
+					if( orientParametricTriangle( data, tri ) ) data.elements.insert( data.elements.end(), tri, tri + 3 );
+				}
+			} else {
+				// A cell one lattice step across has no lattice point inside it
+				GLuint center = (su >= 2 && sv >= 2) ? sample( (GLuint)(iu + su / 2), (GLuint)(iv + sv / 2) ) :
+					sample.extra( (iu + 0.5f * su) / sample.nu, (iv + 0.5f * sv) / sample.nv );
+				for( size_t k = 0; k < ring.size(); k++ ) {
+					tri[0] = center; tri[1] = ring[k]; tri[2] = ring[(k + 1) % ring.size()];
+					if( orientParametricTriangle( data, tri ) ) data.elements.insert( data.elements.end(), tri, tri + 3 );
+				}
+			}
+		}
+
+		// Drop the samples that are not vertices of any triangle, keeping the rest in order
+		const GLuint NONE = (GLuint)-1;
+		std::vector<GLuint> remap( data.numVerts(), NONE );
+		for( size_t e = 0; e < data.elements.size(); e++ ) remap[data.elements[e]] = 0;
+		GLuint n = 0;
+		for( GLuint i = 0; i < (GLuint)remap.size(); i++ ) {
+			if( remap[i] == NONE ) continue;
+			remap[i] = n;
+			std::copy( &data.positions[3 * (size_t)i], &data.positions[3 * (size_t)i] + 3, &data.positions[3 * (size_t)n] );
+			std::copy( &data.normals[3 * (size_t)i], &data.normals[3 * (size_t)i] + 3, &data.normals[3 * (size_t)n] );
+			n++;
+		}
+		data.positions.resize( 3 * (size_t)n );
+		data.normals.resize( 3 * (size_t)n );
+		for( size_t e = 0; e < data.elements.size(); e++ ) data.elements[e] = remap[data.elements[e]];
+	}
+
+	template<class Surface>
+	inline TriangleMesh * buildParametric( const Surface &surface, int uDivs, int vDivs )
+	{
+		MeshData &data = builderScratch();
+		buildParametric( data, surface, uDivs, vDivs );
+		return new TriangleMesh(data);
+	}
+
+	template<class Surface>
+	inline TriangleMesh * buildParametric( const Surface &surface, int uDivs, int vDivs, const TessellationOptions &options )
+	{
+		MeshData &data = builderScratch();
+		buildParametric( data, surface, uDivs, vDivs, options );
+		return new TriangleMesh(data);
+	}
+
+	inline void TorusSurface::operator()( GLfloat u, GLfloat v, GLfloat * position, GLfloat * normal ) const
+	{
+		float ringAngle = (float)(2.0 * GLTW_PI) * u, sideAngle = (float)(2.0 * GLTW_PI) * v;
+		float cu = cosf(ringAngle), su = sinf(ringAngle);
+		float cv = cosf(sideAngle), sv = sinf(sideAngle);
+		float r = outerRadius + innerRadius * cv;
+		position[0] = r * cu; position[1] = r * su; position[2] = innerRadius * sv;
+		normal[0] = cv * cu; normal[1] = cv * su; normal[2] = sv;
+	}
+
+	inline void SphereSurface::operator()( GLfloat u, GLfloat v, GLfloat * position, GLfloat * normal ) const
+	{
+		float theta = (float)(2.0 * GLTW_PI) * u, phi = (float)GLTW_PI * v;
+		// The poles are exact, so that the triangles that collapse there are dropped
+		float sp = (v <= 0.0f || v >= 1.0f) ? 0.0f : sinf(phi);
+		float cp = v <= 0.0f ? 1.0f : (v >= 1.0f ? -1.0f : cosf(phi));
+		normal[0] = sp * cosf(theta); normal[1] = sp * sinf(theta); normal[2] = cp;
+		for( int j = 0; j < 3; j++ ) position[j] = radius * normal[j];
+	}
+
+	inline void CylinderSurface::operator()( GLfloat u, GLfloat v, GLfloat * position, GLfloat * normal ) const
+	{
+		float angle = (float)(2.0 * GLTW_PI) * u;
+		float r = (1.0f - v) * base + v * top;
+		float normZ = (base - top) / height;
+		float nlen = sqrtf( 1.0f + normZ * normZ );
+		float c = cosf(angle), s = sinf(angle);
+		position[0] = r * c; position[1] = r * s; position[2] = v * height;
+		normal[0] = c / nlen; normal[1] = s / nlen; normal[2] = normZ / nlen;
+	}
+
+	inline TriangleMesh * buildTorus( GLfloat outerRadius, GLfloat innerRadius, GLint nSides, GLint nRings ) {
+		MeshData &data = builderScratch();
+		buildTorus( data, outerRadius, innerRadius, nSides, nRings );
+		return new TriangleMesh(data);
+	}
 
-		return mesh;
+	inline void buildTorus( MeshData &data, GLfloat outerRadius, GLfloat innerRadius, GLint nSides, GLint nRings ) {
+		GLTW_TRACE_INTERNAL( "buildTorus" );
+		buildParametric( data, TorusSurface( outerRadius, innerRadius ), nRings, nSides );
 	}
 
 	inline TriangleMesh * buildCylinder( float base, float top, float height, int slices, int stacks )
 	{
-		GLuint elements = slices * stacks * 6;
-		GLuint nVerts = slices * (stacks + 1);
-
-		// Allocate temporary space for the vertex data
-		GLfloat * verts;
-		GLfloat * normals;
-		GLuint * el;
-		verts = new GLfloat[ nVerts * 3 ];
-		normals = new GLfloat[ nVerts * 3 ];
-		el = new GLuint[ elements ];
-
-		// Generate the points
-		GLuint vIdx = 0;
-		GLfloat x, y, z, nx, ny, nlen;
-		float sliceFac = 2.0 * GLTW_PI / slices;
-		float stackFac = height / stacks;
-		float angle = 0.0f, alpha = 0.0f, r = 0.0f;
-		float normZ = (base - top) / height;
-		for( int i = 0; i <= stacks ; i++ ) {
-			z = i * stackFac;
-			alpha = z / height;
-			r = (1 - alpha) * base + alpha * top;
-			for( int j = 0; j < slices; j++ ) {
-				angle = sliceFac * j;
-				x = nx = cosf(angle);
-				y = ny = sinf(angle);
-				nlen = sqrt(nx * nx + ny * ny + normZ * normZ);
-				x *= r;
-				y *= r;
-				verts[vIdx] = x;
-				verts[vIdx+1] = y;
-				verts[vIdx+2] = z;
-				normals[vIdx] = nx / nlen;
-				normals[vIdx+1] = ny / nlen;
-				normals[vIdx+2] = normZ / nlen;
-				vIdx += 3;
-			}
-		}
-
-		// Generate the element indexes for triangles
-		GLuint elIdx = 0, stackStart, nextStackStart;
-		for( int i = 0; i < stacks; i++ ) {
-			stackStart = i * slices;
-			nextStackStart = (i+1) * slices;
-			for( int j = 0; j < slices; j++ ) {
-				// Triangle one
-				el[elIdx] = stackStart + j;
-				el[elIdx+1] = nextStackStart + j;
-				el[elIdx+2] = nextStackStart + ((j+1) % slices);
-				// Triangle 2
-				el[elIdx+3] = stackStart + j;
-				el[elIdx+4] = nextStackStart + ((j+1) % slices);
-				el[elIdx+5] = stackStart + ((j+1) % slices);
-				elIdx += 6;
-			}
-		}
+		MeshData &data = builderScratch();
+		buildCylinder( data, base, top, height, slices, stacks );
+		return new TriangleMesh(data);
+	}
 
-		TriangleMesh *mesh = new TriangleMesh(nVerts, elements);
-		mesh->copyPositionData(verts);
-		mesh->copyNormalData(normals);
-		mesh->copyElementData(el);
-
-		// Delete the local arrays, we don't need them anymore.
-		delete [] verts;
-		delete [] normals;
-		delete [] el;
-
-		return mesh;
+	inline void buildCylinder( MeshData &data, float base, float top, float height, int slices, int stacks )
+	{
+		GLTW_TRACE_INTERNAL( "buildCylinder" );
+		buildParametric( data, CylinderSurface( base, top, height ), slices, stacks );
 	}
 
 	inline TriangleMesh * buildCube() 
 	{
+		MeshData &data = builderScratch();
+		buildCube( data );
+		return new TriangleMesh(data);
+	}
+
+	inline void buildCube( MeshData &data )
+	{
+		GLTW_TRACE_INTERNAL( "buildCube" );
 		float side = 1.0f;
 		float side2 = side / 2.0f;
 
@@ -344,93 +915,42 @@ namespace gltw {
 			20,21,22,20,22,23
 		};
 
-		TriangleMesh *mesh = new TriangleMesh(24, 36);
-		mesh->copyPositionData(v);
-		mesh->copyNormalData(n);
-		mesh->copyElementData(el);
-
-		return mesh;
+		data.resize( 24, 36 );
+		std::copy( v, v + 72, data.positions.begin() );
+		std::copy( n, n + 72, data.normals.begin() );
+		std::copy( el, el + 36, data.elements.begin() );
 	}
 
 	inline TriangleMesh * buildSphere(GLfloat radius, int slices, int stacks)
 	{
-		GLuint nVerts = slices * (stacks + 1);
-		GLuint elements = (slices * 2 * (stacks-1) ) * 3;
-
-		// Allocate the temporary arrays for the vertex data
-		GLfloat *verts = new GLfloat[nVerts*3];
-		GLfloat *norms = new GLfloat[nVerts*3];
-		GLuint * el = new GLuint[elements];
-
-		// Generate positions and normals
-		GLfloat theta, phi;
-		GLfloat thetaFac = (2.0 * GLTW_PI) / slices;
-		GLfloat phiFac = GLTW_PI / stacks;
-		GLfloat nx, ny, nz;
-		GLuint idx = 0;
-		for( int i = 0; i < slices; i++ ) {
-			theta = i * thetaFac;
-			for( int j = 0; j <= stacks; j++ ) {
-				phi = j * phiFac;
-				nx = sinf(phi) * cosf(theta);
-				ny = sinf(phi) * sinf(theta);
-				nz = cosf(phi);
-				verts[idx] = radius * nx; verts[idx+1] = radius * ny; verts[idx+2] = radius * nz;
-				norms[idx] = nx; norms[idx+1] = ny; norms[idx+2] = nz;
-				idx += 3;
-			}
-		}
+		MeshData &data = builderScratch();
+		buildSphere( data, radius, slices, stacks );
+		return new TriangleMesh(data);
+	}
 
-		// Generate the element list
-		idx = 0;
-		for( int i = 0; i < slices; i++ ) {
-			GLuint stackStart = i * (stacks + 1);
-			GLuint nextStackStart = ((i+1) % slices) * (stacks+1);
-			for( int j = 0; j < stacks; j++ ) {
-				if( j == 0 ) {
-					el[idx] = stackStart;
-					el[idx+1] = stackStart + 1;
-					el[idx+2] = nextStackStart + 1;
-					idx += 3;
-				} else if( j == stacks - 1) {
-					el[idx] = stackStart + j;
-					el[idx+1] = stackStart + j + 1;
-					el[idx+2] = nextStackStart + j;
-					idx += 3;
-				} else {
-					el[idx] = stackStart + j;
-					el[idx+1] = stackStart + j + 1;
-					el[idx+2] = nextStackStart + j + 1;
-					el[idx+3] = nextStackStart + j;
-					el[idx+4] = stackStart + j;
-					el[idx+5] = nextStackStart + j + 1;
-					idx += 6;
-				}
-			}
-		}
-
-
-		TriangleMesh * mesh = new TriangleMesh(nVerts,elements);
-		mesh->copyPositionData(verts);
-		mesh->copyNormalData(norms);
-		mesh->copyElementData(el);
-
-		// Delete our vertex data, we don't need it anymore
-		delete [] verts;
-		delete [] norms;
-		delete [] el;
-
-		return mesh;
+	inline void buildSphere( MeshData &data, GLfloat radius, int slices, int stacks )
+	{
+		GLTW_TRACE_INTERNAL( "buildSphere" );
+		buildParametric( data, SphereSurface( radius ), slices, stacks );
 	}
 
 	inline TriangleMesh * buildPlane(float xsize, float zsize, int xdivs, int zdivs)
 	{
+		MeshData &data = builderScratch();
+		buildPlane( data, xsize, zsize, xdivs, zdivs );
+		return new TriangleMesh(data);
+	}
+
+	inline void buildPlane( MeshData &data, float xsize, float zsize, int xdivs, int zdivs )
+	{
+		GLTW_TRACE_INTERNAL( "buildPlane" );
 		if( xdivs < 1 ) xdivs = 1;
 		if( zdivs < 1 ) zdivs = 1;
 
-		float * v = new float[3 * (xdivs + 1) * (zdivs + 1)];
-		float * n = new float[3 * (xdivs + 1) * (zdivs + 1)];
-		GLuint * el = new GLuint[6 * xdivs * zdivs];
+		data.resize( (xdivs + 1) * (zdivs + 1), 6 * xdivs * zdivs );
+		float * v = data.positions.data();
+		float * n = data.normals.data();
+		GLuint * el = data.elements.data();
 
 		float x2 = xsize / 2.0f;
 		float z2 = zsize / 2.0f;
@@ -467,19 +987,5 @@ namespace gltw {
 				idx += 6;
 			}
 		}
-
-		int verts = (xdivs+1) * (zdivs+1);
-		int elements = 6 * xdivs * zdivs;
-		TriangleMesh * mesh = new TriangleMesh(verts, elements);
-
-		mesh->copyPositionData(v);
-		mesh->copyNormalData(n);
-		mesh->copyElementData(el);
-
-		delete [] v;
-		delete [] n;
-		delete [] el;
-
-		return mesh;
 	}
 }
@@ -0,0 +1,169 @@
+#ifndef __gltw_bvh_hpp
+#define __gltw_bvh_hpp
+
+#include <cfloat>
+#include <vector>
+
+namespace gltw {
+
+	/** The result of MeshBVH::raycast */
+	struct RayHit {
+		/** The index of the triangle that was hit */
+		GLuint triangle;
+		/** The distance along the ray, in units of the ray's direction vector */
+		GLfloat distance;
+		/** The barycentric coordinates of the hit: point = (1 - u - v) * a + u * b + v * c */
+		GLfloat u, v;
+	};
+
+	/** The result of MeshBVH::closestPoint */
+	struct PointHit {
+		/** The index of the closest triangle */
+		GLuint triangle;
+		/** The closest point on that triangle */
+		GLfloat point[3];
+		/** The distance from the query point to the closest point */
+		GLfloat distance;
+	};
+
+	/**
+	 * <p>A bounding volume hierarchy over a set of triangles, for ray picking and other
+	 * spatial queries in logarithmic time.  The tree is built with the surface area heuristic,
+	 * in parallel on a ThreadPool.  Ray casts test both children of a node against all
+	 * three slabs at once using SSE where available.</p>
+	 *
+	 * <p>The BVH does not copy the positions or elements: they must remain valid, and at the
+	 * same addresses, while the BVH is used.  When the positions change but the triangles do not,
+	 * refit() updates the boxes in linear time.  Refitting does not improve the tree, so after
+	 * large changes build() gives faster queries.</p>
+	 *
+	 * <p>VertexBatch::keepQueryData provides a BVH for a VertexBatch or TriangleMesh, kept up to
+	 * date as its data is copied.</p>
+	 *
+	 * <p><code>
+	 *    gltw::MeshBVH bvh;<br />
+	 *    bvh.build( data.positions.data(), data.elements.data(), data.numElements() / 3 );<br />
+	 *    gltw::RayHit hit;<br />
+	 *    if( bvh.raycast( origin, direction, hit ) ) { ... }<br />
+	 * </code></p>
+	 */
+	class MeshBVH {
+	public:
+		/** Constructs an empty BVH */
+		MeshBVH();
+
+		/**
+		 * Build the BVH.
+		 *
+		 * @param positions 3 values (x,y,z) per vertex
+		 * @param elements 3 indices per triangle, or NULL if each three consecutive vertices form a triangle
+		 * @param numTriangles the number of triangles
+		 * @param pool the threads to build with, defaults to ThreadPool::shared()
+		 */
+		void build( const GLfloat * positions, const GLuint * elements, size_t numTriangles, ThreadPool * pool = NULL );
+
+		/**
+		 * Recompute the bounding boxes after the positions have changed.  The positions must
+		 * still be at the address given to build(), and the triangles must be unchanged.
+		 *
+		 * @param pool the threads to use, defaults to ThreadPool::shared()
+		 */
+		void refit( ThreadPool * pool = NULL );
+
+		/** @return true if the BVH has no triangles */
+		bool empty() const { return nodes.empty(); }
+		/** @return the number of triangles */
+		size_t numTriangles() const { return nTriangles; }
+		/** @return the number of nodes in the tree */
+		size_t numNodes() const { return nodes.size(); }
+
+		/**
+		 * Retrieve the bounding box of all of the triangles.
+		 *
+		 * @param min (out) 3 values receiving the minimum corner
+		 * @param max (out) 3 values receiving the maximum corner
+		 * @return false if the BVH is empty.
+		 */
+		bool bounds( GLfloat * min, GLfloat * max ) const;
+
+		/**
+		 * Find the first triangle hit by a ray.  Both sides of each triangle are hit.
+		 *
+		 * @param origin 3 values, the start of the ray
+		 * @param direction 3 values, the direction of the ray (need not be normalized)
+		 * @param hit (out) receives the hit
+		 * @param maxDistance hits beyond this distance along the ray are ignored
+		 * @return true if a triangle was hit
+		 */
+		bool raycast( const GLfloat * origin, const GLfloat * direction, RayHit & hit /*out*/,
+			GLfloat maxDistance = FLT_MAX ) const;
+
+		/**
+		 * Find the point on the triangles closest to a given point.
+		 *
+		 * @param point 3 values, the query point
+		 * @param hit (out) receives the closest point
+		 * @param maxDistance triangles further than this are ignored
+		 * @return true if a triangle was found within maxDistance
+		 */
+		bool closestPoint( const GLfloat * point, PointHit & hit /*out*/, GLfloat maxDistance = FLT_MAX ) const;
+
+		/**
+		 * Find the triangles that overlap an axis-aligned box.  Each triangle is tested exactly,
+		 * not just its bounding box.
+		 *
+		 * @param min 3 values, the minimum corner of the box
+		 * @param max 3 values, the maximum corner of the box
+		 * @param triangles (out) receives the indices of the triangles, in no particular order
+		 * @return the number of triangles found
+		 */
+		size_t overlapBox( const GLfloat * min, const GLfloat * max, std::vector<GLuint> & triangles /*out*/ ) const;
+
+	private:
+		/**
+		 * An interior node (count == 0) has children at index and index + 1.
+		 * A leaf has the triangles order[index .. index + count).
+		 */
+		struct Node {
+			GLfloat min[3];
+			GLuint index;
+			GLfloat max[3];
+			GLuint count;
+		};
+
+		struct Box {
+			GLfloat min[3], max[3];
+			void clear();
+			void grow( const GLfloat * p );
+			void grow( const Box & b );
+			GLfloat halfArea() const;
+		};
+
+		/** A triangle's box, moved about with it while building so that the build reads memory in order */
+		struct Ref {
+			Box box;
+			GLuint triangle;
+		};
+
+		/** Subtrees of up to deferSize triangles are listed in deferred, as (node, begin, end, depth), rather than built */
+		struct BuildContext {
+			std::vector<Ref> * refs;
+			ThreadPool * pool;
+			std::vector<size_t> * deferred;
+			size_t deferSize;
+		};
+
+		void triangle( GLuint t, const GLfloat * v[3] ) const;
+		void buildNode( std::vector<Node> & out, size_t node, size_t begin, size_t end, int depth, BuildContext & ctx );
+
+		const GLfloat * positions;
+		const GLuint * elements;
+		size_t nTriangles;
+		std::vector<Node> nodes;
+		std::vector<GLuint> order;
+	};
+}
+
+#include "gltw_bvh.inl"
+
+#endif
@@ -0,0 +1,588 @@
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GLTW_BVH_SSE 1
+#endif
+
+namespace gltw {
+
+	/// @privatesection
+	/** The number of SAH bins per axis, the largest leaf, and the depth beyond which nodes are split at the median */
+	enum { BVH_BINS = 16, BVH_MAX_LEAF = 8, BVH_MAX_SAH_DEPTH = 48, BVH_STACK_SIZE = 128 };
+
+	/** A ray prepared for testing against many boxes */
+	struct BVHRay {
+		GLfloat origin[3], invDir[3];
+#ifdef GLTW_BVH_SSE
+		__m128 origin4, invDir4;
+#endif
+
+		BVHRay( const GLfloat * o, const GLfloat * d ) {
+			for( int i = 0; i < 3; i++ ) { origin[i] = o[i]; invDir[i] = 1.0f / d[i]; }
+#ifdef GLTW_BVH_SSE
+			origin4 = _mm_setr_ps( origin[0], origin[1], origin[2], 0.0f );
+			invDir4 = _mm_setr_ps( invDir[0], invDir[1], invDir[2], 0.0f );
+#endif
+		}
+
+		/**
+		 * The slab test: intersect the ray with the box's three pairs of planes.
+		 *
+		 * @param min the minimum corner of the box
+		 * @param max the maximum corner of the box
+		 * @param tMax the current closest hit
+		 * @param tNear (out) the distance at which the ray enters the box
+		 */
+		bool hitsBox( const GLfloat * min, const GLfloat * max, GLfloat tMax, GLfloat & tNear ) const {
+			GLfloat enter = -FLT_MAX, exit = FLT_MAX;
+			for( int i = 0; i < 3; i++ ) {
+				GLfloat t1 = (min[i] - origin[i]) * invDir[i], t2 = (max[i] - origin[i]) * invDir[i];
+				enter = std::max( enter, std::min( t1, t2 ) );
+				exit = std::min( exit, std::max( t1, t2 ) );
+			}
+			tNear = enter;
+			return enter <= exit && exit >= 0.0f && enter <= tMax;
+		}
+
+		/**
+		 * The slab test against both children of a node.  With SSE, each box's three slabs
+		 * are intersected at once, and the two boxes are reduced together.
+		 *
+		 * @param minA the minimum corner of the first box, followed by one more value (ignored)
+		 * @param maxA the maximum corner of the first box, followed by one more value (ignored)
+		 * @param minB the minimum corner of the second box, likewise
+		 * @param maxB the maximum corner of the second box, likewise
+		 * @param tMax the current closest hit
+		 * @param tNear (out) the distances at which the ray enters the two boxes
+		 * @return bit 0 set if the ray hits the first box, bit 1 if it hits the second
+		 */
+		int hitsBoxes( const GLfloat * minA, const GLfloat * maxA, const GLfloat * minB, const GLfloat * maxB,
+			GLfloat tMax, GLfloat tNear[2] ) const
+		{
+#ifdef GLTW_BVH_SSE
+			__m128 a1 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( minA ), origin4 ), invDir4 );
+			__m128 a2 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( maxA ), origin4 ), invDir4 );
+			__m128 b1 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( minB ), origin4 ), invDir4 );
+			__m128 b2 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( maxB ), origin4 ), invDir4 );
+			// Interleave to (ax, bx, ay, by) and (az, bz, -, -), then reduce over x, y and z
+			__m128 loA = _mm_min_ps( a1, a2 ), loB = _mm_min_ps( b1, b2 );
+			__m128 hiA = _mm_max_ps( a1, a2 ), hiB = _mm_max_ps( b1, b2 );
+			__m128 loXY = _mm_unpacklo_ps( loA, loB ), loZ = _mm_unpackhi_ps( loA, loB );
+			__m128 hiXY = _mm_unpacklo_ps( hiA, hiB ), hiZ = _mm_unpackhi_ps( hiA, hiB );
+			__m128 enter = _mm_max_ps( _mm_max_ps( loXY, _mm_movehl_ps( loXY, loXY ) ), loZ );
+			__m128 exit = _mm_min_ps( _mm_min_ps( hiXY, _mm_movehl_ps( hiXY, hiXY ) ), hiZ );
+			__m128 hit = _mm_and_ps( _mm_cmple_ps( enter, exit ),
+				_mm_and_ps( _mm_cmpge_ps( exit, _mm_setzero_ps() ), _mm_cmple_ps( enter, _mm_set1_ps( tMax ) ) ) );
+			_mm_storel_pi( (__m64 *)tNear, enter );
+			return _mm_movemask_ps( hit ) & 3;
+#else
+			return (hitsBox( minA, maxA, tMax, tNear[0] ) ? 1 : 0) | (hitsBox( minB, maxB, tMax, tNear[1] ) ? 2 : 0);
+#endif
+		}
+	};
+
+	inline void bvhSub( const GLfloat * a, const GLfloat * b, GLfloat * out ) {
+		out[0] = a[0] - b[0]; out[1] = a[1] - b[1]; out[2] = a[2] - b[2];
+	}
+
+	inline GLfloat bvhDot( const GLfloat * a, const GLfloat * b ) {
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	inline void bvhCross( const GLfloat * a, const GLfloat * b, GLfloat * out ) {
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	/** The closest point on triangle abc to p (Ericson, Real-Time Collision Detection, 5.1.5) */
+	inline void closestPointOnTriangle( const GLfloat * p, const GLfloat * a, const GLfloat * b, const GLfloat * c, GLfloat * out ) {
+		GLfloat ab[3], ac[3], ap[3], bp[3], cp[3];
+		bvhSub( b, a, ab ); bvhSub( c, a, ac ); bvhSub( p, a, ap );
+		GLfloat d1 = bvhDot( ab, ap ), d2 = bvhDot( ac, ap );
+		if( d1 <= 0.0f && d2 <= 0.0f ) { std::copy( a, a + 3, out ); return; }
+		bvhSub( p, b, bp );
+		GLfloat d3 = bvhDot( ab, bp ), d4 = bvhDot( ac, bp );
+		if( d3 >= 0.0f && d4 <= d3 ) { std::copy( b, b + 3, out ); return; }
+		GLfloat vc = d1 * d4 - d3 * d2;
+		if( vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f ) {
+			GLfloat v = d1 / (d1 - d3);
+			for( int i = 0; i < 3; i++ ) out[i] = a[i] + v * ab[i];
+			return;
+		}
+		bvhSub( p, c, cp );
+		GLfloat d5 = bvhDot( ab, cp ), d6 = bvhDot( ac, cp );
+		if( d6 >= 0.0f && d5 <= d6 ) { std::copy( c, c + 3, out ); return; }
+		GLfloat vb = d5 * d2 - d1 * d6;
+		if( vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f ) {
+			GLfloat w = d2 / (d2 - d6);
+			for( int i = 0; i < 3; i++ ) out[i] = a[i] + w * ac[i];
+			return;
+		}
+		GLfloat va = d3 * d6 - d5 * d4;
+		if( va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f ) {
+			GLfloat w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+			for( int i = 0; i < 3; i++ ) out[i] = b[i] + w * (c[i] - b[i]);
+			return;
+		}
+		GLfloat denom = 1.0f / (va + vb + vc);
+		GLfloat v = vb * denom, w = vc * denom;
+		for( int i = 0; i < 3; i++ ) out[i] = a[i] + ab[i] * v + ac[i] * w;
+	}
+
+	/** Whether triangle abc overlaps the box with the given center and half size, by the separating axis test */
+	inline bool triangleOverlapsBox( const GLfloat * center, const GLfloat * half, const GLfloat * a, const GLfloat * b, const GLfloat * c ) {
+		GLfloat v[3][3], e[3][3];
+		bvhSub( a, center, v[0] ); bvhSub( b, center, v[1] ); bvhSub( c, center, v[2] );
+		bvhSub( v[1], v[0], e[0] ); bvhSub( v[2], v[1], e[1] ); bvhSub( v[0], v[2], e[2] );
+
+		// The box's faces, the triangle's plane, and the cross products of the edges with the box's axes
+		GLfloat axes[13][3] = {
+			{ 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }
+		};
+		bvhCross( e[0], e[1], axes[3] );
+		for( int i = 0; i < 3; i++ ) {
+			for( int j = 0; j < 3; j++ ) {
+				GLfloat unit[3] = { 0, 0, 0 };
+				unit[j] = 1.0f;
+				bvhCross( e[i], unit, axes[4 + 3 * i + j] );
+			}
+		}
+		for( int k = 0; k < 13; k++ ) {
+			const GLfloat * axis = axes[k];
+			GLfloat p0 = bvhDot( v[0], axis ), p1 = bvhDot( v[1], axis ), p2 = bvhDot( v[2], axis );
+			GLfloat r = half[0] * std::fabs( axis[0] ) + half[1] * std::fabs( axis[1] ) + half[2] * std::fabs( axis[2] );
+			if( std::min( p0, std::min( p1, p2 ) ) > r || std::max( p0, std::max( p1, p2 ) ) < -r ) return false;
+		}
+		return true;
+	}
+	/// @publicsection
+
+	inline void MeshBVH::Box::clear() {
+		for( int i = 0; i < 3; i++ ) { min[i] = FLT_MAX; max[i] = -FLT_MAX; }
+	}
+
+	inline void MeshBVH::Box::grow( const GLfloat * p ) {
+		for( int i = 0; i < 3; i++ ) {
+			min[i] = std::min( min[i], p[i] );
+			max[i] = std::max( max[i], p[i] );
+		}
+	}
+
+	inline void MeshBVH::Box::grow( const Box & b ) {
+		for( int i = 0; i < 3; i++ ) {
+			min[i] = std::min( min[i], b.min[i] );
+			max[i] = std::max( max[i], b.max[i] );
+		}
+	}
+
+	inline GLfloat MeshBVH::Box::halfArea() const {
+		GLfloat d[3] = { max[0] - min[0], max[1] - min[1], max[2] - min[2] };
+		if( d[0] < 0.0f ) return 0.0f;
+		return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+	}
+
+	inline MeshBVH::MeshBVH() : positions(NULL), elements(NULL), nTriangles(0) { }
+
+	inline void MeshBVH::triangle( GLuint t, const GLfloat * v[3] ) const {
+		for( int k = 0; k < 3; k++ ) {
+			size_t index = elements ? elements[3 * (size_t)t + k] : 3 * (size_t)t + k;
+			v[k] = positions + 3 * index;
+		}
+	}
+
+	inline void MeshBVH::build( const GLfloat * pos, const GLuint * elems, size_t numTriangles, ThreadPool * pool )
+	{
+		positions = pos;
+		elements = elems;
+		nTriangles = numTriangles;
+		nodes.clear();
+		order.resize( numTriangles );
+		if( numTriangles == 0 ) return;
+		if( pool == NULL ) pool = &ThreadPool::shared();
+
+		const size_t CHUNK = 1 << 14;
+		std::vector<Ref> refs( numTriangles );
+		pool->parallelFor( (numTriangles + CHUNK - 1) / CHUNK, [&]( size_t chunk ) {
+			for( size_t t = chunk * CHUNK; t < std::min( numTriangles, (chunk + 1) * CHUNK ); t++ ) {
+				const GLfloat * v[3];
+				triangle( (GLuint)t, v );
+				refs[t].box.clear();
+				for( int k = 0; k < 3; k++ ) refs[t].box.grow( v[k] );
+				refs[t].triangle = (GLuint)t;
+			}
+		} );
+
+		// The top of the tree is built here, with the binning spread over the pool, down to
+		// subtrees small enough that there are several per thread.  The subtrees are then
+		// built in parallel and appended.
+		nodes.reserve( 2 * numTriangles / BVH_MAX_LEAF + 1 );
+		nodes.resize( 1 );
+		std::vector<size_t> deferred;
+		BuildContext ctx = { &refs, pool, &deferred, std::max( numTriangles / (8 * (size_t)pool->size()), (size_t)4096 ) };
+		buildNode( nodes, 0, 0, numTriangles, 0, ctx );
+
+		const size_t nTasks = deferred.size() / 4;
+		std::vector< std::vector<Node> > subtrees( nTasks );
+		pool->parallelFor( nTasks, [&]( size_t k ) {
+			BuildContext local = { &refs, NULL, NULL, 0 };
+			subtrees[k].resize( 1 );
+			buildNode( subtrees[k], 0, deferred[4 * k + 1], deferred[4 * k + 2], (int)deferred[4 * k + 3], local );
+		} );
+		for( size_t k = 0; k < nTasks; k++ ) {
+			const std::vector<Node> & sub = subtrees[k];
+			size_t base = nodes.size();
+			for( size_t i = 0; i < sub.size(); i++ ) {
+				Node n = sub[i];
+				if( n.count == 0 ) n.index = (GLuint)(base + n.index - 1);
+				if( i == 0 ) nodes[deferred[4 * k]] = n;
+				else nodes.push_back( n );
+			}
+		}
+		pool->parallelFor( (numTriangles + CHUNK - 1) / CHUNK, [&]( size_t chunk ) {
+			for( size_t t = chunk * CHUNK; t < std::min( numTriangles, (chunk + 1) * CHUNK ); t++ ) {
+				order[t] = refs[t].triangle;
+			}
+		} );
+	}
+
+	inline void MeshBVH::buildNode( std::vector<Node> & out, size_t node, size_t begin, size_t end, int depth, BuildContext & ctx )
+	{
+		const size_t count = end - begin;
+		if( ctx.deferred && count <= ctx.deferSize ) {
+			ctx.deferred->push_back( node );
+			ctx.deferred->push_back( begin );
+			ctx.deferred->push_back( end );
+			ctx.deferred->push_back( depth );
+			return;
+		}
+
+		std::vector<Ref> & refs = *ctx.refs;
+		const size_t CHUNK = 1 << 14;
+		const bool parallel = ctx.pool != NULL && count >= 4 * CHUNK;
+		const size_t nChunks = parallel ? (count + CHUNK - 1) / CHUNK : 1;
+
+		// Bounds of the triangles, and of their centers
+		// Per-chunk partial results; the common serial case stays off the heap
+		Box serialBox[2];
+		std::vector<Box> parallelBox( parallel ? 2 * nChunks : 0 );
+		Box * chunkBox = parallel ? parallelBox.data() : serialBox;
+		auto boundRange = [&]( size_t chunk ) {
+			Box & box = chunkBox[2 * chunk], & centers = chunkBox[2 * chunk + 1];
+			box.clear();
+			centers.clear();
+			for( size_t i = begin + chunk * CHUNK; i < (parallel ? std::min( end, begin + (chunk + 1) * CHUNK ) : end); i++ ) {
+				const Box & b = refs[i].box;
+				GLfloat c[3] = { b.min[0] + b.max[0], b.min[1] + b.max[1], b.min[2] + b.max[2] };
+				box.grow( b );
+				centers.grow( c );
+			}
+		};
+		if( parallel ) ctx.pool->parallelFor( nChunks, boundRange );
+		else boundRange( 0 );
+		Box box = chunkBox[0], centers = chunkBox[1];
+		for( size_t c = 1; c < nChunks; c++ ) {
+			box.grow( chunkBox[2 * c] );
+			centers.grow( chunkBox[2 * c + 1] );
+		}
+		std::copy( box.min, box.min + 3, out[node].min );
+		std::copy( box.max, box.max + 3, out[node].max );
+
+		if( count <= 2 ) {
+			out[node].index = (GLuint)begin;
+			out[node].count = (GLuint)count;
+			return;
+		}
+
+		// Bin the centers along each axis and evaluate the surface area heuristic at each bin boundary
+		// Small nodes use fewer bins, which costs little in quality and a lot less time
+		const int nBins = (int)std::min( (size_t)BVH_BINS, 4 + count / 4 );
+		GLfloat scale[3];
+		for( int a = 0; a < 3; a++ ) {
+			GLfloat extent = centers.max[a] - centers.min[a];
+			scale[a] = extent > 0.0f ? nBins * 0.9999f / extent : 0.0f;
+		}
+		auto binOf = [&]( const Ref & r, int a ) {
+			const Box & b = r.box;
+			int bin = (int)((b.min[a] + b.max[a] - centers.min[a]) * scale[a]);
+			return std::min( std::max( bin, 0 ), nBins - 1 );
+		};
+
+		struct Bins {
+			Box box[3][BVH_BINS];
+			size_t count[3][BVH_BINS];
+		};
+		Bins serialBins;
+		std::vector<Bins> parallelBins( parallel ? nChunks : 0 );
+		Bins * chunkBins = parallel ? parallelBins.data() : &serialBins;
+		auto binRange = [&]( size_t chunk ) {
+			Bins & bins = chunkBins[chunk];
+			for( int a = 0; a < 3; a++ ) {
+				for( int b = 0; b < nBins; b++ ) { bins.box[a][b].clear(); bins.count[a][b] = 0; }
+			}
+			for( size_t i = begin + chunk * CHUNK; i < (parallel ? std::min( end, begin + (chunk + 1) * CHUNK ) : end); i++ ) {
+				const Ref & r = refs[i];
+				for( int a = 0; a < 3; a++ ) {
+					if( scale[a] == 0.0f ) continue;
+					int b = binOf( r, a );
+					bins.box[a][b].grow( r.box );
+					bins.count[a][b]++;
+				}
+			}
+		};
+		if( parallel ) ctx.pool->parallelFor( nChunks, binRange );
+		else binRange( 0 );
+		Bins & bins = chunkBins[0];
+		for( size_t c = 1; c < nChunks; c++ ) {
+			for( int a = 0; a < 3; a++ ) {
+				for( int b = 0; b < nBins; b++ ) {
+					bins.box[a][b].grow( chunkBins[c].box[a][b] );
+					bins.count[a][b] += chunkBins[c].count[a][b];
+				}
+			}
+		}
+
+		// Cost of a split, relative to intersecting one triangle: 1 to traverse the node,
+		// plus each child's triangles weighted by the probability of entering it
+		int bestAxis = -1, bestSplit = 0;
+		GLfloat bestCost = FLT_MAX, area = box.halfArea();
+		for( int a = 0; a < 3; a++ ) {
+			if( scale[a] == 0.0f ) continue;
+			GLfloat rightArea[BVH_BINS];
+			size_t rightCount[BVH_BINS];
+			Box right;
+			right.clear();
+			size_t n = 0;
+			for( int b = nBins - 1; b > 0; b-- ) {
+				right.grow( bins.box[a][b] );
+				n += bins.count[a][b];
+				rightArea[b] = right.halfArea();
+				rightCount[b] = n;
+			}
+			Box left;
+			left.clear();
+			n = 0;
+			for( int b = 0; b < nBins - 1; b++ ) {
+				left.grow( bins.box[a][b] );
+				n += bins.count[a][b];
+				if( n == 0 || rightCount[b + 1] == 0 ) continue;
+				GLfloat cost = 1.0f + (left.halfArea() * n + rightArea[b + 1] * rightCount[b + 1]) / std::max( area, FLT_MIN );
+				if( cost < bestCost ) {
+					bestCost = cost;
+					bestAxis = a;
+					bestSplit = b;
+				}
+			}
+		}
+
+		if( count <= BVH_MAX_LEAF && (bestAxis < 0 || bestCost >= (GLfloat)count) ) {
+			out[node].index = (GLuint)begin;
+			out[node].count = (GLuint)count;
+			return;
+		}
+
+		size_t mid = begin + count / 2;
+		if( bestAxis >= 0 && depth < BVH_MAX_SAH_DEPTH ) {
+			Ref * split = std::partition( &refs[begin], &refs[0] + end, [&]( const Ref & r ) {
+				return binOf( r, bestAxis ) <= bestSplit;
+			} );
+			size_t m = split - &refs[0];
+			if( m != begin && m != end ) mid = m;
+		}
+
+		size_t child = out.size();
+		out.resize( child + 2 );
+		out[node].index = (GLuint)child;
+		out[node].count = 0;
+		buildNode( out, child, begin, mid, depth + 1, ctx );
+		buildNode( out, child + 1, mid, end, depth + 1, ctx );
+	}
+
+	inline void MeshBVH::refit( ThreadPool * pool )
+	{
+		if( nodes.empty() ) return;
+		if( pool == NULL ) pool = &ThreadPool::shared();
+
+		const size_t CHUNK = 1 << 12;
+		pool->parallelFor( (nodes.size() + CHUNK - 1) / CHUNK, [&]( size_t chunk ) {
+			for( size_t i = chunk * CHUNK; i < std::min( nodes.size(), (chunk + 1) * CHUNK ); i++ ) {
+				Node & n = nodes[i];
+				if( n.count == 0 ) continue;
+				Box box;
+				box.clear();
+				for( GLuint k = 0; k < n.count; k++ ) {
+					const GLfloat * v[3];
+					triangle( order[n.index + k], v );
+					for( int j = 0; j < 3; j++ ) box.grow( v[j] );
+				}
+				std::copy( box.min, box.min + 3, n.min );
+				std::copy( box.max, box.max + 3, n.max );
+			}
+		} );
+
+		// Children always follow their parents
+		for( size_t i = nodes.size(); i-- > 0; ) {
+			Node & n = nodes[i];
+			if( n.count != 0 ) continue;
+			const Node & a = nodes[n.index], & b = nodes[n.index + 1];
+			for( int k = 0; k < 3; k++ ) {
+				n.min[k] = std::min( a.min[k], b.min[k] );
+				n.max[k] = std::max( a.max[k], b.max[k] );
+			}
+		}
+	}
+
+	inline bool MeshBVH::bounds( GLfloat * min, GLfloat * max ) const {
+		if( nodes.empty() ) return false;
+		std::copy( nodes[0].min, nodes[0].min + 3, min );
+		std::copy( nodes[0].max, nodes[0].max + 3, max );
+		return true;
+	}
+
+	inline bool MeshBVH::raycast( const GLfloat * origin, const GLfloat * direction, RayHit & hit, GLfloat maxDistance ) const
+	{
+		if( nodes.empty() ) return false;
+		BVHRay ray( origin, direction );
+		GLfloat tMax = maxDistance, tNear;
+		bool found = false;
+
+		struct Entry { GLuint node; GLfloat tNear; } stack[BVH_STACK_SIZE];
+		int top = 0;
+		if( !ray.hitsBox( nodes[0].min, nodes[0].max, tMax, tNear ) ) return false;
+		stack[top].node = 0;
+		stack[top++].tNear = tNear;
+		while( top > 0 ) {
+			const Entry e = stack[--top];
+			if( e.tNear > tMax ) continue;
+			const Node & n = nodes[e.node];
+			if( n.count == 0 ) {
+				const Node & a = nodes[n.index], & b = nodes[n.index + 1];
+				GLfloat t[2];
+				int hits = ray.hitsBoxes( a.min, a.max, b.min, b.max, tMax, t );
+				bool hit0 = (hits & 1) != 0, hit1 = (hits & 2) != 0;
+				GLfloat t0 = t[0], t1 = t[1];
+				// Push the far child first, so that the near one is visited first
+				if( hit0 && hit1 && t1 < t0 ) {
+					stack[top].node = n.index; stack[top++].tNear = t0;
+					stack[top].node = n.index + 1; stack[top++].tNear = t1;
+				} else {
+					if( hit1 ) { stack[top].node = n.index + 1; stack[top++].tNear = t1; }
+					if( hit0 ) { stack[top].node = n.index; stack[top++].tNear = t0; }
+				}
+				continue;
+			}
+
+			// Moller-Trumbore
+			for( GLuint k = 0; k < n.count; k++ ) {
+				GLuint t = order[n.index + k];
+				const GLfloat * v[3];
+				triangle( t, v );
+				GLfloat e1[3], e2[3], p[3], s[3], q[3];
+				bvhSub( v[1], v[0], e1 );
+				bvhSub( v[2], v[0], e2 );
+				bvhCross( direction, e2, p );
+				GLfloat det = bvhDot( e1, p );
+				if( det == 0.0f ) continue;
+				GLfloat invDet = 1.0f / det;
+				bvhSub( origin, v[0], s );
+				GLfloat u = bvhDot( s, p ) * invDet;
+				if( u < 0.0f || u > 1.0f ) continue;
+				bvhCross( s, e1, q );
+				GLfloat w = bvhDot( direction, q ) * invDet;
+				if( w < 0.0f || u + w > 1.0f ) continue;
+				GLfloat dist = bvhDot( e2, q ) * invDet;
+				if( dist < 0.0f || dist > tMax ) continue;
+				tMax = dist;
+				hit.triangle = t;
+				hit.distance = dist;
+				hit.u = u;
+				hit.v = w;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+	inline bool MeshBVH::closestPoint( const GLfloat * point, PointHit & hit, GLfloat maxDistance ) const
+	{
+		if( nodes.empty() ) return false;
+		auto boxDistance2 = [&]( const Node & n ) {
+			GLfloat d2 = 0.0f;
+			for( int i = 0; i < 3; i++ ) {
+				GLfloat d = std::max( std::max( n.min[i] - point[i], point[i] - n.max[i] ), 0.0f );
+				d2 += d * d;
+			}
+			return d2;
+		};
+
+		GLfloat best2 = maxDistance < FLT_MAX ? maxDistance * maxDistance : FLT_MAX;
+		bool found = false;
+		struct Entry { GLuint node; GLfloat dist2; } stack[BVH_STACK_SIZE];
+		int top = 0;
+		stack[top].node = 0;
+		stack[top++].dist2 = boxDistance2( nodes[0] );
+		while( top > 0 ) {
+			const Entry e = stack[--top];
+			if( e.dist2 > best2 ) continue;
+			const Node & n = nodes[e.node];
+			if( n.count == 0 ) {
+				GLfloat d0 = boxDistance2( nodes[n.index] ), d1 = boxDistance2( nodes[n.index + 1] );
+				// Push the farther child first, so that the nearer one is visited first
+				GLuint first = n.index, second = n.index + 1;
+				if( d1 < d0 ) { std::swap( first, second ); std::swap( d0, d1 ); }
+				if( d1 <= best2 ) { stack[top].node = second; stack[top++].dist2 = d1; }
+				if( d0 <= best2 ) { stack[top].node = first; stack[top++].dist2 = d0; }
+				continue;
+			}
+			for( GLuint k = 0; k < n.count; k++ ) {
+				GLuint t = order[n.index + k];
+				const GLfloat * v[3];
+				GLfloat c[3], d[3];
+				triangle( t, v );
+				closestPointOnTriangle( point, v[0], v[1], v[2], c );
+				bvhSub( c, point, d );
+				GLfloat dist2 = bvhDot( d, d );
+				if( dist2 > best2 ) continue;
+				best2 = dist2;
+				hit.triangle = t;
+				std::copy( c, c + 3, hit.point );
+				found = true;
+			}
+		}
+		if( found ) hit.distance = std::sqrt( best2 );
+		return found;
+	}
+
+	inline size_t MeshBVH::overlapBox( const GLfloat * min, const GLfloat * max, std::vector<GLuint> & triangles ) const
+	{
+		triangles.clear();
+		if( nodes.empty() ) return 0;
+		GLfloat center[3], half[3];
+		for( int i = 0; i < 3; i++ ) {
+			center[i] = 0.5f * (min[i] + max[i]);
+			half[i] = 0.5f * (max[i] - min[i]);
+		}
+
+		GLuint stack[BVH_STACK_SIZE];
+		int top = 0;
+		stack[top++] = 0;
+		while( top > 0 ) {
+			const Node & n = nodes[stack[--top]];
+			if( n.min[0] > max[0] || n.max[0] < min[0] || n.min[1] > max[1] || n.max[1] < min[1] ||
+				n.min[2] > max[2] || n.max[2] < min[2] ) continue;
+			if( n.count == 0 ) {
+				stack[top++] = n.index;
+				stack[top++] = n.index + 1;
+				continue;
+			}
+			for( GLuint k = 0; k < n.count; k++ ) {
+				GLuint t = order[n.index + k];
+				const GLfloat * v[3];
+				triangle( t, v );
+				if( triangleOverlapsBox( center, half, v[0], v[1], v[2] ) ) triangles.push_back( t );
+			}
+		}
+		return triangles.size();
+	}
+}
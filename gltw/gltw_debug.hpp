@@ -0,0 +1,128 @@
+#ifndef __gltw_debug_hpp
+#define __gltw_debug_hpp
+
+#include <vector>
+
+namespace gltw {
+
+	/**
+	 * <p>Immediate-mode drawing of lines, points, boxes, wire spheres and axes, for debug
+	 * overlays.  Each call appends vertices with a color to a stream in CPU memory.  flush()
+	 * copies the whole stream into a single buffer, and draws all of the lines with one draw
+	 * call using the ::SHADER_PER_VERT_COLOR shader, and all of the points with another.
+	 * So the cost of a frame's overlay is a single upload and at most two draws, however
+	 * many primitives it holds.</p>
+	 *
+	 * <p>The buffer grows to fit the largest frame and is reused; each upload orphans its
+	 * previous contents, so it never waits for the previous frame's draws.  Positions are
+	 * given in world space.</p>
+	 *
+	 * <p><code>
+	 *    // Initialization<br />
+	 *    gltw::DebugDraw debug;<br />
+	 *    <br />
+	 *    // Within the draw function<br />
+	 *    GLfloat red[] = { 1.0f, 0.0f, 0.0f, 1.0f };<br />
+	 *    for( ... ) debug.aabb( box[i].min, box[i].max, red );<br />
+	 *    debug.line( from, to );<br />
+	 *    debug.axis( model );<br />
+	 *    debug.flush( view, projection );<br />
+	 * </code></p>
+	 */
+	class DebugDraw : public NonCopyable {
+	public:
+		/**
+		 * Constructs an empty stream.  This constructor does not call any OpenGL functions.
+		 *
+		 * @param sphereSegments the number of line segments in each circle of a wire sphere
+		 */
+		explicit DebugDraw( int sphereSegments = 24 );
+
+		/** Deletes the buffer and vertex array object */
+		~DebugDraw();
+
+		/**
+		 * Add a line segment.
+		 *
+		 * @param from the first end (x,y,z)
+		 * @param to the second end (x,y,z)
+		 * @param color the color (r,g,b,a), or NULL for white
+		 */
+		void line( const GLfloat * from, const GLfloat * to, const GLfloat * color = NULL );
+
+		/**
+		 * Add a point, drawn as a round dot of the size set by setPointSize.
+		 *
+		 * @param position the point (x,y,z)
+		 * @param color the color (r,g,b,a), or NULL for white
+		 */
+		void point( const GLfloat * position, const GLfloat * color = NULL );
+
+		/**
+		 * Add the twelve edges of an axis-aligned box.
+		 *
+		 * @param min the minimum corner (x,y,z)
+		 * @param max the maximum corner (x,y,z)
+		 * @param color the color (r,g,b,a), or NULL for white
+		 */
+		void aabb( const GLfloat * min, const GLfloat * max, const GLfloat * color = NULL );
+
+		/**
+		 * Add a wire sphere: three circles around the center, in the xy, yz and zx planes.
+		 *
+		 * @param center the center (x,y,z)
+		 * @param radius the radius
+		 * @param color the color (r,g,b,a), or NULL for white
+		 */
+		void sphereWire( const GLfloat * center, GLfloat radius, const GLfloat * color = NULL );
+
+		/**
+		 * Add the axes of a coordinate frame, x in red, y in green and z in blue.
+		 *
+		 * @param model the frame's model matrix (16 values, column-major), or NULL for the
+		 *    world axes
+		 * @param length the length of each axis, before the model matrix is applied
+		 */
+		void axis( const GLfloat * model = NULL, GLfloat length = 1.0f );
+
+		/** Set the diameter of points, in pixels, defaults to 4 */
+		void setPointSize( GLfloat size ) { pointSize = size; }
+
+		/**
+		 * Upload the primitives added since the last flush, draw them, and empty the stream.
+		 * The ::SHADER_PER_VERT_COLOR variant is made active (and the ::FEATURE_POINTS
+		 * variant of it, if there are points), and given the view and projection matrices.
+		 * The last variant used remains active.
+		 *
+		 * @param view the view matrix (16 values, column-major)
+		 * @param projection the projection matrix (16 values, column-major)
+		 * @return the number of draw calls made, at most two
+		 */
+		size_t flush( const GLfloat * view, const GLfloat * projection );
+
+		/** Empty the stream without drawing it */
+		void clear();
+
+		/** @return the number of line vertices (twice the number of segments) in the stream */
+		size_t numLineVertices() const { return lines.size() / FLOATS_PER_VERTEX; }
+		/** @return the number of points in the stream */
+		size_t numPoints() const { return points.size() / FLOATS_PER_VERTEX; }
+
+	private:
+		// Each vertex is a position (x,y,z) followed by a color (r,g,b,a)
+		static const int FLOATS_PER_VERTEX = 7;
+
+		static void vertex( std::vector<GLfloat> & stream, GLfloat x, GLfloat y, GLfloat z, const GLfloat * color );
+
+		std::vector<GLfloat> lines, points;
+		// The unit circle, as (cos, sin) at each segment's start
+		std::vector<GLfloat> circle;
+		GLfloat pointSize;
+		GLuint vaID, bufID;
+		size_t capacity;
+	};
+}
+
+#include "gltw_debug.inl"
+
+#endif
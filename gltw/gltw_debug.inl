@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gltw {
+
+	inline DebugDraw::DebugDraw( int sphereSegments ) : pointSize(4.0f), vaID(0), bufID(0), capacity(0)
+	{
+		const int n = std::max( sphereSegments, 3 );
+		circle.resize( 2 * n );
+		for( int i = 0; i < n; i++ ) {
+			const double angle = 2.0 * GLTW_PI * i / n;
+			circle[2 * i] = (GLfloat)cos( angle );
+			circle[2 * i + 1] = (GLfloat)sin( angle );
+		}
+	}
+
+	inline DebugDraw::~DebugDraw() {
+		if( vaID != 0 ) glDeleteVertexArrays( 1, &vaID );
+		if( bufID != 0 ) {
+			glDeleteBuffers( 1, &bufID );
+			trackMemory( MEMORY_VERTICES, -(long long)capacity );
+		}
+	}
+
+	inline void DebugDraw::vertex( std::vector<GLfloat> & stream, GLfloat x, GLfloat y, GLfloat z, const GLfloat * color ) {
+		static const GLfloat white[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		if( color == NULL ) color = white;
+		const GLfloat v[FLOATS_PER_VERTEX] = { x, y, z, color[0], color[1], color[2], color[3] };
+		stream.insert( stream.end(), v, v + FLOATS_PER_VERTEX );
+	}
+
+	inline void DebugDraw::line( const GLfloat * from, const GLfloat * to, const GLfloat * color ) {
+		vertex( lines, from[0], from[1], from[2], color );
+		vertex( lines, to[0], to[1], to[2], color );
+	}
+
+	inline void DebugDraw::point( const GLfloat * position, const GLfloat * color ) {
+		vertex( points, position[0], position[1], position[2], color );
+	}
+
+	inline void DebugDraw::aabb( const GLfloat * min, const GLfloat * max, const GLfloat * color ) {
+		// Four edges along each axis, one from each corner of the opposite face
+		for( int axis = 0; axis < 3; axis++ ) {
+			const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+			for( int corner = 0; corner < 4; corner++ ) {
+				GLfloat a[3], b[3];
+				a[axis] = min[axis];
+				b[axis] = max[axis];
+				a[u] = b[u] = (corner & 1) ? max[u] : min[u];
+				a[v] = b[v] = (corner & 2) ? max[v] : min[v];
+				line( a, b, color );
+			}
+		}
+	}
+
+	inline void DebugDraw::sphereWire( const GLfloat * center, GLfloat radius, const GLfloat * color ) {
+		const size_t n = circle.size() / 2;
+		lines.reserve( lines.size() + 3 * 2 * n * FLOATS_PER_VERTEX );
+		for( int axis = 0; axis < 3; axis++ ) {
+			const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+			for( size_t i = 0; i < n; i++ ) {
+				const size_t j = (i + 1) % n;
+				GLfloat a[3], b[3];
+				a[axis] = b[axis] = center[axis];
+				a[u] = center[u] + radius * circle[2 * i];
+				a[v] = center[v] + radius * circle[2 * i + 1];
+				b[u] = center[u] + radius * circle[2 * j];
+				b[v] = center[v] + radius * circle[2 * j + 1];
+				line( a, b, color );
+			}
+		}
+	}
+
+	inline void DebugDraw::axis( const GLfloat * model, GLfloat length ) {
+		static const GLfloat identity[] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+		static const GLfloat colors[3][4] = { { 1, 0, 0, 1 }, { 0, 1, 0, 1 }, { 0, 0, 1, 1 } };
+		if( model == NULL ) model = identity;
+		const GLfloat origin[] = { model[12], model[13], model[14] };
+		for( int i = 0; i < 3; i++ ) {
+			const GLfloat end[] = {
+				origin[0] + length * model[4 * i],
+				origin[1] + length * model[4 * i + 1],
+				origin[2] + length * model[4 * i + 2]
+			};
+			line( origin, end, colors[i] );
+		}
+	}
+
+	inline void DebugDraw::clear() {
+		lines.clear();
+		points.clear();
+	}
+
+	inline size_t DebugDraw::flush( const GLfloat * view, const GLfloat * projection ) {
+		const size_t numLines = numLineVertices(), numPts = numPoints();
+		if( numLines + numPts == 0 ) return 0;
+		GLTW_TRACE_INTERNAL( "DebugDraw::flush" );
+
+		if( vaID == 0 ) {
+			glGenVertexArrays( 1, &vaID );
+			glGenBuffers( 1, &bufID );
+			glBindVertexArray( vaID );
+			glBindBuffer( GL_ARRAY_BUFFER, bufID );
+			const GLsizei stride = FLOATS_PER_VERTEX * sizeof(GLfloat);
+			glEnableVertexAttribArray( GLTW_ATTRIB_IDX_POSITION );
+			glVertexAttribPointer( GLTW_ATTRIB_IDX_POSITION, 3, GL_FLOAT, GL_FALSE, stride, 0 );
+			glEnableVertexAttribArray( GLTW_ATTRIB_IDX_COLOR );
+			glVertexAttribPointer( GLTW_ATTRIB_IDX_COLOR, 4, GL_FLOAT, GL_FALSE, stride, (const GLvoid *)(3 * sizeof(GLfloat)) );
+			glBindVertexArray( 0 );
+		}
+
+		// Grow the buffer by doubling, so it is reallocated only a few times
+		const size_t lineBytes = lines.size() * sizeof(GLfloat), pointBytes = points.size() * sizeof(GLfloat);
+		const size_t bytes = lineBytes + pointBytes;
+		glBindBuffer( GL_ARRAY_BUFFER, bufID );
+		if( bytes > capacity ) {
+			size_t size = std::max( capacity, (size_t)64 << 10 );
+			while( size < bytes ) size *= 2;
+			glBufferData( GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW );
+			trackMemory( MEMORY_VERTICES, (long long)size - (long long)capacity );
+			capacity = size;
+		}
+		void * dest = glMapBufferRange( GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+		if( dest == NULL ) {
+			cerr << "Error in DebugDraw.flush: unable to map the vertex buffer." << endl;
+			glBindBuffer( GL_ARRAY_BUFFER, 0 );
+			clear();
+			return 0;
+		}
+		memcpy( dest, lines.data(), lineBytes );
+		memcpy( (char *)dest + lineBytes, points.data(), pointBytes );
+		bool mapped = glUnmapBuffer( GL_ARRAY_BUFFER ) == GL_TRUE;
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+		GLTW_TRACE_COUNT( COUNTER_BYTES_UPLOADED, bytes );
+		clear();
+		if( !mapped ) return 0;
+
+		size_t draws = 0;
+		glBindVertexArray( vaID );
+		if( numLines > 0 ) {
+			useShaderVariant( stockShaderKey( SHADER_PER_VERT_COLOR ) );
+			setProjectionMatrix( const_cast<GLfloat *>(projection) );
+			setModelViewMatrix( const_cast<GLfloat *>(view) );
+			glDrawArrays( GL_LINES, 0, (GLsizei)numLines );
+			GLTW_TRACE_COUNT( COUNTER_DRAWS, 1 );
+			GLTW_TRACE_COUNT( COUNTER_VERTICES, numLines );
+			draws++;
+		}
+		if( numPts > 0 ) {
+			useShaderVariant( shaderKey( FEATURE_VERTEX_COLOR | FEATURE_POINTS ) );
+			setProjectionMatrix( const_cast<GLfloat *>(projection) );
+			setModelViewMatrix( const_cast<GLfloat *>(view) );
+			gltw::setPointSize( pointSize );
+			glDrawArrays( GL_POINTS, (GLint)numLines, (GLsizei)numPts );
+			GLTW_TRACE_COUNT( COUNTER_DRAWS, 1 );
+			GLTW_TRACE_COUNT( COUNTER_VERTICES, numPts );
+			draws++;
+		}
+		glBindVertexArray( 0 );
+		return draws;
+	}
+}
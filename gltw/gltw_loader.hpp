@@ -0,0 +1,73 @@
+#ifndef __gltw_loader_hpp
+#define __gltw_loader_hpp
+
+namespace gltw {
+
+	/// @defgroup loaders Functions for loading meshes from files
+	/// Wavefront OBJ and PLY (ASCII and binary) files are supported.  The file is mapped
+	/// into memory (see MappedFile) and split into chunks that are parsed in parallel on a
+	/// ThreadPool.  Polygons are split into triangle fans, and if the file has no normals,
+	/// smooth normals are computed with ::computeNormals.
+	///
+	/// <code>
+	///    gltw::TriangleMesh * mesh = gltw::loadTriangleMesh( "bunny.ply" );<br />
+	///    if( mesh == NULL ) { ... }<br />
+	/// </code>
+	/// @{
+
+	/**
+	 * Load a mesh from a Wavefront OBJ file.  Vertex positions, normals and the common
+	 * <code>v x y z r g b</code> vertex color extension are read; texture coordinates,
+	 * groups and materials are ignored.  Where a face uses different position and normal
+	 * indices, vertices are duplicated as needed.
+	 *
+	 * @param fileName the name of the file
+	 * @param data (out) receives the mesh
+	 * @param pool the threads to parse with, defaults to ThreadPool::shared()
+	 * @return true if the file was loaded.  If not, an error message is displayed.
+	 */
+	bool loadOBJ( const char * fileName, MeshData & data /*out*/, ThreadPool * pool = NULL );
+
+	/**
+	 * Load a mesh from a PLY file in any of its three formats.  The vertex properties
+	 * x, y, z, nx, ny, nz, red, green, blue and alpha are read, along with the faces'
+	 * vertex_indices (or vertex_index) list.  Other elements and properties are skipped.
+	 *
+	 * @param fileName the name of the file
+	 * @param data (out) receives the mesh
+	 * @param pool the threads to parse with, defaults to ThreadPool::shared()
+	 * @return true if the file was loaded.  If not, an error message is displayed.
+	 */
+	bool loadPLY( const char * fileName, MeshData & data /*out*/, ThreadPool * pool = NULL );
+
+	/**
+	 * Load a mesh from an OBJ or PLY file, chosen by the file's extension.
+	 *
+	 * @param fileName the name of the file, ending in .obj or .ply
+	 * @param data (out) receives the mesh
+	 * @param pool the threads to parse with, defaults to ThreadPool::shared()
+	 * @return true if the file was loaded.  If not, an error message is displayed.
+	 */
+	bool loadMeshData( const char * fileName, MeshData & data /*out*/, ThreadPool * pool = NULL );
+
+	/**
+	 * Load a mesh from an OBJ or PLY file into a new TriangleMesh.  It is the caller's
+	 * responsibility to delete the TriangleMesh when finished.
+	 *
+	 * <p>Binary PLY files are streamed: vertices and faces are parsed in fixed-size batches
+	 * and copied into the mesh's buffers as they are parsed, so the file is never held
+	 * in memory as a whole MeshData.  If the file has no normals, the positions are kept
+	 * until the normals have been computed.  Other files are loaded with ::loadMeshData.</p>
+	 *
+	 * @param fileName the name of the file, ending in .obj or .ply
+	 * @param usage the buffer usage specifer to be used, defaults to GL_STATIC_DRAW.
+	 * @param pool the threads to parse with, defaults to ThreadPool::shared()
+	 * @return the new mesh, or NULL if the file could not be loaded.
+	 */
+	TriangleMesh * loadTriangleMesh( const char * fileName, GLenum usage = GL_STATIC_DRAW, ThreadPool * pool = NULL );
+	/// @}
+}
+
+#include "gltw_loader.inl"
+
+#endif
@@ -0,0 +1,899 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+
+namespace gltw {
+
+	/// @privatesection
+	/** Parsing of numbers and lines in a memory-mapped text file, which is not null terminated */
+	struct TextScanner {
+		static bool isSpace( char c ) { return c == ' ' || c == '\t' || c == '\r'; }
+		static bool isDigit( char c ) { return (unsigned)(c - '0') < 10; }
+
+		static const char * skipSpace( const char * p, const char * end ) {
+			while( p < end && isSpace(*p) ) p++;
+			return p;
+		}
+
+		static const char * lineEnd( const char * p, const char * end ) {
+			const char * e = (const char *)memchr( p, '\n', end - p );
+			return e ? e : end;
+		}
+
+		/**
+		 * Parse a decimal number.  The digits are accumulated in an integer and scaled
+		 * once by an exact power of ten, which is much faster than strtod and independent
+		 * of the locale.  Infinities and NaNs fall back on strtod.
+		 *
+		 * @return the end of the number, or NULL if there is no number at p
+		 */
+		static const char * parseFloat( const char * p, const char * end, GLfloat & out ) {
+			static const double powers[] = {
+				1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+				1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+			};
+			p = skipSpace( p, end );
+			const char * start = p;
+			bool negative = false;
+			if( p < end && (*p == '-' || *p == '+') ) negative = (*p++ == '-');
+
+			uint64_t mantissa = 0;
+			int digits = 0, exponent = 0;
+			bool any = false;
+			for( ; p < end && isDigit(*p); p++ ) {
+				any = true;
+				if( digits < 19 ) {
+					mantissa = mantissa * 10 + (*p - '0');
+					if( mantissa != 0 ) digits++;
+				} else {
+					exponent++;
+				}
+			}
+			if( p < end && *p == '.' ) {
+				for( p++; p < end && isDigit(*p); p++ ) {
+					any = true;
+					if( digits < 19 ) {
+						mantissa = mantissa * 10 + (*p - '0');
+						if( mantissa != 0 ) digits++;
+						exponent--;
+					}
+				}
+			}
+			if( !any ) {
+				char buf[32];
+				size_t n = std::min( (size_t)(end - start), sizeof(buf) - 1 );
+				memcpy( buf, start, n );
+				buf[n] = '\0';
+				char * stop;
+				out = (GLfloat)strtod( buf, &stop );
+				return stop == buf ? NULL : start + (stop - buf);
+			}
+			if( p < end && (*p == 'e' || *p == 'E') ) {
+				const char * q = p + 1;
+				bool negativeExp = false;
+				if( q < end && (*q == '-' || *q == '+') ) negativeExp = (*q++ == '-');
+				if( q < end && isDigit(*q) ) {
+					int e = 0;
+					for( ; q < end && isDigit(*q); q++ ) {
+						if( e < 10000 ) e = e * 10 + (*q - '0');
+					}
+					exponent += negativeExp ? -e : e;
+					p = q;
+				}
+			}
+
+			double value = (double)mantissa;
+			if( exponent < 0 && exponent >= -22 ) value /= powers[-exponent];
+			else if( exponent > 0 && exponent <= 22 ) value *= powers[exponent];
+			else if( exponent != 0 ) value *= std::pow( 10.0, exponent );
+			out = (GLfloat)(negative ? -value : value);
+			return p;
+		}
+
+		/** @return the end of the integer, or NULL if there is no integer at p */
+		static const char * parseInt( const char * p, const char * end, long long & out ) {
+			p = skipSpace( p, end );
+			bool negative = false;
+			if( p < end && (*p == '-' || *p == '+') ) negative = (*p++ == '-');
+			if( p == end || !isDigit(*p) ) return NULL;
+			long long value = 0;
+			for( ; p < end && isDigit(*p); p++ ) value = value * 10 + (*p - '0');
+			out = negative ? -value : value;
+			return p;
+		}
+
+		/**
+		 * Split text into chunks of about chunkSize bytes, each starting at the beginning of a line.
+		 * Chunk i is [bounds[i], bounds[i + 1]).
+		 */
+		static void splitLines( const char * begin, const char * end, size_t chunkSize, std::vector<const char *> & bounds ) {
+			bounds.clear();
+			bounds.push_back( begin );
+			const char * p = begin;
+			while( (size_t)(end - p) > chunkSize ) {
+				const char * nl = (const char *)memchr( p + chunkSize, '\n', end - (p + chunkSize) );
+				if( nl == NULL || nl + 1 == end ) break;
+				p = nl + 1;
+				bounds.push_back( p );
+			}
+			bounds.push_back( end );
+		}
+	};
+
+	/** The parsed contents of one chunk of an OBJ file */
+	struct ObjChunk {
+		std::vector<GLfloat> positions, normals, colors;
+		/** (position, normal) index pairs, three per triangle.  See encode(). */
+		std::vector<long long> corners;
+		bool hasColors, hasNormalRefs, error;
+
+		ObjChunk() : hasColors(false), hasNormalRefs(false), error(false) { }
+
+		static const long long NONE = LLONG_MIN;
+		static const long long RELATIVE = 1LL << 62;
+
+		/**
+		 * Absolute indices are stored zero-based.  Negative (relative) indices depend on the
+		 * number of vertices in earlier chunks, so they are stored relative to the start of
+		 * this chunk, offset by -RELATIVE, and resolved once all chunks are parsed.
+		 */
+		static long long encode( long long index, size_t count ) {
+			if( index > 0 ) return index - 1;
+			return (long long)count + index - RELATIVE;
+		}
+
+		static long long decode( long long index, size_t base ) {
+			if( index == NONE || index >= 0 ) return index;
+			return index + RELATIVE + (long long)base;
+		}
+
+		void parse( const char * p, const char * end ) {
+			std::vector<long long> poly;
+			while( p < end ) {
+				const char * e = TextScanner::lineEnd( p, end );
+				const char * q = TextScanner::skipSpace( p, e );
+				if( e - q > 1 && q[0] == 'v' && TextScanner::isSpace(q[1]) ) {
+					GLfloat v[6];
+					int k = 0;
+					for( q++; k < 6; k++ ) {
+						const char * r = TextScanner::parseFloat( q, e, v[k] );
+						if( r == NULL ) break;
+						q = r;
+					}
+					if( k < 3 ) { error = true; return; }
+					positions.insert( positions.end(), v, v + 3 );
+					if( k == 6 && !hasColors ) {
+						colors.assign( 4 * (positions.size() / 3 - 1), 1.0f );
+						hasColors = true;
+					}
+					if( hasColors ) {
+						GLfloat c[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+						if( k == 6 ) { c[0] = v[3]; c[1] = v[4]; c[2] = v[5]; }
+						colors.insert( colors.end(), c, c + 4 );
+					}
+				} else if( e - q > 2 && q[0] == 'v' && q[1] == 'n' && TextScanner::isSpace(q[2]) ) {
+					GLfloat v[3];
+					q += 2;
+					for( int k = 0; k < 3; k++ ) {
+						q = TextScanner::parseFloat( q, e, v[k] );
+						if( q == NULL ) { error = true; return; }
+					}
+					normals.insert( normals.end(), v, v + 3 );
+				} else if( e - q > 1 && q[0] == 'f' && TextScanner::isSpace(q[1]) ) {
+					// Each corner is v, v/vt, v//vn or v/vt/vn
+					poly.clear();
+					for( q++; (q = TextScanner::skipSpace( q, e )) < e; ) {
+						long long v, vt, vn = 0;
+						q = TextScanner::parseInt( q, e, v );
+						if( q == NULL || v == 0 ) { error = true; return; }
+						if( q < e && *q == '/' ) {
+							q++;
+							if( q < e && *q != '/' ) {
+								q = TextScanner::parseInt( q, e, vt );
+								if( q == NULL ) { error = true; return; }
+							}
+							if( q < e && *q == '/' ) {
+								q = TextScanner::parseInt( q + 1, e, vn );
+								if( q == NULL || vn == 0 ) { error = true; return; }
+							}
+						}
+						if( q < e && !TextScanner::isSpace(*q) ) { error = true; return; }
+						poly.push_back( encode( v, positions.size() / 3 ) );
+						poly.push_back( vn == 0 ? (long long)NONE : encode( vn, normals.size() / 3 ) );
+						if( vn != 0 ) hasNormalRefs = true;
+					}
+					if( poly.size() < 6 ) { error = true; return; }
+					for( size_t k = 4; k < poly.size(); k += 2 ) {
+						corners.push_back( poly[0] );
+						corners.push_back( poly[1] );
+						corners.push_back( poly[k - 2] );
+						corners.push_back( poly[k - 1] );
+						corners.push_back( poly[k] );
+						corners.push_back( poly[k + 1] );
+					}
+				}
+				// Everything else (comments, texture coordinates, groups, materials) is skipped
+				p = e + 1;
+			}
+		}
+	};
+
+	/** The header of a PLY file, and the location of the data in binary files */
+	struct PlyFile {
+		enum Format { ASCII, BINARY_LITTLE_ENDIAN, BINARY_BIG_ENDIAN };
+		enum Type { INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64 };
+		enum { FACES_PER_SEGMENT = 1 << 16 };
+
+		struct Property {
+			string name;
+			int type, countType;
+			bool isList;
+			/** Where a vertex property is stored: 0-2 position, 3-5 normal, 6-9 color, or -1 */
+			int slot;
+			GLfloat scale;
+			size_t offset;
+		};
+
+		struct Element {
+			string name;
+			size_t count;
+			std::vector<Property> properties;
+			/** The size of each item in binary files, or 0 if the items contain lists */
+			size_t stride;
+		};
+
+		Format format;
+		bool swap;
+		std::vector<Element> elements;
+		const char * body, * end;
+		int vertexElement, faceElement, faceList;
+		bool hasNormals, hasColors;
+
+		// Binary files only: the vertex data, and the faces split into segments of
+		// FACES_PER_SEGMENT faces, with the number of triangles before each segment
+		const char * vertexData;
+		std::vector<const char *> segments;
+		std::vector<size_t> segmentTris;
+
+		size_t numVerts() const { return vertexElement < 0 ? 0 : elements[vertexElement].count; }
+		size_t numTriangles() const { return segmentTris.empty() ? 0 : segmentTris.back(); }
+
+		static int typeSize( int type ) {
+			static const int sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+			return sizes[type];
+		}
+
+		static int typeFromName( const string & name ) {
+			static const char * names[][2] = {
+				{ "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+				{ "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" }
+			};
+			for( int t = 0; t < 8; t++ ) {
+				if( name == names[t][0] || name == names[t][1] ) return t;
+			}
+			return -1;
+		}
+
+		double read( const char * p, int type ) const {
+			unsigned char b[8];
+			int n = typeSize( type );
+			if( swap ) {
+				for( int i = 0; i < n; i++ ) b[i] = (unsigned char)p[n - 1 - i];
+			} else {
+				memcpy( b, p, n );
+			}
+			switch( type ) {
+			case INT8: return (signed char)b[0];
+			case UINT8: return b[0];
+			case INT16: { int16_t v; memcpy( &v, b, 2 ); return v; }
+			case UINT16: { uint16_t v; memcpy( &v, b, 2 ); return v; }
+			case INT32: { int32_t v; memcpy( &v, b, 4 ); return v; }
+			case UINT32: { uint32_t v; memcpy( &v, b, 4 ); return v; }
+			case FLOAT32: { float v; memcpy( &v, b, 4 ); return v; }
+			default: { double v; memcpy( &v, b, 8 ); return v; }
+			}
+		}
+
+		/** Parse the header, and for binary files, find the vertex data and face segments */
+		bool open( const char * data, size_t size, const char * fileName ) {
+			vertexElement = faceElement = faceList = -1;
+			end = data + size;
+			const char * p = data;
+			bool first = true, haveFormat = false;
+			for( ;; ) {
+				if( p >= end ) {
+					cerr << fileName << ": missing end_header" << endl;
+					return false;
+				}
+				const char * e = TextScanner::lineEnd( p, end );
+				std::istringstream line( string( p, e ) );
+				p = e + 1;
+				string keyword;
+				line >> keyword;
+				if( first ) {
+					if( keyword != "ply" ) {
+						cerr << fileName << ": not a PLY file" << endl;
+						return false;
+					}
+					first = false;
+				} else if( keyword == "format" ) {
+					string name;
+					line >> name;
+					if( name == "ascii" ) format = ASCII;
+					else if( name == "binary_little_endian" ) format = BINARY_LITTLE_ENDIAN;
+					else if( name == "binary_big_endian" ) format = BINARY_BIG_ENDIAN;
+					else {
+						cerr << fileName << ": unknown format " << name << endl;
+						return false;
+					}
+					haveFormat = true;
+				} else if( keyword == "element" ) {
+					Element el;
+					line >> el.name >> el.count;
+					if( !line ) {
+						cerr << fileName << ": malformed element" << endl;
+						return false;
+					}
+					el.stride = 0;
+					if( el.name == "vertex" ) vertexElement = (int)elements.size();
+					else if( el.name == "face" ) faceElement = (int)elements.size();
+					elements.push_back( el );
+				} else if( keyword == "property" ) {
+					Property prop;
+					string type;
+					line >> type;
+					prop.isList = (type == "list");
+					prop.countType = -1;
+					if( prop.isList ) {
+						string countType;
+						line >> countType >> type;
+						prop.countType = typeFromName( countType );
+					}
+					line >> prop.name;
+					prop.type = typeFromName( type );
+					if( !line || elements.empty() || prop.type < 0 || (prop.isList && prop.countType < 0) ) {
+						cerr << fileName << ": malformed property" << endl;
+						return false;
+					}
+					prop.slot = -1;
+					prop.scale = 1.0f;
+					prop.offset = 0;
+					elements.back().properties.push_back( prop );
+				} else if( keyword == "end_header" ) {
+					break;
+				}
+				// comment and obj_info lines are skipped
+			}
+			body = p < end ? p : end;
+			if( !haveFormat || vertexElement < 0 ) {
+				cerr << fileName << ": missing format or vertex element" << endl;
+				return false;
+			}
+
+			// Find where the vertex properties are stored
+			static const char * slotNames[] = { "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue", "alpha" };
+			bool found[10] = { false };
+			Element & vertex = elements[vertexElement];
+			for( size_t i = 0; i < vertex.properties.size(); i++ ) {
+				Property & prop = vertex.properties[i];
+				for( int s = 0; s < 10 && !prop.isList; s++ ) {
+					if( prop.name != slotNames[s] ) continue;
+					prop.slot = s;
+					found[s] = true;
+					if( s >= 6 && prop.type != FLOAT32 && prop.type != FLOAT64 )
+						prop.scale = prop.type == UINT16 ? 1.0f / 65535.0f : 1.0f / 255.0f;
+				}
+			}
+			if( !found[0] || !found[1] || !found[2] ) {
+				cerr << fileName << ": the vertices have no x, y and z properties" << endl;
+				return false;
+			}
+			hasNormals = found[3] && found[4] && found[5];
+			hasColors = found[6] && found[7] && found[8];
+			if( faceElement >= 0 ) {
+				const Element & face = elements[faceElement];
+				for( size_t i = 0; i < face.properties.size(); i++ ) {
+					if( face.properties[i].isList && (face.properties[i].name == "vertex_indices" ||
+						face.properties[i].name == "vertex_index") ) faceList = (int)i;
+				}
+				if( faceList < 0 ) {
+					cerr << fileName << ": the faces have no vertex_indices property" << endl;
+					return false;
+				}
+			}
+
+			if( format == ASCII ) return true;
+			unsigned short one = 1;
+			bool littleEndianHost = *(unsigned char *)&one == 1;
+			swap = (format == BINARY_LITTLE_ENDIAN) != littleEndianHost;
+
+			for( size_t e = 0; e < elements.size(); e++ ) {
+				Element & el = elements[e];
+				size_t stride = 0;
+				for( size_t i = 0; i < el.properties.size(); i++ ) {
+					if( el.properties[i].isList ) { stride = 0; break; }
+					el.properties[i].offset = stride;
+					stride += typeSize( el.properties[i].type );
+				}
+				el.stride = stride;
+			}
+			if( elements[vertexElement].stride == 0 ) {
+				cerr << fileName << ": list properties in binary vertices are not supported" << endl;
+				return false;
+			}
+
+			// Items with lists vary in size, so they are walked one at a time
+			p = body;
+			for( size_t e = 0; e < elements.size(); e++ ) {
+				const Element & el = elements[e];
+				if( (int)e == vertexElement ) vertexData = p;
+				if( el.stride != 0 ) {
+					if( (size_t)(end - p) / el.stride < el.count ) { p = end + 1; break; }
+					p += el.count * el.stride;
+					continue;
+				}
+				size_t tris = 0;
+				for( size_t item = 0; item < el.count; item++ ) {
+					if( (int)e == faceElement && item % FACES_PER_SEGMENT == 0 ) {
+						segments.push_back( p );
+						segmentTris.push_back( tris );
+					}
+					for( size_t i = 0; i < el.properties.size(); i++ ) {
+						const Property & prop = el.properties[i];
+						if( !prop.isList ) {
+							p += typeSize( prop.type );
+							continue;
+						}
+						if( end - p < typeSize( prop.countType ) ) { p = end + 1; break; }
+						double count = read( p, prop.countType );
+						p += typeSize( prop.countType );
+						if( count < 0 || count * typeSize( prop.type ) > (double)(end - p) ) { p = end + 1; break; }
+						p += (size_t)count * typeSize( prop.type );
+						if( (int)e == faceElement && (int)i == faceList && count > 2 ) tris += (size_t)count - 2;
+					}
+					if( p > end ) break;
+				}
+				if( (int)e == faceElement ) segmentTris.push_back( tris );
+				if( p > end ) break;
+			}
+			if( p > end ) {
+				cerr << fileName << ": unexpected end of file" << endl;
+				return false;
+			}
+			return true;
+		}
+
+		/** Read binary vertices [first, first + count) into the given arrays (normals and colors may be NULL) */
+		void readVertices( size_t first, size_t count, GLfloat * pos, GLfloat * norm, GLfloat * col ) const {
+			const Element & el = elements[vertexElement];
+			for( size_t v = 0; v < count; v++ ) {
+				const char * item = vertexData + (first + v) * el.stride;
+				if( col ) col[4 * v + 3] = 1.0f;
+				for( size_t i = 0; i < el.properties.size(); i++ ) {
+					const Property & prop = el.properties[i];
+					if( prop.slot < 0 ) continue;
+					GLfloat value = (GLfloat)read( item + prop.offset, prop.type ) * prop.scale;
+					if( prop.slot < 3 ) pos[3 * v + prop.slot] = value;
+					else if( prop.slot < 6 ) { if( norm ) norm[3 * v + prop.slot - 3] = value; }
+					else if( col ) col[4 * v + prop.slot - 6] = value;
+				}
+			}
+		}
+
+		/** Read the triangles of one binary face segment.  @return false if an index is out of range */
+		bool readFaces( size_t segment, GLuint * out ) const {
+			const Element & el = elements[faceElement];
+			const char * p = segments[segment];
+			size_t nFaces = std::min( (size_t)FACES_PER_SEGMENT, el.count - segment * FACES_PER_SEGMENT );
+			const long long nVerts = (long long)numVerts();
+			for( size_t f = 0; f < nFaces; f++ ) {
+				for( size_t i = 0; i < el.properties.size(); i++ ) {
+					const Property & prop = el.properties[i];
+					if( !prop.isList ) {
+						p += typeSize( prop.type );
+						continue;
+					}
+					size_t count = (size_t)read( p, prop.countType );
+					p += typeSize( prop.countType );
+					if( (int)i != faceList ) {
+						p += count * typeSize( prop.type );
+						continue;
+					}
+					// Triangle fan
+					GLuint corner[3];
+					for( size_t k = 0; k < count; k++, p += typeSize( prop.type ) ) {
+						long long index = (long long)read( p, prop.type );
+						if( index < 0 || index >= nVerts ) return false;
+						corner[k < 2 ? k : 2] = (GLuint)index;
+						if( k >= 2 ) {
+							*out++ = corner[0];
+							*out++ = corner[1];
+							*out++ = corner[2];
+							corner[1] = corner[2];
+						}
+					}
+				}
+			}
+			return true;
+		}
+
+		/** Parse a line of an ASCII vertex.  @return false if the line is malformed */
+		bool parseVertex( const char * p, const char * e, GLfloat * pos, GLfloat * norm, GLfloat * col ) const {
+			const Element & el = elements[vertexElement];
+			if( col ) col[3] = 1.0f;
+			for( size_t i = 0; i < el.properties.size(); i++ ) {
+				const Property & prop = el.properties[i];
+				GLfloat value;
+				if( prop.isList ) {
+					long long count;
+					p = TextScanner::parseInt( p, e, count );
+					for( long long k = 0; p != NULL && k < count; k++ ) p = TextScanner::parseFloat( p, e, value );
+					if( p == NULL ) return false;
+					continue;
+				}
+				p = TextScanner::parseFloat( p, e, value );
+				if( p == NULL ) return false;
+				value *= prop.scale;
+				if( prop.slot < 0 ) continue;
+				if( prop.slot < 3 ) pos[prop.slot] = value;
+				else if( prop.slot < 6 ) { if( norm ) norm[prop.slot - 3] = value; }
+				else if( col ) col[prop.slot - 6] = value;
+			}
+			return true;
+		}
+
+		/** Parse a line of an ASCII face, appending its triangles.  @return false if the line is malformed */
+		bool parseFace( const char * p, const char * e, std::vector<GLuint> & out ) const {
+			const Element & el = elements[faceElement];
+			const long long nVerts = (long long)numVerts();
+			for( size_t i = 0; i < el.properties.size(); i++ ) {
+				const Property & prop = el.properties[i];
+				long long count;
+				if( !prop.isList ) {
+					GLfloat value;
+					p = TextScanner::parseFloat( p, e, value );
+					if( p == NULL ) return false;
+					continue;
+				}
+				p = TextScanner::parseInt( p, e, count );
+				if( p == NULL ) return false;
+				GLuint corner[3];
+				for( long long k = 0; k < count; k++ ) {
+					long long index;
+					p = TextScanner::parseInt( p, e, index );
+					if( p == NULL ) return false;
+					if( (int)i != faceList ) continue;
+					if( index < 0 || index >= nVerts ) return false;
+					corner[k < 2 ? k : 2] = (GLuint)index;
+					if( k >= 2 ) {
+						out.push_back( corner[0] );
+						out.push_back( corner[1] );
+						out.push_back( corner[2] );
+						corner[1] = corner[2];
+					}
+				}
+			}
+			return true;
+		}
+	};
+
+	inline bool hasExtension( const char * fileName, const char * ext ) {
+		size_t n = strlen( fileName ), m = strlen( ext );
+		if( n < m ) return false;
+		for( size_t i = 0; i < m; i++ ) {
+			if( tolower( (unsigned char)fileName[n - m + i] ) != ext[i] ) return false;
+		}
+		return true;
+	}
+	/// @publicsection
+
+	inline bool loadOBJ( const char * fileName, MeshData & data, ThreadPool * pool )
+	{
+		if( pool == NULL ) pool = &ThreadPool::shared();
+		MappedFile file;
+		if( !file.open( fileName ) ) {
+			cerr << "Unable to open file: " << fileName << endl;
+			return false;
+		}
+
+		std::vector<const char *> bounds;
+		TextScanner::splitLines( file.data(), file.data() + file.size(), 1 << 20, bounds );
+		const size_t nChunks = bounds.size() - 1;
+		std::vector<ObjChunk> chunks( nChunks );
+		pool->parallelFor( nChunks, [&]( size_t c ) {
+			chunks[c].parse( bounds[c], bounds[c + 1] );
+		} );
+
+		// Offsets of each chunk's vertices, normals and triangle corners
+		std::vector<size_t> vBase( nChunks + 1, 0 ), nBase( nChunks + 1, 0 ), cBase( nChunks + 1, 0 );
+		bool hasColors = false, hasNormalRefs = false;
+		for( size_t c = 0; c < nChunks; c++ ) {
+			if( chunks[c].error ) {
+				cerr << fileName << ": malformed vertex or face" << endl;
+				return false;
+			}
+			vBase[c + 1] = vBase[c] + chunks[c].positions.size() / 3;
+			nBase[c + 1] = nBase[c] + chunks[c].normals.size() / 3;
+			cBase[c + 1] = cBase[c] + chunks[c].corners.size() / 2;
+			hasColors = hasColors || chunks[c].hasColors;
+			hasNormalRefs = hasNormalRefs || chunks[c].hasNormalRefs;
+		}
+		const size_t nPositions = vBase[nChunks], nNormals = nBase[nChunks], nCorners = cBase[nChunks];
+		if( nPositions >= (size_t)UINT_MAX ) {
+			cerr << fileName << ": too many vertices" << endl;
+			return false;
+		}
+
+		// Resolve relative indices and check ranges
+		std::atomic<bool> badIndex( false );
+		pool->parallelFor( nChunks, [&]( size_t c ) {
+			std::vector<long long> & corners = chunks[c].corners;
+			for( size_t k = 0; k < corners.size(); k += 2 ) {
+				long long v = ObjChunk::decode( corners[k], vBase[c] );
+				long long n = ObjChunk::decode( corners[k + 1], nBase[c] );
+				if( v < 0 || v >= (long long)nPositions || (n != ObjChunk::NONE && (n < 0 || n >= (long long)nNormals)) )
+					badIndex = true;
+				corners[k] = v;
+				corners[k + 1] = n;
+			}
+		} );
+		if( badIndex ) {
+			cerr << fileName << ": face index out of range" << endl;
+			return false;
+		}
+
+		data.clear();
+		data.positions.resize( 3 * nPositions );
+		if( hasColors ) data.colors.resize( 4 * nPositions );
+		data.elements.resize( nCorners );
+		pool->parallelFor( nChunks, [&]( size_t c ) {
+			const ObjChunk & chunk = chunks[c];
+			std::copy( chunk.positions.begin(), chunk.positions.end(), data.positions.begin() + 3 * vBase[c] );
+			if( chunk.hasColors )
+				std::copy( chunk.colors.begin(), chunk.colors.end(), data.colors.begin() + 4 * vBase[c] );
+			else if( hasColors )
+				std::fill( data.colors.begin() + 4 * vBase[c], data.colors.begin() + 4 * vBase[c + 1], 1.0f );
+			if( !hasNormalRefs ) {
+				for( size_t k = 0; k < chunk.corners.size(); k += 2 )
+					data.elements[cBase[c] + k / 2] = (GLuint)chunk.corners[k];
+			}
+		} );
+
+		if( !hasNormalRefs ) {
+			computeNormals( data, pool );
+			return true;
+		}
+
+		// Each position keeps the first normal it is used with.  Corners that pair it with a
+		// different normal get a copy of the vertex.
+		std::vector<long long> owner( nPositions, ObjChunk::NONE + 1 );
+		std::vector<long long> extra;
+		std::unordered_map<uint64_t, GLuint> extraIndex;
+		for( size_t c = 0; c < nChunks; c++ ) {
+			const std::vector<long long> & corners = chunks[c].corners;
+			for( size_t k = 0; k < corners.size(); k += 2 ) {
+				long long v = corners[k], n = corners[k + 1];
+				GLuint index = (GLuint)v;
+				if( owner[v] == ObjChunk::NONE + 1 ) {
+					owner[v] = n;
+				} else if( owner[v] != n ) {
+					uint64_t key = (uint64_t)v * (nNormals + 1) + (n == ObjChunk::NONE ? nNormals : (size_t)n);
+					std::pair<std::unordered_map<uint64_t, GLuint>::iterator, bool> slot =
+						extraIndex.insert( std::make_pair( key, (GLuint)(nPositions + extra.size() / 2) ) );
+					if( slot.second ) {
+						extra.push_back( v );
+						extra.push_back( n );
+					}
+					index = slot.first->second;
+				}
+				data.elements[cBase[c] + k / 2] = index;
+			}
+		}
+
+		const size_t nVerts = nPositions + extra.size() / 2;
+		if( nVerts >= (size_t)UINT_MAX ) {
+			cerr << fileName << ": too many vertices" << endl;
+			return false;
+		}
+		data.positions.resize( 3 * nVerts );
+		data.normals.assign( 3 * nVerts, 0.0f );
+		if( hasColors ) data.colors.resize( 4 * nVerts );
+		std::vector<GLfloat> fileNormals( 3 * nNormals );
+		for( size_t c = 0; c < nChunks; c++ )
+			std::copy( chunks[c].normals.begin(), chunks[c].normals.end(), fileNormals.begin() + 3 * nBase[c] );
+		for( size_t i = 0; i < nVerts; i++ ) {
+			size_t v = i < nPositions ? i : (size_t)extra[2 * (i - nPositions)];
+			long long n = i < nPositions ? owner[i] : extra[2 * (i - nPositions) + 1];
+			if( i >= nPositions ) {
+				std::copy( &data.positions[3 * v], &data.positions[3 * v] + 3, &data.positions[3 * i] );
+				if( hasColors ) std::copy( &data.colors[4 * v], &data.colors[4 * v] + 4, &data.colors[4 * i] );
+			}
+			if( n >= 0 ) std::copy( &fileNormals[3 * n], &fileNormals[3 * n] + 3, &data.normals[3 * i] );
+		}
+		return true;
+	}
+
+	inline bool loadPLY( const char * fileName, MeshData & data, ThreadPool * pool )
+	{
+		if( pool == NULL ) pool = &ThreadPool::shared();
+		MappedFile file;
+		if( !file.open( fileName ) ) {
+			cerr << "Unable to open file: " << fileName << endl;
+			return false;
+		}
+		PlyFile ply;
+		if( !ply.open( file.data(), file.size(), fileName ) ) return false;
+
+		const size_t nVerts = ply.numVerts(), nTris = ply.numTriangles();
+		if( nVerts >= (size_t)UINT_MAX || 3 * nTris >= (size_t)UINT_MAX ) {
+			cerr << fileName << ": too many vertices" << endl;
+			return false;
+		}
+		data.clear();
+		data.positions.resize( 3 * nVerts );
+		if( ply.hasNormals ) data.normals.resize( 3 * nVerts );
+		if( ply.hasColors ) data.colors.resize( 4 * nVerts );
+
+		if( ply.format != PlyFile::ASCII ) {
+			const size_t CHUNK = 1 << 14;
+			pool->parallelFor( (nVerts + CHUNK - 1) / CHUNK, [&]( size_t chunk ) {
+				size_t first = chunk * CHUNK;
+				ply.readVertices( first, std::min( CHUNK, nVerts - first ), &data.positions[3 * first],
+					ply.hasNormals ? &data.normals[3 * first] : NULL, ply.hasColors ? &data.colors[4 * first] : NULL );
+			} );
+			data.elements.resize( 3 * nTris );
+			std::atomic<bool> badIndex( false );
+			pool->parallelFor( ply.segments.size(), [&]( size_t s ) {
+				if( !ply.readFaces( s, data.elements.data() + 3 * ply.segmentTris[s] ) ) badIndex = true;
+			} );
+			if( badIndex ) {
+				cerr << fileName << ": face index out of range" << endl;
+				return false;
+			}
+		} else {
+			// Each item is one line.  Count the lines in each chunk to find which
+			// element each line belongs to.
+			std::vector<const char *> bounds;
+			TextScanner::splitLines( ply.body, ply.end, 1 << 20, bounds );
+			const size_t nChunks = bounds.size() - 1;
+			std::vector<size_t> lineBase( nChunks + 1, 0 );
+			pool->parallelFor( nChunks, [&]( size_t c ) {
+				size_t lines = std::count( bounds[c], bounds[c + 1], '\n' );
+				if( bounds[c + 1] > bounds[c] && bounds[c + 1][-1] != '\n' ) lines++;
+				lineBase[c + 1] = lines;
+			} );
+			for( size_t c = 0; c < nChunks; c++ ) lineBase[c + 1] += lineBase[c];
+
+			std::vector<size_t> elementBase( ply.elements.size() + 1, 0 );
+			for( size_t e = 0; e < ply.elements.size(); e++ ) elementBase[e + 1] = elementBase[e] + ply.elements[e].count;
+			if( lineBase[nChunks] < elementBase.back() ) {
+				cerr << fileName << ": unexpected end of file" << endl;
+				return false;
+			}
+
+			std::vector< std::vector<GLuint> > chunkTris( nChunks );
+			std::atomic<bool> malformed( false );
+			pool->parallelFor( nChunks, [&]( size_t c ) {
+				size_t line = lineBase[c], e = 0;
+				for( const char * p = bounds[c]; p < bounds[c + 1] && !malformed; line++ ) {
+					const char * end = TextScanner::lineEnd( p, bounds[c + 1] );
+					while( e < ply.elements.size() && line >= elementBase[e + 1] ) e++;
+					bool ok = true;
+					if( (int)e == ply.vertexElement ) {
+						size_t v = line - elementBase[e];
+						ok = ply.parseVertex( p, end, &data.positions[3 * v], ply.hasNormals ? &data.normals[3 * v] : NULL,
+							ply.hasColors ? &data.colors[4 * v] : NULL );
+					} else if( (int)e == ply.faceElement ) {
+						ok = ply.parseFace( p, end, chunkTris[c] );
+					}
+					if( !ok ) malformed = true;
+					p = end + 1;
+				}
+			} );
+			if( malformed ) {
+				cerr << fileName << ": malformed vertex or face" << endl;
+				return false;
+			}
+
+			std::vector<size_t> triBase( nChunks + 1, 0 );
+			for( size_t c = 0; c < nChunks; c++ ) triBase[c + 1] = triBase[c] + chunkTris[c].size();
+			data.elements.resize( triBase[nChunks] );
+			pool->parallelFor( nChunks, [&]( size_t c ) {
+				std::copy( chunkTris[c].begin(), chunkTris[c].end(), data.elements.begin() + triBase[c] );
+			} );
+		}
+
+		if( !ply.hasNormals ) computeNormals( data, pool );
+		return true;
+	}
+
+	inline bool loadMeshData( const char * fileName, MeshData & data, ThreadPool * pool )
+	{
+		if( hasExtension( fileName, ".obj" ) ) return loadOBJ( fileName, data, pool );
+		if( hasExtension( fileName, ".ply" ) ) return loadPLY( fileName, data, pool );
+		cerr << "Unknown mesh file type: " << fileName << endl;
+		return false;
+	}
+
+	inline TriangleMesh * loadTriangleMesh( const char * fileName, GLenum usage, ThreadPool * pool )
+	{
+		if( pool == NULL ) pool = &ThreadPool::shared();
+		MappedFile file;
+		PlyFile ply;
+		bool stream = hasExtension( fileName, ".ply" ) && file.open( fileName );
+		if( stream ) {
+			if( !ply.open( file.data(), file.size(), fileName ) ) return NULL;
+			stream = ply.format != PlyFile::ASCII;
+		}
+		if( !stream ) {
+			MeshData data;
+			if( !loadMeshData( fileName, data, pool ) ) return NULL;
+			return new TriangleMesh( data, usage );
+		}
+
+		const size_t nVerts = ply.numVerts(), nTris = ply.numTriangles();
+		if( nVerts >= (size_t)UINT_MAX || 3 * nTris >= (size_t)UINT_MAX ) {
+			cerr << fileName << ": too many vertices" << endl;
+			return NULL;
+		}
+		int attributes = ATTRIB_POSITION | ATTRIB_NORMAL | (ply.hasColors ? ATTRIB_COLOR : 0);
+		TriangleMesh * mesh = new TriangleMesh( (GLuint)nVerts, (GLuint)(3 * nTris), attributes, usage );
+
+		// Vertices, in batches.  Without normals in the file, the positions are kept to compute them.
+		const size_t BATCH = 1 << 18, CHUNK = 1 << 14;
+		MeshData batch;
+		batch.resize( (GLuint)std::min( BATCH, nVerts ), 0 );
+		if( ply.hasColors ) batch.colors.resize( 4 * std::min( BATCH, nVerts ) );
+		std::vector<GLfloat> positions, normals;
+		if( !ply.hasNormals ) {
+			positions.resize( 3 * nVerts );
+			normals.assign( 3 * nVerts, 0.0f );
+		}
+		for( size_t first = 0; first < nVerts; first += BATCH ) {
+			size_t count = std::min( BATCH, nVerts - first );
+			GLfloat * pos = ply.hasNormals ? batch.positions.data() : &positions[3 * first];
+			pool->parallelFor( (count + CHUNK - 1) / CHUNK, [&]( size_t chunk ) {
+				size_t begin = chunk * CHUNK;
+				ply.readVertices( first + begin, std::min( CHUNK, count - begin ), pos + 3 * begin,
+					ply.hasNormals ? &batch.normals[3 * begin] : NULL, ply.hasColors ? &batch.colors[4 * begin] : NULL );
+			} );
+			mesh->copyPositionData( pos, (GLuint)first, (GLuint)count );
+			if( ply.hasNormals ) mesh->copyNormalData( batch.normals.data(), (GLuint)first, (GLuint)count );
+			if( ply.hasColors ) mesh->copyColorData( batch.colors.data(), (GLuint)first, (GLuint)count );
+		}
+
+		// Faces, a few segments at a time
+		const size_t nSegments = ply.segments.size(), group = 4 * (size_t)pool->size();
+		std::vector<GLuint> elements;
+		std::atomic<bool> badIndex( false );
+		for( size_t s0 = 0; s0 < nSegments && !badIndex; s0 += group ) {
+			size_t s1 = std::min( nSegments, s0 + group );
+			size_t firstTri = ply.segmentTris[s0], count = ply.segmentTris[s1] - firstTri;
+			elements.resize( 3 * count );
+			pool->parallelFor( s1 - s0, [&]( size_t s ) {
+				if( !ply.readFaces( s0 + s, elements.data() + 3 * (ply.segmentTris[s0 + s] - firstTri) ) ) badIndex = true;
+			} );
+			if( badIndex ) break;
+			mesh->copyElementData( elements.data(), (GLuint)(3 * firstTri), (GLuint)(3 * count) );
+			if( !ply.hasNormals ) accumulateNormals( positions.data(), elements.data(), count, normals.data() );
+		}
+		if( badIndex ) {
+			cerr << fileName << ": face index out of range" << endl;
+			delete mesh;
+			return NULL;
+		}
+		if( nTris == 0 ) mesh->copyElementData( NULL, 0, 0 );
+
+		if( !ply.hasNormals ) {
+			normalizeNormals( normals.data(), nVerts, pool );
+			mesh->copyNormalData( normals.data() );
+		}
+		return mesh;
+	}
+}
@@ -0,0 +1,251 @@
+#ifndef __gltw_matrix_hpp
+#define __gltw_matrix_hpp
+
+#include <cstring>
+#include <vector>
+
+namespace gltw {
+
+	/// @defgroup matrix Functions for 4x4 matrices
+	/// Matrices are arrays of 16 GLfloat values in column-major order, as taken by
+	/// ::setModelViewMatrix and ::setProjectionMatrix.  The functions use SSE where available.
+	/// @{
+
+	/**
+	 * Multiply two 4x4 matrices.
+	 *
+	 * @param a the left matrix
+	 * @param b the right matrix
+	 * @param out (out) receives a * b.  It may be the same array as a or b.
+	 */
+	void multiplyMatrix4( const GLfloat * a, const GLfloat * b, GLfloat * out );
+
+	/**
+	 * Invert a 4x4 matrix.
+	 *
+	 * @param m the matrix
+	 * @param out (out) receives the inverse.  It may be the same array as m.
+	 * @return false if the matrix is singular, in which case out is unchanged.
+	 */
+	bool invertMatrix4( const GLfloat * m, GLfloat * out );
+
+	/**
+	 * Compute the matrix that transforms normals by a model-view matrix: the inverse transpose
+	 * of its upper 3x3.  Unlike the upper 3x3 itself, this keeps normals perpendicular to
+	 * their surfaces under non-uniform scaling.
+	 *
+	 * @param mv the model-view matrix (16 values)
+	 * @param out (out) receives the normal matrix (9 values, column-major).  If mv is singular,
+	 *    this is the upper 3x3 of mv.
+	 */
+	void normalMatrix( const GLfloat * mv, GLfloat * out );
+
+	/**
+	 * Compute a perspective projection matrix, as gluPerspective does.
+	 *
+	 * @param fovy the vertical field of view, in radians
+	 * @param aspect the width of the view divided by its height
+	 * @param zNear the distance to the near clipping plane, greater than zero
+	 * @param zFar the distance to the far clipping plane
+	 * @param out (out) receives the matrix
+	 */
+	void perspectiveMatrix4( GLfloat fovy, GLfloat aspect, GLfloat zNear, GLfloat zFar, GLfloat * out );
+
+	/**
+	 * Compute an orthographic projection matrix, as glOrtho does.
+	 *
+	 * @param left the left edge of the view volume
+	 * @param right the right edge of the view volume
+	 * @param bottom the bottom edge of the view volume
+	 * @param top the top edge of the view volume
+	 * @param zNear the distance to the near clipping plane
+	 * @param zFar the distance to the far clipping plane
+	 * @param out (out) receives the matrix
+	 */
+	void orthoMatrix4( GLfloat left, GLfloat right, GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar, GLfloat * out );
+
+	/**
+	 * Compute a view matrix, as gluLookAt does.
+	 *
+	 * @param eye the position of the camera (x,y,z)
+	 * @param center the point the camera looks at (x,y,z)
+	 * @param up the direction that is up in the view (x,y,z), not parallel to the line of sight
+	 * @param out (out) receives the matrix
+	 */
+	void lookAtMatrix4( const GLfloat * eye, const GLfloat * center, const GLfloat * up, GLfloat * out );
+
+	/**
+	 * Transform an array of points by a matrix, treating each as (x,y,z,1).  The matrix is
+	 * taken to be affine: the w of each result is ignored, without dividing by it.  With
+	 * SSE, four points are transformed at a time.
+	 *
+	 * @param m the matrix
+	 * @param points 3 * count values (x,y,z)
+	 * @param count the number of points
+	 * @param out (out) receives 3 * count values (x,y,z).  It may be the same array as points.
+	 */
+	void transformPoints( const GLfloat * m, const GLfloat * points, size_t count, GLfloat * out );
+	/// @}
+
+	/** A 3 component vector */
+	struct vec3 {
+		GLfloat x, y, z;
+
+		/** Constructs the zero vector */
+		vec3() : x(0.0f), y(0.0f), z(0.0f) { }
+		vec3( GLfloat x, GLfloat y, GLfloat z ) : x(x), y(y), z(z) { }
+		/** Constructs a vector from 3 values */
+		explicit vec3( const GLfloat * v ) : x(v[0]), y(v[1]), z(v[2]) { }
+
+		/** @return the components as an array of 3 values */
+		GLfloat * data() { return &x; }
+		const GLfloat * data() const { return &x; }
+
+		vec3 operator+( const vec3 & v ) const { return vec3( x + v.x, y + v.y, z + v.z ); }
+		vec3 operator-( const vec3 & v ) const { return vec3( x - v.x, y - v.y, z - v.z ); }
+		vec3 operator-() const { return vec3( -x, -y, -z ); }
+		vec3 operator*( GLfloat s ) const { return vec3( x * s, y * s, z * s ); }
+	};
+
+	/** @return the dot product of two vectors */
+	inline GLfloat dot( const vec3 & a, const vec3 & b ) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	/** @return the cross product a x b */
+	inline vec3 cross( const vec3 & a, const vec3 & b ) {
+		return vec3( a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x );
+	}
+	/** @return the length of a vector */
+	inline GLfloat length( const vec3 & v ) { return sqrtf( dot( v, v ) ); }
+	/** @return the vector scaled to unit length, or the zero vector if it has none */
+	inline vec3 normalize( const vec3 & v ) {
+		const GLfloat len = length( v );
+		return len > 0.0f ? v * (1.0f / len) : vec3();
+	}
+
+	/** A 4 component vector, such as a point in homogeneous coordinates */
+	struct vec4 {
+		GLfloat x, y, z, w;
+
+		/** Constructs the zero vector */
+		vec4() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) { }
+		vec4( GLfloat x, GLfloat y, GLfloat z, GLfloat w ) : x(x), y(y), z(z), w(w) { }
+		vec4( const vec3 & v, GLfloat w ) : x(v.x), y(v.y), z(v.z), w(w) { }
+		/** Constructs a vector from 4 values */
+		explicit vec4( const GLfloat * v ) : x(v[0]), y(v[1]), z(v[2]), w(v[3]) { }
+
+		/** @return the components as an array of 4 values */
+		GLfloat * data() { return &x; }
+		const GLfloat * data() const { return &x; }
+		/** @return (x,y,z) */
+		vec3 xyz() const { return vec3( x, y, z ); }
+	};
+
+	/**
+	 * <p>A 4x4 matrix of 16 GLfloat values in column-major order.  It converts to a pointer to
+	 * its values, so it can be passed as is to ::setModelViewMatrix, ::setProjectionMatrix,
+	 * ::setUniformMatrix4 and the other matrix functions, and indexed as an array.  Products
+	 * and inverses use the SSE kernels of ::multiplyMatrix4 and ::invertMatrix4.</p>
+	 *
+	 * <p><code>
+	 *    gltw::mat4 view = gltw::mat4::lookAt( eye, center, gltw::vec3( 0, 1, 0 ) );<br />
+	 *    gltw::mat4 mv = view * gltw::mat4::translation( 1, 0, 0 );<br />
+	 *    gltw::setModelViewMatrix( mv );<br />
+	 * </code></p>
+	 */
+	struct mat4 {
+		GLfloat m[16];
+
+		/** Constructs the identity matrix */
+		mat4();
+		/** Constructs a matrix from 16 values in column-major order */
+		explicit mat4( const GLfloat * values );
+
+		operator GLfloat *() { return m; }
+		operator const GLfloat *() const { return m; }
+
+		/** @return the product this * b */
+		mat4 operator*( const mat4 & b ) const;
+		/** @return the product this * v */
+		vec4 operator*( const vec4 & v ) const;
+		/** Replace this matrix by this * b */
+		mat4 & operator*=( const mat4 & b ) { multiplyMatrix4( m, b.m, m ); return *this; }
+
+		/** @return the point transformed by this matrix, taking w to be 1 and ignoring the resulting w */
+		vec3 transformPoint( const vec3 & p ) const;
+		/** @return the direction transformed by the upper 3x3 of this matrix */
+		vec3 transformVector( const vec3 & v ) const;
+		/**
+		 * @param out (out) receives the inverse of this matrix
+		 * @return false if this matrix is singular, in which case out is unchanged
+		 */
+		bool inverse( mat4 & out ) const { return invertMatrix4( m, out.m ); }
+		/** @return the transpose of this matrix */
+		mat4 transposed() const;
+
+		/** @return a matrix that translates by (x,y,z) */
+		static mat4 translation( GLfloat x, GLfloat y, GLfloat z );
+		/** @return a matrix that scales by (x,y,z) */
+		static mat4 scaling( GLfloat x, GLfloat y, GLfloat z );
+		/** @return a matrix that rotates by an angle in radians, counter-clockwise about an axis */
+		static mat4 rotation( GLfloat angle, const vec3 & axis );
+		/** @return a perspective projection, see ::perspectiveMatrix4 */
+		static mat4 perspective( GLfloat fovy, GLfloat aspect, GLfloat zNear, GLfloat zFar );
+		/** @return an orthographic projection, see ::orthoMatrix4 */
+		static mat4 ortho( GLfloat left, GLfloat right, GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar );
+		/** @return a view matrix, see ::lookAtMatrix4 */
+		static mat4 lookAt( const vec3 & eye, const vec3 & center, const vec3 & up );
+	};
+
+	/**
+	 * <p>A stack of matrices, as the fixed-function pipeline kept for the model-view matrix.
+	 * The top of the stack is a mat4, so it can be passed to the shader functions directly.
+	 * Each transformation multiplies the top on the right, so it applies to what is drawn
+	 * before the transformations above it.</p>
+	 *
+	 * <p><code>
+	 *    gltw::MatrixStack modelView;<br />
+	 *    modelView.load( view );<br />
+	 *    modelView.push();<br />
+	 *    modelView.translate( 0, 1, 0 );<br />
+	 *    modelView.rotate( angle, gltw::vec3( 0, 1, 0 ) );<br />
+	 *    gltw::setModelViewMatrix( modelView.top() );<br />
+	 *    mesh.draw();<br />
+	 *    modelView.pop();<br />
+	 * </code></p>
+	 */
+	class MatrixStack {
+	public:
+		/** Constructs a stack holding the identity matrix */
+		MatrixStack() : stack( 1 ) { }
+
+		/** Push a copy of the top matrix */
+		void push() { stack.push_back( stack.back() ); }
+		/** Pop the top matrix.  The last matrix is never popped. */
+		void pop();
+
+		/** @return the top matrix */
+		mat4 & top() { return stack.back(); }
+		const mat4 & top() const { return stack.back(); }
+		/** @return the number of matrices on the stack, at least one */
+		size_t depth() const { return stack.size(); }
+
+		/** Replace the top matrix by the identity */
+		void loadIdentity() { stack.back() = mat4(); }
+		/** Replace the top matrix by a matrix (16 values, column-major) */
+		void load( const GLfloat * m ) { memcpy( stack.back().m, m, sizeof(stack.back().m) ); }
+		/** Multiply the top matrix on the right by a matrix (16 values, column-major) */
+		void multiply( const GLfloat * m ) { multiplyMatrix4( stack.back().m, m, stack.back().m ); }
+		/** Multiply the top matrix by a translation */
+		void translate( GLfloat x, GLfloat y, GLfloat z );
+		/** Multiply the top matrix by a scaling */
+		void scale( GLfloat x, GLfloat y, GLfloat z );
+		/** Multiply the top matrix by a rotation of an angle in radians about an axis */
+		void rotate( GLfloat angle, const vec3 & axis ) { multiply( mat4::rotation( angle, axis ) ); }
+
+	private:
+		std::vector<mat4> stack;
+	};
+}
+
+#include "gltw_matrix.inl"
+
+#endif
@@ -0,0 +1,327 @@
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GLTW_MATRIX_SSE 1
+#endif
+
+namespace gltw {
+
+#ifdef GLTW_MATRIX_SSE
+	/// @privatesection
+	// Lanes (x, y, z, w) of one vector, and (x, y) of a followed by (z, w) of b
+#define GLTW_SWIZZLE(v, x, y, z, w) _mm_shuffle_ps( (v), (v), _MM_SHUFFLE(w, z, y, x) )
+#define GLTW_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps( (a), (b), _MM_SHUFFLE(w, z, y, x) )
+
+	// 2x2 matrices held as (m00, m01, m10, m11): a * b, adj(a) * b and a * adj(b)
+	inline __m128 mat2Mul( __m128 a, __m128 b ) {
+		return _mm_add_ps( _mm_mul_ps( a, GLTW_SWIZZLE(b, 0, 3, 0, 3) ),
+			_mm_mul_ps( GLTW_SWIZZLE(a, 1, 0, 3, 2), GLTW_SWIZZLE(b, 2, 1, 2, 1) ) );
+	}
+
+	inline __m128 mat2AdjMul( __m128 a, __m128 b ) {
+		return _mm_sub_ps( _mm_mul_ps( GLTW_SWIZZLE(a, 3, 3, 0, 0), b ),
+			_mm_mul_ps( GLTW_SWIZZLE(a, 1, 1, 2, 2), GLTW_SWIZZLE(b, 2, 3, 0, 1) ) );
+	}
+
+	inline __m128 mat2MulAdj( __m128 a, __m128 b ) {
+		return _mm_sub_ps( _mm_mul_ps( a, GLTW_SWIZZLE(b, 3, 0, 3, 0) ),
+			_mm_mul_ps( GLTW_SWIZZLE(a, 1, 0, 3, 2), GLTW_SWIZZLE(b, 2, 1, 2, 1) ) );
+	}
+	/// @publicsection
+#endif
+
+	inline void multiplyMatrix4( const GLfloat * a, const GLfloat * b, GLfloat * out ) {
+#ifdef GLTW_MATRIX_SSE
+		__m128 a0 = _mm_loadu_ps( a ), a1 = _mm_loadu_ps( a + 4 ), a2 = _mm_loadu_ps( a + 8 ), a3 = _mm_loadu_ps( a + 12 );
+		__m128 col[4];
+		// Each column of the result combines the columns of a, weighted by a column of b
+		for( int j = 0; j < 4; j++ ) {
+			col[j] = _mm_add_ps(
+				_mm_add_ps( _mm_mul_ps( a0, _mm_set1_ps( b[4 * j] ) ), _mm_mul_ps( a1, _mm_set1_ps( b[4 * j + 1] ) ) ),
+				_mm_add_ps( _mm_mul_ps( a2, _mm_set1_ps( b[4 * j + 2] ) ), _mm_mul_ps( a3, _mm_set1_ps( b[4 * j + 3] ) ) ) );
+		}
+		for( int j = 0; j < 4; j++ ) _mm_storeu_ps( out + 4 * j, col[j] );
+#else
+		GLfloat r[16];
+		for( int j = 0; j < 4; j++ ) {
+			for( int i = 0; i < 4; i++ ) {
+				r[4 * j + i] = a[i] * b[4 * j] + a[4 + i] * b[4 * j + 1] + a[8 + i] * b[4 * j + 2] + a[12 + i] * b[4 * j + 3];
+			}
+		}
+		memcpy( out, r, sizeof(r) );
+#endif
+	}
+
+	inline bool invertMatrix4( const GLfloat * m, GLfloat * out ) {
+#ifdef GLTW_MATRIX_SSE
+		// Blockwise inversion with 2x2 sub-matrices (after Eric Zhang).  The columns are treated as
+		// rows, which inverts the transpose and so gives the transpose of the inverse: read back as
+		// columns, that is the inverse.
+		__m128 c0 = _mm_loadu_ps( m ), c1 = _mm_loadu_ps( m + 4 ), c2 = _mm_loadu_ps( m + 8 ), c3 = _mm_loadu_ps( m + 12 );
+		__m128 A = _mm_movelh_ps( c0, c1 ), B = _mm_movehl_ps( c1, c0 );
+		__m128 C = _mm_movelh_ps( c2, c3 ), D = _mm_movehl_ps( c3, c2 );
+
+		// The determinants of A, B, C and D
+		__m128 detSub = _mm_sub_ps(
+			_mm_mul_ps( GLTW_SHUFFLE(c0, c2, 0, 2, 0, 2), GLTW_SHUFFLE(c1, c3, 1, 3, 1, 3) ),
+			_mm_mul_ps( GLTW_SHUFFLE(c0, c2, 1, 3, 1, 3), GLTW_SHUFFLE(c1, c3, 0, 2, 0, 2) ) );
+		__m128 detA = GLTW_SWIZZLE(detSub, 0, 0, 0, 0), detB = GLTW_SWIZZLE(detSub, 1, 1, 1, 1);
+		__m128 detC = GLTW_SWIZZLE(detSub, 2, 2, 2, 2), detD = GLTW_SWIZZLE(detSub, 3, 3, 3, 3);
+
+		__m128 DC = mat2AdjMul( D, C ), AB = mat2AdjMul( A, B );
+		__m128 X = _mm_sub_ps( _mm_mul_ps( detD, A ), mat2Mul( B, DC ) );
+		__m128 W = _mm_sub_ps( _mm_mul_ps( detA, D ), mat2Mul( C, AB ) );
+		__m128 Y = _mm_sub_ps( _mm_mul_ps( detB, C ), mat2MulAdj( D, AB ) );
+		__m128 Z = _mm_sub_ps( _mm_mul_ps( detC, B ), mat2MulAdj( A, DC ) );
+
+		// |M| = |A||D| + |B||C| - tr(adj(A) B adj(D) C)
+		__m128 tr = _mm_mul_ps( AB, GLTW_SWIZZLE(DC, 0, 2, 1, 3) );
+		tr = _mm_add_ps( tr, GLTW_SWIZZLE(tr, 2, 3, 0, 1) );
+		tr = _mm_add_ps( tr, GLTW_SWIZZLE(tr, 1, 0, 3, 2) );
+		__m128 det = _mm_sub_ps( _mm_add_ps( _mm_mul_ps( detA, detD ), _mm_mul_ps( detB, detC ) ), tr );
+		if( _mm_cvtss_f32( det ) == 0.0f ) return false;
+
+		__m128 rDet = _mm_div_ps( _mm_setr_ps( 1.0f, -1.0f, -1.0f, 1.0f ), det );
+		X = _mm_mul_ps( X, rDet );
+		Y = _mm_mul_ps( Y, rDet );
+		Z = _mm_mul_ps( Z, rDet );
+		W = _mm_mul_ps( W, rDet );
+		_mm_storeu_ps( out, GLTW_SHUFFLE(X, Y, 3, 1, 3, 1) );
+		_mm_storeu_ps( out + 4, GLTW_SHUFFLE(X, Y, 2, 0, 2, 0) );
+		_mm_storeu_ps( out + 8, GLTW_SHUFFLE(Z, W, 3, 1, 3, 1) );
+		_mm_storeu_ps( out + 12, GLTW_SHUFFLE(Z, W, 2, 0, 2, 0) );
+		return true;
+#else
+		// Cofactor expansion
+		GLfloat inv[16];
+		inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+		inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+		inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+		inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+		inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+		inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+		inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+		inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+		inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+		inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+		inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+		inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+		inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+		inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+		inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+		inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+		GLfloat det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+		if( det == 0.0f ) return false;
+		det = 1.0f / det;
+		for( int i = 0; i < 16; i++ ) out[i] = inv[i] * det;
+		return true;
+#endif
+	}
+
+	inline void normalMatrix( const GLfloat * mv, GLfloat * out ) {
+		GLfloat inv[16];
+		if( invertMatrix4( mv, inv ) ) {
+			// Transpose the upper 3x3 of the inverse
+			for( int c = 0; c < 3; c++ )
+				for( int r = 0; r < 3; r++ ) out[3 * c + r] = inv[4 * r + c];
+		} else {
+			for( int c = 0; c < 3; c++ )
+				for( int r = 0; r < 3; r++ ) out[3 * c + r] = mv[4 * c + r];
+		}
+	}
+
+	inline void perspectiveMatrix4( GLfloat fovy, GLfloat aspect, GLfloat zNear, GLfloat zFar, GLfloat * out ) {
+		const GLfloat f = 1.0f / tanf( 0.5f * fovy );
+		memset( out, 0, 16 * sizeof(GLfloat) );
+		out[0] = f / aspect;
+		out[5] = f;
+		out[10] = (zFar + zNear) / (zNear - zFar);
+		out[11] = -1.0f;
+		out[14] = 2.0f * zFar * zNear / (zNear - zFar);
+	}
+
+	inline void orthoMatrix4( GLfloat left, GLfloat right, GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar, GLfloat * out ) {
+		memset( out, 0, 16 * sizeof(GLfloat) );
+		out[0] = 2.0f / (right - left);
+		out[5] = 2.0f / (top - bottom);
+		out[10] = -2.0f / (zFar - zNear);
+		out[12] = -(right + left) / (right - left);
+		out[13] = -(top + bottom) / (top - bottom);
+		out[14] = -(zFar + zNear) / (zFar - zNear);
+		out[15] = 1.0f;
+	}
+
+	inline void lookAtMatrix4( const GLfloat * eye, const GLfloat * center, const GLfloat * up, GLfloat * out ) {
+		// The rows of the rotation are the camera's side, up and backward directions
+		const vec3 e( eye );
+		const vec3 f = normalize( vec3( center ) - e );
+		const vec3 s = normalize( cross( f, vec3( up ) ) );
+		const vec3 u = cross( s, f );
+		out[0] = s.x; out[4] = s.y; out[8] = s.z;
+		out[1] = u.x; out[5] = u.y; out[9] = u.z;
+		out[2] = -f.x; out[6] = -f.y; out[10] = -f.z;
+		out[3] = out[7] = out[11] = 0.0f;
+		out[12] = -dot( s, e );
+		out[13] = -dot( u, e );
+		out[14] = dot( f, e );
+		out[15] = 1.0f;
+	}
+
+	inline void transformPoints( const GLfloat * m, const GLfloat * points, size_t count, GLfloat * out ) {
+		size_t i = 0;
+#ifdef GLTW_MATRIX_SSE
+		// Four points at a time: the three vectors holding them are rearranged into their xs, ys
+		// and zs, which are transformed with the matrix values broadcast, and rearranged back
+		__m128 mm[12];
+		for( int c = 0; c < 4; c++ ) {
+			for( int r = 0; r < 3; r++ ) mm[3 * c + r] = _mm_set1_ps( m[4 * c + r] );
+		}
+		for( ; i + 4 <= count; i += 4 ) {
+			const __m128 a = _mm_loadu_ps( points + 3 * i ), b = _mm_loadu_ps( points + 3 * i + 4 ), c = _mm_loadu_ps( points + 3 * i + 8 );
+			const __m128 x = GLTW_SHUFFLE( GLTW_SHUFFLE(a, a, 0, 3, 0, 3), GLTW_SHUFFLE(b, c, 2, 2, 1, 1), 0, 1, 0, 2 );
+			const __m128 y = GLTW_SHUFFLE( GLTW_SHUFFLE(a, b, 1, 1, 0, 0), GLTW_SHUFFLE(b, c, 3, 3, 2, 2), 0, 2, 0, 2 );
+			const __m128 z = GLTW_SHUFFLE( GLTW_SHUFFLE(a, b, 2, 2, 1, 1), GLTW_SHUFFLE(c, c, 0, 3, 0, 3), 0, 2, 0, 1 );
+			__m128 o[3];
+			for( int r = 0; r < 3; r++ ) {
+				o[r] = _mm_add_ps( _mm_add_ps( _mm_mul_ps( mm[r], x ), _mm_mul_ps( mm[3 + r], y ) ),
+					_mm_add_ps( _mm_mul_ps( mm[6 + r], z ), mm[9 + r] ) );
+			}
+			_mm_storeu_ps( out + 3 * i, GLTW_SHUFFLE( GLTW_SHUFFLE(o[0], o[1], 0, 0, 0, 0), GLTW_SHUFFLE(o[2], o[0], 0, 0, 1, 1), 0, 2, 0, 2 ) );
+			_mm_storeu_ps( out + 3 * i + 4, GLTW_SHUFFLE( GLTW_SHUFFLE(o[1], o[2], 1, 1, 1, 1), GLTW_SHUFFLE(o[0], o[1], 2, 2, 2, 2), 0, 2, 0, 2 ) );
+			_mm_storeu_ps( out + 3 * i + 8, GLTW_SHUFFLE( GLTW_SHUFFLE(o[2], o[0], 2, 2, 3, 3), GLTW_SHUFFLE(o[1], o[2], 3, 3, 3, 3), 0, 2, 0, 2 ) );
+		}
+#endif
+		for( const GLfloat * p = points + 3 * i, * end = points + 3 * count; p < end; p += 3 ) {
+			const GLfloat x = p[0], y = p[1], z = p[2];
+			GLfloat * o = out + (p - points);
+			for( int r = 0; r < 3; r++ ) o[r] = m[r] * x + m[4 + r] * y + m[8 + r] * z + m[12 + r];
+		}
+	}
+
+	inline mat4::mat4() {
+		memset( m, 0, sizeof(m) );
+		m[0] = m[5] = m[10] = m[15] = 1.0f;
+	}
+
+	inline mat4::mat4( const GLfloat * values ) {
+		memcpy( m, values, sizeof(m) );
+	}
+
+	inline mat4 mat4::operator*( const mat4 & b ) const {
+		mat4 r( *this );
+		multiplyMatrix4( m, b.m, r.m );
+		return r;
+	}
+
+	inline vec4 mat4::operator*( const vec4 & v ) const {
+		vec4 r;
+#ifdef GLTW_MATRIX_SSE
+		const __m128 x = _mm_add_ps(
+			_mm_add_ps( _mm_mul_ps( _mm_loadu_ps( m ), _mm_set1_ps( v.x ) ), _mm_mul_ps( _mm_loadu_ps( m + 4 ), _mm_set1_ps( v.y ) ) ),
+			_mm_add_ps( _mm_mul_ps( _mm_loadu_ps( m + 8 ), _mm_set1_ps( v.z ) ), _mm_mul_ps( _mm_loadu_ps( m + 12 ), _mm_set1_ps( v.w ) ) ) );
+		_mm_storeu_ps( r.data(), x );
+#else
+		for( int i = 0; i < 4; i++ ) r.data()[i] = m[i] * v.x + m[4 + i] * v.y + m[8 + i] * v.z + m[12 + i] * v.w;
+#endif
+		return r;
+	}
+
+	inline vec3 mat4::transformPoint( const vec3 & p ) const {
+		return vec3( m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+			m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+			m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14] );
+	}
+
+	inline vec3 mat4::transformVector( const vec3 & v ) const {
+		return vec3( m[0] * v.x + m[4] * v.y + m[8] * v.z,
+			m[1] * v.x + m[5] * v.y + m[9] * v.z,
+			m[2] * v.x + m[6] * v.y + m[10] * v.z );
+	}
+
+	inline mat4 mat4::transposed() const {
+		mat4 r;
+		for( int c = 0; c < 4; c++ )
+			for( int i = 0; i < 4; i++ ) r.m[4 * c + i] = m[4 * i + c];
+		return r;
+	}
+
+	inline mat4 mat4::translation( GLfloat x, GLfloat y, GLfloat z ) {
+		mat4 r;
+		r.m[12] = x;
+		r.m[13] = y;
+		r.m[14] = z;
+		return r;
+	}
+
+	inline mat4 mat4::scaling( GLfloat x, GLfloat y, GLfloat z ) {
+		mat4 r;
+		r.m[0] = x;
+		r.m[5] = y;
+		r.m[10] = z;
+		return r;
+	}
+
+	inline mat4 mat4::rotation( GLfloat angle, const vec3 & axis ) {
+		// Rodrigues' formula, as glRotate uses
+		const vec3 a = normalize( axis );
+		const GLfloat c = cosf( angle ), s = sinf( angle ), t = 1.0f - c;
+		mat4 r;
+		r.m[0] = t * a.x * a.x + c;
+		r.m[1] = t * a.x * a.y + s * a.z;
+		r.m[2] = t * a.x * a.z - s * a.y;
+		r.m[4] = t * a.x * a.y - s * a.z;
+		r.m[5] = t * a.y * a.y + c;
+		r.m[6] = t * a.y * a.z + s * a.x;
+		r.m[8] = t * a.x * a.z + s * a.y;
+		r.m[9] = t * a.y * a.z - s * a.x;
+		r.m[10] = t * a.z * a.z + c;
+		return r;
+	}
+
+	inline mat4 mat4::perspective( GLfloat fovy, GLfloat aspect, GLfloat zNear, GLfloat zFar ) {
+		mat4 r;
+		perspectiveMatrix4( fovy, aspect, zNear, zFar, r.m );
+		return r;
+	}
+
+	inline mat4 mat4::ortho( GLfloat left, GLfloat right, GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar ) {
+		mat4 r;
+		orthoMatrix4( left, right, bottom, top, zNear, zFar, r.m );
+		return r;
+	}
+
+	inline mat4 mat4::lookAt( const vec3 & eye, const vec3 & center, const vec3 & up ) {
+		mat4 r;
+		lookAtMatrix4( eye.data(), center.data(), up.data(), r.m );
+		return r;
+	}
+
+	inline void MatrixStack::pop() {
+		if( stack.size() == 1 ) {
+			cerr << "Error in MatrixStack.pop: stack underflow." << endl;
+			return;
+		}
+		stack.pop_back();
+	}
+
+	inline void MatrixStack::translate( GLfloat x, GLfloat y, GLfloat z ) {
+		// Only the last column changes
+		GLfloat * m = stack.back().m;
+		for( int i = 0; i < 4; i++ ) m[12 + i] += m[i] * x + m[4 + i] * y + m[8 + i] * z;
+	}
+
+	inline void MatrixStack::scale( GLfloat x, GLfloat y, GLfloat z ) {
+		GLfloat * m = stack.back().m;
+		for( int i = 0; i < 4; i++ ) {
+			m[i] *= x;
+			m[4 + i] *= y;
+			m[8 + i] *= z;
+		}
+	}
+
+#ifdef GLTW_MATRIX_SSE
+#undef GLTW_SWIZZLE
+#undef GLTW_SHUFFLE
+#endif
+}
@@ -0,0 +1,186 @@
+#ifndef __gltw_memory_hpp
+#define __gltw_memory_hpp
+
+#include <mutex>
+#include <vector>
+
+namespace gltw {
+
+	/// @defgroup memory GPU memory
+	/// <p>GLTW counts the bytes of the buffer objects it allocates, by category, and can keep
+	/// them within a budget.  Meshes marked as evictable (see VertexBatch::setEviction) are
+	/// evicted when the budget is exceeded, least recently drawn first: their buffers are read
+	/// back to CPU memory or to a temporary file, and deleted.  An evicted mesh is restored
+	/// when it is next drawn, prepared or updated, so the application need not know that it
+	/// was evicted.</p>
+	///
+	/// <p>The budget is enforced when a mesh is drawn for the first time or after being
+	/// restored, and by ::enforceMemoryBudget.  Both happen on the rendering thread, since
+	/// eviction deletes vertex array objects.  Obtaining a DrawCommand restores a mesh but
+	/// never evicts one, so the commands collected for a frame stay valid until the next
+	/// draw() or ::enforceMemoryBudget.  Buffers created on other
+	/// threads, such as by a MeshUploader, are counted as they are created.</p>
+	///
+	/// <p><code>
+	///    gltw::setMemoryBudget( 256 << 20 );<br />
+	///    for( ... ) meshes[i]->setEviction( gltw::EVICT_TO_MEMORY );<br />
+	///    <br />
+	///    // Within the draw function<br />
+	///    for( ... ) meshes[i]->draw();<br />
+	///    cout << gltw::memoryStats().used << " bytes in use" << endl;<br />
+	/// </code></p>
+	/// @{
+
+	/** The kinds of GPU memory counted */
+	enum MemoryCategory {
+		/** Vertex attribute buffers of a VertexBatch or TriangleMesh */
+		MEMORY_VERTICES,
+		/** Element index buffers of a TriangleMesh */
+		MEMORY_ELEMENTS,
+		/** The buffers of a ParticleSystem */
+		MEMORY_PARTICLES,
+		/** Textures, render targets, and the pixel buffers used to upload and read them back */
+		MEMORY_TEXTURES,
+		NUM_MEMORY_CATEGORIES
+	};
+
+	/** Where the data of an evicted mesh is kept until it is restored */
+	enum EvictionBacking {
+		/** The mesh is never evicted */
+		EVICT_NEVER,
+		/** The buffers are read back to CPU memory */
+		EVICT_TO_MEMORY,
+		/** The buffers are read back to an unnamed temporary file, which is deleted when the mesh is restored */
+		EVICT_TO_DISK
+	};
+
+	/** A snapshot of the GPU memory counts, see ::memoryStats */
+	struct MemoryStats {
+		/** The bytes allocated in all categories */
+		size_t used;
+		/** The budget, or zero if there is none */
+		size_t budget;
+		/** The bytes allocated in each ::MemoryCategory */
+		size_t bytes[NUM_MEMORY_CATEGORIES];
+		/** The number of objects that may be evicted */
+		size_t evictable;
+		/** The number of those objects that are currently evicted */
+		size_t evicted;
+		/** The bytes held by the evicted objects, which are not counted in used */
+		size_t evictedBytes;
+		/** The number of evictions since the program started */
+		unsigned long long evictions;
+		/** The number of restores since the program started */
+		unsigned long long restores;
+	};
+
+	/**
+	 * Set the budget for GPU memory.  It takes effect when a mesh is next drawn for the
+	 * first time or after being restored, or ::enforceMemoryBudget is called.
+	 *
+	 * @param bytes the budget, or zero for no budget (the default)
+	 */
+	void setMemoryBudget( size_t bytes );
+
+	/** @return the budget for GPU memory, or zero if there is none */
+	size_t memoryBudget();
+
+	/** @return the bytes of GPU memory allocated, in all categories */
+	size_t memoryUsed();
+
+	/** @return the current counts of GPU memory */
+	MemoryStats memoryStats();
+
+	/**
+	 * Evict the least recently drawn evictable objects until the memory used is within the
+	 * budget, or no more can be evicted.  Call this on the rendering thread.
+	 *
+	 * @return the number of bytes freed
+	 */
+	size_t enforceMemoryBudget();
+
+	/**
+	 * Count GPU memory allocated or freed outside of GLTW's own classes, so that it is
+	 * included in the budget.  This may be called on any thread.
+	 *
+	 * @param category the category to count it in
+	 * @param bytes the bytes allocated, or negative for bytes freed
+	 */
+	void trackMemory( MemoryCategory category, long long bytes );
+
+	/**
+	 * An object holding GPU memory that can be evicted when the budget is exceeded.  The
+	 * derived class reports its size, evicts itself, records its use with touch(), and
+	 * restores itself when next used.
+	 */
+	class EvictableResource {
+	public:
+		/** Removes this object from the registry, if it is registered */
+		virtual ~EvictableResource();
+
+		/**
+		 * Free the GPU memory of this object, keeping what is needed to restore it.
+		 *
+		 * @return false if nothing was freed
+		 */
+		virtual bool evict() = 0;
+
+		/** @return the bytes of GPU memory currently held by this object */
+		virtual size_t gpuBytes() const = 0;
+
+		/** @return the bytes of GPU memory this object holds while evicted, zero otherwise */
+		virtual size_t evictedBytes() const = 0;
+
+		/** @return the use count of the last time this object was drawn */
+		unsigned long long lastUsed() const { return lastUse; }
+
+	protected:
+		EvictableResource();
+
+		/** Add this object to, or remove it from, the objects that may be evicted */
+		void registerEvictable( bool evictable );
+		/** Take over the registration and last use of another object, which is left unregistered */
+		void moveEvictable( EvictableResource & other );
+		/** @return whether this object may be evicted */
+		bool registeredEvictable() const { return registryIndex != NOT_REGISTERED; }
+		/** Record a use of this object.  Only the rendering thread may call this. */
+		void touch() { lastUse = ++useClock(); }
+		/**
+		 * Enforce the budget, as ::enforceMemoryBudget, without evicting this object.
+		 * Called as the object is drawn after being prepared.
+		 */
+		size_t enforceBudgetKeeping();
+
+	private:
+		friend size_t enforceMemoryBudget();
+		static const size_t NOT_REGISTERED = ~(size_t)0;
+		static unsigned long long & useClock();
+		static size_t enforce( const EvictableResource * keep );
+
+		size_t registryIndex;
+		unsigned long long lastUse;
+	};
+	/// @}
+
+	/// @privatesection
+	struct MemoryState {
+		std::mutex mutex;
+		// Guarded by mutex
+		size_t bytes[NUM_MEMORY_CATEGORIES];
+		size_t budget;
+		std::vector<EvictableResource *> evictable;
+		unsigned long long evictions, restores;
+		bool warned;
+
+		MemoryState();
+		static MemoryState & state();
+	};
+
+	/** Count an eviction or a restore, for memoryStats */
+	void countEviction( bool restore );
+	/// @publicsection
+}
+
+#include "gltw_memory.inl"
+
+#endif
@@ -0,0 +1,153 @@
+namespace gltw {
+
+	inline MemoryState::MemoryState() : budget(0), evictions(0), restores(0), warned(false) {
+		for( int i = 0; i < NUM_MEMORY_CATEGORIES; i++ ) bytes[i] = 0;
+	}
+
+	inline MemoryState & MemoryState::state() {
+		static MemoryState state;
+		return state;
+	}
+
+	inline void setMemoryBudget( size_t bytes ) {
+		MemoryState & state = MemoryState::state();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		state.budget = bytes;
+		state.warned = false;
+	}
+
+	inline size_t memoryBudget() {
+		MemoryState & state = MemoryState::state();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		return state.budget;
+	}
+
+	inline size_t memoryUsed() {
+		MemoryState & state = MemoryState::state();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		size_t used = 0;
+		for( int i = 0; i < NUM_MEMORY_CATEGORIES; i++ ) used += state.bytes[i];
+		return used;
+	}
+
+	inline MemoryStats memoryStats() {
+		MemoryState & state = MemoryState::state();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		MemoryStats stats;
+		stats.used = 0;
+		for( int i = 0; i < NUM_MEMORY_CATEGORIES; i++ ) {
+			stats.bytes[i] = state.bytes[i];
+			stats.used += state.bytes[i];
+		}
+		stats.budget = state.budget;
+		stats.evictable = state.evictable.size();
+		stats.evicted = stats.evictedBytes = 0;
+		for( size_t i = 0; i < state.evictable.size(); i++ ) {
+			size_t held = state.evictable[i]->evictedBytes();
+			if( held > 0 ) {
+				stats.evicted++;
+				stats.evictedBytes += held;
+			}
+		}
+		stats.evictions = state.evictions;
+		stats.restores = state.restores;
+		return stats;
+	}
+
+	inline void trackMemory( MemoryCategory category, long long bytes ) {
+		MemoryState & state = MemoryState::state();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		state.bytes[category] += (size_t)bytes;
+	}
+
+	inline void countEviction( bool restore ) {
+		MemoryState & state = MemoryState::state();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		if( restore ) state.restores++;
+		else state.evictions++;
+	}
+
+	inline size_t enforceMemoryBudget() {
+		return EvictableResource::enforce( NULL );
+	}
+
+	inline EvictableResource::EvictableResource() : registryIndex(NOT_REGISTERED), lastUse(0) { }
+
+	inline EvictableResource::~EvictableResource() {
+		registerEvictable( false );
+	}
+
+	inline unsigned long long & EvictableResource::useClock() {
+		static unsigned long long clock = 0;
+		return clock;
+	}
+
+	inline void EvictableResource::registerEvictable( bool evictable ) {
+		if( evictable == registeredEvictable() ) return;
+		MemoryState & state = MemoryState::state();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		if( evictable ) {
+			registryIndex = state.evictable.size();
+			state.evictable.push_back( this );
+		} else {
+			// Move the last entry into this one's place
+			EvictableResource * last = state.evictable.back();
+			state.evictable[registryIndex] = last;
+			last->registryIndex = registryIndex;
+			state.evictable.pop_back();
+			registryIndex = NOT_REGISTERED;
+		}
+	}
+
+	inline void EvictableResource::moveEvictable( EvictableResource & other ) {
+		registerEvictable( false );
+		lastUse = other.lastUse;
+		if( !other.registeredEvictable() ) return;
+		MemoryState & state = MemoryState::state();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		registryIndex = other.registryIndex;
+		state.evictable[registryIndex] = this;
+		other.registryIndex = NOT_REGISTERED;
+	}
+
+	inline size_t EvictableResource::enforceBudgetKeeping() {
+		return enforce( this );
+	}
+
+	inline size_t EvictableResource::enforce( const EvictableResource * keep ) {
+		MemoryState & state = MemoryState::state();
+		size_t freed = 0;
+		for( ;; ) {
+			EvictableResource * victim = NULL;
+			{
+				std::lock_guard<std::mutex> lock( state.mutex );
+				size_t used = 0;
+				for( int i = 0; i < NUM_MEMORY_CATEGORIES; i++ ) used += state.bytes[i];
+				if( state.budget == 0 || used <= state.budget ) {
+					state.warned = false;
+					break;
+				}
+				// The least recently used object that holds memory.  A linear search is
+				// enough, as eviction is rare compared to drawing.
+				for( size_t i = 0; i < state.evictable.size(); i++ ) {
+					EvictableResource * r = state.evictable[i];
+					if( r == keep || r->gpuBytes() == 0 ) continue;
+					if( victim == NULL || r->lastUse < victim->lastUse ) victim = r;
+				}
+				if( victim == NULL ) {
+					if( !state.warned ) {
+						cerr << "Warning: GPU memory use (" << used << " bytes) exceeds the budget of "
+							<< state.budget << " bytes, and nothing more can be evicted." << endl;
+						state.warned = true;
+					}
+					break;
+				}
+			}
+			// Evicting counts the freed memory, which takes the lock
+			size_t bytes = victim->gpuBytes();
+			if( !victim->evict() ) break;
+			freed += bytes;
+		}
+		return freed;
+	}
+}
@@ -0,0 +1,73 @@
+#ifndef __gltw_mesh_hpp
+#define __gltw_mesh_hpp
+
+namespace gltw {
+
+	/** The outcome of ::weldMeshData */
+	struct WeldResult {
+		/** The number of vertices before welding */
+		GLuint vertsBefore;
+		/** The number of vertices after welding */
+		GLuint vertsAfter;
+		/** The number of triangles removed because welding collapsed two or more of their corners */
+		GLuint degenerateTriangles;
+
+		/** @return the fraction of the vertices that were removed, in [0, 1) */
+		float reduction() const {
+			return vertsBefore == 0 ? 0.0f : 1.0f - (float)vertsAfter / (float)vertsBefore;
+		}
+	};
+
+	/**
+	 * <p>Merge duplicate vertices in mesh data and remap the elements to match.  Every
+	 * attribute present in the data is compared: two vertices are merged when each of
+	 * their components round to the same multiple of the relevant epsilon.  A vertex is
+	 * replaced by the first (lowest index) vertex it matches, and the surviving vertices
+	 * keep their relative order, so the result does not depend on the number of threads.</p>
+	 *
+	 * <p>Rounding to a grid means that two vertices closer than epsilon may still be kept
+	 * apart if they fall on either side of a grid boundary.  An epsilon of zero merges only
+	 * exact duplicates.</p>
+	 *
+	 * <p>If the data has no elements, each three consecutive vertices are taken as a triangle
+	 * and elements are created.  Triangles that collapse are removed.</p>
+	 *
+	 * <p>If the attribute arrays hold different numbers of vertices, or an element refers
+	 * to a vertex that does not exist, an error message is displayed and the data is left
+	 * unchanged.</p>
+	 *
+	 * <p><code>
+	 *    gltw::MeshData data;<br />
+	 *    gltw::buildCube( data );<br />
+	 *    gltw::WeldResult result = gltw::weldMeshData( data );<br />
+	 *    cout << "Removed " << result.reduction() * 100 << "% of the vertices" << endl;<br />
+	 * </code></p>
+	 *
+	 * @param data the mesh data to weld, modified in place
+	 * @param positionEpsilon the grid spacing for positions
+	 * @param attributeEpsilon the grid spacing for normals, colors and texture coordinates
+	 * @param pool the threads to use, defaults to ThreadPool::shared()
+	 * @return the number of vertices before and after welding
+	 */
+	WeldResult weldMeshData( MeshData & data, GLfloat positionEpsilon = 1e-6f,
+		GLfloat attributeEpsilon = 1e-4f, ThreadPool * pool = NULL );
+
+	/**
+	 * Replace the normals of mesh data with smooth vertex normals, each the area-weighted
+	 * average of the normals of the triangles that share the vertex.  Vertices that belong
+	 * to no triangle get the normal (0, 0, 1).
+	 *
+	 * @param data the mesh data, which must have elements
+	 * @param pool the threads to use, defaults to ThreadPool::shared()
+	 */
+	void computeNormals( MeshData & data, ThreadPool * pool = NULL );
+
+	/// @privatesection
+	void accumulateNormals( const GLfloat * positions, const GLuint * triangles, size_t numTriangles, GLfloat * normals );
+	void normalizeNormals( GLfloat * normals, size_t numVerts, ThreadPool * pool );
+	/// @publicsection
+}
+
+#include "gltw_mesh.inl"
+
+#endif
@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace gltw {
+
+	/// @privatesection
+	/** The attributes of a MeshData, rounded to a grid for comparison */
+	struct WeldKeys {
+		const GLfloat * arrays[4];
+		int sizes[4];
+		double scales[4];
+		int numArrays;
+
+		static long long quantize( GLfloat v, double scale ) {
+			if( scale == 0.0 ) {
+				// Exact comparison.  Treat -0 as 0.
+				if( v == 0.0f ) return 0;
+				int32_t bits;
+				memcpy( &bits, &v, sizeof(bits) );
+				return bits;
+			}
+			return (long long)std::floor( v * scale + 0.5 );
+		}
+
+		uint64_t hash( size_t i ) const {
+			uint64_t h = 14695981039346656037ULL;
+			for( int a = 0; a < numArrays; a++ ) {
+				const GLfloat * v = arrays[a] + i * sizes[a];
+				for( int c = 0; c < sizes[a]; c++ ) {
+					h ^= (uint64_t)quantize( v[c], scales[a] );
+					h *= 1099511628211ULL;
+					h ^= h >> 29;
+				}
+			}
+			return h;
+		}
+
+		bool equal( size_t i, size_t j ) const {
+			for( int a = 0; a < numArrays; a++ ) {
+				const GLfloat * u = arrays[a] + i * sizes[a], * v = arrays[a] + j * sizes[a];
+				for( int c = 0; c < sizes[a]; c++ ) {
+					if( quantize( u[c], scales[a] ) != quantize( v[c], scales[a] ) ) return false;
+				}
+			}
+			return true;
+		}
+	};
+	/// @publicsection
+
+	inline WeldResult weldMeshData( MeshData & data, GLfloat positionEpsilon, GLfloat attributeEpsilon, ThreadPool * pool )
+	{
+		const size_t n = data.numVerts();
+		WeldResult result = { (GLuint)n, (GLuint)n, 0 };
+		if( (!data.normals.empty() && data.normals.size() != 3 * n) ||
+			(!data.colors.empty() && data.colors.size() != 4 * n) ||
+			(!data.texCoords.empty() && data.texCoords.size() != 2 * n) ) {
+			cerr << "weldMeshData:  the attribute arrays have different numbers of vertices." << endl;
+			return result;
+		}
+		for( size_t e = 0; e < data.elements.size(); e++ ) {
+			if( data.elements[e] >= n ) {
+				cerr << "weldMeshData:  element " << e << " refers to vertex " << data.elements[e]
+					<< ", but there are only " << n << " vertices." << endl;
+				return result;
+			}
+		}
+		if( n == 0 ) return result;
+		if( pool == NULL ) pool = &ThreadPool::shared();
+
+		WeldKeys keys;
+		keys.numArrays = 0;
+		const std::vector<GLfloat> * attribs[4] = { &data.positions, &data.normals, &data.colors, &data.texCoords };
+		const int sizes[4] = { 3, 3, 4, 2 };
+		const GLfloat eps[4] = { positionEpsilon, attributeEpsilon, attributeEpsilon, attributeEpsilon };
+		for( int a = 0; a < 4; a++ ) {
+			if( attribs[a]->empty() ) continue;
+			keys.arrays[keys.numArrays] = attribs[a]->data();
+			keys.sizes[keys.numArrays] = sizes[a];
+			keys.scales[keys.numArrays] = eps[a] > 0.0f ? 1.0 / eps[a] : 0.0;
+			keys.numArrays++;
+		}
+
+		// The vertices are hashed in chunks, then sorted by hash into shards so that each
+		// shard can be searched for duplicates independently.  Within a shard, vertices
+		// are visited in index order, so the first of each set of duplicates survives.
+		const size_t CHUNK = 1 << 16;
+		const size_t nChunks = (n + CHUNK - 1) / CHUNK;
+		const size_t nShards = 4 * (size_t)pool->size();
+		std::vector<uint64_t> hashes( n );
+		std::vector<size_t> counts( nChunks * nShards, 0 );
+		pool->parallelFor( nChunks, [&]( size_t chunk ) {
+			size_t * count = &counts[chunk * nShards];
+			for( size_t i = chunk * CHUNK; i < std::min( n, (chunk + 1) * CHUNK ); i++ ) {
+				hashes[i] = keys.hash( i );
+				count[(hashes[i] >> 32) % nShards]++;
+			}
+		} );
+
+		// counts becomes the start of each chunk's run of vertices within each shard
+		std::vector<size_t> shardStart( nShards + 1 );
+		size_t total = 0;
+		for( size_t s = 0; s < nShards; s++ ) {
+			shardStart[s] = total;
+			for( size_t chunk = 0; chunk < nChunks; chunk++ ) {
+				size_t count = counts[chunk * nShards + s];
+				counts[chunk * nShards + s] = total;
+				total += count;
+			}
+		}
+		shardStart[nShards] = total;
+
+		std::vector<GLuint> order( n );
+		pool->parallelFor( nChunks, [&]( size_t chunk ) {
+			size_t * offset = &counts[chunk * nShards];
+			for( size_t i = chunk * CHUNK; i < std::min( n, (chunk + 1) * CHUNK ); i++ ) {
+				order[offset[(hashes[i] >> 32) % nShards]++] = (GLuint)i;
+			}
+		} );
+
+		// remap[i] is the first vertex equal to vertex i.  Each shard has an open-addressed
+		// table of the surviving vertices by hash, with collisions chained together.
+		const GLuint NONE = (GLuint)-1;
+		std::vector<GLuint> remap( n ), chain( n );
+		pool->parallelFor( nShards, [&]( size_t s ) {
+			size_t mask = 15;
+			while( mask < 2 * (shardStart[s + 1] - shardStart[s]) ) mask = 2 * mask + 1;
+			std::vector<GLuint> table( mask + 1, NONE );
+			for( size_t k = shardStart[s]; k < shardStart[s + 1]; k++ ) {
+				GLuint i = order[k];
+				size_t slot = hashes[i] & mask;
+				while( table[slot] != NONE && hashes[table[slot]] != hashes[i] ) slot = (slot + 1) & mask;
+				GLuint j = table[slot];
+				while( j != NONE && !keys.equal( i, j ) ) j = chain[j];
+				if( j != NONE ) {
+					remap[i] = j;
+				} else {
+					remap[i] = i;
+					chain[i] = table[slot];
+					table[slot] = i;
+				}
+			}
+		} );
+
+		// Number the surviving vertices in order
+		std::vector<size_t> chunkBase( nChunks + 1, 0 );
+		pool->parallelFor( nChunks, [&]( size_t chunk ) {
+			size_t count = 0;
+			for( size_t i = chunk * CHUNK; i < std::min( n, (chunk + 1) * CHUNK ); i++ ) {
+				if( remap[i] == i ) count++;
+			}
+			chunkBase[chunk + 1] = count;
+		} );
+		for( size_t chunk = 0; chunk < nChunks; chunk++ ) chunkBase[chunk + 1] += chunkBase[chunk];
+		const size_t nUnique = chunkBase[nChunks];
+
+		std::vector<GLuint> & index = order;
+		pool->parallelFor( nChunks, [&]( size_t chunk ) {
+			GLuint next = (GLuint)chunkBase[chunk];
+			for( size_t i = chunk * CHUNK; i < std::min( n, (chunk + 1) * CHUNK ); i++ ) {
+				if( remap[i] == i ) index[i] = next++;
+			}
+		} );
+
+		// Copy the surviving vertices
+		MeshData out;
+		out.positions.resize( 3 * nUnique );
+		if( !data.normals.empty() ) out.normals.resize( 3 * nUnique );
+		if( !data.colors.empty() ) out.colors.resize( 4 * nUnique );
+		if( !data.texCoords.empty() ) out.texCoords.resize( 2 * nUnique );
+		pool->parallelFor( nChunks, [&]( size_t chunk ) {
+			for( size_t i = chunk * CHUNK; i < std::min( n, (chunk + 1) * CHUNK ); i++ ) {
+				if( remap[i] != i ) {
+					index[i] = index[remap[i]];
+					continue;
+				}
+				size_t dst = index[i];
+				memcpy( &out.positions[3 * dst], &data.positions[3 * i], 3 * sizeof(GLfloat) );
+				if( !out.normals.empty() ) memcpy( &out.normals[3 * dst], &data.normals[3 * i], 3 * sizeof(GLfloat) );
+				if( !out.colors.empty() ) memcpy( &out.colors[4 * dst], &data.colors[4 * i], 4 * sizeof(GLfloat) );
+				if( !out.texCoords.empty() ) memcpy( &out.texCoords[2 * dst], &data.texCoords[2 * i], 2 * sizeof(GLfloat) );
+			}
+		} );
+
+		// Remap the elements, creating them for unindexed data, and drop collapsed triangles
+		if( data.elements.empty() ) {
+			out.elements.assign( index.begin(), index.begin() + (n - n % 3) );
+		} else {
+			out.elements.swap( data.elements );
+			const size_t nElements = out.elements.size();
+			pool->parallelFor( (nElements + CHUNK - 1) / CHUNK, [&]( size_t chunk ) {
+				for( size_t e = chunk * CHUNK; e < std::min( nElements, (chunk + 1) * CHUNK ); e++ ) {
+					out.elements[e] = index[out.elements[e]];
+				}
+			} );
+		}
+		size_t kept = 0;
+		for( size_t t = 0; t + 2 < out.elements.size(); t += 3 ) {
+			GLuint a = out.elements[t], b = out.elements[t + 1], c = out.elements[t + 2];
+			if( a == b || b == c || a == c ) {
+				result.degenerateTriangles++;
+				continue;
+			}
+			out.elements[kept++] = a;
+			out.elements[kept++] = b;
+			out.elements[kept++] = c;
+		}
+		out.elements.resize( kept );
+
+		data.positions.swap( out.positions );
+		data.normals.swap( out.normals );
+		data.colors.swap( out.colors );
+		data.texCoords.swap( out.texCoords );
+		data.elements.swap( out.elements );
+		result.vertsAfter = (GLuint)nUnique;
+		return result;
+	}
+
+	inline void computeNormals( MeshData & data, ThreadPool * pool )
+	{
+		data.normals.assign( 3 * (size_t)data.numVerts(), 0.0f );
+		accumulateNormals( data.positions.data(), data.elements.data(), data.numElements() / 3, data.normals.data() );
+		normalizeNormals( data.normals.data(), data.numVerts(), pool );
+	}
+
+	inline void accumulateNormals( const GLfloat * positions, const GLuint * triangles, size_t numTriangles, GLfloat * normals )
+	{
+		// The cross product's length is twice the triangle's area, which gives the weighting
+		for( size_t t = 0; t < numTriangles; t++ ) {
+			const GLuint * tri = triangles + 3 * t;
+			const GLfloat * a = positions + 3 * tri[0], * b = positions + 3 * tri[1], * c = positions + 3 * tri[2];
+			GLfloat u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			GLfloat v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			GLfloat cross[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+			for( int k = 0; k < 3; k++ ) {
+				GLfloat * dst = normals + 3 * tri[k];
+				dst[0] += cross[0]; dst[1] += cross[1]; dst[2] += cross[2];
+			}
+		}
+	}
+
+	inline void normalizeNormals( GLfloat * normals, size_t numVerts, ThreadPool * pool )
+	{
+		if( pool == NULL ) pool = &ThreadPool::shared();
+		const size_t CHUNK = 1 << 16;
+		pool->parallelFor( (numVerts + CHUNK - 1) / CHUNK, [&]( size_t chunk ) {
+			for( size_t i = chunk * CHUNK; i < std::min( numVerts, (chunk + 1) * CHUNK ); i++ ) {
+				GLfloat * v = normals + 3 * i;
+				GLfloat len = std::sqrt( v[0] * v[0] + v[1] * v[1] + v[2] * v[2] );
+				if( len > 0.0f ) {
+					v[0] /= len; v[1] /= len; v[2] /= len;
+				} else {
+					v[0] = 0.0f; v[1] = 0.0f; v[2] = 1.0f;
+				}
+			}
+		} );
+	}
+}
@@ -0,0 +1,167 @@
+#ifndef __gltw_occlusion_hpp
+#define __gltw_occlusion_hpp
+
+#include <vector>
+
+namespace gltw {
+
+	/** How an OcclusionCuller acts on the results of its queries */
+	enum OcclusionMode {
+		/**
+		 * Each object's box is queried, then the object is drawn within
+		 * glBeginConditionalRender on the result of that query.  The GPU skips the hidden
+		 * objects within the same frame, and the CPU never waits for a result.
+		 */
+		OCCLUSION_CONDITIONAL,
+		/**
+		 * Each object is drawn if the latest available result of its query showed it
+		 * visible, and the boxes are queried after the objects are drawn.  There are fewer
+		 * draw calls than with ::OCCLUSION_CONDITIONAL, but an object that comes into view
+		 * appears a frame or more late.
+		 */
+		OCCLUSION_LAST_FRAME
+	};
+
+	/** The statistics of one OcclusionCuller::draw */
+	struct OcclusionStats {
+		/** The number of objects */
+		GLuint objects;
+		/** The objects outside the view frustum, which were neither queried nor drawn */
+		GLuint outsideFrustum;
+		/** The boxes queried */
+		GLuint queries;
+		/** The objects drawn.  With ::OCCLUSION_CONDITIONAL this includes those the GPU skipped. */
+		GLuint drawn;
+		/**
+		 * The objects in the frustum that the latest available query results showed to be
+		 * hidden.  Results are read without waiting, so they are usually a frame old.
+		 */
+		GLuint occluded;
+	};
+
+	/**
+	 * <p>Skips drawing meshes that are hidden behind others, using occlusion queries on their
+	 * bounding boxes.  Each object is a mesh with a bounding box, a model matrix, a color and
+	 * a stock shader variant.  The box is drawn as a scaled cube, with color and depth
+	 * writes turned off, inside an occlusion query: if none of its samples pass the depth
+	 * test, nothing inside it can be visible.  See ::OcclusionMode for how the results
+	 * are used.</p>
+	 *
+	 * <p>Queries only see what is already in the depth buffer, so draw the large occluders,
+	 * such as walls and floors, before calling draw().  Objects outside the view frustum are
+	 * skipped without a query, and objects whose boxes cross the near plane, or hold the
+	 * eye, are always drawn.</p>
+	 *
+	 * <p>The meshes are not owned by the culler, and must outlive it or be removed by
+	 * clear().</p>
+	 *
+	 * <p><code>
+	 *    // Initialization<br />
+	 *    gltw::OcclusionCuller culler;<br />
+	 *    for( ... ) culler.add( *mesh, boundsMin, boundsMax, model );<br />
+	 *    <br />
+	 *    // Within the draw function<br />
+	 *    walls.draw();<br />
+	 *    culler.draw( view, projection );<br />
+	 *    cout << culler.stats().occluded << " hidden" << endl;<br />
+	 * </code></p>
+	 */
+	class OcclusionCuller : public NonCopyable {
+	public:
+		/**
+		 * Constructs an empty culler.
+		 *
+		 * @param mode how the query results are used
+		 * @param queryTarget GL_SAMPLES_PASSED, or GL_ANY_SAMPLES_PASSED where OpenGL 3.3 is
+		 *    available, which lets the GPU stop counting at the first sample
+		 */
+		explicit OcclusionCuller( OcclusionMode mode = OCCLUSION_CONDITIONAL, GLenum queryTarget = GL_SAMPLES_PASSED );
+
+		/** Deletes the queries and the box mesh */
+		~OcclusionCuller();
+
+		/**
+		 * Add an object.
+		 *
+		 * @param mesh the mesh, which is drawn with its draw() method
+		 * @param min the minimum corner of the mesh's bounding box, in model space
+		 * @param max the maximum corner of the mesh's bounding box, in model space
+		 * @param model the model matrix (16 values, column-major), or NULL for the identity
+		 * @param color the color given to setColor (r,g,b,a), or NULL for white
+		 * @param shader the stock shader variant to draw the mesh with
+		 * @return the index of the object
+		 */
+		size_t add( VertexBatch & mesh, const GLfloat * min, const GLfloat * max, const GLfloat * model = NULL,
+			const GLfloat * color = NULL, ShaderKey shader = stockShaderKey( SHADER_DEFAULT_LIGHT ) );
+
+		/**
+		 * Move an object.
+		 *
+		 * @param object the index returned by add()
+		 * @param model the new model matrix (16 values, column-major)
+		 */
+		void setModelMatrix( size_t object, const GLfloat * model );
+
+		/**
+		 * Query and draw the objects, grouped by shader.  Each shader variant is made active
+		 * and given the projection matrix, with the view matrix times the object's model
+		 * matrix as its model-view matrix.  Face culling and the color and depth masks are
+		 * restored afterwards, but the active shader is not.  With ::OCCLUSION_LAST_FRAME the
+		 * boxes are queried last, so the ::SHADER_FLAT shader that draws them is left active.
+		 * Otherwise the last variant used to draw an object is, or ::SHADER_FLAT if the boxes
+		 * were queried and no object was drawn.
+		 *
+		 * @param view the view matrix (16 values, column-major)
+		 * @param projection the projection matrix (16 values, column-major)
+		 * @return the number of objects drawn, as in OcclusionStats::drawn
+		 */
+		size_t draw( const GLfloat * view, const GLfloat * projection );
+
+		/** @return the statistics of the last draw() */
+		const OcclusionStats & stats() const { return frameStats; }
+
+		/** @return whether the latest available query result showed an object to be visible */
+		bool visible( size_t object ) const { return objects[object].visible; }
+
+		/** @return the number of objects */
+		size_t numObjects() const { return objects.size(); }
+
+		/** Remove all of the objects */
+		void clear();
+
+	private:
+		struct Object {
+			VertexBatch * mesh;
+			GLfloat min[3], max[3];
+			GLfloat model[16];
+			// The model matrix times the scale and translation taking the unit cube to the box
+			GLfloat boxModel[16];
+			GLfloat color[4];
+			ShaderKey shader;
+			GLuint query;
+			bool pending, visible;
+		};
+
+		void updateBoxModel( Object & obj );
+		GLuint queryBoxes( const GLfloat * view, const GLfloat * projection );
+
+		OcclusionMode mode;
+		GLenum target;
+		TriangleMeshPtr box;
+		std::vector<Object> objects;
+		// The objects in order of shader, rebuilt when objects are added
+		std::vector<size_t> order;
+		// For each object this frame: 0 if outside the frustum, 1 if queried and 2 if too near to query
+		std::vector<char> tests;
+		OcclusionStats frameStats;
+	};
+
+	/// @privatesection
+	/** Whether any corner of a box is nearer than the near plane of a model-view-projection matrix */
+	bool boxCrossesNearPlane( const GLfloat * mvp, const GLfloat * min, const GLfloat * max );
+	/// @publicsection
+}
+
+#include "gltw_occlusion.inl"
+
+#endif
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <numeric>
+
+namespace gltw {
+
+	inline bool boxCrossesNearPlane( const GLfloat * m, const GLfloat * min, const GLfloat * max ) {
+		for( int corner = 0; corner < 8; corner++ ) {
+			GLfloat p[3] = { (corner & 1) ? max[0] : min[0], (corner & 2) ? max[1] : min[1], (corner & 4) ? max[2] : min[2] };
+			GLfloat z = m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14];
+			GLfloat w = m[3] * p[0] + m[7] * p[1] + m[11] * p[2] + m[15];
+			if( z < -w ) return true;
+		}
+		return false;
+	}
+
+	inline OcclusionCuller::OcclusionCuller( OcclusionMode m, GLenum queryTarget ) :
+		mode(m), target(queryTarget), box(buildCube())
+	{
+		OcclusionStats empty = { 0, 0, 0, 0, 0 };
+		frameStats = empty;
+	}
+
+	inline OcclusionCuller::~OcclusionCuller() {
+		clear();
+	}
+
+	inline size_t OcclusionCuller::add( VertexBatch & mesh, const GLfloat * min, const GLfloat * max, const GLfloat * model,
+		const GLfloat * color, ShaderKey shader )
+	{
+		Object obj;
+		obj.mesh = &mesh;
+		for( int j = 0; j < 3; j++ ) {
+			obj.min[j] = min[j];
+			obj.max[j] = max[j];
+		}
+		for( int i = 0; i < 16; i++ ) obj.model[i] = model ? model[i] : (i % 5 == 0 ? 1.0f : 0.0f);
+		for( int i = 0; i < 4; i++ ) obj.color[i] = color ? color[i] : 1.0f;
+		obj.shader = shader;
+		glGenQueries( 1, &obj.query );
+		// Visible until a query shows otherwise
+		obj.pending = false;
+		obj.visible = true;
+		updateBoxModel( obj );
+		objects.push_back( obj );
+		order.clear();
+		return objects.size() - 1;
+	}
+
+	inline void OcclusionCuller::setModelMatrix( size_t object, const GLfloat * model ) {
+		Object & obj = objects[object];
+		std::copy( model, model + 16, obj.model );
+		updateBoxModel( obj );
+	}
+
+	inline void OcclusionCuller::updateBoxModel( Object & obj ) {
+		// The box is enlarged a little, so that it is not hidden by the surfaces of the mesh itself
+		GLfloat margin = 0.0f;
+		for( int j = 0; j < 3; j++ ) margin = std::max( margin, 0.01f * (obj.max[j] - obj.min[j]) );
+		for( int r = 0; r < 4; r++ ) {
+			obj.boxModel[12 + r] = obj.model[12 + r];
+			for( int j = 0; j < 3; j++ ) {
+				obj.boxModel[4 * j + r] = obj.model[4 * j + r] * (obj.max[j] - obj.min[j] + 2.0f * margin);
+				obj.boxModel[12 + r] += obj.model[4 * j + r] * 0.5f * (obj.min[j] + obj.max[j]);
+			}
+		}
+	}
+
+	inline size_t OcclusionCuller::draw( const GLfloat * view, const GLfloat * projection )
+	{
+		OcclusionStats stats = { (GLuint)objects.size(), 0, 0, 0, 0 };
+		if( order.size() != objects.size() ) {
+			order.resize( objects.size() );
+			std::iota( order.begin(), order.end(), (size_t)0 );
+			std::stable_sort( order.begin(), order.end(), [this]( size_t a, size_t b ) {
+				return objects[a].shader < objects[b].shader;
+			} );
+		}
+
+		// Collect the query results that have arrived, without waiting, and test the boxes
+		// against the frustum
+		GLfloat viewProjection[16], mvp[16], mv[16];
+		multiplyMatrix4( projection, view, viewProjection );
+		tests.resize( objects.size() );
+		for( size_t i = 0; i < objects.size(); i++ ) {
+			Object & obj = objects[i];
+			if( obj.pending ) {
+				GLuint available = 0;
+				glGetQueryObjectuiv( obj.query, GL_QUERY_RESULT_AVAILABLE, &available );
+				if( available ) {
+					GLuint samples = 0;
+					glGetQueryObjectuiv( obj.query, GL_QUERY_RESULT, &samples );
+					obj.visible = samples > 0;
+					obj.pending = false;
+				}
+			}
+
+			multiplyMatrix4( viewProjection, obj.model, mvp );
+			if( !boxInFrustum( mvp, obj.min, obj.max ) ) {
+				// Drawn as soon as it returns to the frustum
+				tests[i] = 0;
+				obj.visible = true;
+				stats.outsideFrustum++;
+			} else if( boxCrossesNearPlane( mvp, obj.min, obj.max ) ) {
+				// Part of the box would be clipped, so the query could miss it
+				tests[i] = 2;
+				obj.visible = true;
+			} else {
+				tests[i] = 1;
+				if( !obj.visible ) stats.occluded++;
+			}
+		}
+
+		if( mode == OCCLUSION_CONDITIONAL ) stats.queries = queryBoxes( view, projection );
+
+		bool first = true;
+		ShaderKey current = 0;
+		for( size_t k = 0; k < order.size(); k++ ) {
+			Object & obj = objects[order[k]];
+			const char test = tests[order[k]];
+			if( test == 0 ) continue;
+			if( mode == OCCLUSION_LAST_FRAME && test == 1 && !obj.visible ) continue;
+
+			if( first || obj.shader != current ) {
+				useShaderVariant( obj.shader );
+				setProjectionMatrix( const_cast<GLfloat *>(projection) );
+				current = obj.shader;
+				first = false;
+			}
+			multiplyMatrix4( view, obj.model, mv );
+			setModelViewMatrix( mv );
+			setColor( obj.color );
+
+			const bool conditional = mode == OCCLUSION_CONDITIONAL && test == 1;
+			if( conditional ) glBeginConditionalRender( obj.query, GL_QUERY_NO_WAIT );
+			obj.mesh->draw();
+			if( conditional ) glEndConditionalRender();
+			stats.drawn++;
+		}
+
+		// The boxes are queried after the objects are drawn, so the objects occlude each other
+		if( mode == OCCLUSION_LAST_FRAME ) stats.queries = queryBoxes( view, projection );
+
+		frameStats = stats;
+		return stats.drawn;
+	}
+
+	inline GLuint OcclusionCuller::queryBoxes( const GLfloat * view, const GLfloat * projection )
+	{
+		GLboolean colorMask[4], depthMask;
+		glGetBooleanv( GL_COLOR_WRITEMASK, colorMask );
+		glGetBooleanv( GL_DEPTH_WRITEMASK, &depthMask );
+		const GLboolean cullFace = glIsEnabled( GL_CULL_FACE );
+		glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+		glDepthMask( GL_FALSE );
+		glDisable( GL_CULL_FACE );
+
+		useShaderVariant( stockShaderKey( SHADER_FLAT ) );
+		setProjectionMatrix( const_cast<GLfloat *>(projection) );
+		GLuint n = 0;
+		GLfloat mv[16];
+		for( size_t i = 0; i < objects.size(); i++ ) {
+			Object & obj = objects[i];
+			// A query whose result has not arrived is left to finish, unless it is needed this frame
+			if( tests[i] != 1 || (mode == OCCLUSION_LAST_FRAME && obj.pending) ) continue;
+			multiplyMatrix4( view, obj.boxModel, mv );
+			setModelViewMatrix( mv );
+			glBeginQuery( target, obj.query );
+			box->draw();
+			glEndQuery( target );
+			obj.pending = true;
+			n++;
+		}
+
+		glColorMask( colorMask[0], colorMask[1], colorMask[2], colorMask[3] );
+		glDepthMask( depthMask );
+		if( cullFace ) glEnable( GL_CULL_FACE );
+		return n;
+	}
+
+	inline void OcclusionCuller::clear() {
+		for( size_t i = 0; i < objects.size(); i++ ) glDeleteQueries( 1, &objects[i].query );
+		objects.clear();
+		order.clear();
+		tests.clear();
+	}
+}
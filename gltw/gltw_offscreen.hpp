@@ -0,0 +1,223 @@
+#ifndef __gltw_offscreen_hpp
+#define __gltw_offscreen_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gltw {
+
+	/**
+	 * <p>An offscreen framebuffer to render into, with a color texture and an optional depth
+	 * (or depth and stencil) renderbuffer.  The color texture can be sampled once rendering
+	 * has finished, or its pixels read back with an AsyncReadback.  The attachments are
+	 * counted against the GPU memory budget as textures.</p>
+	 *
+	 * <p><code>
+	 *    // Initialization<br />
+	 *    gltw::RenderTarget target( 1920, 1080, GL_RGBA8, GL_DEPTH24_STENCIL8 );<br />
+	 *    <br />
+	 *    // Within the draw function<br />
+	 *    target.bind();<br />
+	 *    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );<br />
+	 *    scene.draw();<br />
+	 *    gltw::RenderTarget::unbind();<br />
+	 * </code></p>
+	 */
+	class RenderTarget : public NonCopyable {
+	public:
+		/**
+		 * Create the framebuffer and its attachments.  Exits if the combination of formats
+		 * is not supported by the driver.
+		 *
+		 * @param width the width, in pixels
+		 * @param height the height, in pixels
+		 * @param colorFormat the internal format of the color texture, such as GL_RGBA8 or GL_RGBA16F
+		 * @param depthFormat the internal format of the depth renderbuffer, such as
+		 *    GL_DEPTH_COMPONENT24 or GL_DEPTH24_STENCIL8, or GL_NONE for no depth buffer
+		 */
+		RenderTarget( GLsizei width, GLsizei height, GLenum colorFormat = GL_RGBA8, GLenum depthFormat = GL_DEPTH_COMPONENT24 );
+
+		/** Deletes the framebuffer and its attachments */
+		~RenderTarget();
+
+		/** Bind the framebuffer for drawing and reading, and set the viewport to cover it */
+		void bind() const;
+
+		/**
+		 * Bind the default framebuffer again.  The viewport is left as it is.
+		 */
+		static void unbind();
+
+		/** @return the framebuffer object */
+		GLuint id() const { return fboID; }
+		/** @return the color texture, which must not be bound while drawing into the target */
+		Texture & colorTexture() { return *color; }
+		/** @return the depth renderbuffer, or zero if there is none */
+		GLuint depthBuffer() const { return depthID; }
+		/** @return the width, in pixels */
+		GLsizei width() const { return color->width(); }
+		/** @return the height, in pixels */
+		GLsizei height() const { return color->height(); }
+		/** @return the internal format of the depth renderbuffer, or GL_NONE */
+		GLenum depthFormat() const { return depthFmt; }
+
+	private:
+		GLuint fboID;
+		TexturePtr color;
+		GLuint depthID;
+		GLenum depthFmt;
+		size_t depthBytes;
+	};
+
+	/** A RenderTarget owned by a std::unique_ptr */
+	typedef std::unique_ptr<RenderTarget> RenderTargetPtr;
+
+	/** A frame of pixels read back by an AsyncReadback, as given to its consumer */
+	struct ReadbackFrame {
+		/** The number of the frame, counting from zero in the order they were read */
+		unsigned long long number;
+		/** The pixels, rows from the bottom up, packed without padding.  Valid only during the call. */
+		const void * pixels;
+		/** The size of the pixels, in bytes */
+		size_t bytes;
+		/** The size of the frame, in pixels */
+		GLsizei width, height;
+		/** The format and type the pixels were read with */
+		GLenum format, type;
+	};
+
+	/** Counts of the work done by an AsyncReadback, see AsyncReadback::stats */
+	struct ReadbackStats {
+		/** The frames passed to read() */
+		unsigned long long read;
+		/** The frames handed to the consumer, including any lost because their buffer could not be mapped */
+		unsigned long long delivered;
+		/** The times read() waited because every buffer of the ring was in use */
+		unsigned long long stalls;
+	};
+
+	/**
+	 * <p>Reads frames back from render targets without stalling the rendering thread.  Each
+	 * read() starts a copy from the target into the next of a ring of pixel pack buffers, and
+	 * returns at once.  Later calls to read() or update() find the copies the GPU has
+	 * finished, by their fences, map those buffers and hand them to a consumer thread, which
+	 * calls the consumer function.  So rendering frame n, copying frame n-1 and consuming
+	 * frame n-2 all overlap.</p>
+	 *
+	 * <p>Frames are consumed in order, on a single thread.  If the consumer falls behind,
+	 * the ring fills up and read() waits for the oldest frame, rather than dropping
+	 * frames or growing without bound.  A deeper ring absorbs more variation in the
+	 * consumer's speed, at the cost of a buffer per frame of depth.  All of the OpenGL calls
+	 * are made on the rendering thread; the consumer needs no context.</p>
+	 *
+	 * <p><code>
+	 *    // Initialization<br />
+	 *    gltw::AsyncReadback readback( []( const gltw::ReadbackFrame & frame ) {<br />
+	 *    &nbsp;&nbsp;&nbsp;&nbsp;encoder.write( frame.pixels, frame.bytes );<br />
+	 *    }, 3 );<br />
+	 *    <br />
+	 *    // Each frame<br />
+	 *    target.bind();<br />
+	 *    scene.draw();<br />
+	 *    readback.read( target );<br />
+	 *    <br />
+	 *    // When done<br />
+	 *    readback.finish();<br />
+	 * </code></p>
+	 */
+	class AsyncReadback : public NonCopyable {
+	public:
+		/** The function that receives each frame, on the consumer thread */
+		typedef std::function<void( const ReadbackFrame & )> Consumer;
+
+		/**
+		 * Start the consumer thread.  The buffers are created by the first read().
+		 *
+		 * @param consumer the function that receives each frame
+		 * @param depth the number of pixel pack buffers in the ring, at least 2
+		 */
+		explicit AsyncReadback( Consumer consumer, int depth = 3 );
+
+		/**
+		 * Delivers the frames already read, as finish(), then stops the consumer thread and
+		 * deletes the buffers.  This must be called on the rendering thread.
+		 */
+		~AsyncReadback();
+
+		/**
+		 * Start reading the color attachment of a render target into the next buffer of the
+		 * ring.  This must be called on the rendering thread after drawing into the target.
+		 * It leaves the target bound for reading, and waits only if every buffer is in use.
+		 *
+		 * @param target the render target
+		 * @param format the format to read the pixels in, such as GL_RGBA or GL_RED
+		 * @param type the type of the pixel components, such as GL_UNSIGNED_BYTE or GL_FLOAT
+		 * @return the number of the frame, as given to the consumer
+		 */
+		unsigned long long read( const RenderTarget & target, GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE );
+
+		/**
+		 * Hand the frames whose copies have finished to the consumer, and recycle the buffers
+		 * the consumer is done with.  read() does this too, so calling update() is only
+		 * needed to deliver frames promptly when no more are being read.  It never waits.
+		 * This must be called on the rendering thread.
+		 *
+		 * @return the number of frames handed to the consumer
+		 */
+		size_t update();
+
+		/**
+		 * Wait until every frame read so far has been consumed.  This must be called on the
+		 * rendering thread.
+		 */
+		void finish();
+
+		/** @return the number of frames read but not yet consumed */
+		size_t pending() const;
+
+		/** @return the number of buffers in the ring */
+		int depth() const { return (int)slots.size(); }
+
+		/** @return the counts of frames read and delivered, and of stalls */
+		ReadbackStats stats() const;
+
+	private:
+		enum SlotState { SLOT_FREE, SLOT_COPYING, SLOT_CONSUMING, SLOT_CONSUMED };
+		// A pixel pack buffer of the ring, and the frame it holds
+		struct Slot {
+			GLuint pbo;
+			size_t size;
+			GLsync fence;
+			SlotState state;
+			ReadbackFrame frame;
+		};
+
+		void consumerLoop();
+		size_t deliver( bool wait );
+		void recycle();
+
+		Consumer consumer;
+		std::thread thread;
+		mutable std::mutex mutex;
+		std::condition_variable wake, consumed;
+		// Guarded by mutex: the slots handed to the consumer, their states once handed over,
+		// and the count of frames delivered
+		std::deque<size_t> queue;
+		std::vector<Slot> slots;
+		unsigned long long numDelivered;
+		bool quit;
+
+		// Used only on the rendering thread
+		size_t next;
+		unsigned long long numRead, numStalls;
+	};
+}
+
+#include "gltw_offscreen.inl"
+
+#endif
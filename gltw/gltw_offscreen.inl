@@ -0,0 +1,285 @@
+namespace gltw {
+
+	/// @privatesection
+	/** The bytes of each pixel read with a format and type, as packed by glReadPixels */
+	inline size_t readbackPixelSize( GLenum format, GLenum type ) {
+		switch( type ) {
+			case GL_UNSIGNED_INT_24_8:
+			case GL_UNSIGNED_INT_8_8_8_8:
+			case GL_UNSIGNED_INT_8_8_8_8_REV:
+			case GL_UNSIGNED_INT_2_10_10_10_REV:
+			case GL_UNSIGNED_INT_10F_11F_11F_REV:
+				return 4;
+			case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+				return 8;
+			default:
+				break;
+		}
+		size_t components;
+		switch( format ) {
+			case GL_RG: case GL_RG_INTEGER: components = 2; break;
+			case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: components = 3; break;
+			case GL_RGBA: case GL_BGRA: case GL_RGBA_INTEGER: components = 4; break;
+			default: components = 1; break;
+		}
+		switch( type ) {
+			case GL_BYTE: case GL_UNSIGNED_BYTE: return components;
+			case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: return 2 * components;
+			default: return 4 * components;
+		}
+	}
+
+	/** The bytes of each pixel of a depth renderbuffer format */
+	inline size_t depthFormatSize( GLenum format ) {
+		switch( format ) {
+			case GL_DEPTH_COMPONENT16: return 2;
+			case GL_DEPTH32F_STENCIL8: return 8;
+			default: return 4;
+		}
+	}
+	/// @publicsection
+
+	inline RenderTarget::RenderTarget( GLsizei width, GLsizei height, GLenum colorFormat, GLenum depthFormat ) :
+		fboID(0), depthID(0), depthFmt(depthFormat), depthBytes(0)
+	{
+		color.reset( new Texture( width, height, 1, colorFormat ) );
+		color->setWrap( GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE );
+
+		glGenFramebuffers( 1, &fboID );
+		glBindFramebuffer( GL_FRAMEBUFFER, fboID );
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color->id(), 0 );
+		if( depthFmt != GL_NONE ) {
+			glGenRenderbuffers( 1, &depthID );
+			glBindRenderbuffer( GL_RENDERBUFFER, depthID );
+			glRenderbufferStorage( GL_RENDERBUFFER, depthFmt, width, height );
+			glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+			const bool stencil = depthFmt == GL_DEPTH24_STENCIL8 || depthFmt == GL_DEPTH32F_STENCIL8;
+			glFramebufferRenderbuffer( GL_FRAMEBUFFER, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+				GL_RENDERBUFFER, depthID );
+			depthBytes = depthFormatSize( depthFmt ) * width * height;
+			trackMemory( MEMORY_TEXTURES, (long long)depthBytes );
+		}
+		GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+		glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+		if( status != GL_FRAMEBUFFER_COMPLETE ) {
+			cerr << "Error in RenderTarget constructor:  the framebuffer is incomplete (status 0x"
+				<< std::hex << status << std::dec << ")." << endl;
+			exit(1);
+		}
+	}
+
+	inline RenderTarget::~RenderTarget() {
+		glDeleteFramebuffers( 1, &fboID );
+		if( depthID != 0 ) {
+			glDeleteRenderbuffers( 1, &depthID );
+			trackMemory( MEMORY_TEXTURES, -(long long)depthBytes );
+		}
+	}
+
+	inline void RenderTarget::bind() const {
+		glBindFramebuffer( GL_FRAMEBUFFER, fboID );
+		glViewport( 0, 0, color->width(), color->height() );
+	}
+
+	inline void RenderTarget::unbind() {
+		glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	}
+
+	inline AsyncReadback::AsyncReadback( Consumer fn, int depth ) :
+		consumer(fn), numDelivered(0), quit(false), next(0), numRead(0), numStalls(0)
+	{
+		Slot slot = {};
+		slot.state = SLOT_FREE;
+		slots.resize( std::max( depth, 2 ), slot );
+		thread = std::thread( &AsyncReadback::consumerLoop, this );
+	}
+
+	inline AsyncReadback::~AsyncReadback() {
+		finish();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		thread.join();
+
+		for( size_t i = 0; i < slots.size(); i++ ) {
+			if( slots[i].pbo == 0 ) continue;
+			glDeleteBuffers( 1, &slots[i].pbo );
+			trackMemory( MEMORY_TEXTURES, -(long long)slots[i].size );
+		}
+	}
+
+	inline void AsyncReadback::consumerLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			while( !quit && queue.empty() ) wake.wait(lock);
+			if( queue.empty() ) break;
+			size_t index = queue.front();
+			queue.pop_front();
+			lock.unlock();
+
+			{
+				GLTW_TRACE_INTERNAL( "AsyncReadback::consume" );
+				consumer( slots[index].frame );
+			}
+
+			lock.lock();
+			slots[index].state = SLOT_CONSUMED;
+			numDelivered++;
+			consumed.notify_all();
+		}
+	}
+
+	inline void AsyncReadback::recycle() {
+		std::vector<size_t> done;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for( size_t i = 0; i < slots.size(); i++ ) {
+				if( slots[i].state == SLOT_CONSUMED ) done.push_back( i );
+			}
+		}
+		if( done.empty() ) return;
+		for( size_t i = 0; i < done.size(); i++ ) {
+			glBindBuffer( GL_PIXEL_PACK_BUFFER, slots[done[i]].pbo );
+			glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+		}
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+		std::lock_guard<std::mutex> lock(mutex);
+		for( size_t i = 0; i < done.size(); i++ ) slots[done[i]].state = SLOT_FREE;
+	}
+
+	inline size_t AsyncReadback::deliver( bool wait ) {
+		size_t delivered = 0;
+		for(;;) {
+			// The oldest copy still in progress.  Copies finish in the order they were
+			// started, so there is nothing to deliver if it has not finished.
+			size_t oldest = slots.size();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for( size_t i = 0; i < slots.size(); i++ ) {
+					if( slots[i].state != SLOT_COPYING ) continue;
+					if( oldest == slots.size() || slots[i].frame.number < slots[oldest].frame.number ) oldest = i;
+				}
+			}
+			if( oldest == slots.size() ) break;
+			Slot & s = slots[oldest];
+
+			GLenum status;
+			do {
+				status = glClientWaitSync( s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000 : 0 );
+			} while( wait && status == GL_TIMEOUT_EXPIRED );
+			if( status == GL_TIMEOUT_EXPIRED ) break;
+			if( status == GL_WAIT_FAILED ) {
+				cerr << "AsyncReadback: waiting for a readback failed." << endl;
+			}
+			glDeleteSync( s.fence );
+			s.fence = 0;
+			wait = false;
+
+			glBindBuffer( GL_PIXEL_PACK_BUFFER, s.pbo );
+			s.frame.pixels = glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, s.frame.bytes, GL_MAP_READ_BIT );
+			std::lock_guard<std::mutex> lock(mutex);
+			if( s.frame.pixels == NULL ) {
+				cerr << "AsyncReadback: unable to map a pixel pack buffer, frame " << s.frame.number << " is lost." << endl;
+				s.state = SLOT_FREE;
+				numDelivered++;
+				continue;
+			}
+			s.state = SLOT_CONSUMING;
+			queue.push_back( oldest );
+			wake.notify_one();
+			delivered++;
+		}
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+		return delivered;
+	}
+
+	inline size_t AsyncReadback::update() {
+		GLTW_TRACE_INTERNAL( "AsyncReadback::update" );
+		recycle();
+		return deliver( false );
+	}
+
+	inline unsigned long long AsyncReadback::read( const RenderTarget & target, GLenum format, GLenum type ) {
+		GLTW_TRACE_INTERNAL( "AsyncReadback::read" );
+		recycle();
+		deliver( false );
+
+		// The next buffer of the ring holds the oldest frame still in use, if any
+		Slot & s = slots[next];
+		SlotState state;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			state = s.state;
+		}
+		if( state != SLOT_FREE ) {
+			GLTW_TRACE_INTERNAL( "AsyncReadback::stall" );
+			numStalls++;
+			if( state == SLOT_COPYING ) deliver( true );
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while( s.state == SLOT_CONSUMING ) consumed.wait(lock);
+			}
+			recycle();
+		}
+
+		const GLsizei width = target.width(), height = target.height();
+		const size_t bytes = readbackPixelSize( format, type ) * width * height;
+		if( s.pbo == 0 ) glGenBuffers( 1, &s.pbo );
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, s.pbo );
+		if( s.size < bytes ) {
+			glBufferData( GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ );
+			trackMemory( MEMORY_TEXTURES, (long long)bytes - (long long)s.size );
+			s.size = bytes;
+		}
+
+		GLint alignment;
+		glGetIntegerv( GL_PACK_ALIGNMENT, &alignment );
+		glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+		glBindFramebuffer( GL_READ_FRAMEBUFFER, target.id() );
+		glReadBuffer( GL_COLOR_ATTACHMENT0 );
+		glReadPixels( 0, 0, width, height, format, type, 0 );
+		glPixelStorei( GL_PACK_ALIGNMENT, alignment );
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+		s.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		glFlush();
+
+		ReadbackFrame frame = { numRead++, NULL, bytes, width, height, format, type };
+		s.frame = frame;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			s.state = SLOT_COPYING;
+		}
+		next = (next + 1) % slots.size();
+		return frame.number;
+	}
+
+	inline void AsyncReadback::finish() {
+		GLTW_TRACE_INTERNAL( "AsyncReadback::finish" );
+		for(;;) {
+			bool copying = false;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				for( size_t i = 0; i < slots.size(); i++ ) copying |= slots[i].state == SLOT_COPYING;
+				if( !copying ) {
+					while( numDelivered < numRead ) consumed.wait(lock);
+				}
+			}
+			if( !copying ) break;
+			deliver( true );
+		}
+		recycle();
+	}
+
+	inline size_t AsyncReadback::pending() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return (size_t)(numRead - numDelivered);
+	}
+
+	inline ReadbackStats AsyncReadback::stats() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		ReadbackStats stats = { numRead, numDelivered, numStalls };
+		return stats;
+	}
+}
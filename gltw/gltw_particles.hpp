@@ -0,0 +1,120 @@
+#ifndef __gltw_particles_hpp
+#define __gltw_particles_hpp
+
+namespace gltw {
+
+	/**
+	 * <p>A set of particles simulated entirely on the GPU using transform feedback.
+	 * The particle state (position, velocity and age) lives in two buffers.  Each call to
+	 * update() runs a vertex shader over one buffer and captures the results in the other,
+	 * and the buffers then swap roles, so no vertex data passes between the CPU and GPU after
+	 * the initial upload.</p>
+	 *
+	 * <p>The default update shader integrates the velocity under gravity.  Each particle
+	 * lives for a fixed lifetime, after which it is returned to the emitter with its initial
+	 * velocity.  Particles with a negative age wait at the emitter, which can be used to
+	 * stagger their release.</p>
+	 *
+	 * <p>The particles are drawn as GL_POINTS with the active stock shader, usually
+	 * the ::FEATURE_POINTS variant:</p>
+	 *
+	 * <p><code>
+	 *    // Initialization<br />
+	 *    gltw::ParticleSystem particles( n );<br />
+	 *    particles.copyParticleData( NULL, velocities, ages );<br />
+	 *    <br />
+	 *    // Within the draw function<br />
+	 *    particles.update( dt );<br />
+	 *    gltw::useShaderVariant( gltw::shaderKey( gltw::FEATURE_POINTS ) );<br />
+	 *    gltw::setModelViewMatrix( mv );<br />
+	 *    particles.draw();<br />
+	 * </code></p>
+	 */
+	class ParticleSystem : public NonCopyable {
+	public:
+		/**
+		 * Construct a ParticleSystem and compile the default update shader.
+		 *
+		 * @param numParticles the number of particles.  Once constructed, this is fixed and
+		 *         cannot be changed.
+		 */
+		explicit ParticleSystem( GLuint numParticles );
+
+		/** Deletes the buffers, vertex arrays and update shader */
+		~ParticleSystem();
+
+		/**
+		 * Replace the update shader with a custom vertex shader.  The shader receives the inputs
+		 * <code>vec3 vPosition</code>, <code>vec3 vVelocity</code>, <code>float vAge</code> and
+		 * <code>vec3 vInitVelocity</code>, and must write the outputs <code>vec3 Position</code>,
+		 * <code>vec3 Velocity</code> and <code>float Age</code>.  The uniforms
+		 * <code>float dt</code>, <code>float time</code>, <code>float lifetime</code>,
+		 * <code>vec3 gravity</code> and <code>vec3 emitter</code> are set by update() if present.
+		 * Use updateProgram() to set any other uniforms.
+		 *
+		 * @param vertexSource the source code of the vertex shader (null terminated)
+		 * @return true if the shader compiled and linked.  If not, the previous shader is kept.
+		 */
+		bool setUpdateShader( const char * vertexSource );
+
+		/**
+		 * Set the state of all of the particles.  Any of the arrays may be NULL, in which case
+		 * that part of the state is set to zero.
+		 *
+		 * @param positions 3 * numParticles values (x,y,z)
+		 * @param velocities 3 * numParticles values, also used as the initial velocities
+		 * @param ages numParticles values, in seconds
+		 */
+		void copyParticleData( const GLfloat * positions, const GLfloat * velocities, const GLfloat * ages );
+
+		/**
+		 * Copy per-particle colors, used when drawing with a ::FEATURE_VERTEX_COLOR variant.
+		 *
+		 * @param data 4 * numParticles values (r,g,b,a)
+		 */
+		void copyColorData( const GLfloat * data );
+
+		/** Set the acceleration due to gravity, defaults to (0, -9.8, 0) */
+		void setGravity( GLfloat x, GLfloat y, GLfloat z );
+		/** Set the position where particles are released, defaults to the origin */
+		void setEmitter( GLfloat x, GLfloat y, GLfloat z );
+		/** Set the lifetime of the particles in seconds, defaults to 5 */
+		void setLifetime( GLfloat seconds );
+
+		/**
+		 * Advance the simulation.  This draws nothing; the rasterizer is disabled while the
+		 * update shader runs.  The active stock shader is restored afterwards.
+		 *
+		 * @param dt the time step, in seconds
+		 */
+		void update( GLfloat dt );
+
+		/** Draw the particles as GL_POINTS using the active shader. */
+		void draw();
+
+		/** @return the number of particles */
+		GLuint numParticles() const { return nParticles; }
+		/** @return the ID of the update shader program */
+		GLuint updateProgram() const { return programID; }
+
+	private:
+		enum Buffer { STATE_A, STATE_B, INIT_VELOCITY, COLOR, NUM_BUFFERS };
+		enum UpdateAttribute { UPDATE_POSITION, UPDATE_VELOCITY, UPDATE_AGE, UPDATE_INIT_VELOCITY };
+
+		GLuint linkUpdateShader( const char * vertexSource );
+		void buildVertexArrays();
+
+		GLuint nParticles;
+		GLuint programID;
+		GLuint bufIDs[NUM_BUFFERS];
+		// Vertex arrays for updating from, and drawing, each state buffer
+		GLuint updateVA[2], drawVA[2];
+		int current;
+		GLfloat time, lifetime, gravity[3], emitter[3];
+		GLint locDt, locTime, locLifetime, locGravity, locEmitter;
+	};
+}
+
+#include "gltw_particles.inl"
+
+#endif
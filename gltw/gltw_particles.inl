@@ -0,0 +1,238 @@
+namespace gltw {
+
+	inline ParticleSystem::ParticleSystem( GLuint numParticles ) :
+		nParticles(numParticles), programID(0), current(0), time(0.0f), lifetime(5.0f)
+	{
+		for( int i = 0; i < NUM_BUFFERS; i++ ) bufIDs[i] = 0;
+		for( int i = 0; i < 2; i++ ) updateVA[i] = drawVA[i] = 0;
+		gravity[0] = 0.0f; gravity[1] = -9.8f; gravity[2] = 0.0f;
+		emitter[0] = emitter[1] = emitter[2] = 0.0f;
+
+		const char * defaultSource =
+			"#version 150 \n"
+			"in vec3 vPosition;"
+			"in vec3 vVelocity;"
+			"in float vAge;"
+			"in vec3 vInitVelocity;"
+			"uniform float dt;"
+			"uniform float lifetime;"
+			"uniform vec3 gravity;"
+			"uniform vec3 emitter;"
+			"out vec3 Position;"
+			"out vec3 Velocity;"
+			"out float Age;"
+			"void main() {"
+			"   Age = vAge + dt;"
+			"   if( Age < 0.0 || Age >= lifetime ) {"
+			"      Position = emitter;"
+			"      Velocity = vInitVelocity;"
+			"      if( Age >= lifetime ) Age -= lifetime;"
+			"   } else {"
+			"      Position = vPosition + vVelocity * dt;"
+			"      Velocity = vVelocity + gravity * dt;"
+			"   }"
+			"}";
+		if( !setUpdateShader( defaultSource ) ) {
+			cerr << "Error in ParticleSystem constructor:  unable to build the update shader." << endl;
+			exit(1);
+		}
+	}
+
+	inline ParticleSystem::~ParticleSystem() {
+		if( bufIDs[STATE_A] != 0 ) trackMemory( MEMORY_PARTICLES, -(long long)(17 * sizeof(GLfloat) * nParticles) );
+		if( bufIDs[COLOR] != 0 ) trackMemory( MEMORY_PARTICLES, -(long long)(4 * sizeof(GLfloat) * nParticles) );
+		// Delete buffers/vertex arrays safely ignores 0s
+		glDeleteBuffers( NUM_BUFFERS, bufIDs );
+		glDeleteVertexArrays( 2, updateVA );
+		glDeleteVertexArrays( 2, drawVA );
+		if( programID != 0 ) gltw::deleteProgram( programID );
+	}
+
+	inline GLuint ParticleSystem::linkUpdateShader( const char * vertexSource )
+	{
+		GLuint vert = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(vert, 1, &vertexSource, NULL);
+		glCompileShader(vert);
+		if( ! checkCompilationStatus(vert) ) {
+			glDeleteShader(vert);
+			return 0;
+		}
+
+		// No fragment shader is needed, nothing is rasterized
+		GLuint id = glCreateProgram();
+		glAttachShader(id, vert);
+		glBindAttribLocation( id, UPDATE_POSITION, "vPosition" );
+		glBindAttribLocation( id, UPDATE_VELOCITY, "vVelocity" );
+		glBindAttribLocation( id, UPDATE_AGE, "vAge" );
+		glBindAttribLocation( id, UPDATE_INIT_VELOCITY, "vInitVelocity" );
+		const char * outputs[] = { "Position", "Velocity", "Age" };
+		glTransformFeedbackVaryings( id, 3, outputs, GL_INTERLEAVED_ATTRIBS );
+		if( ! linkProgram(id) ) {
+			gltw::deleteProgram(id);
+			return 0;
+		}
+		return id;
+	}
+
+	inline bool ParticleSystem::setUpdateShader( const char * vertexSource )
+	{
+		GLuint id = linkUpdateShader( vertexSource );
+		if( id == 0 ) return false;
+
+		if( programID != 0 ) gltw::deleteProgram( programID );
+		programID = id;
+		locDt = glGetUniformLocation( id, "dt" );
+		locTime = glGetUniformLocation( id, "time" );
+		locLifetime = glGetUniformLocation( id, "lifetime" );
+		locGravity = glGetUniformLocation( id, "gravity" );
+		locEmitter = glGetUniformLocation( id, "emitter" );
+		return true;
+	}
+
+	inline void ParticleSystem::copyParticleData( const GLfloat * positions, const GLfloat * velocities, const GLfloat * ages )
+	{
+		// Interleave the state as the update shader writes it: position, velocity, age
+		std::vector<GLfloat> state( 7 * (size_t)nParticles, 0.0f );
+		std::vector<GLfloat> initVelocity( 3 * (size_t)nParticles, 0.0f );
+		for( size_t i = 0; i < nParticles; i++ ) {
+			for( int c = 0; c < 3; c++ ) {
+				if( positions ) state[7 * i + c] = positions[3 * i + c];
+				if( velocities ) state[7 * i + 3 + c] = initVelocity[3 * i + c] = velocities[3 * i + c];
+			}
+			if( ages ) state[7 * i + 6] = ages[i];
+		}
+
+		if( bufIDs[STATE_A] == 0 ) {
+			glGenBuffers( 3, bufIDs );
+			// Two copies of the state, and the initial velocities
+			trackMemory( MEMORY_PARTICLES, (long long)(17 * sizeof(GLfloat) * nParticles) );
+		}
+		glBindBuffer( GL_ARRAY_BUFFER, bufIDs[STATE_A] );
+		glBufferData( GL_ARRAY_BUFFER, state.size() * sizeof(GLfloat), state.data(), GL_DYNAMIC_COPY );
+		glBindBuffer( GL_ARRAY_BUFFER, bufIDs[STATE_B] );
+		glBufferData( GL_ARRAY_BUFFER, state.size() * sizeof(GLfloat), NULL, GL_DYNAMIC_COPY );
+		glBindBuffer( GL_ARRAY_BUFFER, bufIDs[INIT_VELOCITY] );
+		glBufferData( GL_ARRAY_BUFFER, initVelocity.size() * sizeof(GLfloat), initVelocity.data(), GL_STATIC_DRAW );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+		GLTW_TRACE_COUNT( COUNTER_BYTES_UPLOADED, (state.size() + initVelocity.size()) * sizeof(GLfloat) );
+
+		current = STATE_A;
+		time = 0.0f;
+		buildVertexArrays();
+	}
+
+	inline void ParticleSystem::copyColorData( const GLfloat * data )
+	{
+		bool created = false;
+		if( bufIDs[COLOR] == 0 ) {
+			glGenBuffers( 1, &bufIDs[COLOR] );
+			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[COLOR] );
+			glBufferData( GL_ARRAY_BUFFER, 4 * sizeof(GLfloat) * nParticles, NULL, GL_STATIC_DRAW );
+			trackMemory( MEMORY_PARTICLES, (long long)(4 * sizeof(GLfloat) * nParticles) );
+			created = true;
+		}
+		glBindBuffer( GL_ARRAY_BUFFER, bufIDs[COLOR] );
+		glBufferSubData( GL_ARRAY_BUFFER, 0, 4 * sizeof(GLfloat) * nParticles, data );
+		GLTW_TRACE_COUNT( COUNTER_BYTES_UPLOADED, 4 * sizeof(GLfloat) * nParticles );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+		if( created && bufIDs[STATE_A] != 0 ) buildVertexArrays();
+	}
+
+	inline void ParticleSystem::buildVertexArrays()
+	{
+		glDeleteVertexArrays( 2, updateVA );
+		glDeleteVertexArrays( 2, drawVA );
+		glGenVertexArrays( 2, updateVA );
+		glGenVertexArrays( 2, drawVA );
+
+		const GLsizei stride = 7 * sizeof(GLfloat);
+		for( int i = 0; i < 2; i++ ) {
+			glBindVertexArray( updateVA[i] );
+			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[STATE_A + i] );
+			glVertexAttribPointer( UPDATE_POSITION, 3, GL_FLOAT, GL_FALSE, stride, 0 );
+			glVertexAttribPointer( UPDATE_VELOCITY, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid *)(3 * sizeof(GLfloat)) );
+			glVertexAttribPointer( UPDATE_AGE, 1, GL_FLOAT, GL_FALSE, stride, (const GLvoid *)(6 * sizeof(GLfloat)) );
+			glEnableVertexAttribArray( UPDATE_POSITION );
+			glEnableVertexAttribArray( UPDATE_VELOCITY );
+			glEnableVertexAttribArray( UPDATE_AGE );
+			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[INIT_VELOCITY] );
+			glVertexAttribPointer( UPDATE_INIT_VELOCITY, 3, GL_FLOAT, GL_FALSE, 0, 0 );
+			glEnableVertexAttribArray( UPDATE_INIT_VELOCITY );
+
+			// Drawing uses the stock shader attribute locations
+			glBindVertexArray( drawVA[i] );
+			glBindBuffer( GL_ARRAY_BUFFER, bufIDs[STATE_A + i] );
+			glVertexAttribPointer( GLTW_ATTRIB_IDX_POSITION, 3, GL_FLOAT, GL_FALSE, stride, 0 );
+			glEnableVertexAttribArray( GLTW_ATTRIB_IDX_POSITION );
+			if( bufIDs[COLOR] != 0 ) {
+				glBindBuffer( GL_ARRAY_BUFFER, bufIDs[COLOR] );
+				glVertexAttribPointer( GLTW_ATTRIB_IDX_COLOR, 4, GL_FLOAT, GL_FALSE, 0, 0 );
+				glEnableVertexAttribArray( GLTW_ATTRIB_IDX_COLOR );
+			}
+		}
+		glBindVertexArray( 0 );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	}
+
+	inline void ParticleSystem::setGravity( GLfloat x, GLfloat y, GLfloat z ) {
+		gravity[0] = x; gravity[1] = y; gravity[2] = z;
+	}
+
+	inline void ParticleSystem::setEmitter( GLfloat x, GLfloat y, GLfloat z ) {
+		emitter[0] = x; emitter[1] = y; emitter[2] = z;
+	}
+
+	inline void ParticleSystem::setLifetime( GLfloat seconds ) {
+		lifetime = seconds;
+	}
+
+	inline void ParticleSystem::update( GLfloat dt )
+	{
+		if( bufIDs[STATE_A] == 0 ) {
+			cerr << "ParticleSystem is not ready to update.  Missing particle data." << endl;
+			return;
+		}
+		time += dt;
+
+		GLTW_TRACE_INTERNAL( "ParticleSystem::update" );
+		glUseProgram( programID );
+		if( locDt != -1 ) glUniform1f( locDt, dt );
+		if( locTime != -1 ) glUniform1f( locTime, time );
+		if( locLifetime != -1 ) glUniform1f( locLifetime, lifetime );
+		if( locGravity != -1 ) glUniform3fv( locGravity, 1, gravity );
+		if( locEmitter != -1 ) glUniform3fv( locEmitter, 1, emitter );
+
+		// Read from the current buffer, capture into the other one
+		int next = 1 - current;
+		glEnable( GL_RASTERIZER_DISCARD );
+		glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, bufIDs[STATE_A + next] );
+		glBindVertexArray( updateVA[current] );
+		glBeginTransformFeedback( GL_POINTS );
+		glDrawArrays( GL_POINTS, 0, nParticles );
+		glEndTransformFeedback();
+		GLTW_TRACE_COUNT( COUNTER_DRAWS, 1 );
+		GLTW_TRACE_COUNT( COUNTER_VERTICES, nParticles );
+		glBindVertexArray( 0 );
+		glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0 );
+		glDisable( GL_RASTERIZER_DISCARD );
+		current = next;
+
+		ShaderState &state = ShaderState::state();
+		glUseProgram( state.active ? state.activeID : 0 );
+		GLTW_TRACE_COUNT( COUNTER_PROGRAM_SWITCHES, 2 );
+	}
+
+	inline void ParticleSystem::draw()
+	{
+		if( bufIDs[STATE_A] == 0 ) {
+			cerr << "ParticleSystem is not ready to draw.  Missing particle data." << endl;
+			return;
+		}
+		GLTW_TRACE_INTERNAL( "ParticleSystem::draw" );
+		glBindVertexArray( drawVA[current] );
+		glDrawArrays( GL_POINTS, 0, nParticles );
+		glBindVertexArray( 0 );
+		GLTW_TRACE_COUNT( COUNTER_DRAWS, 1 );
+		GLTW_TRACE_COUNT( COUNTER_VERTICES, nParticles );
+	}
+}
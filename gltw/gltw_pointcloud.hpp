@@ -0,0 +1,245 @@
+#ifndef __gltw_pointcloud_hpp
+#define __gltw_pointcloud_hpp
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace gltw {
+
+	/** Options for building a point cloud octree, see PointCloudBuilder */
+	struct PointCloudOptions {
+		/** The most points held by a node, which is also the size of each slot of a PointCloud's buffer pool */
+		GLuint maxNodePoints;
+		/** The number of cells along each edge of a node's sampling grid.  A node keeps at most one point per cell. */
+		int gridResolution;
+		/** The deepest level of the octree.  Points that do not fit in a node at this level, normally only coincident ones, are dropped. */
+		int maxDepth;
+
+		explicit PointCloudOptions( GLuint maxNodePoints = 20000, int gridResolution = 128, int maxDepth = 20 ) :
+			maxNodePoints(maxNodePoints), gridResolution(gridResolution), maxDepth(maxDepth) { }
+	};
+
+	/// @privatesection
+	/** The header of a point cloud octree file */
+	struct PointCloudHeader {
+		char magic[8];
+		uint64_t numPoints, numNodes, tableOffset;
+		GLfloat min[3], size;
+		uint32_t maxNodePoints, gridResolution;
+	};
+
+	/** A node of a point cloud octree, as stored in the file */
+	struct PointCloudNode {
+		/** The minimum corner and edge length of the node's cube */
+		GLfloat min[3], size;
+		/** The offset of the node's points from the start of the file */
+		uint64_t offset;
+		/** The number of points */
+		uint32_t numPoints;
+		/** The depth of the node, zero for the root */
+		uint32_t depth;
+		/** The indices of the children, in the order of the octants (x + 2y + 4z), or -1 */
+		int32_t children[8];
+	};
+	/// @publicsection
+
+	/**
+	 * <p>Builds the octree file drawn by a PointCloud from points given in any number of
+	 * pieces, without holding them all in memory.  The points are first spilled to a
+	 * temporary file.  build() then partitions them top down: each node keeps at most one
+	 * point in each cell of a grid over its cube, up to PointCloudOptions::maxNodePoints,
+	 * and passes the rest to its eight children through temporary files of their own.  So
+	 * every node is an evenly spaced subsample of its part of the cloud, and a node together
+	 * with its ancestors is a denser one.</p>
+	 *
+	 * <p>The file holds each node's points contiguously, 16 bytes per point (3 floats and an
+	 * RGBA8 color), followed by the table of nodes.  It is written in the byte order of the
+	 * machine that builds it.</p>
+	 *
+	 * <p><code>
+	 *    gltw::PointCloudBuilder builder;<br />
+	 *    while( scanner.read( positions, colors, count ) ) builder.add( positions, colors, count );<br />
+	 *    builder.build( "scan.pco" );<br />
+	 * </code></p>
+	 */
+	class PointCloudBuilder : public NonCopyable {
+	public:
+		/** Constructs an empty builder.  The temporary file is created by the first add(). */
+		explicit PointCloudBuilder( const PointCloudOptions & options = PointCloudOptions() );
+
+		/** Deletes the temporary file */
+		~PointCloudBuilder();
+
+		/**
+		 * Add points to the cloud.
+		 *
+		 * @param positions 3 * count values (x,y,z)
+		 * @param colors 4 * count values (r,g,b,a) in [0,1], stored as bytes, or NULL for white
+		 * @param count the number of points.  Points with infinite or NaN coordinates are skipped.
+		 * @return false if the points could not be written to the temporary file
+		 */
+		bool add( const GLfloat * positions, const GLfloat * colors, size_t count );
+
+		/**
+		 * Build the octree of the points added so far and write it to a file.  The builder
+		 * is emptied.
+		 *
+		 * @param fileName the name of the file to write
+		 * @return false if there are no points, or a file could not be written
+		 */
+		bool build( const char * fileName );
+
+		/** @return the number of points added since the last build */
+		size_t numPoints() const { return count; }
+
+	private:
+		struct Point {
+			GLfloat position[3];
+			unsigned char color[4];
+		};
+
+		int32_t buildNode( FILE * in, size_t numPoints, const GLfloat * min, GLfloat size, int depth );
+		bool writePoints( const Point * points, size_t numPoints );
+
+		PointCloudOptions options;
+		FILE * spill;
+		size_t count;
+		GLfloat min[3], max[3];
+
+		// Used by build()
+		FILE * out;
+		uint64_t written;
+		bool failed;
+		size_t dropped;
+		std::vector<PointCloudNode> nodes;
+	};
+
+	/** Counts of the nodes and points of a PointCloud, see PointCloud::stats */
+	struct PointCloudStats {
+		/** The nodes in the octree */
+		size_t nodes;
+		/** The nodes selected by the last update() */
+		size_t selected;
+		/** The nodes in GPU memory */
+		size_t resident;
+		/** The selected nodes not yet in GPU memory */
+		size_t loading;
+		/** The points of the selected nodes */
+		size_t pointsSelected;
+		/** The points drawn, those of the selected nodes in GPU memory */
+		size_t pointsDrawn;
+		/** The points uploaded by the last update() */
+		size_t pointsUploaded;
+	};
+
+	/**
+	 * <p>Draws a point cloud far larger than GPU memory from an octree file written by a
+	 * PointCloudBuilder.  The file is memory mapped, and nodes are streamed into a fixed pool
+	 * of slots in a single vertex buffer, each slot holding one node.</p>
+	 *
+	 * <p>Each update() selects the nodes to draw: starting at the root, the nodes inside the
+	 * view frustum are visited in order of their size on screen, largest first, and a node's
+	 * children are visited while the spacing of its points on screen is wider than the
+	 * target spacing.  Selection stops at the point budget, or when the pool is full.  Selected
+	 * nodes that are not resident are read from the file by a loader thread, and uploaded a
+	 * few at a time, into free slots or those of the least recently selected nodes.  Until a
+	 * node arrives its area is drawn with the coarser points of its ancestors.</p>
+	 *
+	 * <p>draw() draws every selected resident node with a single glMultiDrawArrays, using
+	 * the ::FEATURE_POINTS variant of the ::SHADER_PER_VERT_COLOR or ::SHADER_FLAT shader.</p>
+	 *
+	 * <p><code>
+	 *    // Initialization<br />
+	 *    gltw::PointCloud cloud( "scan.pco", 3000000 );<br />
+	 *    <br />
+	 *    // Within the draw function<br />
+	 *    cloud.update( view, projection, viewportHeight );<br />
+	 *    cloud.draw( view, projection );<br />
+	 * </code></p>
+	 */
+	class PointCloud : public NonCopyable {
+	public:
+		/**
+		 * Open an octree file, allocate the buffer pool and start the loader thread.  If the
+		 * file cannot be read an error message is displayed, and isOpen() returns false.
+		 *
+		 * @param fileName the file written by PointCloudBuilder::build
+		 * @param pointBudget the most points to draw in a frame
+		 * @param numSlots the number of nodes the buffer pool holds, or zero for enough to
+		 *    reach the budget with nodes half full, plus some room to keep nodes near the view.
+		 *    Each slot takes 16 bytes for each of the file's maximum points per node.
+		 */
+		explicit PointCloud( const char * fileName, size_t pointBudget = 3000000, size_t numSlots = 0 );
+
+		/** Stops the loader thread and deletes the buffer pool */
+		~PointCloud();
+
+		/** @return whether the file was opened */
+		bool isOpen() const { return file.isOpen() && !nodes.empty(); }
+
+		/**
+		 * Select the nodes to draw for a view, upload nodes that have been loaded, and
+		 * request the selected nodes that are not resident.  This never waits for the loader.
+		 * This must be called on the rendering thread, typically once per frame.
+		 *
+		 * @param view the view matrix (16 values, column-major)
+		 * @param projection the projection matrix (16 values, column-major)
+		 * @param viewportHeight the height of the viewport, in pixels
+		 */
+		void update( const GLfloat * view, const GLfloat * projection, GLsizei viewportHeight );
+
+		/**
+		 * Draw the selected nodes that are resident.  A ::FEATURE_POINTS shader variant is
+		 * made active, and given the projection matrix, with the view matrix as its
+		 * model-view matrix.
+		 *
+		 * @param view the view matrix (16 values, column-major)
+		 * @param projection the projection matrix (16 values, column-major)
+		 * @param color the color of every point, or NULL to use the colors of the points
+		 * @return the number of points drawn
+		 */
+		size_t draw( const GLfloat * view, const GLfloat * projection, const GLfloat * color = NULL );
+
+		/** Set the most points to draw in a frame */
+		void setPointBudget( size_t points ) { pointBudget = points; }
+		/** Set the most points to upload in each update(), defaults to 500000 */
+		void setUploadBudget( size_t points ) { uploadBudget = points; }
+		/** Set the spacing of points on screen, in pixels, below which nodes are not refined.  Defaults to 2. */
+		void setTargetSpacing( GLfloat pixels ) { targetSpacing = pixels; }
+		/** Set the diameter of the points, in pixels, defaults to 2 */
+		void setPointSize( GLfloat size ) { pointSize = size; }
+
+		/** @return the number of points in the file */
+		size_t numPoints() const { return totalPoints; }
+		/** @return the minimum corner of the octree's cube (x,y,z) */
+		const GLfloat * boundsMin() const { return nodes.empty() ? NULL : nodes[0].min; }
+		/** @return the edge length of the octree's cube */
+		GLfloat boundsSize() const { return nodes.empty() ? 0.0f : nodes[0].size; }
+
+		/** @return the counts of nodes and points selected, resident and drawn */
+		PointCloudStats stats() const;
+
+	private:
+		void select( const GLfloat * view, const GLfloat * projection, GLsizei viewportHeight );
+
+		MappedFile file;
+		std::vector<PointCloudNode> nodes;
+		size_t totalPoints;
+		GLuint maxNodePoints;
+		GLfloat gridResolution;
+
+		std::vector<int32_t> selected;
+		GLuint vaID;
+		size_t pointBudget, uploadBudget, pointsUploaded;
+		GLfloat targetSpacing, pointSize;
+
+		// Declared last, so that its loader thread stops before the file and nodes it reads are destroyed
+		StreamingPool pool;
+	};
+}
+
+#include "gltw_pointcloud.inl"
+
+#endif
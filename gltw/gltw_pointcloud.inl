@@ -0,0 +1,383 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_set>
+#include <utility>
+
+namespace gltw {
+
+	/// @privatesection
+	/** Identifies a point cloud octree file, and the version of its layout */
+	static const char GLTW_POINT_CLOUD_MAGIC[8] = { 'G', 'L', 'T', 'W', 'P', 'C', '1', '\0' };
+	/// @publicsection
+
+	inline PointCloudBuilder::PointCloudBuilder( const PointCloudOptions & opts ) :
+		options(opts), spill(NULL), count(0), out(NULL), written(0), failed(false), dropped(0)
+	{
+		options.maxNodePoints = std::max( options.maxNodePoints, 1u );
+		options.gridResolution = std::max( options.gridResolution, 1 );
+		for( int i = 0; i < 3; i++ ) {
+			min[i] = FLT_MAX;
+			max[i] = -FLT_MAX;
+		}
+	}
+
+	inline PointCloudBuilder::~PointCloudBuilder() {
+		if( spill ) fclose( spill );
+	}
+
+	inline bool PointCloudBuilder::add( const GLfloat * positions, const GLfloat * colors, size_t numPoints ) {
+		if( spill == NULL ) {
+			spill = tmpfile();
+			if( spill == NULL ) {
+				cerr << "Error in PointCloudBuilder.add: unable to create a temporary file." << endl;
+				return false;
+			}
+		}
+		std::vector<Point> chunk;
+		size_t skipped = 0;
+		for( size_t first = 0; first < numPoints; first += 4096 ) {
+			const size_t n = std::min( numPoints - first, (size_t)4096 );
+			chunk.clear();
+			for( size_t i = first; i < first + n; i++ ) {
+				const GLfloat * p = positions + 3 * i;
+				if( !std::isfinite( p[0] ) || !std::isfinite( p[1] ) || !std::isfinite( p[2] ) ) {
+					skipped++;
+					continue;
+				}
+				Point point;
+				for( int j = 0; j < 3; j++ ) {
+					point.position[j] = p[j];
+					min[j] = std::min( min[j], p[j] );
+					max[j] = std::max( max[j], p[j] );
+				}
+				for( int j = 0; j < 4; j++ ) {
+					GLfloat c = colors ? colors[4 * i + j] : 1.0f;
+					point.color[j] = (unsigned char)(std::min( std::max( c, 0.0f ), 1.0f ) * 255.0f + 0.5f);
+				}
+				chunk.push_back( point );
+			}
+			if( fwrite( chunk.data(), sizeof(Point), chunk.size(), spill ) != chunk.size() ) {
+				cerr << "Error in PointCloudBuilder.add: unable to write to the temporary file." << endl;
+				return false;
+			}
+			count += chunk.size();
+		}
+		if( skipped > 0 ) {
+			cerr << "Warning: PointCloudBuilder.add skipped " << skipped << " points with non-finite coordinates." << endl;
+		}
+		return true;
+	}
+
+	inline bool PointCloudBuilder::writePoints( const Point * points, size_t numPoints ) {
+		if( numPoints > 0 && fwrite( points, sizeof(Point), numPoints, out ) != numPoints ) failed = true;
+		written += sizeof(Point) * numPoints;
+		return !failed;
+	}
+
+	inline int32_t PointCloudBuilder::buildNode( FILE * in, size_t numPoints, const GLfloat * nodeMin, GLfloat size, int depth ) {
+		const int32_t index = (int32_t)nodes.size();
+		PointCloudNode node;
+		memset( &node, 0, sizeof(node) );
+		for( int i = 0; i < 3; i++ ) node.min[i] = nodeMin[i];
+		node.size = size;
+		node.depth = (uint32_t)depth;
+		for( int i = 0; i < 8; i++ ) node.children[i] = -1;
+		nodes.push_back( node );
+
+		const size_t chunkSize = 65536;
+		FILE * children[8] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+		size_t childCounts[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+		{
+			std::vector<Point> chunk( std::min( numPoints, chunkSize ) ), kept;
+			const bool leaf = numPoints <= options.maxNodePoints || depth >= options.maxDepth;
+			if( !leaf ) kept.reserve( options.maxNodePoints );
+
+			// Keep the first point that falls in each cell of the grid, and pass the others down
+			const int res = options.gridResolution;
+			const GLfloat toCell = res / size, half = 0.5f * size;
+			std::unordered_set<uint64_t> taken;
+			std::vector<Point> parts[8];
+			for( size_t done = 0; done < numPoints; ) {
+				const size_t n = std::min( numPoints - done, chunkSize );
+				if( fread( chunk.data(), sizeof(Point), n, in ) != n ) {
+					cerr << "Error in PointCloudBuilder.build: unable to read a temporary file." << endl;
+					failed = true;
+					break;
+				}
+				done += n;
+				for( size_t i = 0; i < n; i++ ) {
+					const Point & p = chunk[i];
+					if( leaf ) {
+						if( kept.size() < options.maxNodePoints ) kept.push_back( p );
+						else dropped++;
+						continue;
+					}
+					uint64_t key = 0;
+					int octant = 0;
+					for( int j = 2; j >= 0; j-- ) {
+						const GLfloat offset = p.position[j] - nodeMin[j];
+						const int cell = std::min( std::max( (int)(offset * toCell), 0 ), res - 1 );
+						key = key * res + cell;
+						if( offset >= half ) octant |= 1 << j;
+					}
+					if( kept.size() < options.maxNodePoints && taken.insert( key ).second ) {
+						kept.push_back( p );
+					} else {
+						parts[octant].push_back( p );
+					}
+				}
+				for( int o = 0; o < 8 && !failed; o++ ) {
+					if( parts[o].empty() ) continue;
+					if( children[o] == NULL && (children[o] = tmpfile()) == NULL ) {
+						cerr << "Error in PointCloudBuilder.build: unable to create a temporary file." << endl;
+						failed = true;
+						break;
+					}
+					if( fwrite( parts[o].data(), sizeof(Point), parts[o].size(), children[o] ) != parts[o].size() ) {
+						cerr << "Error in PointCloudBuilder.build: unable to write to a temporary file." << endl;
+						failed = true;
+					}
+					childCounts[o] += parts[o].size();
+					parts[o].clear();
+				}
+				if( failed ) break;
+			}
+			nodes[index].offset = written;
+			nodes[index].numPoints = (uint32_t)kept.size();
+			writePoints( kept.data(), kept.size() );
+		}
+
+		for( int o = 0; o < 8; o++ ) {
+			if( children[o] == NULL ) continue;
+			if( !failed ) {
+				rewind( children[o] );
+				const GLfloat childMin[] = {
+					nodeMin[0] + ((o & 1) ? 0.5f * size : 0.0f),
+					nodeMin[1] + ((o & 2) ? 0.5f * size : 0.0f),
+					nodeMin[2] + ((o & 4) ? 0.5f * size : 0.0f)
+				};
+				const int32_t child = buildNode( children[o], childCounts[o], childMin, 0.5f * size, depth + 1 );
+				nodes[index].children[o] = child;
+			}
+			fclose( children[o] );
+		}
+		return index;
+	}
+
+	inline bool PointCloudBuilder::build( const char * fileName ) {
+		if( count == 0 ) {
+			cerr << "Error in PointCloudBuilder.build: there are no points." << endl;
+			return false;
+		}
+		out = fopen( fileName, "wb" );
+		if( out == NULL ) {
+			cerr << "Error in PointCloudBuilder.build: unable to open file " << fileName << " for writing." << endl;
+			return false;
+		}
+		GLTW_TRACE_INTERNAL( "PointCloudBuilder::build" );
+
+		// The root is a cube, slightly larger than the bounds so the maximum falls inside
+		PointCloudHeader header;
+		memset( &header, 0, sizeof(header) );
+		memcpy( header.magic, GLTW_POINT_CLOUD_MAGIC, sizeof(header.magic) );
+		GLfloat size = std::max( std::max( max[0] - min[0], max[1] - min[1] ), max[2] - min[2] );
+		size = size > 0.0f ? size * 1.0001f : 1.0f;
+		header.numPoints = count;
+		for( int i = 0; i < 3; i++ ) header.min[i] = min[i];
+		header.size = size;
+		header.maxNodePoints = options.maxNodePoints;
+		header.gridResolution = (uint32_t)options.gridResolution;
+		failed = false;
+		dropped = 0;
+		if( fwrite( &header, sizeof(header), 1, out ) != 1 ) failed = true;
+		written = sizeof(header);
+
+		rewind( spill );
+		nodes.clear();
+		buildNode( spill, count, header.min, size, 0 );
+
+		header.numNodes = nodes.size();
+		header.tableOffset = written;
+		if( fwrite( nodes.data(), sizeof(PointCloudNode), nodes.size(), out ) != nodes.size() ) failed = true;
+		if( fseek( out, 0, SEEK_SET ) != 0 || fwrite( &header, sizeof(header), 1, out ) != 1 ) failed = true;
+		if( fclose( out ) != 0 ) failed = true;
+		out = NULL;
+		if( failed ) cerr << "Error in PointCloudBuilder.build: unable to write file " << fileName << "." << endl;
+		if( dropped > 0 ) {
+			cerr << "Warning: PointCloudBuilder dropped " << dropped << " points that did not fit in the nodes "
+				<< "at the deepest level of the octree." << endl;
+		}
+
+		fclose( spill );
+		spill = NULL;
+		count = 0;
+		for( int i = 0; i < 3; i++ ) {
+			min[i] = FLT_MAX;
+			max[i] = -FLT_MAX;
+		}
+		std::vector<PointCloudNode>().swap( nodes );
+		return !failed;
+	}
+
+	inline PointCloud::PointCloud( const char * fileName, size_t budget, size_t numSlots ) :
+		totalPoints(0), maxNodePoints(0), gridResolution(1), vaID(0), pointBudget(budget),
+		uploadBudget(500000), pointsUploaded(0), targetSpacing(2.0f), pointSize(2.0f)
+	{
+		if( !file.open( fileName ) ) {
+			cerr << "Error in PointCloud constructor:  unable to open file " << fileName << "." << endl;
+			return;
+		}
+		PointCloudHeader header;
+		bool valid = file.size() >= sizeof(header);
+		if( valid ) {
+			memcpy( &header, file.data(), sizeof(header) );
+			valid = memcmp( header.magic, GLTW_POINT_CLOUD_MAGIC, sizeof(header.magic) ) == 0 && header.numNodes > 0 &&
+				header.tableOffset <= file.size() &&
+				header.numNodes <= (file.size() - header.tableOffset) / sizeof(PointCloudNode);
+		}
+		if( valid ) {
+			nodes.resize( (size_t)header.numNodes );
+			memcpy( nodes.data(), file.data() + header.tableOffset, nodes.size() * sizeof(PointCloudNode) );
+			for( size_t i = 0; i < nodes.size() && valid; i++ ) {
+				valid = nodes[i].numPoints <= header.maxNodePoints &&
+					nodes[i].offset + (uint64_t)nodes[i].numPoints * 16 <= header.tableOffset;
+				// Children follow their parent, which also rules out cycles
+				for( int o = 0; o < 8 && valid; o++ ) {
+					const int32_t c = nodes[i].children[o];
+					valid = c == -1 || (c > (int64_t)i && (size_t)c < nodes.size());
+				}
+			}
+		}
+		if( !valid ) {
+			cerr << "Error in PointCloud constructor:  " << fileName << " is not a point cloud octree file." << endl;
+			nodes.clear();
+			file.close();
+			return;
+		}
+		totalPoints = (size_t)header.numPoints;
+		maxNodePoints = header.maxNodePoints;
+		gridResolution = (GLfloat)header.gridResolution;
+
+		if( numSlots == 0 ) numSlots = 2 * pointBudget / maxNodePoints + 16;
+		// Each vertex is a position (3 floats) and a color (4 bytes)
+		pool.start( nodes.size(), numSlots, 16 * (size_t)maxNodePoints, [this]( size_t index, std::vector<char> & points ) {
+			// Reading the mapping is what brings the node in from disk
+			const PointCloudNode & node = nodes[index];
+			const char * src = file.data() + node.offset;
+			points.assign( src, src + 16 * (size_t)node.numPoints );
+		} );
+
+		glGenVertexArrays( 1, &vaID );
+		glBindVertexArray( vaID );
+		glBindBuffer( GL_ARRAY_BUFFER, pool.buffer() );
+		glEnableVertexAttribArray( GLTW_ATTRIB_IDX_POSITION );
+		glVertexAttribPointer( GLTW_ATTRIB_IDX_POSITION, 3, GL_FLOAT, GL_FALSE, 16, 0 );
+		glEnableVertexAttribArray( GLTW_ATTRIB_IDX_COLOR );
+		glVertexAttribPointer( GLTW_ATTRIB_IDX_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, 16, (const GLvoid *)12 );
+		glBindVertexArray( 0 );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	}
+
+	inline PointCloud::~PointCloud() {
+		if( vaID != 0 ) glDeleteVertexArrays( 1, &vaID );
+	}
+
+	inline void PointCloud::select( const GLfloat * view, const GLfloat * projection, GLsizei viewportHeight ) {
+		GLfloat viewProjection[16];
+		multiplyMatrix4( projection, view, viewProjection );
+		// Pixels per unit of length at unit distance, or at any distance for an orthographic projection
+		const GLfloat pixelsPerUnit = 0.5f * projection[5] * viewportHeight;
+		const bool perspective = projection[11] != 0.0f;
+
+		selected.clear();
+		pool.beginFrame();
+		size_t points = 0;
+		std::priority_queue<std::pair<GLfloat, int32_t> > queue;
+		queue.push( std::make_pair( FLT_MAX, 0 ) );
+		while( !queue.empty() && selected.size() < pool.numSlots() ) {
+			const GLfloat screenSize = queue.top().first;
+			const int32_t index = queue.top().second;
+			queue.pop();
+			const PointCloudNode & node = nodes[index];
+			const GLfloat max[] = { node.min[0] + node.size, node.min[1] + node.size, node.min[2] + node.size };
+			if( !boxInFrustum( viewProjection, node.min, max ) ) continue;
+			if( points + node.numPoints > pointBudget ) break;
+			selected.push_back( index );
+			pool.select( index, node.numPoints );
+			points += node.numPoints;
+
+			// Refine while the node's points are spread wider on screen than the target
+			if( screenSize / gridResolution <= targetSpacing ) continue;
+			for( int o = 0; o < 8; o++ ) {
+				const int32_t c = node.children[o];
+				if( c < 0 ) continue;
+				const PointCloudNode & child = nodes[c];
+				GLfloat distance = 1.0f;
+				if( perspective ) {
+					GLfloat center[3], eye[3];
+					for( int i = 0; i < 3; i++ ) center[i] = child.min[i] + 0.5f * child.size;
+					for( int i = 0; i < 3; i++ ) {
+						eye[i] = view[i] * center[0] + view[4 + i] * center[1] + view[8 + i] * center[2] + view[12 + i];
+					}
+					const GLfloat radius = 0.866f * child.size;
+					distance = std::max( sqrtf( eye[0] * eye[0] + eye[1] * eye[1] + eye[2] * eye[2] ) - radius, 1e-6f );
+				}
+				queue.push( std::make_pair( child.size * pixelsPerUnit / distance, c ) );
+			}
+		}
+	}
+
+	inline void PointCloud::update( const GLfloat * view, const GLfloat * projection, GLsizei viewportHeight ) {
+		if( !isOpen() ) return;
+		GLTW_TRACE_INTERNAL( "PointCloud::update" );
+		select( view, projection, viewportHeight );
+		pointsUploaded = pool.update( uploadBudget );
+	}
+
+	inline size_t PointCloud::draw( const GLfloat * view, const GLfloat * projection, const GLfloat * color ) {
+		if( !isOpen() ) return 0;
+		std::vector<GLint> firsts;
+		std::vector<GLsizei> counts;
+		size_t points = 0;
+		for( size_t i = 0; i < selected.size(); i++ ) {
+			const int32_t index = selected[i];
+			if( !pool.isResident( index ) || nodes[index].numPoints == 0 ) continue;
+			firsts.push_back( (GLint)(maxNodePoints * pool.slotOf( index )) );
+			counts.push_back( (GLsizei)nodes[index].numPoints );
+			points += nodes[index].numPoints;
+		}
+		if( firsts.empty() ) return 0;
+
+		GLTW_TRACE_INTERNAL( "PointCloud::draw" );
+		useShaderVariant( shaderKey( FEATURE_POINTS | (color ? 0 : FEATURE_VERTEX_COLOR) ) );
+		setProjectionMatrix( const_cast<GLfloat *>(projection) );
+		setModelViewMatrix( const_cast<GLfloat *>(view) );
+		if( color ) setColor( const_cast<GLfloat *>(color) );
+		gltw::setPointSize( pointSize );
+		glBindVertexArray( vaID );
+		glMultiDrawArrays( GL_POINTS, firsts.data(), counts.data(), (GLsizei)firsts.size() );
+		glBindVertexArray( 0 );
+		GLTW_TRACE_COUNT( COUNTER_DRAWS, 1 );
+		GLTW_TRACE_COUNT( COUNTER_VERTICES, points );
+		return points;
+	}
+
+	inline PointCloudStats PointCloud::stats() const {
+		PointCloudStats stats;
+		stats.nodes = nodes.size();
+		stats.selected = selected.size();
+		stats.resident = pool.numResident();
+		stats.loading = stats.pointsSelected = stats.pointsDrawn = 0;
+		for( size_t i = 0; i < selected.size(); i++ ) {
+			const size_t n = nodes[selected[i]].numPoints;
+			stats.pointsSelected += n;
+			if( pool.isResident( selected[i] ) ) stats.pointsDrawn += n;
+			else stats.loading++;
+		}
+		stats.pointsUploaded = pointsUploaded;
+		return stats;
+	}
+}
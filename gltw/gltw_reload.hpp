@@ -0,0 +1,115 @@
+#ifndef __gltw_reload_hpp
+#define __gltw_reload_hpp
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace gltw {
+
+	class ShaderWatcher;
+
+	/**
+	 * A shader program created from a pair of files and kept up to date by a
+	 * ShaderWatcher.  The program ID may change whenever ShaderWatcher::update
+	 * is called, so query id() each frame rather than storing it.
+	 */
+	class WatchedProgram : public NonCopyable {
+	public:
+		/** @return the ID of the most recent successfully linked program (0 if none) */
+		GLuint id() const { return programID; }
+		/** @return the number of times this program has been replaced by a recompiled version */
+		int generation() const { return gen; }
+
+	private:
+		friend class ShaderWatcher;
+		WatchedProgram( const char * vertexFileName, const char * fragmentFileName );
+
+		string files[2];
+		// The most recent expansion of each file
+		SharedExpansion sources[2];
+		GLuint programID;
+		int gen;
+
+		// Sources expanded by the watcher thread, waiting to be compiled (guarded by the watcher's mutex)
+		SharedExpansion pending[2];
+		// A program that has been submitted for compilation and linking, but not yet checked
+		GLuint compilingID;
+		SharedExpansion compiling[2];
+	};
+
+	/**
+	 * Watches the files behind shader programs and recompiles them when they change.
+	 * The files are expanded with ::expandShaderSource, and a program is rebuilt
+	 * when the file or any file it includes changes.
+	 * A background thread waits for changes (using inotify on Linux, or by polling
+	 * the file modification times elsewhere) and loads the new source.  The new program
+	 * is compiled and linked during calls to update(), and replaces the old program only
+	 * if it links successfully, so a broken edit leaves the previous program in use.
+	 *
+	 * <p>Construct the watcher and call watchShaderPair() and update() with the OpenGL
+	 * context current.  Call update() once per frame, at the frame boundary.  When no
+	 * file has changed, update() does nothing but test a single flag.</p>
+	 *
+	 * <p><code>
+	 *    gltw::ShaderWatcher watcher;<br />
+	 *    const gltw::WatchedProgram *prog = watcher.watchShaderPair("shader.vert", "shader.frag");<br />
+	 *    <br />
+	 *    // Within the draw function<br />
+	 *    watcher.update();<br />
+	 *    glUseProgram( prog->id() );<br />
+	 * </code></p>
+	 */
+	class ShaderWatcher : public NonCopyable {
+	public:
+		/** Starts the background watcher thread. */
+		ShaderWatcher();
+		/** Stops the background thread and deletes all watched programs. */
+		~ShaderWatcher();
+
+		/**
+		 * Compile and link the vertex and fragment shaders contained in the files
+		 * with the provided file names, and watch the files for changes.
+		 * The returned object is owned by the ShaderWatcher.
+		 *
+		 * @param vertexFileName the name of the file containing the vertex shader code
+		 * @param fragmentFileName the name of the file containing the fragment shader code
+		 * @return the watched program, or NULL if the files could not be read.  If the
+		 *    initial compilation fails, the program is still watched but its id() is 0
+		 *    until the files are fixed.
+		 */
+		const WatchedProgram * watchShaderPair( const char * vertexFileName, const char * fragmentFileName );
+
+		/**
+		 * Swap in any recompiled programs.  Call once per frame at a frame boundary.
+		 * Compilation and linking of changed programs is submitted during one call
+		 * and its result is collected during a later call, so that a driver that
+		 * compiles in the background does not block the render thread.
+		 *
+		 * @return true if any program's ID changed during this call.
+		 */
+		bool update();
+
+	private:
+		void run();
+		void scan();
+		void submit( WatchedProgram * prog );
+		bool collect( WatchedProgram * prog );
+		void addWatch( const string & fileName );
+		void addWatches( const SharedExpansion & source );
+
+		std::vector<WatchedProgram *> programs;
+		std::mutex mutex;
+		std::atomic<bool> dirty;
+		std::atomic<bool> stopping;
+		std::thread worker;
+		bool parallelCompile;
+		bool parallelChecked;
+		int notifyFD;
+		std::vector<string> watchedDirs;
+	};
+}
+
+#include "gltw_reload.inl"
+
+#endif
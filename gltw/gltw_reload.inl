@@ -0,0 +1,251 @@
+#include <chrono>
+#include <cstring>
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace gltw {
+
+	inline WatchedProgram::WatchedProgram( const char * vertexFileName, const char * fragmentFileName ) :
+		programID(0), gen(0), compilingID(0)
+	{
+		files[0] = vertexFileName;
+		files[1] = fragmentFileName;
+	}
+
+	inline ShaderWatcher::ShaderWatcher() :
+		dirty(false), stopping(false), parallelCompile(false), parallelChecked(false), notifyFD(-1)
+	{
+#ifdef __linux__
+		notifyFD = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+		if( notifyFD < 0 ) {
+			cerr << "ShaderWatcher: inotify is unavailable, falling back to polling." << endl;
+		}
+#endif
+		worker = std::thread( &ShaderWatcher::run, this );
+	}
+
+	inline ShaderWatcher::~ShaderWatcher() {
+		stopping = true;
+		worker.join();
+#ifdef __linux__
+		if( notifyFD >= 0 ) close(notifyFD);
+#endif
+		for( size_t i = 0; i < programs.size(); i++ ) {
+			if( programs[i]->programID != 0 ) gltw::deleteProgram( programs[i]->programID );
+			if( programs[i]->compilingID != 0 ) gltw::deleteProgram( programs[i]->compilingID );
+			delete programs[i];
+		}
+	}
+
+	inline const WatchedProgram * ShaderWatcher::watchShaderPair( const char * vertexFileName, const char * fragmentFileName )
+	{
+		if( !parallelChecked ) {
+			GLint numExt = 0;
+			glGetIntegerv( GL_NUM_EXTENSIONS, &numExt );
+			for( GLint i = 0; i < numExt; i++ ) {
+				const char * ext = (const char *)glGetStringi( GL_EXTENSIONS, i );
+				if( strcmp( ext, "GL_KHR_parallel_shader_compile" ) == 0 ||
+					strcmp( ext, "GL_ARB_parallel_shader_compile" ) == 0 )
+					parallelCompile = true;
+			}
+			parallelChecked = true;
+		}
+
+		WatchedProgram * prog = new WatchedProgram( vertexFileName, fragmentFileName );
+		for( int i = 0; i < 2; i++ ) {
+			if( !(prog->sources[i] = expandShaderSource( prog->files[i].c_str() )) ) {
+				cerr << "ShaderWatcher: unable to read \"" << prog->files[i] << "\"" << endl;
+				delete prog;
+				return NULL;
+			}
+		}
+		prog->programID = compileShaderPair( prog->sources[0]->code.c_str(), prog->sources[1]->code.c_str(),
+			&prog->sources[0]->files, &prog->sources[1]->files );
+		if( prog->programID != 0 && !linkProgram( prog->programID ) ) {
+			gltw::deleteProgram( prog->programID );
+			prog->programID = 0;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		addWatches( prog->sources[0] );
+		addWatches( prog->sources[1] );
+		programs.push_back( prog );
+		return prog;
+	}
+
+	inline void ShaderWatcher::addWatches( const SharedExpansion & source )
+	{
+		for( size_t i = 0; i < source->files.size(); i++ )
+			addWatch( source->files[i] );
+	}
+
+	inline void ShaderWatcher::addWatch( const string & fileName )
+	{
+#ifdef __linux__
+		if( notifyFD < 0 ) return;
+		// Watch the directory rather than the file, so that editors that save
+		// by renaming a new file over the old one are still noticed.
+		size_t slash = fileName.find_last_of('/');
+		string dir = (slash == string::npos) ? string(".") : fileName.substr(0, slash + 1);
+		for( size_t i = 0; i < watchedDirs.size(); i++ )
+			if( watchedDirs[i] == dir ) return;
+		if( inotify_add_watch( notifyFD, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE ) < 0 ) {
+			cerr << "ShaderWatcher: unable to watch directory \"" << dir << "\"" << endl;
+			return;
+		}
+		watchedDirs.push_back( dir );
+#else
+		(void)fileName;
+#endif
+	}
+
+	inline void ShaderWatcher::run()
+	{
+		while( !stopping ) {
+#ifdef __linux__
+			if( notifyFD >= 0 ) {
+				struct pollfd pfd;
+				pfd.fd = notifyFD;
+				pfd.events = POLLIN;
+				pfd.revents = 0;
+				if( poll( &pfd, 1, 250 ) > 0 ) {
+					// Drain the events.  Which file changed is determined by scan().
+					char buf[4096];
+					while( read( notifyFD, buf, sizeof(buf) ) > 0 ) { }
+					scan();
+				}
+				continue;
+			}
+#endif
+			std::this_thread::sleep_for( std::chrono::milliseconds(250) );
+			scan();
+		}
+	}
+
+	inline void ShaderWatcher::scan()
+	{
+		// Expand the files without holding the mutex, so that update() never waits for
+		// file reads.  Programs are only ever added, and their file names never change,
+		// so a copy of the list is enough.
+		std::vector<WatchedProgram *> watched;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			watched = programs;
+		}
+		// The expansion cache returns the same expansion until the contents of
+		// one of the files actually change.  A missing file is usually an editor in
+		// the middle of saving, so just try again on the next event.
+		std::vector<SharedExpansion> expanded( 2 * watched.size() );
+		for( size_t i = 0; i < watched.size(); i++ ) {
+			expanded[2 * i] = expandShaderSource( watched[i]->files[0].c_str() );
+			expanded[2 * i + 1] = expandShaderSource( watched[i]->files[1].c_str() );
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for( size_t i = 0; i < watched.size(); i++ ) {
+			WatchedProgram * prog = watched[i];
+			const SharedExpansion & vert = expanded[2 * i], & frag = expanded[2 * i + 1];
+			if( !vert || !frag ) continue;
+			if( vert == prog->sources[0] && frag == prog->sources[1] ) continue;
+
+			prog->sources[0] = prog->pending[0] = vert;
+			prog->sources[1] = prog->pending[1] = frag;
+			// An edit may have added includes from other directories
+			addWatches( vert );
+			addWatches( frag );
+			dirty.store( true, std::memory_order_release );
+		}
+	}
+
+	inline void ShaderWatcher::submit( WatchedProgram * prog )
+	{
+		const char * code[2] = { prog->pending[0]->code.c_str(), prog->pending[1]->code.c_str() };
+		GLuint vert = glCreateShader(GL_VERTEX_SHADER);
+		GLuint frag = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(vert, 1, &code[0], NULL);
+		glShaderSource(frag, 1, &code[1], NULL);
+		glCompileShader(vert);
+		glCompileShader(frag);
+
+		// Don't query the compile status here, that would wait for the compiler
+		GLuint id = glCreateProgram();
+		glAttachShader(id, vert);
+		glAttachShader(id, frag);
+		glLinkProgram(id);
+
+		prog->compilingID = id;
+		prog->compiling[0] = prog->pending[0];
+		prog->compiling[1] = prog->pending[1];
+		prog->pending[0].reset();
+		prog->pending[1].reset();
+	}
+
+	inline bool ShaderWatcher::collect( WatchedProgram * prog )
+	{
+		GLuint id = prog->compilingID;
+		if( parallelCompile ) {
+			GLint done = GL_FALSE;
+			glGetProgramiv( id, GL_COMPLETION_STATUS_KHR, &done );
+			if( done == GL_FALSE ) return false;
+		}
+
+		prog->compilingID = 0;
+		SharedExpansion compiling[2] = { prog->compiling[0], prog->compiling[1] };
+		prog->compiling[0].reset();
+		prog->compiling[1].reset();
+		GLint status;
+		glGetProgramiv( id, GL_LINK_STATUS, &status );
+		if( status != GL_TRUE ) {
+			cerr << "ShaderWatcher: failed to rebuild (" << prog->files[0] << ", " << prog->files[1]
+				<< "), keeping the previous program." << endl;
+			GLuint shaders[2];
+			GLsizei count = 0;
+			glGetAttachedShaders( id, 2, &count, shaders );
+			bool compiled = true;
+			for( GLsizei i = 0; i < count; i++ ) {
+				GLint type;
+				glGetShaderiv( shaders[i], GL_SHADER_TYPE, &type );
+				const SharedExpansion &source = compiling[ type == GL_VERTEX_SHADER ? 0 : 1 ];
+				compiled = checkCompilationStatus( shaders[i], &source->files ) && compiled;
+			}
+			if( compiled ) checkLinkStatus( id );
+			gltw::deleteProgram( id );
+			return false;
+		}
+
+		if( prog->programID != 0 ) gltw::deleteProgram( prog->programID );
+		prog->programID = id;
+		prog->gen++;
+		return true;
+	}
+
+	inline bool ShaderWatcher::update()
+	{
+		if( !dirty.load( std::memory_order_acquire ) ) return false;
+		dirty.store( false, std::memory_order_relaxed );
+
+		bool changed = false, busy = false;
+		std::lock_guard<std::mutex> lock(mutex);
+		for( size_t i = 0; i < programs.size(); i++ ) {
+			WatchedProgram * prog = programs[i];
+			if( prog->compilingID != 0 ) {
+				// Without KHR_parallel_shader_compile we can't ask, so the result is collected a frame later
+				changed = collect( prog ) || changed;
+				if( prog->compilingID != 0 ) busy = true;
+			}
+			if( prog->compilingID == 0 && prog->pending[0] ) {
+				submit( prog );
+				busy = true;
+			}
+		}
+		if( busy ) dirty.store( true, std::memory_order_relaxed );
+		return changed;
+	}
+}
@@ -3,9 +3,14 @@
 
 #include <string>
 using std::string;
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace gltw {
-	/** The supported shaders */
+	/** The supported shaders.  Each is a particular variant of the stock shader,
+	 * see ::stockShaderKey and ::useShaderVariant for other combinations of features. */
 	enum Shader {
 		/** The Flat Shader.  This gives all polygons a flat color, specified by
 		  * the color defined by ::setColor.  It supports the ::ATTRIB_POSITION attribute 
@@ -57,31 +62,190 @@ namespace gltw {
 		/** The index of the color attribute */
 		GLTW_ATTRIB_IDX_COLOR,
 		/** The index of the normal attribute */
-		GLTW_ATTRIB_IDX_NORMAL
+		GLTW_ATTRIB_IDX_NORMAL,
+		/** The index of the texture coordinate attribute */
+		GLTW_ATTRIB_IDX_TEXCOORD
 	};
 
+	/**
+	 * The optional features of the stock shaders.  The stock shaders are variants of
+	 * a single shader, and each combination of features is compiled separately, so a
+	 * variant contains only the code for the features it uses.  See ::shaderKey.
+	 */
+	enum ShaderFeature {
+		/** Use the ::ATTRIB_COLOR attribute instead of the color set by ::setColor */
+		FEATURE_VERTEX_COLOR = 0x01,
+		/** Diffuse shading using the ::ATTRIB_NORMAL attribute.  Without point lights, the light
+		 * is located at the camera position. */
+		FEATURE_LIGHTING = 0x02,
+		/** Linear fog based on the distance from the camera, see ::setFog.  There is no fog until setFog is called. */
+		FEATURE_FOG = 0x04,
+		/** Round points of a fixed size in pixels (see ::setPointSize), for drawing GL_POINTS */
+		FEATURE_POINTS = 0x08,
+		/** Multiply the color by the texture bound to texture unit 0, sampled at the
+		 * ::ATTRIB_TEXCOORD attribute (see Texture::bind) */
+		FEATURE_TEXTURE = 0x10,
+		/** Multiply the color by a layer of the array texture bound to texture unit 0.  The
+		 * layer is encoded in the t coordinate of the ::ATTRIB_TEXCOORD attribute as
+		 * 2 * layer + t, as TextureAtlas::remapTexCoords writes it.  Implies ::FEATURE_TEXTURE. */
+		FEATURE_TEXTURE_ARRAY = 0x20
+	};
+
+	/** The maximum number of point lights supported by a shader variant */
+	const int GLTW_MAX_LIGHTS = 8;
+
+	/** Identifies a stock shader variant: a combination of ::ShaderFeature flags
+	 * and a number of point lights.  Build one with ::shaderKey. */
+	typedef unsigned int ShaderKey;
+
+	/**
+	 * Build the key of a stock shader variant.  This is a constant expression, so
+	 * keys may be used as compile-time constants.
+	 *
+	 * @param features any of the entries in the ::ShaderFeature enum, combined with
+	 *     a bitwise OR operator (|).
+	 * @param numPointLights the number of point lights (0 to ::GLTW_MAX_LIGHTS), positioned via
+	 *     ::setLightPosition.  Point lights imply ::FEATURE_LIGHTING.
+	 */
+	constexpr ShaderKey shaderKey( unsigned int features, unsigned int numPointLights = 0 ) {
+		return (features & 0xff) | (numPointLights > 0 ? (unsigned int)FEATURE_LIGHTING : 0u) |
+			((numPointLights > (unsigned int)GLTW_MAX_LIGHTS ? (unsigned int)GLTW_MAX_LIGHTS : numPointLights) << 8);
+	}
+
+	/** @return the ::ShaderFeature flags of a shader variant key */
+	constexpr unsigned int shaderKeyFeatures( ShaderKey key ) { return key & 0xff; }
+	/** @return the number of point lights of a shader variant key */
+	constexpr unsigned int shaderKeyLights( ShaderKey key ) { return (key >> 8) & 0xf; }
+
+	/**
+	 * The key of the variant that implements one of the stock shaders.
+	 *
+	 * @param shader the stock shader (not ::SHADER_NONE)
+	 */
+	constexpr ShaderKey stockShaderKey( Shader shader ) {
+		return shader == SHADER_PER_VERT_COLOR ? shaderKey( FEATURE_VERTEX_COLOR ) :
+			shader == SHADER_DEFAULT_LIGHT ? shaderKey( FEATURE_LIGHTING ) :
+			shader == SHADER_POINT_LIGHT ? shaderKey( FEATURE_LIGHTING, 1 ) :
+			shaderKey( 0 );
+	}
+
 	/** @internal */
 	class ShaderState {
 	private:
 		ShaderState();
 
 	public:
-		/** The IDs of the shader programs */
-		GLuint shaderIDs[ gltw::SHADER_NONE ];
-		/** The currently active shader */
-		Shader activeShader;
-		/** Source code for the shaders */
-		const char * source[gltw::SHADER_NONE][2];
-		/** Retrieves the singleton object. */
+		/** The IDs of the compiled shader variants, compiled on first use */
+		std::unordered_map<ShaderKey, GLuint> programs;
+		/** Whether or not a stock shader is active */
+		bool active;
+		/** The key of the active variant */
+		ShaderKey activeKey;
+		/** The ID of the active variant */
+		GLuint activeID;
+		/** The model-view and projection matrices of the active variant, from which mvp is computed */
+		GLfloat mv[16], proj[16];
+		/** The locations of the matrix uniforms in the active variant, or -1 where unused */
+		GLint mvLocation, mvpLocation, normMatrixLocation;
+		/** Source code template for the variants (vertex, fragment) */
+		const char * source[2];
+		/**
+		 * Retrieves the state of the calling thread.  Each thread has its own state, and
+		 * so its own stock shader programs, compiled in whatever context is current on that
+		 * thread.  This allows a second thread with a shared context (see MeshUploader)
+		 * to use GLTW alongside the rendering thread.
+		 */
 		static ShaderState& state();
 	};
 
+	/** Shader source code shared between the source cache and its users */
+	typedef std::shared_ptr<const string> SharedSource;
+
+	/** @internal
+	 * A cache of shader source files, keyed by path.  An entry is reused
+	 * as long as the modification time and size of the file are unchanged, so
+	 * repeated loads of the same file share a single buffer.
+	 */
+	class SourceCache {
+	private:
+		SourceCache() { }
+
+		struct Entry {
+			FileStamp stamp;
+			SharedSource source;
+		};
+		std::mutex mutex;
+		std::unordered_map<string, Entry> entries;
+
+	public:
+		/** Retrieves the singleton object. */
+		static SourceCache& cache();
+		/** Returns the contents of the file, or a null pointer if it cannot be read. */
+		SharedSource load( const char * fileName );
+		/** Discards all cached sources. */
+		void clear();
+	};
+
+	/**
+	 * Shader source code produced by ::expandShaderSource, with all <code>#include</code>
+	 * directives replaced by the contents of the included files.
+	 */
+	struct ExpandedSource {
+		/** The expanded source code */
+		string code;
+		/** The files that make up the expanded source.  The index of each file is the
+		 * source string number used in the <code>#line</code> directives, and therefore
+		 * in compiler error messages.  The first file is the one that was expanded. */
+		std::vector<string> files;
+	};
+
+	/** An expanded shader source shared between the expansion cache and its users */
+	typedef std::shared_ptr<const ExpandedSource> SharedExpansion;
+
+	/** @internal
+	 * A cache of expanded shader sources, keyed by the path of the root file.
+	 * Each entry remembers the content hash of every file it depends on, and is
+	 * reused until one of those files actually changes.
+	 */
+	class ExpansionCache {
+	private:
+		ExpansionCache() { }
+
+		struct Dependency {
+			string file;
+			SharedSource source;
+			unsigned long long hash;
+		};
+		struct Entry {
+			std::vector<Dependency> deps;
+			SharedExpansion expansion;
+		};
+		std::mutex mutex;
+		std::unordered_map<string, Entry> entries;
+
+		bool expandFile( const string & fileName, int &version, std::vector<string> &stack,
+			std::vector<string> &once, Entry &entry, ExpandedSource &out );
+
+	public:
+		/** Retrieves the singleton object. */
+		static ExpansionCache& cache();
+		/** Returns the expansion of the file, or a null pointer if it could not be expanded. */
+		SharedExpansion expand( const char * fileName );
+		/** Discards all cached expansions. */
+		void clear();
+	};
+
     /// @privatesection
-    bool compileAndLinkStockShader( gltw::Shader );
+    GLuint compileAndLinkShaderVariant( ShaderKey key );
 	bool getFileContents( const char * fileName, string &str /*out*/ );
-    bool checkCompilationStatus( GLuint );
+    bool checkCompilationStatus( GLuint, const std::vector<string> *files = NULL );
+	GLuint compileShaderPair( const char *vertex, const char *fragment,
+		const std::vector<string> *vertexFiles, const std::vector<string> *fragmentFiles );
+	unsigned long long hashSource( const string &str );
+	bool isPragmaOnce( const string &code, size_t pos, size_t end );
     bool checkLinkStatus( GLuint );
     void initUniforms();
+	void updateMatrixUniforms( bool modelViewChanged );
 	/// @publicsection
 
 	/**
@@ -170,7 +334,8 @@ namespace gltw {
 
 	/**
 	 * Compile and link the vertex and fragment shaders contained in the 
-	 * files with the provided file names.
+	 * files with the provided file names.  The files are expanded with
+	 * ::expandShaderSource, so they may use <code>#include</code>.
 	 *
 	 * @param vertexFileName the name of the file containing the vertex shader code
 	 * @param fragmentFileName the name of the file containing the fragment shader code
@@ -180,7 +345,8 @@ namespace gltw {
 
 	/**
 	 * Compile the vertex and fragment shaders contained in the
-	 * files with the provided file names.  The files are compiled and attached
+	 * files with the provided file names.  The files are expanded with
+	 * ::expandShaderSource, so they may use <code>#include</code>.  They are compiled and attached
 	 * to a shader program.  The ID of the shader program is returned (or 0 on error).
 	 * The program must be linked (using gltw::linkProgram or glLinkProgram) prior to use.
 	 *
@@ -190,6 +356,53 @@ namespace gltw {
 	 */
 	GLuint compileShaderPairFromFile( const char *vertexFileName, const char *fragmentFileName );
 
+	/**
+	 * Load the contents of a shader source file.  The file is read with a single
+	 * memory-mapped or bulk read, and kept in an in-process cache keyed by path, modification
+	 * time and size.  Loading an unchanged file again returns the same buffer without re-reading it.
+	 *
+	 * @param fileName the name of the file
+	 * @return the contents of the file, or a null pointer if the file could not be read.
+	 */
+	SharedSource loadShaderSource( const char * fileName );
+
+	/**
+	 * Discard all shader source files held by the cache used by ::loadShaderSource,
+	 * and all expansions held by the cache used by ::expandShaderSource.
+	 */
+	void clearShaderSourceCache();
+
+	/**
+	 * Load a shader source file and expand its <code>#include "file"</code> directives.
+	 * Included file names are relative to the directory of the including file.
+	 * A file containing <code>#pragma once</code> is included at most once, and
+	 * <code>#version</code> directives in included files are removed.  Traditional
+	 * <code>#ifndef</code> include guards are left to the GLSL preprocessor.
+	 *
+	 * <p><code>#line</code> directives are inserted so that compiler errors refer to the
+	 * line within the original file.  The source string number of each line is the
+	 * index of its file in ExpandedSource::files (see ::annotateShaderLog).</p>
+	 *
+	 * <p>The expansion is cached.  It is reused, and the same pointer returned, until the
+	 * contents of the file or one of the files it includes change.</p>
+	 *
+	 * @param fileName the name of the file to expand
+	 * @return the expanded source, or a null pointer if a file could not be read or
+	 *   the includes are recursive.  Errors are displayed to standard error.
+	 */
+	SharedExpansion expandShaderSource( const char * fileName );
+
+	/**
+	 * Replace the source string numbers in a shader compiler log with file names.
+	 * Handles the common <code>0:12(5):</code>, <code>ERROR: 0:12:</code> and
+	 * <code>0(12) :</code> formats.
+	 *
+	 * @param log the compiler info log
+	 * @param files the file name of each source string (see ExpandedSource::files)
+	 * @return the annotated log
+	 */
+	string annotateShaderLog( const string &log, const std::vector<string> &files );
+
 	/**
 	 * Compile and link (if necessary) the given shader and make it
 	 * the "active" shader.  If any compiler
@@ -198,10 +411,34 @@ namespace gltw {
 	 * @param shader the shader to compile/load
 	 */
     void useStockShader( gltw::Shader shader);
+
+	/**
+	 * Compile and link (if necessary) the given stock shader variant and make it
+	 * the "active" shader.  Each variant is compiled once, on first use.
+	 * If any compiler errors occur, they will be displayed to standard error.
+	 *
+	 * <p><code>
+	 *    const gltw::ShaderKey litFog = gltw::shaderKey( gltw::FEATURE_FOG, 2 );<br />
+	 *    gltw::useShaderVariant( litFog );<br />
+	 * </code></p>
+	 *
+	 * @param key the key of the variant, see ::shaderKey
+	 */
+	void useShaderVariant( ShaderKey key );
+
+	/**
+	 * Retrieve the ID of a stock shader variant, compiling and linking it if necessary.
+	 *
+	 * @param key the key of the variant, see ::shaderKey
+	 * @return the ID of the shader program, or 0 if it failed to compile or link.
+	 */
+	GLuint getShaderVariant( ShaderKey key );
     
 	/**
 	 * Set the model-view matrix for the currently active shader.
-	 * If no shader is active, this does nothing.
+	 * If no shader is active, this does nothing.  The stock shaders receive the
+	 * product of the projection and model-view matrices, and the normal matrix (see
+	 * ::normalMatrix), computed here rather than for every vertex.
 	 *
 	 * @param m a pointer to the matrix, an array of 16 GLfloat values organized
 	 *    in column-major order.
@@ -257,6 +494,39 @@ namespace gltw {
 	 * @param z the z coordinate of the position
 	 */
     void setLightPosition( GLfloat x, GLfloat y, GLfloat z );
+
+	/**
+	 * Set the position of one of the point lights (in eye coordinates) used by the currently
+	 * active shader.  If no shader is active, or the shader does not have that many point lights,
+	 * this function does nothing.
+	 *
+	 * @param light the index of the light
+	 * @param pos a pointer an array of 3 GLfloat values organized
+	 *    as {x, y, z}
+	 */
+	void setLightPosition( int light, GLfloat *pos );
+
+	/**
+	 * Set the fog parameters used by the currently active shader.  The fog is
+	 * linear in the distance from the camera.  If no shader is active, or the shader
+	 * does not use ::FEATURE_FOG, this function does nothing.  Until this is called for a
+	 * shader, its fog begins too far away to be seen.
+	 *
+	 * @param color a pointer an array of 4 GLfloat values organized
+	 *    as {r, g, b, a}
+	 * @param start the distance at which the fog begins
+	 * @param end the distance at which the fog is fully opaque
+	 */
+	void setFog( GLfloat *color, GLfloat start, GLfloat end );
+
+	/**
+	 * Set the diameter of points, in pixels, drawn by the currently active shader.
+	 * If no shader is active, or the shader does not use ::FEATURE_POINTS,
+	 * this function does nothing.
+	 *
+	 * @param size the diameter of the points
+	 */
+	void setPointSize( GLfloat size );
 }
 
 #include "gltw_shader.inl"
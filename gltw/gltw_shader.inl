@@ -1,140 +1,187 @@
 
-#include <fstream>
-using std::ifstream;
-using std::ios;
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <regex>
 #include <sstream>
+using std::istringstream;
 using std::ostringstream;
 
 namespace gltw {
-	inline ShaderState::ShaderState() { 
-		for( int i = 0; i < SHADER_NONE; i++ ) shaderIDs[i] = 0; 
-			
-        source[SHADER_FLAT][0] = 
-			"#version 150 \n"
-			"in vec4 vPosition;"
-			"uniform mat4 mv;"
-			"uniform mat4 proj;"
-			"void main() {"
-			"  gl_Position = proj * mv * vPosition;"
-			"}";
-		source[SHADER_FLAT][1] = 
-			"#version 150 \n"
-			"uniform vec4 color;"
-			"out vec4 FragColor;"
-			"void main() {"
-			"   FragColor = color;"
-			"}";
-		source[SHADER_PER_VERT_COLOR][0] = 
-		    "#version 150 \n"
-			"in vec4 vPosition;"
-			"in vec4 vColor;"
-			"out vec4 color;"
-			"uniform mat4 mv;"
-			"uniform mat4 proj;"
-			"void main() {"
-			"  color = vColor;"
-			"  gl_Position = proj * mv * vPosition;"
-			"}";
-		source[SHADER_PER_VERT_COLOR][1] = 
-		    "#version 150 \n"
-			"in vec4 color;"
-			"out vec4 FragColor;"
-			"void main() {"
-			"  FragColor = color;"
-			"}";
-		source[SHADER_DEFAULT_LIGHT][0] = 
-			"#version 150 \n"
-			"in vec3 vPosition;"
-			"in vec3 vNormal;"
-			"uniform mat4 mv;"
-			"uniform mat4 proj;"
-			"uniform vec4 color = vec4(0.9,0.9,0.9,1.0);"
-			"out vec4 fColor;"
-			"void main() {"
-			"   mat3 normMatrix = mat3(mv[0].xyz, mv[1].xyz, mv[2].xyz);"
-			"   vec3 n = normalize( normMatrix * vNormal );"
-			"   vec3 light = vec3(0.0,0.0,1.0);"
-			"   fColor = vec4( color.rgb * max(0.0, dot(n,light)), color.a );"
-			"   gl_Position = proj * mv * vec4(vPosition,1.0);"
-			"}";
-		source[SHADER_DEFAULT_LIGHT][1] = 
-			"#version 150 \n"
-			"in vec4 fColor;"
-			"out vec4 FragColor;"
-			"void main() {"
-			"   FragColor = fColor;"
-			"}";
-		source[SHADER_POINT_LIGHT][0] = 
-			"#version 150 \n"
-			"in vec3 vPosition;"
-			"in vec3 vNormal;"
-			"uniform mat4 mv;"
-			"uniform mat4 proj;"
-			"uniform vec4 color = vec4(0.9,0.9,0.9,1.0);"
-			"uniform vec3 lightPos = vec3(0.0);"
-			"out vec4 fColor;"
-			"void main() {"
-			"   mat3 normMatrix = mat3(mv[0].xyz, mv[1].xyz, mv[2].xyz);"
-			"   vec3 n = normalize( normMatrix * vNormal );"
-			"   vec4 ecPos = mv * vec4(vPosition,1.0);"
-			"   vec3 light = normalize( lightPos - ecPos.xyz );"
-			"   fColor = vec4( color.rgb * max(0.0, dot(n,light)), color.a );"
-			"   gl_Position = proj * mv * vec4(vPosition,1.0);"
-			"}";
-		source[SHADER_POINT_LIGHT][1] = 
-			"#version 150 \n"
-			"in vec4 fColor;"
-			"out vec4 FragColor;"
-			"void main() {"
-			"   FragColor = fColor;"
-			"}";
-		
-		activeShader = SHADER_NONE;
+	inline ShaderState::ShaderState() : active(false), activeKey(0), activeID(0),
+		mvLocation(-1), mvpLocation(-1), normMatrixLocation(-1) {
+		// The variants are produced by defining GLTW_VERTEX_COLOR, GLTW_LIGHTING, GLTW_FOG,
+		// GLTW_POINTS, GLTW_TEXTURE, GLTW_TEXTURE_ARRAY and GLTW_NUM_LIGHTS ahead of these templates, see
+		// compileAndLinkShaderVariant.
+		source[0] =
+			"in vec4 vPosition;\n"
+			"#ifdef GLTW_VERTEX_COLOR\n"
+			"in vec4 vColor;\n"
+			"#else\n"
+			"uniform vec4 color = vec4(0.9,0.9,0.9,1.0);\n"
+			"#endif\n"
+			"#ifdef GLTW_LIGHTING\n"
+			"in vec3 vNormal;\n"
+			"#if GLTW_NUM_LIGHTS > 0\n"
+			"uniform vec3 lightPos[GLTW_NUM_LIGHTS];\n"
+			"#endif\n"
+			"#endif\n"
+			"#ifdef GLTW_FOG\n"
+			"out float fogDist;\n"
+			"#endif\n"
+			"#ifdef GLTW_POINTS\n"
+			"uniform float pointSize = 4.0;\n"
+			"#endif\n"
+			"#ifdef GLTW_TEXTURE\n"
+			"in vec2 vTexCoord;\n"
+			"out vec2 fTexCoord;\n"
+			"#ifdef GLTW_TEXTURE_ARRAY\n"
+			"flat out float fLayer;\n"
+			"#endif\n"
+			"#endif\n"
+			// mvp and normMatrix are computed on the CPU, see updateMatrixUniforms
+			"#if defined(GLTW_FOG) || (defined(GLTW_LIGHTING) && GLTW_NUM_LIGHTS > 0)\n"
+			"#define GLTW_EYE_POSITION\n"
+			"uniform mat4 mv;\n"
+			"#endif\n"
+			"#ifdef GLTW_LIGHTING\n"
+			"uniform mat3 normMatrix;\n"
+			"#endif\n"
+			"uniform mat4 mvp;\n"
+			"out vec4 fColor;\n"
+			"void main() {\n"
+			"#ifdef GLTW_EYE_POSITION\n"
+			"   vec4 ecPos = mv * vPosition;\n"
+			"#endif\n"
+			"#ifdef GLTW_VERTEX_COLOR\n"
+			"   vec4 base = vColor;\n"
+			"#else\n"
+			"   vec4 base = color;\n"
+			"#endif\n"
+			"#ifdef GLTW_LIGHTING\n"
+			"   vec3 n = normalize( normMatrix * vNormal );\n"
+			"   float diffuse = 0.0;\n"
+			"#if GLTW_NUM_LIGHTS > 0\n"
+			"   for( int i = 0; i < GLTW_NUM_LIGHTS; i++ )\n"
+			"      diffuse += max(0.0, dot(n, normalize( lightPos[i] - ecPos.xyz )));\n"
+			"#else\n"
+			"   diffuse = max(0.0, dot(n, vec3(0.0,0.0,1.0)));\n"
+			"#endif\n"
+			"   fColor = vec4( base.rgb * diffuse, base.a );\n"
+			"#else\n"
+			"   fColor = base;\n"
+			"#endif\n"
+			"#ifdef GLTW_FOG\n"
+			"   fogDist = length( ecPos.xyz );\n"
+			"#endif\n"
+			"#ifdef GLTW_POINTS\n"
+			"   gl_PointSize = pointSize;\n"
+			"#endif\n"
+			"#ifdef GLTW_TEXTURE_ARRAY\n"
+			"   fLayer = floor( 0.5 * vTexCoord.t );\n"
+			"   fTexCoord = vec2( vTexCoord.s, vTexCoord.t - 2.0 * fLayer );\n"
+			"#elif defined(GLTW_TEXTURE)\n"
+			"   fTexCoord = vTexCoord;\n"
+			"#endif\n"
+			"   gl_Position = mvp * vPosition;\n"
+			"}\n";
+		source[1] =
+			"in vec4 fColor;\n"
+			"#ifdef GLTW_TEXTURE_ARRAY\n"
+			"in vec2 fTexCoord;\n"
+			"flat in float fLayer;\n"
+			"uniform sampler2DArray tex;\n"
+			"#elif defined(GLTW_TEXTURE)\n"
+			"in vec2 fTexCoord;\n"
+			"uniform sampler2D tex;\n"
+			"#endif\n"
+			"#ifdef GLTW_FOG\n"
+			"in float fogDist;\n"
+			"uniform vec4 fogColor = vec4(0.0);\n"
+			// The fog begins beyond any scene until setFog is called
+			"uniform vec2 fogRange = vec2(1.0e30, 2.0e30);\n"
+			"#endif\n"
+			"out vec4 FragColor;\n"
+			"void main() {\n"
+			"#ifdef GLTW_POINTS\n"
+			"   if( length( gl_PointCoord - vec2(0.5) ) > 0.5 ) discard;\n"
+			"#endif\n"
+			"   vec4 c = fColor;\n"
+			"#ifdef GLTW_TEXTURE_ARRAY\n"
+			"   c *= texture( tex, vec3( fTexCoord, fLayer ) );\n"
+			"#elif defined(GLTW_TEXTURE)\n"
+			"   c *= texture( tex, fTexCoord );\n"
+			"#endif\n"
+			"#ifdef GLTW_FOG\n"
+			"   float f = clamp( (fogRange.y - fogDist) / (fogRange.y - fogRange.x), 0.0, 1.0 );\n"
+			"   FragColor = mix( fogColor, c, f );\n"
+			"#else\n"
+			"   FragColor = c;\n"
+			"#endif\n"
+			"}\n";
 	}
 
 	inline ShaderState& ShaderState::state() {
-		static ShaderState *state = new ShaderState();
-		return *state;
+		static thread_local ShaderState state;
+		return state;
 	}
 
 	inline void useStockShader( gltw::Shader shader )
     {
-		GLuint &shaderID = ShaderState::state().shaderIDs[ shader ];
-        
-        if( shaderID == 0 && shader != SHADER_NONE )
-        {
-            if( ! compileAndLinkStockShader( shader ) )
-                exit(1);
-        }
-        
-        ShaderState::state().activeShader = shader;
         if( shader == SHADER_NONE ) {
+            ShaderState::state().active = false;
             glUseProgram(0);
+            GLTW_TRACE_COUNT( COUNTER_PROGRAM_SWITCHES, 1 );
         } else {
-            glUseProgram(shaderID);
-            initUniforms();
+            useShaderVariant( stockShaderKey(shader) );
         }
     }
+
+	inline void useShaderVariant( ShaderKey key )
+	{
+		ShaderState &state = ShaderState::state();
+		GLuint shaderID = getShaderVariant( key );
+		if( shaderID == 0 )
+			exit(1);
+
+		state.active = true;
+		state.activeKey = key;
+		state.activeID = shaderID;
+		glUseProgram(shaderID);
+		GLTW_TRACE_COUNT( COUNTER_PROGRAM_SWITCHES, 1 );
+		// The point size is written by the shader
+		if( shaderKeyFeatures(key) & FEATURE_POINTS ) glEnable( GL_PROGRAM_POINT_SIZE );
+		initUniforms();
+	}
+
+	inline GLuint getShaderVariant( ShaderKey key )
+	{
+		std::unordered_map<ShaderKey, GLuint> &programs = ShaderState::state().programs;
+		std::unordered_map<ShaderKey, GLuint>::iterator it = programs.find( key );
+		if( it != programs.end() ) return it->second;
+
+		GLuint shaderID = compileAndLinkShaderVariant( key );
+		if( shaderID != 0 ) programs[key] = shaderID;
+		return shaderID;
+	}
     
     inline void initUniforms() {
-		gltw::Shader &activeShader = ShaderState::state().activeShader;
+		ShaderState &state = ShaderState::state();
 
-        if( activeShader != SHADER_NONE )
-        {
-            GLuint id = ShaderState::state().shaderIDs[ activeShader ];
-            GLfloat identity[] = {1.0f, 0.0f, 0.0f, 0.0f,
-                                  0.0f, 1.0f, 0.0f, 0.0f,
-                                  0.0f, 0.0f, 1.0f, 0.0f,
-                                  0.0f, 0.0f, 0.0f, 1.0f };
-            setUniformMatrix4( id, "mv", identity );
-            setUniformMatrix4( id, "proj", identity );
-        }
-        
-        if( activeShader == SHADER_FLAT )
+        if( state.active )
         {
-            GLuint id = ShaderState::state().shaderIDs[ activeShader ];
-            GLfloat white[] = {1.0f, 1.0f, 1.0f, 1.0f};
-            setUniform4fv( id, "color", white );
+            for( int i = 0; i < 16; i++ ) state.mv[i] = state.proj[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+            state.mvLocation = glGetUniformLocation( state.activeID, "mv" );
+            state.mvpLocation = glGetUniformLocation( state.activeID, "mvp" );
+            state.normMatrixLocation = glGetUniformLocation( state.activeID, "normMatrix" );
+            updateMatrixUniforms( true );
+
+            // Unlit variants default to white, lit variants keep the default in the shader
+            if( (shaderKeyFeatures(state.activeKey) & (FEATURE_VERTEX_COLOR | FEATURE_LIGHTING)) == 0 )
+            {
+                GLfloat white[] = {1.0f, 1.0f, 1.0f, 1.0f};
+                setUniform4fv( state.activeID, "color", white );
+            }
         }
     }
     
@@ -203,39 +250,55 @@ namespace gltw {
 		delete [] shaderNames;
 	}
     
-    inline bool compileAndLinkStockShader( gltw::Shader shader )
+    inline GLuint compileAndLinkShaderVariant( ShaderKey key )
     {
-		GLuint &shaderID = ShaderState::state().shaderIDs[ shader ];
-        if( shaderID == 0 ) 
-        {
-			shaderID = compileShaderPair(ShaderState::state().source[shader][0],
-				ShaderState::state().source[shader][1]);
-
-			if( shaderID != 0 )
-			{
-				// Set up attribute locations
-				glBindAttribLocation( shaderID, GLTW_ATTRIB_IDX_POSITION, "vPosition" );
-				if( shader == SHADER_PER_VERT_COLOR )
-				{
-					glBindAttribLocation(shaderID, GLTW_ATTRIB_IDX_COLOR, "vColor" );
-				}
-				if( shader == SHADER_DEFAULT_LIGHT || shader == SHADER_POINT_LIGHT ) {
-					glBindAttribLocation(shaderID, GLTW_ATTRIB_IDX_NORMAL, "vNormal" );
-				}
-				// Link shader
-				if( ! linkProgram( shaderID ) ) {
-					gltw::deleteProgram(shaderID);
-					shaderID = 0;
-					return false;
-				}
+		unsigned int features = shaderKeyFeatures( key );
+
+		ostringstream defines;
+		defines << "#version 150\n";
+		if( features & FEATURE_VERTEX_COLOR ) defines << "#define GLTW_VERTEX_COLOR\n";
+		if( features & FEATURE_LIGHTING ) defines << "#define GLTW_LIGHTING\n";
+		if( features & FEATURE_FOG ) defines << "#define GLTW_FOG\n";
+		if( features & FEATURE_POINTS ) defines << "#define GLTW_POINTS\n";
+		if( features & (FEATURE_TEXTURE | FEATURE_TEXTURE_ARRAY) ) defines << "#define GLTW_TEXTURE\n";
+		if( features & FEATURE_TEXTURE_ARRAY ) defines << "#define GLTW_TEXTURE_ARRAY\n";
+		defines << "#define GLTW_NUM_LIGHTS " << shaderKeyLights( key ) << "\n";
+		string vert = defines.str() + ShaderState::state().source[0];
+		string frag = defines.str() + ShaderState::state().source[1];
+
+		GLuint shaderID = compileShaderPair( vert.c_str(), frag.c_str() );
+		if( shaderID != 0 )
+		{
+			// Set up attribute locations
+			glBindAttribLocation( shaderID, GLTW_ATTRIB_IDX_POSITION, "vPosition" );
+			if( features & FEATURE_VERTEX_COLOR ) {
+				glBindAttribLocation(shaderID, GLTW_ATTRIB_IDX_COLOR, "vColor" );
 			}
-        }
+			if( features & FEATURE_LIGHTING ) {
+				glBindAttribLocation(shaderID, GLTW_ATTRIB_IDX_NORMAL, "vNormal" );
+			}
+			if( features & (FEATURE_TEXTURE | FEATURE_TEXTURE_ARRAY) ) {
+				glBindAttribLocation(shaderID, GLTW_ATTRIB_IDX_TEXCOORD, "vTexCoord" );
+			}
+			// Link shader
+			if( ! linkProgram( shaderID ) ) {
+				gltw::deleteProgram(shaderID);
+				shaderID = 0;
+			}
+		}
 
-        return true;
+        return shaderID;
     }
 
     inline GLuint compileShaderPair( const char * vertex, const char * fragment )
     {
+		return compileShaderPair( vertex, fragment, NULL, NULL );
+	}
+
+    inline GLuint compileShaderPair( const char * vertex, const char * fragment,
+		const std::vector<string> *vertexFiles, const std::vector<string> *fragmentFiles )
+    {
+		GLTW_TRACE_INTERNAL( "compileShaderPair" );
 		GLuint programID = 0;
 
 		// Create the shader objects
@@ -248,13 +311,13 @@ namespace gltw {
             
         // Compile
         glCompileShader(vert);
-        if( ! checkCompilationStatus(vert) ) {
+        if( ! checkCompilationStatus(vert, vertexFiles) ) {
             glDeleteShader(vert);
             glDeleteShader(frag);
             return 0;
         }
         glCompileShader(frag);
-        if( ! checkCompilationStatus(frag) ) {
+        if( ! checkCompilationStatus(frag, fragmentFiles) ) {
             glDeleteShader(vert);
             glDeleteShader(frag);
             return 0;
@@ -284,43 +347,282 @@ namespace gltw {
 
 	inline GLuint compileAndLinkShaderPairFromFile( const char *vertexFileName, const char *fragmentFileName )
 	{
-		 string vShaderCode, fShaderCode;
-		 if( !getFileContents( vertexFileName, vShaderCode) ) return 0;
-		 if( !getFileContents( fragmentFileName, fShaderCode) ) return 0;
+		GLuint programID = compileShaderPairFromFile( vertexFileName, fragmentFileName );
 
-		 return compileAndLinkShaderPair(vShaderCode.c_str(), fShaderCode.c_str());
+		if( programID == 0 ) return 0;
+
+        if( ! linkProgram(programID ) ) {
+        	gltw::deleteProgram(programID);
+            programID = 0;
+        }
+
+		return programID;
 	}
 
 	inline GLuint compileShaderPairFromFile( const char *vertexFileName, const char *fragmentFileName )
 	{
-		string vShaderCode, fShaderCode;
-		if( !getFileContents( vertexFileName, vShaderCode) ) return 0;
-		if( !getFileContents( fragmentFileName, fShaderCode) ) return 0;
+		SharedExpansion vShader = expandShaderSource( vertexFileName );
+		if( !vShader ) return 0;
+		SharedExpansion fShader = expandShaderSource( fragmentFileName );
+		if( !fShader ) return 0;
 
-		return compileShaderPair(vShaderCode.c_str(), fShaderCode.c_str());
+		return compileShaderPair(vShader->code.c_str(), fShader->code.c_str(), &vShader->files, &fShader->files);
 	}
 
 	inline bool getFileContents( const char * fileName, string &str /*out*/ )
 	{
-		ifstream inFile( fileName, ios::in );
-		if( !inFile ) return false;
-		ostringstream code;
-		while( inFile.good() ) {
-			int c = inFile.get();
-			if( !inFile.eof() ) code << (char)c;
+		SharedSource code = loadShaderSource( fileName );
+		if( !code ) return false;
+		str = *code;
+		return true;
+	}
+
+	inline SourceCache& SourceCache::cache() {
+		static SourceCache *cache = new SourceCache();
+		return *cache;
+	}
+
+	inline SharedSource SourceCache::load( const char * fileName )
+	{
+		FileStamp stamp;
+		if( !getFileStamp( fileName, stamp ) ) return SharedSource();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		Entry &entry = entries[fileName];
+		if( entry.source && entry.stamp == stamp ) return entry.source;
+
+		MappedFile file( fileName );
+		if( !file.isOpen() ) {
+			entries.erase(fileName);
+			return SharedSource();
 		}
-		inFile.close();
-		str = code.str();
+		entry.source = std::make_shared<const string>( file.data(), file.size() );
+		// Use the size actually read, in case the file changed since it was stamped
+		entry.stamp = stamp;
+		entry.stamp.size = (long long)file.size();
+		return entry.source;
+	}
+
+	inline void SourceCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.clear();
+	}
+
+	inline SharedSource loadShaderSource( const char * fileName )
+	{
+		return SourceCache::cache().load( fileName );
+	}
+
+	inline void clearShaderSourceCache()
+	{
+		ExpansionCache::cache().clear();
+		SourceCache::cache().clear();
+	}
+
+	inline unsigned long long hashSource( const string &str )
+	{
+		// 64-bit FNV-1a
+		unsigned long long h = 14695981039346656037ULL;
+		for( size_t i = 0; i < str.size(); i++ ) {
+			h ^= (unsigned char)str[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	inline ExpansionCache& ExpansionCache::cache() {
+		static ExpansionCache *cache = new ExpansionCache();
+		return *cache;
+	}
+
+	inline SharedExpansion ExpansionCache::expand( const char * fileName )
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Entry &entry = entries[fileName];
+
+		if( entry.expansion ) {
+			// Reuse the expansion unless the contents of a dependency changed.  The source
+			// cache returns the same buffer for an untouched file, so hashing is only needed
+			// for files that were rewritten.
+			bool changed = false;
+			for( size_t i = 0; i < entry.deps.size() && !changed; i++ ) {
+				Dependency &dep = entry.deps[i];
+				SharedSource src = loadShaderSource( dep.file.c_str() );
+				if( !src || (src != dep.source && hashSource(*src) != dep.hash) ) changed = true;
+				else dep.source = src;
+			}
+			if( !changed ) return entry.expansion;
+		}
+
+		Entry fresh;
+		std::shared_ptr<ExpandedSource> result = std::make_shared<ExpandedSource>();
+		std::vector<string> stack, once;
+		int version = 110;
+		if( !expandFile( fileName, version, stack, once, fresh, *result ) ) {
+			entries.erase(fileName);
+			return SharedExpansion();
+		}
+		fresh.expansion = result;
+		entry = fresh;
+		return entry.expansion;
+	}
+
+	inline bool ExpansionCache::expandFile( const string & fileName, int &version, std::vector<string> &stack,
+		std::vector<string> &once, Entry &entry, ExpandedSource &out )
+	{
+		SharedSource src = loadShaderSource( fileName.c_str() );
+		if( !src ) {
+			cerr << "Unable to read shader source \"" << fileName << "\"" << endl;
+			return false;
+		}
+
+		bool known = false;
+		for( size_t i = 0; i < entry.deps.size(); i++ )
+			if( entry.deps[i].file == fileName ) known = true;
+		if( !known ) {
+			Dependency dep = { fileName, src, hashSource(*src) };
+			entry.deps.push_back(dep);
+		}
+
+		size_t index = 0;
+		while( index < out.files.size() && out.files[index] != fileName ) index++;
+		if( index == out.files.size() ) out.files.push_back(fileName);
+
+		bool root = stack.empty();
+		stack.push_back(fileName);
+
+		// Before GLSL 3.30, #line sets the number of the line following the directive to line + 1
+		int lineBase = (version >= 330) ? 0 : -1;
+		if( !root ) {
+			ostringstream lineDirective;
+			lineDirective << "#line " << (1 + lineBase) << " " << index << "\n";
+			out.code += lineDirective.str();
+		}
+
+		size_t slash = fileName.find_last_of("/\\");
+		string dir = (slash == string::npos) ? string() : fileName.substr(0, slash + 1);
+
+		const string &code = *src;
+		size_t pos = 0;
+		int lineNo = 1;
+		while( pos < code.size() ) {
+			size_t end = code.find('\n', pos);
+			if( end == string::npos ) end = code.size();
+
+			// Look for a directive
+			size_t p = code.find_first_not_of(" \t", pos);
+			string directive;
+			if( p < end && code[p] == '#' ) {
+				p = code.find_first_not_of(" \t", p + 1);
+				size_t wordEnd = p;
+				while( wordEnd < end && isalpha((unsigned char)code[wordEnd]) ) wordEnd++;
+				if( p < end ) directive = code.substr(p, wordEnd - p);
+				p = wordEnd;
+			}
+
+			if( directive == "include" ) {
+				size_t open = code.find_first_of("\"<", p);
+				size_t close = (open < end) ? code.find_first_of("\">", open + 1) : string::npos;
+				if( open >= end || close >= end ) {
+					cerr << fileName << ":" << lineNo << ": malformed #include" << endl;
+					stack.pop_back();
+					return false;
+				}
+				string name = code.substr(open + 1, close - open - 1);
+				string path = (name[0] == '/' || dir.empty()) ? name : dir + name;
+
+				bool skip = false;
+				for( size_t i = 0; i < once.size(); i++ ) if( once[i] == path ) skip = true;
+				for( size_t i = 0; i < stack.size(); i++ ) {
+					if( stack[i] == path && !skip ) {
+						cerr << fileName << ":" << lineNo << ": recursive #include of \"" << path << "\"" << endl;
+						stack.pop_back();
+						return false;
+					}
+				}
+
+				if( skip ) {
+					out.code += "\n";
+				} else {
+					if( !expandFile( path, version, stack, once, entry, out ) ) {
+						cerr << "  included from " << fileName << ":" << lineNo << endl;
+						stack.pop_back();
+						return false;
+					}
+					if( !out.code.empty() && out.code[out.code.size() - 1] != '\n' ) out.code += "\n";
+					ostringstream lineDirective;
+					lineDirective << "#line " << (lineNo + 1 + lineBase) << " " << index << "\n";
+					out.code += lineDirective.str();
+				}
+			} else if( directive == "pragma" && isPragmaOnce( code, p, end ) ) {
+				once.push_back(fileName);
+				out.code += "\n";
+			} else if( directive == "version" && !root ) {
+				out.code += "\n";
+			} else {
+				if( directive == "version" ) {
+					version = atoi( code.c_str() + p );
+					lineBase = (version >= 330) ? 0 : -1;
+				}
+				out.code.append( code, pos, end - pos );
+				out.code += "\n";
+			}
+
+			pos = end + 1;
+			lineNo++;
+		}
+
+		stack.pop_back();
 		return true;
 	}
 
+	inline void ExpansionCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.clear();
+	}
+
+	inline bool isPragmaOnce( const string &code, size_t pos, size_t end )
+	{
+		pos = code.find_first_not_of(" \t", pos);
+		return pos < end && end - pos >= 4 && code.compare(pos, 4, "once") == 0;
+	}
+
+	inline SharedExpansion expandShaderSource( const char * fileName )
+	{
+		return ExpansionCache::cache().expand( fileName );
+	}
+
+	inline string annotateShaderLog( const string &log, const std::vector<string> &files )
+	{
+		// Matches "0:12(5): ...", "ERROR: 0:12: ..." and "0(12) : ..."
+		static const std::regex location( "^((?:ERROR|WARNING): )?(\\d+)([:(]\\d+)" );
+		istringstream in( log );
+		ostringstream out;
+		string line;
+		while( std::getline( in, line ) ) {
+			std::smatch m;
+			if( std::regex_search( line, m, location ) ) {
+				size_t idx = (size_t)atol( m[2].str().c_str() );
+				if( idx < files.size() ) {
+					out << m[1] << files[idx] << m[3] << m.suffix() << "\n";
+					continue;
+				}
+			}
+			out << line << "\n";
+		}
+		return out.str();
+	}
+
 	inline bool linkProgram( GLuint id ) 
 	{
+		GLTW_TRACE_INTERNAL( "linkProgram" );
 		glLinkProgram( id );
         return checkLinkStatus(id);
 	}
     
-    inline bool checkCompilationStatus( GLuint shaderID )
+    inline bool checkCompilationStatus( GLuint shaderID, const std::vector<string> *files )
     {
         GLint status, logLen;
         GLchar *log;
@@ -332,7 +634,10 @@ namespace gltw {
         glGetShaderInfoLog(shaderID, logLen, NULL, log);
         
         cerr << "Failed to compile shader" << endl;
-        cerr << log << endl;
+        if( files != NULL )
+            cerr << annotateShaderLog( log, *files ) << endl;
+        else
+            cerr << log << endl;
         
         delete [] log;
         return false;
@@ -356,52 +661,92 @@ namespace gltw {
         return false;
     }
     
+    inline void updateMatrixUniforms( bool modelViewChanged )
+    {
+        ShaderState &state = ShaderState::state();
+        GLfloat mvp[16];
+        multiplyMatrix4( state.proj, state.mv, mvp );
+        glUniformMatrix4fv( state.mvpLocation, 1, GL_FALSE, mvp );
+        if( modelViewChanged ) {
+            if( state.mvLocation != -1 ) glUniformMatrix4fv( state.mvLocation, 1, GL_FALSE, state.mv );
+            if( state.normMatrixLocation != -1 ) {
+                GLfloat normMatrix[9];
+                gltw::normalMatrix( state.mv, normMatrix );
+                glUniformMatrix3fv( state.normMatrixLocation, 1, GL_FALSE, normMatrix );
+            }
+        }
+    }
+
     inline void setModelViewMatrix( GLfloat *matrix )
     {        
         ShaderState &state = ShaderState::state();
-        if( state.activeShader != SHADER_NONE ) {
-            setUniformMatrix4( state.shaderIDs[state.activeShader], "mv", matrix );
+        if( state.active ) {
+            memcpy( state.mv, matrix, sizeof(state.mv) );
+            updateMatrixUniforms( true );
         }
     }
 
 	inline void setProjectionMatrix( GLfloat *matrix )
     {        
         ShaderState &state = ShaderState::state();
-        if( state.activeShader != SHADER_NONE ) {
-            setUniformMatrix4( state.shaderIDs[state.activeShader], "proj", matrix );
+        if( state.active ) {
+            memcpy( state.proj, matrix, sizeof(state.proj) );
+            updateMatrixUniforms( false );
         }
     }
     
     inline void setColor( GLfloat *color )
     {
 		ShaderState &state = ShaderState::state();
-		if( state.activeShader == SHADER_FLAT || state.activeShader == SHADER_DEFAULT_LIGHT ||
-			state.activeShader == SHADER_POINT_LIGHT ) {
-            setUniform4fv( state.shaderIDs[state.activeShader], "color", color);
+		if( state.active && !(shaderKeyFeatures(state.activeKey) & FEATURE_VERTEX_COLOR) ) {
+            setUniform4fv( state.activeID, "color", color);
         }
     }
 	
 	inline void setColor( GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
 		ShaderState &state = ShaderState::state();
-		if( state.activeShader == SHADER_FLAT || state.activeShader == SHADER_DEFAULT_LIGHT ||
-			state.activeShader == SHADER_POINT_LIGHT ) {
-            setUniform4f( state.shaderIDs[state.activeShader], "color", red, green, blue, alpha);
+		if( state.active && !(shaderKeyFeatures(state.activeKey) & FEATURE_VERTEX_COLOR) ) {
+            setUniform4f( state.activeID, "color", red, green, blue, alpha);
         }
 	}
 
 	inline void setLightPosition( GLfloat *pos )
 	{
-		ShaderState &state = ShaderState::state();
-		if( state.activeShader == SHADER_POINT_LIGHT ) {
-            setUniform3fv( state.shaderIDs[state.activeShader], "lightPos", pos);
-        }
+		setLightPosition( 0, pos );
 	}
 
 	inline void setLightPosition( GLfloat x, GLfloat y, GLfloat z )
+	{
+		GLfloat pos[] = { x, y, z };
+		setLightPosition( 0, pos );
+	}
+
+	inline void setLightPosition( int light, GLfloat *pos )
 	{
 		ShaderState &state = ShaderState::state();
-		if( state.activeShader == SHADER_POINT_LIGHT ) {
-            setUniform3f( state.shaderIDs[state.activeShader], "lightPos", x, y, z);
+		if( state.active && light >= 0 && light < (int)shaderKeyLights(state.activeKey) ) {
+			ostringstream name;
+			name << "lightPos[" << light << "]";
+            setUniform3fv( state.activeID, name.str().c_str(), pos);
         }
 	}
+
+	inline void setFog( GLfloat *color, GLfloat start, GLfloat end )
+	{
+		ShaderState &state = ShaderState::state();
+		if( state.active && (shaderKeyFeatures(state.activeKey) & FEATURE_FOG) ) {
+			setUniform4fv( state.activeID, "fogColor", color );
+			GLint location = glGetUniformLocation( state.activeID, "fogRange" );
+			if( location != -1 ) glUniform2f( location, start, end );
+		}
+	}
+
+	inline void setPointSize( GLfloat size )
+	{
+		ShaderState &state = ShaderState::state();
+		if( state.active && (shaderKeyFeatures(state.activeKey) & FEATURE_POINTS) ) {
+			GLint location = glGetUniformLocation( state.activeID, "pointSize" );
+			if( location != -1 ) glUniform1f( location, size );
+		}
+	}
 }
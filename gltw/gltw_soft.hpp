@@ -0,0 +1,145 @@
+#ifndef __gltw_soft_hpp
+#define __gltw_soft_hpp
+
+namespace gltw {
+
+	/**
+	 * <p>A software renderer for machines without a GPU.  It draws the triangles of
+	 * MeshData with the same results as the stock shaders into a framebuffer provided by
+	 * the caller.  It makes no OpenGL calls.  Of the variants of the stock shaders (see
+	 * ::shaderKey), it supports those with the ::FEATURE_VERTEX_COLOR, ::FEATURE_LIGHTING and
+	 * ::FEATURE_FOG features only.</p>
+	 *
+	 * <p>Triangles are rasterized in 64x64 pixel tiles, with the tiles spread over the threads
+	 * of a ThreadPool and four pixels evaluated at a time using SSE where available.
+	 * Within a tile, triangles are drawn in submission order, so the result does not depend
+	 * on the number of threads.</p>
+	 *
+	 * <p>The color buffer holds one 32-bit RGBA pixel per element, with the bytes in the
+	 * order {r, g, b, a} (the layout of GL_RGBA / GL_UNSIGNED_BYTE).  As with glReadPixels,
+	 * the first row is the bottom of the image.  Depth values are in [0, 1], and the depth
+	 * test is GL_LESS.</p>
+	 *
+	 * <p><code>
+	 *    std::vector<unsigned int> color(w * h);<br />
+	 *    std::vector<float> depth(w * h);<br />
+	 *    gltw::SoftRenderer renderer;<br />
+	 *    renderer.setFramebuffer( color.data(), depth.data(), w, h );<br />
+	 *    renderer.clear( 0.0f, 0.0f, 0.0f, 1.0f );<br />
+	 *    renderer.useStockShader( gltw::SHADER_DEFAULT_LIGHT );<br />
+	 *    renderer.setProjectionMatrix( proj );<br />
+	 *    renderer.setModelViewMatrix( mv );<br />
+	 *    renderer.draw( meshData );<br />
+	 * </code></p>
+	 */
+	class SoftRenderer : public NonCopyable {
+	public:
+		/**
+		 * Construct a SoftRenderer.
+		 *
+		 * @param pool the threads to render with, defaults to ThreadPool::shared()
+		 */
+		explicit SoftRenderer( ThreadPool * pool = NULL );
+
+		/**
+		 * Set the framebuffer to draw into.  The buffers are owned by the caller
+		 * and must remain valid while drawing.
+		 *
+		 * @param color width * height RGBA pixels (may be NULL for depth-only rendering)
+		 * @param depth width * height depth values (may be NULL, which disables the depth test)
+		 * @param width the width of the framebuffer in pixels
+		 * @param height the height of the framebuffer in pixels
+		 */
+		void setFramebuffer( unsigned int * color, float * depth, int width, int height );
+
+		/** Fill the color buffer with the given color, and the depth buffer with the given depth */
+		void clear( GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha, GLfloat depth = 1.0f );
+
+		/** Enable or disable the depth test (enabled by default) */
+		void setDepthTest( bool enabled ) { depthTest = enabled; }
+
+		/**
+		 * Make the given stock shader active.  As with ::useStockShader, the model-view and
+		 * projection matrices are reset to the identity, and ::SHADER_FLAT's color is reset to white.
+		 */
+		void useStockShader( Shader shader );
+		/**
+		 * Make the given stock shader variant active, see ::useShaderVariant.  A variant with
+		 * ::FEATURE_POINTS, ::FEATURE_TEXTURE or ::FEATURE_TEXTURE_ARRAY is not supported: an
+		 * error message is displayed, and nothing is drawn until another shader is made active.
+		 */
+		void useShaderVariant( ShaderKey key );
+
+		/** Set the model-view matrix (16 values, column-major) of the active shader */
+		void setModelViewMatrix( const GLfloat * m );
+		/** Set the projection matrix (16 values, column-major) of the active shader */
+		void setProjectionMatrix( const GLfloat * m );
+		/** Set the color of the active shader, as with ::setColor */
+		void setColor( GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha );
+		/** Set the position of a point light (eye coordinates) of the active shader, as with ::setLightPosition */
+		void setLightPosition( GLfloat x, GLfloat y, GLfloat z, int light = 0 );
+		/** Set the fog of the active shader, as with ::setFog */
+		void setFog( const GLfloat * color, GLfloat start, GLfloat end );
+
+		/**
+		 * Draw the triangles in the given data with the active shader.  If the data has
+		 * no elements, each three consecutive vertices form a triangle.  The attributes the
+		 * shader needs are read from the data; missing attributes take the same default values
+		 * as in OpenGL.
+		 *
+		 * @param data the vertex and element data
+		 */
+		void draw( const MeshData & data );
+
+	private:
+		/** The uniform values of one shader variant */
+		struct Uniforms {
+			GLfloat mv[16], proj[16];
+			// The inverse transpose of mv's upper 3x3, as given to the OpenGL shaders
+			GLfloat normMatrix[9];
+			GLfloat color[4];
+			GLfloat lightPos[GLTW_MAX_LIGHTS][3];
+			GLfloat fogColor[4], fogRange[2];
+		};
+
+		/** A triangle ready for rasterization */
+		struct Triangle {
+			// Edge functions: e = a * x + b * y + c, normalized so that the triangle is where all are >= 0
+			float a[3], b[3], c[3];
+			bool topLeft[3];
+			float invArea;
+			float z[3], invW[3];
+			// The varyings (rgba, fog distance) of each vertex, divided by w
+			float v[3][5];
+			int minX, minY, maxX, maxY;
+		};
+
+		enum { TILE_SIZE = 64 };
+
+		void shadeVertices( const MeshData & data, size_t begin, size_t end );
+		void setupTriangle( const float * clip[3], const float * vary[3], std::vector<Triangle> & out );
+		void clipTriangle( size_t chunk, GLuint i0, GLuint i1, GLuint i2 );
+		void rasterize( const Triangle & tri, int x0, int y0, int x1, int y1 );
+
+		ThreadPool * threads;
+		unsigned int * colorBuf;
+		float * depthBuf;
+		int width, height;
+		bool depthTest;
+
+		bool active;
+		ShaderKey activeKey;
+		std::unordered_map<ShaderKey, Uniforms> uniforms;
+		Uniforms * current;
+
+		// Per-draw storage, kept between draws to avoid reallocation
+		std::vector<float> clipPos, varyings;
+		std::vector< std::vector<Triangle> > chunkTris;
+		std::vector< std::vector< std::vector<GLuint> > > chunkBins;
+		int tilesX, tilesY;
+	};
+}
+
+#include "gltw_soft.inl"
+
+#endif
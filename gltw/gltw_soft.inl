@@ -0,0 +1,472 @@
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GLTW_SOFT_SSE 1
+#endif
+
+namespace gltw {
+
+	/// @privatesection
+#ifdef GLTW_SOFT_SSE
+	/** Four floats processed together */
+	struct SoftVec4 {
+		__m128 v;
+		SoftVec4() { }
+		SoftVec4( __m128 x ) : v(x) { }
+		explicit SoftVec4( float x ) : v(_mm_set1_ps(x)) { }
+		SoftVec4( float a, float b, float c, float d ) : v(_mm_setr_ps(a, b, c, d)) { }
+		static SoftVec4 load( const float * p ) { return _mm_loadu_ps(p); }
+		void store( float * p ) const { _mm_storeu_ps(p, v); }
+	};
+	/** A lane mask produced by comparing two SoftVec4 */
+	struct SoftMask4 {
+		__m128 m;
+		SoftMask4( __m128 x ) : m(x) { }
+		int bits() const { return _mm_movemask_ps(m); }
+	};
+	inline SoftVec4 operator + ( SoftVec4 a, SoftVec4 b ) { return _mm_add_ps(a.v, b.v); }
+	inline SoftVec4 operator - ( SoftVec4 a, SoftVec4 b ) { return _mm_sub_ps(a.v, b.v); }
+	inline SoftVec4 operator * ( SoftVec4 a, SoftVec4 b ) { return _mm_mul_ps(a.v, b.v); }
+	inline SoftVec4 operator / ( SoftVec4 a, SoftVec4 b ) { return _mm_div_ps(a.v, b.v); }
+	inline SoftVec4 softMin( SoftVec4 a, SoftVec4 b ) { return _mm_min_ps(a.v, b.v); }
+	inline SoftVec4 softMax( SoftVec4 a, SoftVec4 b ) { return _mm_max_ps(a.v, b.v); }
+	inline SoftMask4 operator & ( SoftMask4 a, SoftMask4 b ) { return _mm_and_ps(a.m, b.m); }
+	inline SoftMask4 softGreaterEqual( SoftVec4 a, SoftVec4 b ) { return _mm_cmpge_ps(a.v, b.v); }
+	inline SoftMask4 softGreater( SoftVec4 a, SoftVec4 b ) { return _mm_cmpgt_ps(a.v, b.v); }
+	inline SoftMask4 softLess( SoftVec4 a, SoftVec4 b ) { return _mm_cmplt_ps(a.v, b.v); }
+	inline SoftMask4 softLessEqual( SoftVec4 a, SoftVec4 b ) { return _mm_cmple_ps(a.v, b.v); }
+	inline void softToInt( SoftVec4 a, int * out ) { _mm_storeu_si128( (__m128i *)out, _mm_cvttps_epi32(a.v) ); }
+#else
+	/** Four floats processed together */
+	struct SoftVec4 {
+		float v[4];
+		SoftVec4() { }
+		explicit SoftVec4( float x ) { v[0] = v[1] = v[2] = v[3] = x; }
+		SoftVec4( float a, float b, float c, float d ) { v[0] = a; v[1] = b; v[2] = c; v[3] = d; }
+		static SoftVec4 load( const float * p ) { return SoftVec4( p[0], p[1], p[2], p[3] ); }
+		void store( float * p ) const { for( int i = 0; i < 4; i++ ) p[i] = v[i]; }
+	};
+	/** A lane mask produced by comparing two SoftVec4 */
+	struct SoftMask4 {
+		int m;
+		explicit SoftMask4( int x ) : m(x) { }
+		int bits() const { return m; }
+	};
+#define GLTW_SOFT_OP(op) \
+	inline SoftVec4 operator op ( SoftVec4 a, SoftVec4 b ) { \
+		return SoftVec4( a.v[0] op b.v[0], a.v[1] op b.v[1], a.v[2] op b.v[2], a.v[3] op b.v[3] ); }
+	GLTW_SOFT_OP(+)
+	GLTW_SOFT_OP(-)
+	GLTW_SOFT_OP(*)
+	GLTW_SOFT_OP(/)
+#undef GLTW_SOFT_OP
+#define GLTW_SOFT_CMP(name, op) \
+	inline SoftMask4 name( SoftVec4 a, SoftVec4 b ) { \
+		return SoftMask4( (a.v[0] op b.v[0]) | (a.v[1] op b.v[1]) << 1 | (a.v[2] op b.v[2]) << 2 | (a.v[3] op b.v[3]) << 3 ); }
+	GLTW_SOFT_CMP(softGreaterEqual, >=)
+	GLTW_SOFT_CMP(softGreater, >)
+	GLTW_SOFT_CMP(softLess, <)
+	GLTW_SOFT_CMP(softLessEqual, <=)
+#undef GLTW_SOFT_CMP
+	inline SoftVec4 softMin( SoftVec4 a, SoftVec4 b ) {
+		return SoftVec4( std::min(a.v[0], b.v[0]), std::min(a.v[1], b.v[1]), std::min(a.v[2], b.v[2]), std::min(a.v[3], b.v[3]) );
+	}
+	inline SoftVec4 softMax( SoftVec4 a, SoftVec4 b ) {
+		return SoftVec4( std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3]) );
+	}
+	inline SoftMask4 operator & ( SoftMask4 a, SoftMask4 b ) { return SoftMask4( a.m & b.m ); }
+	inline void softToInt( SoftVec4 a, int * out ) { for( int i = 0; i < 4; i++ ) out[i] = (int)a.v[i]; }
+#endif
+	/// @publicsection
+
+	inline SoftRenderer::SoftRenderer( ThreadPool * pool ) :
+		threads( pool ? pool : &ThreadPool::shared() ), colorBuf(NULL), depthBuf(NULL),
+		width(0), height(0), depthTest(true), active(false), activeKey(0), current(NULL),
+		tilesX(0), tilesY(0)
+	{ }
+
+	inline void SoftRenderer::setFramebuffer( unsigned int * color, float * depth, int w, int h ) {
+		colorBuf = color;
+		depthBuf = depth;
+		width = w;
+		height = h;
+		tilesX = (w + TILE_SIZE - 1) / TILE_SIZE;
+		tilesY = (h + TILE_SIZE - 1) / TILE_SIZE;
+	}
+
+	inline void SoftRenderer::clear( GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha, GLfloat depth ) {
+		size_t count = (size_t)width * height;
+		if( colorBuf ) {
+			unsigned int pixel;
+			unsigned char * bytes = (unsigned char *)&pixel;
+			GLfloat rgba[] = { red, green, blue, alpha };
+			for( int i = 0; i < 4; i++ )
+				bytes[i] = (unsigned char)( std::min( 1.0f, std::max( 0.0f, rgba[i] ) ) * 255.0f + 0.5f );
+			std::fill( colorBuf, colorBuf + count, pixel );
+		}
+		if( depthBuf ) std::fill( depthBuf, depthBuf + count, depth );
+	}
+
+	inline void SoftRenderer::useStockShader( Shader shader ) {
+		if( shader == SHADER_NONE ) {
+			active = false;
+			current = NULL;
+		} else {
+			useShaderVariant( stockShaderKey(shader) );
+		}
+	}
+
+	inline void SoftRenderer::useShaderVariant( ShaderKey key ) {
+		if( shaderKeyFeatures(key) & (FEATURE_POINTS | FEATURE_TEXTURE | FEATURE_TEXTURE_ARRAY) ) {
+			cerr << "Error in SoftRenderer.useShaderVariant: points and textures are not supported, "
+				<< "nothing will be drawn until another variant is used." << endl;
+			active = false;
+			current = NULL;
+			return;
+		}
+		std::unordered_map<ShaderKey, Uniforms>::iterator it = uniforms.find(key);
+		if( it == uniforms.end() ) {
+			// The initial values given in the stock shader source
+			Uniforms u;
+			memset( &u, 0, sizeof(u) );
+			for( int i = 0; i < 3; i++ ) u.color[i] = 0.9f;
+			u.color[3] = 1.0f;
+			u.fogRange[0] = 1.0e30f;
+			u.fogRange[1] = 2.0e30f;
+			it = uniforms.insert( std::make_pair(key, u) ).first;
+		}
+		active = true;
+		activeKey = key;
+		current = &it->second;
+
+		// As initUniforms does for the OpenGL shaders
+		for( int i = 0; i < 16; i++ ) current->mv[i] = current->proj[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+		for( int i = 0; i < 9; i++ ) current->normMatrix[i] = (i % 4 == 0) ? 1.0f : 0.0f;
+		if( (shaderKeyFeatures(key) & (FEATURE_VERTEX_COLOR | FEATURE_LIGHTING)) == 0 )
+			for( int i = 0; i < 4; i++ ) current->color[i] = 1.0f;
+	}
+
+	inline void SoftRenderer::setModelViewMatrix( const GLfloat * m ) {
+		if( current ) {
+			memcpy( current->mv, m, sizeof(current->mv) );
+			normalMatrix( m, current->normMatrix );
+		}
+	}
+
+	inline void SoftRenderer::setProjectionMatrix( const GLfloat * m ) {
+		if( current ) memcpy( current->proj, m, sizeof(current->proj) );
+	}
+
+	inline void SoftRenderer::setColor( GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha ) {
+		if( current && !(shaderKeyFeatures(activeKey) & FEATURE_VERTEX_COLOR) ) {
+			current->color[0] = red;
+			current->color[1] = green;
+			current->color[2] = blue;
+			current->color[3] = alpha;
+		}
+	}
+
+	inline void SoftRenderer::setLightPosition( GLfloat x, GLfloat y, GLfloat z, int light ) {
+		if( current && light >= 0 && light < (int)shaderKeyLights(activeKey) ) {
+			current->lightPos[light][0] = x;
+			current->lightPos[light][1] = y;
+			current->lightPos[light][2] = z;
+		}
+	}
+
+	inline void SoftRenderer::setFog( const GLfloat * color, GLfloat start, GLfloat end ) {
+		if( current && (shaderKeyFeatures(activeKey) & FEATURE_FOG) ) {
+			memcpy( current->fogColor, color, sizeof(current->fogColor) );
+			current->fogRange[0] = start;
+			current->fogRange[1] = end;
+		}
+	}
+
+	inline void SoftRenderer::shadeVertices( const MeshData & data, size_t begin, size_t end )
+	{
+		// The vertex stage of the stock shader, see ShaderState::ShaderState
+		const Uniforms & u = *current;
+		unsigned int features = shaderKeyFeatures( activeKey );
+		int lights = (int)shaderKeyLights( activeKey );
+		bool hasNormals = !data.normals.empty(), hasColors = !data.colors.empty();
+
+		for( size_t i = begin; i < end; i++ ) {
+			const GLfloat * p = &data.positions[3 * i];
+			float ec[4], * clip = &clipPos[4 * i], * out = &varyings[5 * i];
+			for( int r = 0; r < 4; r++ )
+				ec[r] = u.mv[r] * p[0] + u.mv[4 + r] * p[1] + u.mv[8 + r] * p[2] + u.mv[12 + r];
+			for( int r = 0; r < 4; r++ )
+				clip[r] = u.proj[r] * ec[0] + u.proj[4 + r] * ec[1] + u.proj[8 + r] * ec[2] + u.proj[12 + r] * ec[3];
+
+			// Attributes that are not supplied take the OpenGL defaults (0,0,0,1)
+			float base[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			if( features & FEATURE_VERTEX_COLOR ) {
+				if( hasColors ) memcpy( base, &data.colors[4 * i], sizeof(base) );
+			} else {
+				memcpy( base, u.color, sizeof(base) );
+			}
+
+			if( features & FEATURE_LIGHTING ) {
+				float n[3] = { 0.0f, 0.0f, 0.0f };
+				if( hasNormals ) {
+					const GLfloat * vn = &data.normals[3 * i];
+					for( int r = 0; r < 3; r++ )
+						n[r] = u.normMatrix[r] * vn[0] + u.normMatrix[3 + r] * vn[1] + u.normMatrix[6 + r] * vn[2];
+					float len = sqrtf( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+					if( len > 0.0f ) for( int r = 0; r < 3; r++ ) n[r] /= len;
+				}
+				float diffuse = 0.0f;
+				if( lights > 0 ) {
+					for( int l = 0; l < lights; l++ ) {
+						float d[3];
+						for( int r = 0; r < 3; r++ ) d[r] = u.lightPos[l][r] - ec[r];
+						float len = sqrtf( d[0] * d[0] + d[1] * d[1] + d[2] * d[2] );
+						if( len > 0.0f ) diffuse += std::max( 0.0f, (n[0] * d[0] + n[1] * d[1] + n[2] * d[2]) / len );
+					}
+				} else {
+					diffuse = std::max( 0.0f, n[2] );
+				}
+				for( int r = 0; r < 3; r++ ) base[r] *= diffuse;
+			}
+
+			memcpy( out, base, sizeof(base) );
+			out[4] = sqrtf( ec[0] * ec[0] + ec[1] * ec[1] + ec[2] * ec[2] );
+		}
+	}
+
+	inline void SoftRenderer::clipTriangle( size_t chunk, GLuint i0, GLuint i1, GLuint i2 )
+	{
+		const float * clip[3] = { &clipPos[4 * i0], &clipPos[4 * i1], &clipPos[4 * i2] };
+		const float * vary[3] = { &varyings[5 * i0], &varyings[5 * i1], &varyings[5 * i2] };
+
+		// Trivially reject triangles entirely outside one of the clip planes
+		for( int axis = 0; axis < 3; axis++ ) {
+			if( clip[0][axis] > clip[0][3] && clip[1][axis] > clip[1][3] && clip[2][axis] > clip[2][3] ) return;
+			if( axis < 2 && clip[0][axis] < -clip[0][3] && clip[1][axis] < -clip[1][3] && clip[2][axis] < -clip[2][3] ) return;
+		}
+
+		std::vector<Triangle> & out = chunkTris[chunk];
+		size_t first = out.size();
+
+		float d[3];
+		int inside = 0;
+		for( int k = 0; k < 3; k++ ) {
+			d[k] = clip[k][2] + clip[k][3];
+			if( d[k] >= 0.0f ) inside++;
+		}
+
+		if( inside == 3 ) {
+			setupTriangle( clip, vary, out );
+		} else if( inside > 0 ) {
+			// Clip against the near plane (z = -w), giving a triangle or a quad
+			float poly[4][9];
+			int count = 0;
+			for( int k = 0; k < 3; k++ ) {
+				int j = (k + 1) % 3;
+				if( d[k] >= 0.0f ) {
+					memcpy( poly[count], clip[k], 4 * sizeof(float) );
+					memcpy( poly[count] + 4, vary[k], 5 * sizeof(float) );
+					count++;
+				}
+				if( (d[k] >= 0.0f) != (d[j] >= 0.0f) ) {
+					float t = d[k] / (d[k] - d[j]);
+					for( int c = 0; c < 4; c++ ) poly[count][c] = clip[k][c] + t * (clip[j][c] - clip[k][c]);
+					for( int c = 0; c < 5; c++ ) poly[count][4 + c] = vary[k][c] + t * (vary[j][c] - vary[k][c]);
+					count++;
+				}
+			}
+			for( int k = 1; k + 1 < count; k++ ) {
+				const float * c[3] = { poly[0], poly[k], poly[k + 1] };
+				const float * v[3] = { poly[0] + 4, poly[k] + 4, poly[k + 1] + 4 };
+				setupTriangle( c, v, out );
+			}
+		}
+
+		// Bin the new triangles into the tiles they overlap
+		std::vector< std::vector<GLuint> > & bins = chunkBins[chunk];
+		for( size_t t = first; t < out.size(); t++ ) {
+			const Triangle & tri = out[t];
+			for( int ty = tri.minY / TILE_SIZE; ty <= tri.maxY / TILE_SIZE; ty++ )
+				for( int tx = tri.minX / TILE_SIZE; tx <= tri.maxX / TILE_SIZE; tx++ )
+					bins[ty * tilesX + tx].push_back( (GLuint)t );
+		}
+	}
+
+	inline void SoftRenderer::setupTriangle( const float * clip[3], const float * vary[3], std::vector<Triangle> & out )
+	{
+		Triangle tri;
+		double x[3], y[3];
+		for( int k = 0; k < 3; k++ ) {
+			if( !(clip[k][3] > 0.0f) ) return;
+			float invW = 1.0f / clip[k][3];
+			x[k] = (clip[k][0] * invW * 0.5 + 0.5) * width;
+			y[k] = (clip[k][1] * invW * 0.5 + 0.5) * height;
+			tri.z[k] = clip[k][2] * invW * 0.5f + 0.5f;
+			tri.invW[k] = invW;
+			for( int c = 0; c < 5; c++ ) tri.v[k][c] = vary[k][c] * invW;
+		}
+
+		double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if( !(area != 0.0) ) return;
+		double sign = area > 0.0 ? 1.0 : -1.0;
+
+		double minX = std::min( x[0], std::min(x[1], x[2]) ), maxX = std::max( x[0], std::max(x[1], x[2]) );
+		double minY = std::min( y[0], std::min(y[1], y[2]) ), maxY = std::max( y[0], std::max(y[1], y[2]) );
+		tri.minX = (int)std::max( 0.0, floor(minX) );
+		tri.minY = (int)std::max( 0.0, floor(minY) );
+		tri.maxX = (int)std::min( width - 1.0, ceil(maxX) );
+		tri.maxY = (int)std::min( height - 1.0, ceil(maxY) );
+		if( tri.minX > tri.maxX || tri.minY > tri.maxY ) return;
+
+		// Edge i is opposite vertex i.  The constant term is taken at the center of
+		// pixel (minX, minY) to keep the values small.
+		double px = tri.minX + 0.5, py = tri.minY + 0.5;
+		for( int i = 0; i < 3; i++ ) {
+			int j = (i + 1) % 3, k = (i + 2) % 3;
+			double a = (y[j] - y[k]) * sign, b = (x[k] - x[j]) * sign;
+			double c = ((x[j] - px) * (y[k] - py) - (x[k] - px) * (y[j] - py)) * sign;
+			tri.a[i] = (float)a;
+			tri.b[i] = (float)b;
+			tri.c[i] = (float)c;
+			tri.topLeft[i] = a > 0.0 || (a == 0.0 && b < 0.0);
+		}
+		tri.invArea = (float)(1.0 / (area * sign));
+		out.push_back( tri );
+	}
+
+	inline void SoftRenderer::rasterize( const Triangle & tri, int x0, int y0, int x1, int y1 )
+	{
+		const Uniforms & u = *current;
+		bool fog = (shaderKeyFeatures(activeKey) & FEATURE_FOG) != 0;
+		bool testDepth = depthTest && depthBuf != NULL;
+		const SoftVec4 zero(0.0f), one(1.0f), lanes(0.0f, 1.0f, 2.0f, 3.0f);
+
+		SoftVec4 step[3];
+		for( int i = 0; i < 3; i++ ) step[i] = SoftVec4( tri.a[i] * 4.0f );
+
+		for( int y = y0; y <= y1; y++ ) {
+			SoftVec4 e[3];
+			for( int i = 0; i < 3; i++ )
+				e[i] = SoftVec4( tri.c[i] + tri.b[i] * (y - tri.minY) + tri.a[i] * (x0 - tri.minX) ) + lanes * SoftVec4( tri.a[i] );
+			size_t row = (size_t)y * width;
+
+			for( int x = x0; x <= x1; x += 4 ) {
+				SoftMask4 mask = softLess( lanes, SoftVec4( (float)(x1 - x + 1) ) );
+				for( int i = 0; i < 3; i++ ) {
+					mask = mask & ( tri.topLeft[i] ? softGreaterEqual( e[i], zero ) : softGreater( e[i], zero ) );
+				}
+				int bits = mask.bits();
+				if( bits != 0 ) {
+					SoftVec4 invArea( tri.invArea );
+					SoftVec4 b0 = e[0] * invArea, b1 = e[1] * invArea, b2 = e[2] * invArea;
+					SoftVec4 z = b0 * SoftVec4(tri.z[0]) + b1 * SoftVec4(tri.z[1]) + b2 * SoftVec4(tri.z[2]);
+
+					// Depth clipping, and the depth test
+					mask = mask & softGreaterEqual( z, zero ) & softLessEqual( z, one );
+					float depth[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+					int n = std::min( 4, x1 - x + 1 );
+					if( testDepth ) {
+						memcpy( depth, depthBuf + row + x, n * sizeof(float) );
+						mask = mask & softLess( z, SoftVec4::load(depth) );
+					}
+					bits = mask.bits();
+
+					if( bits != 0 ) {
+						float zs[4];
+						z.store( zs );
+						if( testDepth ) {
+							for( int l = 0; l < n; l++ ) if( bits & (1 << l) ) depthBuf[row + x + l] = zs[l];
+						}
+
+						if( colorBuf ) {
+							// Perspective-correct interpolation of the varyings
+							SoftVec4 w = b0 * SoftVec4(tri.invW[0]) + b1 * SoftVec4(tri.invW[1]) + b2 * SoftVec4(tri.invW[2]);
+							SoftVec4 invW = one / w;
+							SoftVec4 ch[5];
+							for( int c = 0; c < 5; c++ )
+								ch[c] = (b0 * SoftVec4(tri.v[0][c]) + b1 * SoftVec4(tri.v[1][c]) + b2 * SoftVec4(tri.v[2][c])) * invW;
+							if( fog ) {
+								SoftVec4 f = (SoftVec4(u.fogRange[1]) - ch[4]) / SoftVec4(u.fogRange[1] - u.fogRange[0]);
+								f = softMin( one, softMax( zero, f ) );
+								for( int c = 0; c < 4; c++ )
+									ch[c] = SoftVec4(u.fogColor[c]) + (ch[c] - SoftVec4(u.fogColor[c])) * f;
+							}
+							int rgba[4][4];
+							for( int c = 0; c < 4; c++ )
+								softToInt( softMin( one, softMax( zero, ch[c] ) ) * SoftVec4(255.0f) + SoftVec4(0.5f), rgba[c] );
+							for( int l = 0; l < n; l++ ) {
+								if( bits & (1 << l) ) {
+									unsigned char * p = (unsigned char *)(colorBuf + row + x + l);
+									p[0] = (unsigned char)rgba[0][l];
+									p[1] = (unsigned char)rgba[1][l];
+									p[2] = (unsigned char)rgba[2][l];
+									p[3] = (unsigned char)rgba[3][l];
+								}
+							}
+						}
+					}
+				}
+				for( int i = 0; i < 3; i++ ) e[i] = e[i] + step[i];
+			}
+		}
+	}
+
+	inline void SoftRenderer::draw( const MeshData & data )
+	{
+		if( !active || width <= 0 || height <= 0 || (colorBuf == NULL && depthBuf == NULL) ) return;
+
+		// Vertex stage
+		const size_t VERTS_PER_JOB = 4096;
+		size_t nVerts = data.numVerts();
+		clipPos.resize( 4 * nVerts );
+		varyings.resize( 5 * nVerts );
+		threads->parallelFor( (nVerts + VERTS_PER_JOB - 1) / VERTS_PER_JOB, [&]( size_t job ) {
+			shadeVertices( data, job * VERTS_PER_JOB, std::min( nVerts, (job + 1) * VERTS_PER_JOB ) );
+		} );
+
+		// Clip, set up and bin the triangles.  Each chunk of triangles has its own bins,
+		// which are visited in order when rasterizing, so submission order is preserved.
+		bool indexed = !data.elements.empty();
+		size_t nTris = (indexed ? data.elements.size() : nVerts) / 3;
+		const size_t TRIS_PER_CHUNK = 1024;
+		size_t nChunks = std::max( (size_t)1, std::min( (size_t)threads->size() * 4, (nTris + TRIS_PER_CHUNK - 1) / TRIS_PER_CHUNK ) );
+		size_t nTiles = (size_t)tilesX * tilesY;
+		if( chunkTris.size() < nChunks ) {
+			chunkTris.resize( nChunks );
+			chunkBins.resize( nChunks );
+		}
+		threads->parallelFor( nChunks, [&]( size_t chunk ) {
+			chunkTris[chunk].clear();
+			chunkBins[chunk].resize( nTiles );
+			for( size_t t = 0; t < nTiles; t++ ) chunkBins[chunk][t].clear();
+
+			size_t begin = nTris * chunk / nChunks, end = nTris * (chunk + 1) / nChunks;
+			for( size_t t = begin; t < end; t++ ) {
+				GLuint i0 = (GLuint)(3 * t), i1 = i0 + 1, i2 = i0 + 2;
+				if( indexed ) {
+					i0 = data.elements[3 * t];
+					i1 = data.elements[3 * t + 1];
+					i2 = data.elements[3 * t + 2];
+					if( i0 >= nVerts || i1 >= nVerts || i2 >= nVerts ) continue;
+				}
+				clipTriangle( chunk, i0, i1, i2 );
+			}
+		} );
+
+		// Rasterize each tile
+		threads->parallelFor( nTiles, [&]( size_t tile ) {
+			int tx = (int)(tile % tilesX), ty = (int)(tile / tilesX);
+			int x0 = tx * TILE_SIZE, y0 = ty * TILE_SIZE;
+			int x1 = std::min( x0 + TILE_SIZE, width ) - 1, y1 = std::min( y0 + TILE_SIZE, height ) - 1;
+			for( size_t chunk = 0; chunk < nChunks; chunk++ ) {
+				const std::vector<GLuint> & bin = chunkBins[chunk][tile];
+				for( size_t i = 0; i < bin.size(); i++ ) {
+					const Triangle & tri = chunkTris[chunk][bin[i]];
+					rasterize( tri, std::max( x0, tri.minX ), std::max( y0, tri.minY ),
+						std::min( x1, tri.maxX ), std::min( y1, tri.maxY ) );
+				}
+			}
+		} );
+	}
+}
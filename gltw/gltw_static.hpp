@@ -0,0 +1,136 @@
+#ifndef __gltw_static_hpp
+#define __gltw_static_hpp
+
+#include <unordered_map>
+#include <vector>
+
+namespace gltw {
+
+	/** One merged mesh of a StaticBatcher: the instances of one shader variant within one chunk */
+	struct StaticBatch {
+		/** The shader variant that the instances were added with */
+		ShaderKey shader;
+		/** The world-space bounding box of the merged mesh */
+		GLfloat min[3], max[3];
+		/** The number of instances merged into the mesh */
+		GLuint numInstances;
+		/** The merged mesh.  Positions and normals are in world space, and the instances' colors are vertex colors. */
+		TriangleMeshPtr mesh;
+	};
+
+	/**
+	 * <p>Merges many small static meshes into a few large ones, to replace thousands of
+	 * draw calls with a handful.  Each instance is a mesh, a model matrix and a color.  When
+	 * built, the positions and normals of every instance are transformed to world space and
+	 * copied, along with its color, into one TriangleMesh for each shader variant.</p>
+	 *
+	 * <p>A single mesh covering the whole scene could never be culled, so the batcher can also
+	 * split the scene into cubic chunks: an instance goes into the chunk that holds the center
+	 * of its bounding box.  draw() skips the chunks outside the view frustum.</p>
+	 *
+	 * <p>The mesh data given to add() is not copied until build(), so it must remain
+	 * valid and unchanged until then.  Adding the same MeshData many times is cheap.</p>
+	 *
+	 * <p><code>
+	 *    // Initialization<br />
+	 *    gltw::MeshData cube;<br />
+	 *    gltw::buildCube( cube );<br />
+	 *    gltw::StaticBatcher scenery( 50.0f );<br />
+	 *    for( ... ) scenery.add( cube, model, color );<br />
+	 *    scenery.build();<br />
+	 *    <br />
+	 *    // Within the draw function<br />
+	 *    scenery.draw( view, projection );<br />
+	 * </code></p>
+	 */
+	class StaticBatcher : public NonCopyable {
+	public:
+		/**
+		 * Constructs an empty batcher.
+		 *
+		 * @param chunkSize the edge length of the chunks, or zero to merge each shader
+		 *    variant's instances into a single mesh.
+		 */
+		explicit StaticBatcher( GLfloat chunkSize = 0.0f );
+
+		/**
+		 * Add an instance of a mesh.  Nothing is drawn until build() is called.
+		 *
+		 * @param mesh the mesh data, which must include normals.  It is used by build(),
+		 *    not copied here.
+		 * @param model the model matrix (16 values, column-major), or NULL for the identity
+		 * @param color the color (r,g,b,a), or NULL for white.  If the mesh has colors they are
+		 *    multiplied by this.
+		 * @param shader the stock shader variant to draw the instance with.  The instance's
+		 *    color is drawn with ::FEATURE_VERTEX_COLOR, which is added to this key.  With
+		 *    ::FEATURE_TEXTURE or ::FEATURE_TEXTURE_ARRAY the mesh's texture coordinates are
+		 *    copied too, so meshes remapped into one TextureAtlas texture can be merged.  The
+		 *    texture is left to the caller to bind before draw().
+		 */
+		void add( const MeshData & mesh, const GLfloat * model, const GLfloat * color = NULL,
+			ShaderKey shader = stockShaderKey( SHADER_DEFAULT_LIGHT ) );
+
+		/**
+		 * Merge the instances added since the last build into meshes, which replace the
+		 * meshes of any previous build.  The list of instances is then emptied.
+		 *
+		 * @param pool the threads used to transform the instances, defaults to ThreadPool::shared()
+		 * @return the number of merged meshes
+		 */
+		size_t build( ThreadPool * pool = NULL );
+
+		/**
+		 * Draw the merged meshes that are inside the view frustum, grouped by shader.  Each
+		 * shader variant is made active, and given the projection matrix, with the view matrix as its
+		 * model-view matrix.  The last variant used remains active.
+		 *
+		 * @param view the view matrix (16 values, column-major)
+		 * @param projection the projection matrix (16 values, column-major)
+		 * @return the number of meshes drawn
+		 */
+		size_t draw( const GLfloat * view, const GLfloat * projection );
+
+		/** @return the number of instances added since the last build */
+		size_t numInstances() const { return instances.size(); }
+		/** @return the number of merged meshes */
+		size_t numBatches() const { return batches.size(); }
+		/** @return one of the merged meshes, in order of shader variant */
+		const StaticBatch & batch( size_t i ) const { return batches[i]; }
+
+		/** Delete the merged meshes and forget any instances that have not been built */
+		void clear();
+
+	private:
+		struct Source {
+			const MeshData * data;
+			GLfloat min[3], max[3];
+		};
+
+		struct Instance {
+			GLuint source;
+			ShaderKey shader;
+			GLfloat model[16];
+			GLfloat color[4];
+			long long chunk[3];
+			GLuint firstVert, firstElement;
+		};
+
+		GLfloat chunkSize;
+		std::vector<Source> sources;
+		std::unordered_map<const MeshData *, GLuint> sourceIndex;
+		std::vector<Instance> instances;
+		std::vector<StaticBatch> batches;
+	};
+
+	/// @privatesection
+	/**
+	 * Whether a box is at least partly inside the frustum of a view-projection matrix
+	 * (Gribb and Hartmann's plane extraction).  Boxes near the frustum may be accepted.
+	 */
+	bool boxInFrustum( const GLfloat * viewProjection, const GLfloat * min, const GLfloat * max );
+	/// @publicsection
+}
+
+#include "gltw_static.inl"
+
+#endif
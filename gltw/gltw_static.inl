@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cmath>
+
+namespace gltw {
+
+	inline bool boxInFrustum( const GLfloat * m, const GLfloat * min, const GLfloat * max ) {
+		// Each plane is the last row of the matrix plus or minus one of the others
+		for( int i = 0; i < 6; i++ ) {
+			int row = i / 2;
+			GLfloat sign = (i % 2 == 0) ? 1.0f : -1.0f;
+			GLfloat plane[4];
+			for( int j = 0; j < 4; j++ ) plane[j] = m[4 * j + 3] + sign * m[4 * j + row];
+			// The corner furthest along the plane's normal
+			GLfloat d = plane[3];
+			for( int j = 0; j < 3; j++ ) d += plane[j] * (plane[j] >= 0.0f ? max[j] : min[j]);
+			if( d < 0.0f ) return false;
+		}
+		return true;
+	}
+
+	inline StaticBatcher::StaticBatcher( GLfloat size ) : chunkSize(size) { }
+
+	inline void StaticBatcher::add( const MeshData & mesh, const GLfloat * model, const GLfloat * color, ShaderKey shader )
+	{
+		if( mesh.normals.size() != mesh.positions.size() ) {
+			cerr << "Error in StaticBatcher.add: the mesh must include normals." << endl;
+			return;
+		}
+
+		std::unordered_map<const MeshData *, GLuint>::iterator found = sourceIndex.find( &mesh );
+		GLuint source;
+		if( found != sourceIndex.end() ) {
+			source = found->second;
+		} else {
+			source = (GLuint)sources.size();
+			sourceIndex[&mesh] = source;
+			Source s;
+			s.data = &mesh;
+			for( int j = 0; j < 3; j++ ) { s.min[j] = FLT_MAX; s.max[j] = -FLT_MAX; }
+			for( size_t i = 0; i < mesh.positions.size(); i += 3 ) {
+				for( int j = 0; j < 3; j++ ) {
+					s.min[j] = std::min( s.min[j], mesh.positions[i + j] );
+					s.max[j] = std::max( s.max[j], mesh.positions[i + j] );
+				}
+			}
+			sources.push_back( s );
+		}
+
+		Instance inst;
+		inst.source = source;
+		inst.shader = shader | FEATURE_VERTEX_COLOR;
+		for( int i = 0; i < 16; i++ ) inst.model[i] = model ? model[i] : (i % 5 == 0 ? 1.0f : 0.0f);
+		for( int i = 0; i < 4; i++ ) inst.color[i] = color ? color[i] : 1.0f;
+
+		// The chunk holding the center of the transformed bounding box
+		const Source & s = sources[source];
+		for( int row = 0; row < 3; row++ ) {
+			GLfloat center = inst.model[12 + row];
+			for( int j = 0; j < 3; j++ ) center += inst.model[4 * j + row] * 0.5f * (s.min[j] + s.max[j]);
+			inst.chunk[row] = chunkSize > 0.0f ? (long long)std::floor( center / chunkSize ) : 0;
+		}
+		inst.firstVert = inst.firstElement = 0;
+		instances.push_back( inst );
+	}
+
+	inline size_t StaticBatcher::build( ThreadPool * pool )
+	{
+		batches.clear();
+		if( instances.empty() ) return 0;
+		if( pool == NULL ) pool = &ThreadPool::shared();
+
+		// Sort by shader, then chunk, so that each batch is a run of instances
+		std::stable_sort( instances.begin(), instances.end(), []( const Instance & a, const Instance & b ) {
+			if( a.shader != b.shader ) return a.shader < b.shader;
+			for( int j = 0; j < 3; j++ ) {
+				if( a.chunk[j] != b.chunk[j] ) return a.chunk[j] < b.chunk[j];
+			}
+			return false;
+		} );
+
+		std::vector<size_t> runs;
+		std::vector<GLuint> runOf( instances.size() );
+		std::vector<MeshData> merged;
+		size_t numVerts = 0, numElements = 0;
+		for( size_t i = 0; i < instances.size(); i++ ) {
+			Instance & inst = instances[i];
+			const MeshData & data = *sources[inst.source].data;
+			bool newRun = i == 0 || inst.shader != instances[i - 1].shader ||
+				!std::equal( inst.chunk, inst.chunk + 3, instances[i - 1].chunk );
+			// Element indices are 32 bits, so a run that outgrows them continues in a new mesh
+			if( !newRun && numVerts + data.numVerts() > 0xffffffffu ) newRun = true;
+			if( newRun ) {
+				if( i > 0 ) merged.back().resize( (GLuint)numVerts, (GLuint)numElements );
+				runs.push_back( i );
+				merged.push_back( MeshData() );
+				numVerts = numElements = 0;
+			}
+			inst.firstVert = (GLuint)numVerts;
+			inst.firstElement = (GLuint)numElements;
+			runOf[i] = (GLuint)(runs.size() - 1);
+			numVerts += data.numVerts();
+			numElements += data.numElements();
+		}
+		merged.back().resize( (GLuint)numVerts, (GLuint)numElements );
+		runs.push_back( instances.size() );
+		for( size_t r = 0; r < merged.size(); r++ ) {
+			merged[r].colors.resize( 4 * (size_t)merged[r].numVerts() );
+			if( shaderKeyFeatures( instances[runs[r]].shader ) & (FEATURE_TEXTURE | FEATURE_TEXTURE_ARRAY) ) {
+				merged[r].texCoords.resize( 2 * (size_t)merged[r].numVerts() );
+			}
+		}
+
+		std::vector<GLfloat> bounds( 6 * instances.size() );
+		pool->parallelFor( instances.size(), [&]( size_t i ) {
+			const Instance & inst = instances[i];
+			const MeshData & data = *sources[inst.source].data;
+			MeshData & out = merged[runOf[i]];
+			const GLfloat * m = inst.model;
+
+			// Normals transform by the inverse transpose, here the cofactor matrix of the upper 3x3,
+			// whose scale is removed by normalizing.  A mirroring matrix also reverses the winding.
+			const GLfloat * a0 = m, * a1 = m + 4, * a2 = m + 8;
+			GLfloat cof[9];
+			bvhCross( a1, a2, cof );
+			bvhCross( a2, a0, cof + 3 );
+			bvhCross( a0, a1, cof + 6 );
+			const bool mirrored = bvhDot( a0, cof ) < 0.0f;
+
+			GLfloat * box = &bounds[6 * i];
+			for( int j = 0; j < 3; j++ ) { box[j] = FLT_MAX; box[3 + j] = -FLT_MAX; }
+			const GLuint nv = data.numVerts();
+			const bool hasColors = data.colors.size() == 4 * (size_t)nv;
+			for( GLuint v = 0; v < nv; v++ ) {
+				const GLfloat * p = &data.positions[3 * (size_t)v], * n = &data.normals[3 * (size_t)v];
+				GLfloat * po = &out.positions[3 * ((size_t)inst.firstVert + v)];
+				GLfloat * no = &out.normals[3 * ((size_t)inst.firstVert + v)];
+				GLfloat * co = &out.colors[4 * ((size_t)inst.firstVert + v)];
+				for( int row = 0; row < 3; row++ ) {
+					po[row] = m[row] * p[0] + m[4 + row] * p[1] + m[8 + row] * p[2] + m[12 + row];
+					no[row] = cof[row] * n[0] + cof[3 + row] * n[1] + cof[6 + row] * n[2];
+					box[row] = std::min( box[row], po[row] );
+					box[3 + row] = std::max( box[3 + row], po[row] );
+				}
+				GLfloat len = std::sqrt( bvhDot( no, no ) );
+				if( len > 0.0f ) {
+					if( mirrored ) len = -len;
+					for( int j = 0; j < 3; j++ ) no[j] /= len;
+				}
+				for( int j = 0; j < 4; j++ ) co[j] = inst.color[j] * (hasColors ? data.colors[4 * (size_t)v + j] : 1.0f);
+			}
+			if( !out.texCoords.empty() ) {
+				GLfloat * to = &out.texCoords[2 * (size_t)inst.firstVert];
+				if( data.texCoords.size() == 2 * (size_t)nv ) std::copy( data.texCoords.begin(), data.texCoords.end(), to );
+				else std::fill( to, to + 2 * (size_t)nv, 0.0f );
+			}
+
+			const GLuint ne = data.numElements();
+			GLuint * el = &out.elements[inst.firstElement];
+			for( GLuint e = 0; e < ne; e++ ) el[e] = data.elements[e] + inst.firstVert;
+			if( mirrored ) {
+				for( GLuint e = 0; e + 2 < ne; e += 3 ) std::swap( el[e + 1], el[e + 2] );
+			}
+		} );
+
+		batches.resize( merged.size() );
+		for( size_t r = 0; r < merged.size(); r++ ) {
+			StaticBatch & batch = batches[r];
+			batch.shader = instances[runs[r]].shader;
+			batch.numInstances = (GLuint)(runs[r + 1] - runs[r]);
+			for( int j = 0; j < 3; j++ ) { batch.min[j] = FLT_MAX; batch.max[j] = -FLT_MAX; }
+			for( size_t i = runs[r]; i < runs[r + 1]; i++ ) {
+				for( int j = 0; j < 3; j++ ) {
+					batch.min[j] = std::min( batch.min[j], bounds[6 * i + j] );
+					batch.max[j] = std::max( batch.max[j], bounds[6 * i + 3 + j] );
+				}
+			}
+			batch.mesh.reset( new TriangleMesh( merged[r] ) );
+			MeshData().positions.swap( merged[r].positions );
+			MeshData().normals.swap( merged[r].normals );
+			MeshData().colors.swap( merged[r].colors );
+			MeshData().texCoords.swap( merged[r].texCoords );
+			MeshData().elements.swap( merged[r].elements );
+		}
+
+		instances.clear();
+		sources.clear();
+		sourceIndex.clear();
+		return batches.size();
+	}
+
+	inline size_t StaticBatcher::draw( const GLfloat * view, const GLfloat * projection )
+	{
+		GLfloat viewProjection[16];
+		multiplyMatrix4( projection, view, viewProjection );
+
+		size_t drawn = 0;
+		bool first = true;
+		ShaderKey current = 0;
+		for( size_t i = 0; i < batches.size(); i++ ) {
+			StaticBatch & batch = batches[i];
+			if( !boxInFrustum( viewProjection, batch.min, batch.max ) ) continue;
+			if( first || batch.shader != current ) {
+				useShaderVariant( batch.shader );
+				setProjectionMatrix( const_cast<GLfloat *>(projection) );
+				setModelViewMatrix( const_cast<GLfloat *>(view) );
+				current = batch.shader;
+				first = false;
+			}
+			batch.mesh->draw();
+			drawn++;
+		}
+		return drawn;
+	}
+
+	inline void StaticBatcher::clear() {
+		batches.clear();
+		instances.clear();
+		sources.clear();
+		sourceIndex.clear();
+	}
+}
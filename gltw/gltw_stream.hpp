@@ -0,0 +1,126 @@
+#ifndef __gltw_stream_hpp
+#define __gltw_stream_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gltw {
+
+	/**
+	 * <p>Streams items of data from a source too large for GPU memory, such as the nodes of a
+	 * PointCloud or the chunks of a Terrain, into a fixed pool of equal slots in one vertex
+	 * buffer.  Each frame the owner calls beginFrame(), then select() for each item it wants
+	 * drawn, most wanted first, then update().</p>
+	 *
+	 * <p>A loader thread calls the load function for the selected items that are not resident,
+	 * most wanted first.  update() uploads the items that have been loaded and are still
+	 * selected, within a budget, into free slots or else the slots of the items that have gone
+	 * unselected the longest.  It never waits for the loader.  An item is drawn from its slot
+	 * once isResident() is true.</p>
+	 *
+	 * <p>The owner sets up its own vertex array object on buffer().  The load function runs on
+	 * the loader thread, so it may only read data that does not change while the pool runs.</p>
+	 */
+	class StreamingPool : public NonCopyable {
+	public:
+		/**
+		 * Reads an item and fills data with the bytes to upload to its slot, at most the size
+		 * of a slot.  Called on the loader thread.
+		 */
+		typedef std::function<void( size_t item, std::vector<char> & data )> LoadFunction;
+
+		/** Constructs an empty pool.  This constructor does not call any OpenGL functions. */
+		StreamingPool();
+
+		/** Stops the loader thread and deletes the buffer */
+		~StreamingPool();
+
+		/**
+		 * Allocate the buffer and start the loader thread.
+		 *
+		 * @param numItems the number of items in the source, identified by their index
+		 * @param numSlots the number of slots, at most numItems
+		 * @param slotBytes the size of each slot in bytes
+		 * @param load the function that reads an item
+		 */
+		void start( size_t numItems, size_t numSlots, size_t slotBytes, LoadFunction load );
+
+		/** Start selecting the items for a new frame */
+		void beginFrame();
+
+		/**
+		 * Select an item to draw in this frame.  Call this for each item in order of priority.
+		 *
+		 * @param item the index of the item
+		 * @param cost what the item counts against the upload budget, such as its number of points
+		 */
+		void select( size_t item, size_t cost = 1 );
+
+		/**
+		 * Upload the items loaded and still selected, and request the selected items that are
+		 * not resident.  This must be called on the rendering thread, after the items of the
+		 * frame have been selected.
+		 *
+		 * @param uploadBudget the most cost to upload, and half of the most to request
+		 * @return the cost uploaded
+		 */
+		size_t update( size_t uploadBudget );
+
+		/** @return whether an item is in its slot */
+		bool isResident( size_t item ) const { return state[item] == ITEM_RESIDENT; }
+		/** @return the slot of a resident item */
+		size_t slotOf( size_t item ) const { return itemSlot[item]; }
+		/** @return the vertex buffer holding the slots */
+		GLuint buffer() const { return bufID; }
+		/** @return the number of slots */
+		size_t numSlots() const { return slots.size(); }
+		/** @return the number of slots holding an item */
+		size_t numResident() const;
+
+	private:
+		enum ItemState { ITEM_IDLE, ITEM_REQUESTED, ITEM_LOADED, ITEM_RESIDENT };
+		static const size_t NONE = ~(size_t)0;
+		struct Loaded {
+			size_t item;
+			std::vector<char> data;
+		};
+		struct Slot {
+			size_t item;
+			unsigned long long lastUsed;
+		};
+
+		size_t acquireSlot();
+		void loaderLoop();
+
+		LoadFunction load;
+		size_t slotBytes;
+
+		// Used only on the rendering thread
+		std::vector<ItemState> state;
+		std::vector<size_t> itemSlot;
+		std::vector<unsigned long long> selectedFrame;
+		std::vector<size_t> itemCost;
+		std::vector<Slot> slots;
+		// The items selected in this frame, most wanted first
+		std::vector<size_t> wanted;
+		std::vector<Loaded> ready;
+		GLuint bufID;
+		unsigned long long frame;
+
+		std::thread loader;
+		std::mutex mutex;
+		std::condition_variable wake;
+		// Guarded by mutex: the items to load, most wanted first, and the items loaded
+		std::deque<size_t> requests;
+		std::vector<Loaded> loaded;
+		bool quit;
+	};
+}
+
+#include "gltw_stream.inl"
+
+#endif
@@ -0,0 +1,154 @@
+#include <algorithm>
+
+namespace gltw {
+
+	inline StreamingPool::StreamingPool() : slotBytes(0), bufID(0), frame(0), quit(false) { }
+
+	inline StreamingPool::~StreamingPool() {
+		if( loader.joinable() ) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				quit = true;
+			}
+			wake.notify_all();
+			loader.join();
+		}
+		if( bufID != 0 ) {
+			glDeleteBuffers( 1, &bufID );
+			trackMemory( MEMORY_VERTICES, -(long long)(slotBytes * slots.size()) );
+		}
+	}
+
+	inline void StreamingPool::start( size_t numItems, size_t numSlots, size_t bytes, LoadFunction loadFunction ) {
+		load = loadFunction;
+		slotBytes = bytes;
+		numSlots = std::max( std::min( numSlots, numItems ), (size_t)1 );
+		Slot empty = { NONE, 0 };
+		slots.assign( numSlots, empty );
+		state.assign( numItems, ITEM_IDLE );
+		itemSlot.assign( numItems, (size_t)NONE );
+		selectedFrame.assign( numItems, 0 );
+		itemCost.assign( numItems, 0 );
+
+		glGenBuffers( 1, &bufID );
+		glBindBuffer( GL_ARRAY_BUFFER, bufID );
+		glBufferData( GL_ARRAY_BUFFER, slotBytes * numSlots, NULL, GL_DYNAMIC_DRAW );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+		trackMemory( MEMORY_VERTICES, (long long)(slotBytes * numSlots) );
+
+		loader = std::thread( &StreamingPool::loaderLoop, this );
+	}
+
+	inline void StreamingPool::loaderLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			while( !quit && requests.empty() ) wake.wait(lock);
+			if( quit ) break;
+			Loaded result;
+			result.item = requests.front();
+			requests.pop_front();
+			lock.unlock();
+
+			{
+				GLTW_TRACE_INTERNAL( "StreamingPool::load" );
+				load( result.item, result.data );
+			}
+
+			lock.lock();
+			loaded.push_back( std::move(result) );
+		}
+	}
+
+	inline void StreamingPool::beginFrame() {
+		frame++;
+		wanted.clear();
+	}
+
+	inline void StreamingPool::select( size_t item, size_t cost ) {
+		selectedFrame[item] = frame;
+		itemCost[item] = cost;
+		wanted.push_back( item );
+		if( state[item] == ITEM_RESIDENT ) slots[itemSlot[item]].lastUsed = frame;
+	}
+
+	inline size_t StreamingPool::numResident() const {
+		size_t n = 0;
+		for( size_t i = 0; i < slots.size(); i++ ) {
+			if( slots[i].item != NONE ) n++;
+		}
+		return n;
+	}
+
+	inline size_t StreamingPool::acquireSlot() {
+		// A free slot, or else that of the least recently selected item not selected now
+		size_t best = slots.size();
+		for( size_t i = 0; i < slots.size(); i++ ) {
+			if( slots[i].item == NONE ) return i;
+			if( slots[i].lastUsed >= frame ) continue;
+			if( best == slots.size() || slots[i].lastUsed < slots[best].lastUsed ) best = i;
+		}
+		if( best != slots.size() ) {
+			const size_t old = slots[best].item;
+			state[old] = ITEM_IDLE;
+			itemSlot[old] = NONE;
+			slots[best].item = NONE;
+		}
+		return best;
+	}
+
+	inline size_t StreamingPool::update( size_t uploadBudget ) {
+		if( bufID == 0 ) return 0;
+
+		// Upload the loaded items that are still wanted, within the budget
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for( size_t i = 0; i < loaded.size(); i++ ) {
+				state[loaded[i].item] = ITEM_LOADED;
+				ready.push_back( std::move(loaded[i]) );
+			}
+			loaded.clear();
+		}
+		size_t uploaded = 0, kept = 0;
+		glBindBuffer( GL_ARRAY_BUFFER, bufID );
+		for( size_t i = 0; i < ready.size(); i++ ) {
+			const size_t item = ready[i].item;
+			if( selectedFrame[item] != frame ) {
+				state[item] = ITEM_IDLE;
+				continue;
+			}
+			const size_t slot = uploaded < uploadBudget ? acquireSlot() : slots.size();
+			if( slot == slots.size() ) {
+				ready[kept++] = std::move(ready[i]);
+				continue;
+			}
+			const size_t bytes = std::min( ready[i].data.size(), slotBytes );
+			glBufferSubData( GL_ARRAY_BUFFER, slotBytes * slot, bytes, ready[i].data.data() );
+			GLTW_TRACE_COUNT( COUNTER_BYTES_UPLOADED, bytes );
+			slots[slot].item = item;
+			slots[slot].lastUsed = frame;
+			itemSlot[item] = slot;
+			state[item] = ITEM_RESIDENT;
+			uploaded += itemCost[item];
+		}
+		ready.resize( kept );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+		// Replace the requests with the selected items not yet loaded, most wanted first,
+		// enough to keep uploads going until the next update
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for( size_t i = 0; i < requests.size(); i++ ) state[requests[i]] = ITEM_IDLE;
+			requests.clear();
+			size_t requested = 0;
+			for( size_t i = 0; i < wanted.size() && requested < 2 * uploadBudget; i++ ) {
+				const size_t item = wanted[i];
+				if( state[item] != ITEM_IDLE ) continue;
+				state[item] = ITEM_REQUESTED;
+				requests.push_back( item );
+				requested += itemCost[item];
+			}
+		}
+		wake.notify_one();
+		return uploaded;
+	}
+}
@@ -0,0 +1,198 @@
+#ifndef __gltw_terrain_hpp
+#define __gltw_terrain_hpp
+
+#include <cstdint>
+#include <vector>
+
+namespace gltw {
+
+	/**
+	 * Write a heightmap as a tiled terrain file for Terrain.  The heightmap is cut into
+	 * square chunks of chunkSize x chunkSize cells, each stored with its own copy of the
+	 * samples on its border and one sample beyond, so that a chunk can be read and its
+	 * normals computed without its neighbors.  The bounds of the heights of each chunk are
+	 * stored in a table ahead of the samples, for culling chunks that are not loaded.
+	 *
+	 * @param fileName the name of the file to write
+	 * @param heights width * depth heights, in rows of increasing z, each of increasing x
+	 * @param width the number of samples along x
+	 * @param depth the number of samples along z
+	 * @param chunkSize the number of cells along each edge of a chunk, a power of two from 2 to 128.
+	 *    A heightmap that does not fill its last chunks is extended by repeating its edges.
+	 * @return false if the chunk size is invalid, or the file could not be written
+	 */
+	bool writeTerrainFile( const char * fileName, const GLfloat * heights, GLuint width, GLuint depth, GLuint chunkSize = 64 );
+
+	/// @privatesection
+	/** The header of a terrain file */
+	struct TerrainHeader {
+		char magic[8];
+		uint32_t chunksX, chunksZ, chunkSize, reserved;
+	};
+
+	/** A chunk of a terrain file, as stored in its table */
+	struct TerrainChunkInfo {
+		/** The bounds of the heights of the chunk's samples */
+		GLfloat minHeight, maxHeight;
+		/** The offset of the chunk's samples from the start of the file */
+		uint64_t offset;
+	};
+	/// @publicsection
+
+	/** Counts of the chunks and triangles of a Terrain, see Terrain::stats */
+	struct TerrainStats {
+		/** The chunks in the terrain */
+		size_t chunks;
+		/** The chunks within the view distance and frustum after the last update() */
+		size_t selected;
+		/** The chunks in GPU memory */
+		size_t resident;
+		/** The selected chunks not yet in GPU memory */
+		size_t loading;
+		/** The chunks uploaded by the last update() */
+		size_t uploaded;
+		/** The number of selected chunks at each level of detail, from the finest */
+		std::vector<size_t> chunksPerLevel;
+	};
+
+	/**
+	 * <p>Draws height-mapped terrain of any size from a file written by ::writeTerrainFile,
+	 * using geomipmapping.  The terrain is a grid of square chunks, each a grid of vertices
+	 * laid out as ::buildPlane lays them out.  Each chunk is drawn at a level of detail that
+	 * skips vertices, using one vertex every 2<sup>level</sup> samples, chosen by its
+	 * distance from the camera.  The levels of adjacent chunks differ by at most one.  A
+	 * chunk beside a coarser one uses a variant of its triangles that drops the
+	 * vertices of the shared edge the coarser chunk lacks, so there are no cracks.  The
+	 * triangles of every level and combination of coarser neighbors are built once, into
+	 * a single index buffer shared by all chunks.</p>
+	 *
+	 * <p>Only the chunks within the view distance are considered, so the cost of a frame
+	 * depends on the view distance rather than the size of the terrain.  The file is memory
+	 * mapped, and a loader thread reads the chunks near the camera, nearest first, and
+	 * computes their vertices and normals.  update() uploads a few each frame into a fixed
+	 * pool of slots in one vertex buffer, replacing the chunks that have been out of view
+	 * the longest.  A chunk is not drawn until it has been loaded.</p>
+	 *
+	 * <p>The terrain lies in the x-z plane with y up, with the corner of its first sample
+	 * at the origin.</p>
+	 *
+	 * <p><code>
+	 *    // Initialization<br />
+	 *    gltw::writeTerrainFile( "island.ter", heights, 4097, 4097 );<br />
+	 *    gltw::Terrain terrain( "island.ter", 2.0f, 300.0f );<br />
+	 *    <br />
+	 *    // Within the draw function<br />
+	 *    terrain.update( view, projection );<br />
+	 *    terrain.draw( view, projection );<br />
+	 * </code></p>
+	 */
+	class Terrain : public NonCopyable {
+	public:
+		/**
+		 * Open a terrain file, build the index buffer, allocate the pool of chunk slots and
+		 * start the loader thread.  If the file cannot be read an error message is
+		 * displayed, and isOpen() returns false.
+		 *
+		 * @param fileName the file written by ::writeTerrainFile
+		 * @param spacing the distance between samples along x and z
+		 * @param heightScale the factor the heights are multiplied by
+		 * @param numSlots the number of chunks the vertex buffer holds, which also limits the
+		 *    chunks drawn in a frame
+		 */
+		explicit Terrain( const char * fileName, GLfloat spacing = 1.0f, GLfloat heightScale = 1.0f, size_t numSlots = 256 );
+
+		/** Stops the loader thread and deletes the buffers */
+		~Terrain();
+
+		/** @return whether the file was opened */
+		bool isOpen() const { return file.isOpen() && !chunks.empty(); }
+
+		/**
+		 * Select the chunks to draw for a view and their levels of detail, upload chunks
+		 * that have been loaded, and request the selected chunks that are not resident.
+		 * This never waits for the loader.  This must be called on the rendering thread,
+		 * typically once per frame.
+		 *
+		 * @param view the view matrix (16 values, column-major)
+		 * @param projection the projection matrix (16 values, column-major)
+		 */
+		void update( const GLfloat * view, const GLfloat * projection );
+
+		/**
+		 * Draw the selected chunks that are resident, one draw call each.  The shader variant
+		 * is made active, and given the projection matrix, with the view matrix as its
+		 * model-view matrix.
+		 *
+		 * @param view the view matrix (16 values, column-major)
+		 * @param projection the projection matrix (16 values, column-major)
+		 * @param shader the stock shader variant, which may use the ::ATTRIB_POSITION and
+		 *    ::ATTRIB_NORMAL attributes only
+		 * @return the number of triangles drawn
+		 */
+		size_t draw( const GLfloat * view, const GLfloat * projection,
+			ShaderKey shader = stockShaderKey( SHADER_DEFAULT_LIGHT ) );
+
+		/** Set the distance beyond which chunks are not drawn, defaults to 32 chunks */
+		void setViewDistance( GLfloat distance ) { viewDistance = distance; }
+		/**
+		 * Set the distance from the camera at which chunks switch from the finest level of
+		 * detail to the next.  Each further level starts at twice the distance of the
+		 * previous one.  Defaults to twice the size of a chunk.
+		 */
+		void setLodDistance( GLfloat distance ) { lodDistance = distance; }
+		/** Set the most chunks to upload in each update(), defaults to 4 */
+		void setUploadBudget( size_t chunksPerFrame ) { uploadBudget = chunksPerFrame; }
+
+		/** @return the number of chunks along x */
+		GLuint chunksX() const { return numX; }
+		/** @return the number of chunks along z */
+		GLuint chunksZ() const { return numZ; }
+		/** @return the size of a chunk along x and z */
+		GLfloat chunkExtent() const { return chunkSize * spacing; }
+		/** @return the number of levels of detail */
+		int levels() const { return numLevels; }
+
+		/** @return the counts of chunks selected, resident and loading */
+		TerrainStats stats() const;
+
+	private:
+		// Where the triangles of a level and combination of coarser neighbors are in the index buffer
+		struct IndexRange {
+			GLuint first;
+			GLsizei count;
+		};
+		struct Selected {
+			GLuint chunk;
+			GLfloat distance;
+			int level;
+			int coarser;
+		};
+
+		void buildIndices();
+		void select( const GLfloat * view, const GLfloat * projection );
+		void buildVertices( GLuint chunk, std::vector<char> & vertices ) const;
+
+		MappedFile file;
+		std::vector<TerrainChunkInfo> chunks;
+		GLuint numX, numZ, chunkSize;
+		GLfloat spacing, heightScale;
+		int numLevels;
+		// The positions of the vertices of a flat chunk of unit cells centered at the origin, from buildPlane
+		std::vector<GLfloat> grid;
+		// Indexed by level * 16 + the mask of the coarser neighbors
+		std::vector<IndexRange> ranges;
+
+		std::vector<Selected> selected;
+		GLuint vaID, indexBufID;
+		size_t indexBytes;
+		GLfloat viewDistance, lodDistance;
+		size_t uploadBudget, numUploaded;
+
+		// Declared last, so that its loader thread stops before the file and chunks it reads are destroyed
+		StreamingPool pool;
+	};
+}
+
+#include "gltw_terrain.inl"
+
+#endif
@@ -0,0 +1,391 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace gltw {
+
+	/// @privatesection
+	/** Identifies a terrain file, and the version of its layout */
+	static const char GLTW_TERRAIN_MAGIC[8] = { 'G', 'L', 'T', 'W', 'T', 'E', '1', '\0' };
+
+	/** The floats of each terrain vertex: a position (x,y,z) and a normal (x,y,z) */
+	static const int GLTW_TERRAIN_VERTEX_FLOATS = 6;
+	/// @publicsection
+
+	inline bool writeTerrainFile( const char * fileName, const GLfloat * heights, GLuint width, GLuint depth, GLuint chunkSize )
+	{
+		GLTW_TRACE_INTERNAL( "writeTerrainFile" );
+		if( chunkSize < 2 || chunkSize > 128 || (chunkSize & (chunkSize - 1)) != 0 ) {
+			cerr << "Error in writeTerrainFile: the chunk size must be a power of two from 2 to 128." << endl;
+			return false;
+		}
+		if( width < 2 || depth < 2 ) {
+			cerr << "Error in writeTerrainFile: the heightmap must have at least 2 x 2 samples." << endl;
+			return false;
+		}
+		TerrainHeader header;
+		memcpy( header.magic, GLTW_TERRAIN_MAGIC, sizeof(header.magic) );
+		header.chunksX = (width - 2) / chunkSize + 1;
+		header.chunksZ = (depth - 2) / chunkSize + 1;
+		header.chunkSize = chunkSize;
+		header.reserved = 0;
+
+		FILE * out = fopen( fileName, "wb" );
+		if( out == NULL ) {
+			cerr << "Error in writeTerrainFile: unable to open file " << fileName << "." << endl;
+			return false;
+		}
+
+		// Each chunk's samples include a border of one sample beyond its cells, for its normals
+		const size_t side = chunkSize + 3;
+		const size_t numChunks = (size_t)header.chunksX * header.chunksZ;
+		std::vector<TerrainChunkInfo> table( numChunks );
+		std::vector<GLfloat> samples( side * side );
+		bool failed = fwrite( &header, sizeof(header), 1, out ) != 1 ||
+			fseek( out, (long)(numChunks * sizeof(TerrainChunkInfo)), SEEK_CUR ) != 0;
+		uint64_t offset = sizeof(header) + numChunks * sizeof(TerrainChunkInfo);
+		for( size_t c = 0; c < numChunks && !failed; c++ ) {
+			const long x0 = (long)(c % header.chunksX) * chunkSize - 1;
+			const long z0 = (long)(c / header.chunksX) * chunkSize - 1;
+			TerrainChunkInfo & info = table[c];
+			info.minHeight = FLT_MAX;
+			info.maxHeight = -FLT_MAX;
+			info.offset = offset;
+			for( size_t i = 0; i < side; i++ ) {
+				const long z = std::min( std::max( z0 + (long)i, 0L ), (long)depth - 1 );
+				for( size_t j = 0; j < side; j++ ) {
+					const long x = std::min( std::max( x0 + (long)j, 0L ), (long)width - 1 );
+					const GLfloat h = heights[(size_t)z * width + x];
+					samples[i * side + j] = h;
+					if( i >= 1 && i <= chunkSize + 1 && j >= 1 && j <= chunkSize + 1 ) {
+						info.minHeight = std::min( info.minHeight, h );
+						info.maxHeight = std::max( info.maxHeight, h );
+					}
+				}
+			}
+			failed = fwrite( samples.data(), sizeof(GLfloat), samples.size(), out ) != samples.size();
+			offset += samples.size() * sizeof(GLfloat);
+		}
+		if( !failed ) {
+			failed = fseek( out, sizeof(header), SEEK_SET ) != 0 ||
+				fwrite( table.data(), sizeof(TerrainChunkInfo), numChunks, out ) != numChunks;
+		}
+		if( fclose( out ) != 0 ) failed = true;
+		if( failed ) cerr << "Error in writeTerrainFile: unable to write file " << fileName << "." << endl;
+		return !failed;
+	}
+
+	inline Terrain::Terrain( const char * fileName, GLfloat spacing, GLfloat heightScale, size_t numSlots ) :
+		numX(0), numZ(0), chunkSize(0), spacing(spacing), heightScale(heightScale), numLevels(0),
+		vaID(0), indexBufID(0), indexBytes(0), viewDistance(0.0f), lodDistance(0.0f),
+		uploadBudget(4), numUploaded(0)
+	{
+		if( !file.open( fileName ) ) {
+			cerr << "Error in Terrain constructor:  unable to open file " << fileName << "." << endl;
+			return;
+		}
+		TerrainHeader header;
+		bool valid = file.size() >= sizeof(header);
+		if( valid ) {
+			memcpy( &header, file.data(), sizeof(header) );
+			valid = memcmp( header.magic, GLTW_TERRAIN_MAGIC, sizeof(header.magic) ) == 0 &&
+				header.chunksX > 0 && header.chunksZ > 0 &&
+				header.chunkSize >= 2 && header.chunkSize <= 128 && (header.chunkSize & (header.chunkSize - 1)) == 0 &&
+				(uint64_t)header.chunksX * header.chunksZ <= (file.size() - sizeof(header)) / sizeof(TerrainChunkInfo);
+		}
+		if( valid ) {
+			chunks.resize( (size_t)header.chunksX * header.chunksZ );
+			memcpy( chunks.data(), file.data() + sizeof(header), chunks.size() * sizeof(TerrainChunkInfo) );
+			const uint64_t bytes = (uint64_t)(header.chunkSize + 3) * (header.chunkSize + 3) * sizeof(GLfloat);
+			for( size_t i = 0; i < chunks.size() && valid; i++ ) {
+				valid = chunks[i].offset <= file.size() && bytes <= file.size() - chunks[i].offset;
+			}
+		}
+		if( !valid ) {
+			cerr << "Error in Terrain constructor:  " << fileName << " is not a terrain file." << endl;
+			chunks.clear();
+			file.close();
+			return;
+		}
+		numX = header.chunksX;
+		numZ = header.chunksZ;
+		chunkSize = header.chunkSize;
+		for( GLuint s = chunkSize; s > 0; s >>= 1 ) numLevels++;
+		viewDistance = 32.0f * chunkExtent();
+		lodDistance = 2.0f * chunkExtent();
+
+		// Every chunk has the vertex layout of a plane of chunkSize x chunkSize unit cells
+		MeshData plane;
+		buildPlane( plane, (float)chunkSize, (float)chunkSize, chunkSize, chunkSize );
+		grid.swap( plane.positions );
+		buildIndices();
+
+		// Reading the mapping is what brings a chunk in from disk
+		pool.start( chunks.size(), numSlots, (grid.size() / 3) * GLTW_TERRAIN_VERTEX_FLOATS * sizeof(GLfloat),
+			[this]( size_t chunk, std::vector<char> & vertices ) { buildVertices( (GLuint)chunk, vertices ); } );
+
+		const GLsizei stride = GLTW_TERRAIN_VERTEX_FLOATS * sizeof(GLfloat);
+		glGenVertexArrays( 1, &vaID );
+		glBindVertexArray( vaID );
+		glBindBuffer( GL_ARRAY_BUFFER, pool.buffer() );
+		glEnableVertexAttribArray( GLTW_ATTRIB_IDX_POSITION );
+		glVertexAttribPointer( GLTW_ATTRIB_IDX_POSITION, 3, GL_FLOAT, GL_FALSE, stride, 0 );
+		glEnableVertexAttribArray( GLTW_ATTRIB_IDX_NORMAL );
+		glVertexAttribPointer( GLTW_ATTRIB_IDX_NORMAL, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid *)(3 * sizeof(GLfloat)) );
+		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBufID );
+		glBindVertexArray( 0 );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	}
+
+	inline Terrain::~Terrain() {
+		if( vaID != 0 ) glDeleteVertexArrays( 1, &vaID );
+		if( indexBufID != 0 ) {
+			glDeleteBuffers( 1, &indexBufID );
+			trackMemory( MEMORY_ELEMENTS, -(long long)indexBytes );
+		}
+	}
+
+	inline void Terrain::buildIndices() {
+		const int n = (int)chunkSize;
+		std::vector<GLuint> elements;
+		ranges.resize( 16 * numLevels );
+
+		// Adds a triangle between grid vertices (x,z), wound counter-clockwise seen from +y as buildPlane's are
+		struct Emit {
+			std::vector<GLuint> & elements;
+			int n;
+			void operator()( int ax, int az, int bx, int bz, int cx, int cz ) {
+				if( (bz - az) * (cx - ax) - (bx - ax) * (cz - az) < 0 ) {
+					std::swap( bx, cx );
+					std::swap( bz, cz );
+				}
+				elements.push_back( az * (n + 1) + ax );
+				elements.push_back( bz * (n + 1) + bx );
+				elements.push_back( cz * (n + 1) + cx );
+			}
+		} emit = { elements, n };
+
+		for( int level = 0; level < numLevels; level++ ) {
+			const int s = 1 << level, m = n / s;
+			for( int coarser = 0; coarser < 16; coarser++ ) {
+				IndexRange & range = ranges[16 * level + coarser];
+				range.first = (GLuint)elements.size();
+				if( m == 1 ) {
+					// The coarsest level: no neighbor can be coarser
+					emit( 0, 0, 0, n, n, n );
+					emit( 0, 0, n, n, n, 0 );
+					range.count = (GLsizei)(elements.size() - range.first);
+					continue;
+				}
+
+				// The cells away from the edges
+				for( int i = 1; i < m - 1; i++ ) {
+					for( int j = 1; j < m - 1; j++ ) {
+						const int x = j * s, z = i * s;
+						emit( x, z, x, z + s, x + s, z + s );
+						emit( x, z, x + s, z + s, x + s, z );
+					}
+				}
+
+				// The ring of cells along the edges, as four trapezoids each joining an edge of
+				// the chunk to the edge of the interior.  Along an edge shared with a coarser
+				// neighbor only every other vertex is used, so the two sides match.
+				for( int edge = 0; edge < 4; edge++ ) {
+					const int outerStep = (coarser & (1 << edge)) ? 2 * s : s;
+					// Walks the outer and inner rows together, advancing whichever is behind
+					int outer = 0, inner = s;
+					while( outer < n || inner < n - s ) {
+						const bool advanceOuter = inner >= n - s || (outer < n && outer + outerStep <= inner + s);
+						int t[3], d[3];
+						t[0] = outer; d[0] = 0;
+						t[1] = inner; d[1] = s;
+						if( advanceOuter ) {
+							outer += outerStep;
+							t[2] = outer; d[2] = 0;
+						} else {
+							inner += s;
+							t[2] = inner; d[2] = s;
+						}
+						// Edges 0 to 3 are at x = 0, x = n, z = 0 and z = n
+						int x[3], z[3];
+						for( int k = 0; k < 3; k++ ) {
+							switch( edge ) {
+							case 0: x[k] = d[k]; z[k] = t[k]; break;
+							case 1: x[k] = n - d[k]; z[k] = t[k]; break;
+							case 2: x[k] = t[k]; z[k] = d[k]; break;
+							default: x[k] = t[k]; z[k] = n - d[k]; break;
+							}
+						}
+						emit( x[0], z[0], x[1], z[1], x[2], z[2] );
+					}
+				}
+				range.count = (GLsizei)(elements.size() - range.first);
+			}
+		}
+
+		indexBytes = elements.size() * sizeof(GLuint);
+		// Uploaded through the array buffer binding, since the element buffer binding belongs to a vertex array
+		glGenBuffers( 1, &indexBufID );
+		glBindBuffer( GL_ARRAY_BUFFER, indexBufID );
+		glBufferData( GL_ARRAY_BUFFER, indexBytes, elements.data(), GL_STATIC_DRAW );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+		trackMemory( MEMORY_ELEMENTS, (long long)indexBytes );
+		GLTW_TRACE_COUNT( COUNTER_BYTES_UPLOADED, indexBytes );
+	}
+
+	inline void Terrain::buildVertices( GLuint chunk, std::vector<char> & vertices ) const {
+		const size_t side = chunkSize + 3;
+		const GLfloat * h = (const GLfloat *)(file.data() + chunks[chunk].offset);
+		const size_t numVerts = grid.size() / 3;
+		// The sample coordinates of the chunk's center; buildPlane's grid is centered on the origin
+		const GLfloat cx = (GLfloat)((chunk % numX) * chunkSize + chunkSize / 2);
+		const GLfloat cz = (GLfloat)((chunk / numX) * chunkSize + chunkSize / 2);
+		vertices.resize( numVerts * GLTW_TERRAIN_VERTEX_FLOATS * sizeof(GLfloat) );
+		GLfloat * v = (GLfloat *)vertices.data();
+		for( size_t i = 0; i < numVerts; i++ ) {
+			// The grid holds whole numbers, so chunks that share an edge compute the same positions
+			const GLfloat gx = grid[3 * i] + cx, gz = grid[3 * i + 2] + cz;
+			const size_t row = i / (chunkSize + 1) + 1, col = i % (chunkSize + 1) + 1;
+			const GLfloat * p = h + row * side + col;
+			GLfloat nx = (p[-1] - p[1]) * heightScale, ny = 2.0f * spacing, nz = (p[-(long)side] - p[side]) * heightScale;
+			const GLfloat scale = 1.0f / sqrtf( nx * nx + ny * ny + nz * nz );
+			v[0] = gx * spacing;
+			v[1] = p[0] * heightScale;
+			v[2] = gz * spacing;
+			v[3] = nx * scale;
+			v[4] = ny * scale;
+			v[5] = nz * scale;
+			v += GLTW_TERRAIN_VERTEX_FLOATS;
+		}
+	}
+
+	inline void Terrain::select( const GLfloat * view, const GLfloat * projection ) {
+		GLfloat viewProjection[16];
+		multiplyMatrix4( projection, view, viewProjection );
+		GLfloat eye[3];
+		for( int i = 0; i < 3; i++ ) {
+			eye[i] = -(view[4 * i] * view[12] + view[4 * i + 1] * view[13] + view[4 * i + 2] * view[14]);
+		}
+
+		// Only the chunks within the view distance of the camera are visited
+		const GLfloat extent = chunkExtent();
+		const long x0 = std::max( (long)floorf( (eye[0] - viewDistance) / extent ), 0L );
+		const long z0 = std::max( (long)floorf( (eye[2] - viewDistance) / extent ), 0L );
+		const long x1 = std::min( (long)floorf( (eye[0] + viewDistance) / extent ), (long)numX - 1 );
+		const long z1 = std::min( (long)floorf( (eye[2] + viewDistance) / extent ), (long)numZ - 1 );
+		selected.clear();
+		pool.beginFrame();
+		if( x0 > x1 || z0 > z1 ) return;
+
+		for( long cz = z0; cz <= z1; cz++ ) {
+			for( long cx = x0; cx <= x1; cx++ ) {
+				const GLuint index = (GLuint)(cz * numX + cx);
+				const GLfloat a = chunks[index].minHeight * heightScale, b = chunks[index].maxHeight * heightScale;
+				const GLfloat min[] = { cx * extent, std::min( a, b ), cz * extent };
+				const GLfloat max[] = { min[0] + extent, std::max( a, b ), min[2] + extent };
+				GLfloat d2 = 0.0f;
+				for( int i = 0; i < 3; i++ ) {
+					const GLfloat d = std::max( std::max( min[i] - eye[i], eye[i] - max[i] ), 0.0f );
+					d2 += d * d;
+				}
+				const GLfloat distance = sqrtf( d2 );
+				if( distance > viewDistance || !boxInFrustum( viewProjection, min, max ) ) continue;
+				int level = 0;
+				if( distance >= lodDistance ) level = std::min( 1 + (int)floorf( log2f( distance / lodDistance ) ), numLevels - 1 );
+				Selected chunk = { index, distance, level, 0 };
+				selected.push_back( chunk );
+			}
+		}
+
+		// The nearest chunks that fit in the slots
+		std::sort( selected.begin(), selected.end(),
+			[]( const Selected & p, const Selected & q ) { return p.distance < q.distance; } );
+		if( selected.size() > pool.numSlots() ) selected.resize( pool.numSlots() );
+
+		// Lower levels until adjacent chunks differ by at most one, then note the coarser neighbors
+		const long w = x1 - x0 + 1, h = z1 - z0 + 1;
+		std::vector<int> levels( w * h, -1 );
+		for( size_t i = 0; i < selected.size(); i++ ) {
+			const long cx = selected[i].chunk % numX, cz = selected[i].chunk / numX;
+			levels[(cz - z0) * w + (cx - x0)] = selected[i].level;
+		}
+		static const int dx[] = { -1, 1, 0, 0 }, dz[] = { 0, 0, -1, 1 };
+		for( bool changed = true; changed; ) {
+			changed = false;
+			for( long z = 0; z < h; z++ ) {
+				for( long x = 0; x < w; x++ ) {
+					int & level = levels[z * w + x];
+					if( level < 0 ) continue;
+					for( int e = 0; e < 4; e++ ) {
+						const long nx = x + dx[e], nz = z + dz[e];
+						if( nx < 0 || nx >= w || nz < 0 || nz >= h ) continue;
+						const int other = levels[nz * w + nx];
+						if( other >= 0 && level > other + 1 ) {
+							level = other + 1;
+							changed = true;
+						}
+					}
+				}
+			}
+		}
+		for( size_t i = 0; i < selected.size(); i++ ) {
+			Selected & chunk = selected[i];
+			const long x = chunk.chunk % numX - x0, z = chunk.chunk / numX - z0;
+			chunk.level = levels[z * w + x];
+			chunk.coarser = 0;
+			for( int e = 0; e < 4; e++ ) {
+				const long nx = x + dx[e], nz = z + dz[e];
+				if( nx < 0 || nx >= w || nz < 0 || nz >= h ) continue;
+				if( levels[nz * w + nx] > chunk.level ) chunk.coarser |= 1 << e;
+			}
+			pool.select( chunk.chunk );
+		}
+	}
+
+	inline void Terrain::update( const GLfloat * view, const GLfloat * projection ) {
+		if( !isOpen() ) return;
+		GLTW_TRACE_INTERNAL( "Terrain::update" );
+		select( view, projection );
+		numUploaded = pool.update( uploadBudget );
+	}
+
+	inline size_t Terrain::draw( const GLfloat * view, const GLfloat * projection, ShaderKey shader ) {
+		if( !isOpen() || selected.empty() ) return 0;
+		GLTW_TRACE_INTERNAL( "Terrain::draw" );
+		useShaderVariant( shader );
+		setProjectionMatrix( const_cast<GLfloat *>(projection) );
+		setModelViewMatrix( const_cast<GLfloat *>(view) );
+		const GLint vertsPerChunk = (GLint)(grid.size() / 3);
+		size_t triangles = 0;
+		glBindVertexArray( vaID );
+		for( size_t i = 0; i < selected.size(); i++ ) {
+			const Selected & chunk = selected[i];
+			if( !pool.isResident( chunk.chunk ) ) continue;
+			const IndexRange & range = ranges[16 * chunk.level + chunk.coarser];
+			glDrawElementsBaseVertex( GL_TRIANGLES, range.count, GL_UNSIGNED_INT,
+				(const GLvoid *)(range.first * sizeof(GLuint)), vertsPerChunk * (GLint)pool.slotOf( chunk.chunk ) );
+			GLTW_TRACE_COUNT( COUNTER_DRAWS, 1 );
+			GLTW_TRACE_COUNT( COUNTER_VERTICES, range.count );
+			triangles += range.count / 3;
+		}
+		glBindVertexArray( 0 );
+		return triangles;
+	}
+
+	inline TerrainStats Terrain::stats() const {
+		TerrainStats stats;
+		stats.chunks = chunks.size();
+		stats.selected = selected.size();
+		stats.resident = pool.numResident();
+		stats.loading = 0;
+		stats.chunksPerLevel.assign( numLevels, 0 );
+		for( size_t i = 0; i < selected.size(); i++ ) {
+			stats.chunksPerLevel[selected[i].level]++;
+			if( !pool.isResident( selected[i].chunk ) ) stats.loading++;
+		}
+		stats.uploaded = numUploaded;
+		return stats;
+	}
+}
@@ -0,0 +1,289 @@
+#ifndef __gltw_texture_hpp
+#define __gltw_texture_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gltw {
+
+	/**
+	 * <p>A two-dimensional texture, or an array of two-dimensional layers, with a fixed size,
+	 * format and number of mipmap levels.  The storage of every level is allocated by the constructor, and the bytes are
+	 * counted against the GPU memory budget (see ::setMemoryBudget).  Data is copied into a
+	 * level with copyImageData, or streamed in without stalling with a TextureUploader.</p>
+	 *
+	 * <p>The stock shaders sample the texture bound to unit 0 when the
+	 * ::FEATURE_TEXTURE feature is selected, using the ::ATTRIB_TEXCOORD attribute.</p>
+	 *
+	 * <p><code>
+	 *    // Initialization<br />
+	 *    gltw::Texture checker( 256, 256, 0 );<br />
+	 *    checker.copyImageData( 0, pixels );<br />
+	 *    checker.generateMipmaps();<br />
+	 *    <br />
+	 *    // Within the draw function<br />
+	 *    gltw::useShaderVariant( gltw::shaderKey( gltw::FEATURE_LIGHTING | gltw::FEATURE_TEXTURE ) );<br />
+	 *    checker.bind();<br />
+	 *    mesh->draw();<br />
+	 * </code></p>
+	 */
+	class Texture : public NonCopyable {
+	public:
+		/**
+		 * Create the texture and allocate all of its levels.  The minifying filter is
+		 * trilinear when there is more than one level, and the texture repeats.
+		 *
+		 * @param width the width of level 0, in pixels
+		 * @param height the height of level 0, in pixels
+		 * @param levels the number of mipmap levels, or zero for the full chain down to 1x1
+		 * @param internalFormat the internal format, such as GL_RGBA8, GL_R8 or GL_RGBA16F
+		 * @param layers zero for a GL_TEXTURE_2D texture, or the number of layers of a
+		 *     GL_TEXTURE_2D_ARRAY texture
+		 */
+		Texture( GLsizei width, GLsizei height, int levels = 1, GLenum internalFormat = GL_RGBA8, int layers = 0 );
+
+		/** Moves the texture object of another Texture into a new one */
+		Texture( Texture && other );
+
+		/** Deletes this texture object, and moves that of another Texture into this one */
+		Texture & operator = ( Texture && other );
+
+		/** Deletes the texture object */
+		~Texture();
+
+		/**
+		 * Copy pixels into one level of the texture.  This waits for the driver to copy the
+		 * data, so for large images a TextureUploader is preferable.
+		 *
+		 * @param level the mipmap level
+		 * @param data the pixels of the whole level, rows from the bottom up, each row aligned
+		 *     to 4 bytes.  For an array texture, the level of each layer in turn.
+		 * @param format the format of the pixels, such as GL_RGBA or GL_RED
+		 * @param type the type of the pixel components, such as GL_UNSIGNED_BYTE or GL_FLOAT
+		 */
+		void copyImageData( int level, const void * data, GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE );
+
+		/**
+		 * Copy pixels into one level of one layer of an array texture, as copyImageData.
+		 *
+		 * @param layer the layer
+		 * @param level the mipmap level
+		 * @param data the pixels of the whole level of the layer
+		 * @param format the format of the pixels
+		 * @param type the type of the pixel components
+		 */
+		void copyLayerData( int layer, int level, const void * data, GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE );
+
+		/** Compute levels 1 and up from level 0 on the GPU, with glGenerateMipmap */
+		void generateMipmaps();
+
+		/**
+		 * Limit sampling to the levels from this one to the smallest.  A TextureUploader
+		 * uses this to sample only the levels uploaded so far.
+		 *
+		 * @param level the finest level to sample
+		 */
+		void setBaseLevel( int level );
+
+		/** Set the minifying and magnifying filters (GL_TEXTURE_MIN_FILTER and GL_TEXTURE_MAG_FILTER) */
+		void setFilter( GLenum minFilter, GLenum magFilter );
+
+		/** Set the wrap modes for the s and t coordinates (GL_TEXTURE_WRAP_S and GL_TEXTURE_WRAP_T) */
+		void setWrap( GLenum wrapS, GLenum wrapT );
+
+		/**
+		 * Bind this texture to a texture unit.  The active texture unit is left at unit 0.
+		 *
+		 * @param unit the texture unit, 0 for the stock shaders
+		 */
+		void bind( int unit = 0 ) const;
+
+		/** @return the OpenGL texture object */
+		GLuint id() const { return texID; }
+		/** @return the width of a level, in pixels */
+		GLsizei width( int level = 0 ) const;
+		/** @return the height of a level, in pixels */
+		GLsizei height( int level = 0 ) const;
+		/** @return the number of mipmap levels */
+		int levels() const { return numLevels; }
+		/** @return the number of layers, or zero if this is not an array texture */
+		int layers() const { return numLayers; }
+		/** @return GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY */
+		GLenum target() const { return numLayers > 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D; }
+		/** @return the internal format */
+		GLenum internalFormat() const { return format; }
+		/** @return the bytes of GPU memory held by the texture, as counted for the budget */
+		size_t gpuBytes() const;
+
+		/** @return the number of levels in a full mipmap chain for the given size */
+		static int fullLevels( GLsizei width, GLsizei height );
+
+	private:
+		void release();
+		size_t levelBytes( int level ) const;
+
+		GLuint texID;
+		GLsizei w, h;
+		int numLevels, numLayers;
+		GLenum format;
+	};
+
+	/** A Texture owned by a std::unique_ptr */
+	typedef std::unique_ptr<Texture> TexturePtr;
+
+	/**
+	 * An image submitted to a TextureUploader.  Its texture can be used as soon as the
+	 * smallest level has been uploaded, and becomes sharper as the finer levels arrive.
+	 */
+	class PendingTexture : public NonCopyable {
+	public:
+		PendingTexture( std::vector<unsigned char> && pixels, GLsizei width, GLsizei height, bool mipmaps );
+
+		/** @return whether all levels have been uploaded */
+		bool ready() const { return isReady; }
+
+		/**
+		 * @return the texture, or NULL if no level has been uploaded yet.  The texture is
+		 *    owned by this object unless it is taken with release().
+		 */
+		Texture * texture() const { return baseLevel < numLevels ? result.get() : NULL; }
+
+		/** @return the number of levels uploaded so far, smallest first */
+		int levelsLoaded() const { return numLevels - baseLevel; }
+
+		/** Take ownership of the texture.  @return the texture, or an empty pointer if it is not ready yet. */
+		TexturePtr release() { return isReady ? std::move(result) : TexturePtr(); }
+
+	private:
+		friend class TextureUploader;
+		// The levels, generated from the image on a worker thread
+		std::vector<std::vector<unsigned char> > data;
+		TexturePtr result;
+		GLsizei width, height;
+		int numLevels;
+		// The next level to upload, and the finest level from which all have been uploaded
+		int nextLevel, baseLevel;
+		std::vector<bool> loaded;
+		bool isReady;
+	};
+
+	/** A PendingTexture shared between the caller and the TextureUploader */
+	typedef std::shared_ptr<PendingTexture> PendingTexturePtr;
+
+	/**
+	 * <p>Streams RGBA8 images into textures without stalling the rendering thread.  Each
+	 * image's mipmap chain is generated by worker threads.  Then each frame, update() maps
+	 * pixel unpack buffers for the next levels, up to a budget of bytes per frame, and the
+	 * workers copy the levels into them.  The following update() starts the transfers from
+	 * those buffers to the textures, which the GPU performs asynchronously, and reuses each
+	 * buffer once a fence shows its transfer has finished.</p>
+	 *
+	 * <p>Levels are uploaded smallest first, and the texture's base level follows them, so a
+	 * texture appears blurred at once and sharpens over the following frames.  All of the
+	 * OpenGL calls are made by upload() and update() on the rendering thread; the workers
+	 * need no context.</p>
+	 *
+	 * <p><code>
+	 *    // Initialization<br />
+	 *    gltw::TextureUploader uploader( 4 << 20 );<br />
+	 *    gltw::PendingTexturePtr bricks = uploader.upload( std::move( pixels ), 2048, 2048 );<br />
+	 *    <br />
+	 *    // Within the draw function<br />
+	 *    uploader.update();<br />
+	 *    if( bricks->texture() ) bricks->texture()->bind();<br />
+	 * </code></p>
+	 */
+	class TextureUploader : public NonCopyable {
+	public:
+		/**
+		 * Start the worker threads.
+		 *
+		 * @param bytesPerFrame the number of bytes to upload in each update().  A level larger
+		 *    than this is uploaded alone in a frame.
+		 * @param numThreads the number of worker threads
+		 */
+		explicit TextureUploader( size_t bytesPerFrame = 4 << 20, int numThreads = 1 );
+
+		/**
+		 * Stops the worker threads and deletes the pixel unpack buffers.  Textures that have
+		 * not finished uploading keep the levels uploaded so far.  This must be called on the
+		 * rendering thread.
+		 */
+		~TextureUploader();
+
+		/**
+		 * Create a texture for an image and queue the image for upload.  This must be called
+		 * on the rendering thread.  Pass the pixels with std::move to avoid a copy; their
+		 * memory is freed once the upload has completed.
+		 *
+		 * @param pixels the image, 4 bytes per pixel (r,g,b,a), rows from the bottom up
+		 * @param width the width of the image, in pixels
+		 * @param height the height of the image, in pixels
+		 * @param mipmaps whether to generate and upload the full mipmap chain
+		 * @return a handle that provides the texture as its levels are uploaded
+		 */
+		PendingTexturePtr upload( std::vector<unsigned char> pixels, GLsizei width, GLsizei height, bool mipmaps = true );
+
+		/**
+		 * Move uploads forward by a frame: start the transfers of the levels the workers have
+		 * copied, recycle buffers whose transfers have finished, and map buffers for the next
+		 * levels within the byte budget.  This must be called on the rendering thread,
+		 * typically once per frame.  It never waits for the GPU or the workers.  The
+		 * transfers bind each texture to GL_TEXTURE_2D of the active texture unit, and the
+		 * texture bound there before the call is bound again afterwards, so update() may be
+		 * called between draws.
+		 *
+		 * @return the number of bytes whose transfers were started
+		 */
+		size_t update();
+
+		/** Set the number of bytes to upload in each update() */
+		void setBytesPerFrame( size_t bytes ) { budget = bytes; }
+
+		/** @return the number of textures that have been queued but are not ready yet */
+		size_t pending() const { return numPending; }
+
+	private:
+		// A level to copy into a mapped buffer, or with level -1, an image whose levels to generate
+		struct Task {
+			PendingTexturePtr texture;
+			int level;
+			size_t staging;
+			void * dest;
+		};
+		// A pixel unpack buffer, mapped while a worker copies into it, then fenced during the transfer
+		struct Staging {
+			GLuint pbo;
+			size_t size;
+			GLsync fence;
+			bool mapped;
+		};
+
+		void workerLoop();
+		static void generateLevels( PendingTexture & texture );
+		size_t acquireStaging( size_t bytes );
+
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable wake;
+		// Guarded by mutex: the workers' queue, and their results
+		std::deque<Task> tasks;
+		std::vector<PendingTexturePtr> generated;
+		std::vector<Task> copied;
+		bool quit;
+
+		// Used only on the rendering thread
+		std::vector<PendingTexturePtr> uploading;
+		std::vector<Staging> staging;
+		size_t budget;
+		size_t numPending;
+	};
+}
+
+#include "gltw_texture.inl"
+
+#endif
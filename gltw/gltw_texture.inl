@@ -0,0 +1,409 @@
+#include <algorithm>
+#include <cstring>
+
+namespace gltw {
+
+	/// @privatesection
+	/**
+	 * The pixel format and type to allocate a texture of an internal format with, and its
+	 * bytes per pixel.  Formats not listed are treated as 4 byte RGBA.
+	 */
+	inline size_t textureFormatInfo( GLenum internalFormat, GLenum & format, GLenum & type ) {
+		type = GL_UNSIGNED_BYTE;
+		switch( internalFormat ) {
+			case GL_R8: format = GL_RED; return 1;
+			case GL_RG8: format = GL_RG; return 2;
+			case GL_RGB8: format = GL_RGB; return 4;
+			case GL_R16F: format = GL_RED; type = GL_FLOAT; return 2;
+			case GL_RGBA16F: format = GL_RGBA; type = GL_FLOAT; return 8;
+			case GL_R32F: format = GL_RED; type = GL_FLOAT; return 4;
+			case GL_RGBA32F: format = GL_RGBA; type = GL_FLOAT; return 16;
+			case GL_DEPTH_COMPONENT24: format = GL_DEPTH_COMPONENT; type = GL_UNSIGNED_INT; return 4;
+			case GL_DEPTH_COMPONENT32F: format = GL_DEPTH_COMPONENT; type = GL_FLOAT; return 4;
+			default: format = GL_RGBA; return 4;
+		}
+	}
+	/// @publicsection
+
+	inline Texture::Texture( GLsizei width, GLsizei height, int levels, GLenum internalFormat, int layers ) :
+		texID(0), w(width), h(height), numLevels(levels), numLayers(std::max( layers, 0 )), format(internalFormat)
+	{
+		if( width <= 0 || height <= 0 ) {
+			cerr << "Error in Texture constructor:  the width and height must be positive." << endl;
+			exit(1);
+		}
+		int full = fullLevels( width, height );
+		if( numLevels <= 0 || numLevels > full ) numLevels = full;
+
+		GLenum pixelFormat, type;
+		textureFormatInfo( format, pixelFormat, type );
+		const GLenum t = target();
+		glGenTextures( 1, &texID );
+		glBindTexture( t, texID );
+		for( int level = 0; level < numLevels; level++ ) {
+			if( numLayers > 0 )
+				glTexImage3D( t, level, format, this->width(level), this->height(level), numLayers, 0, pixelFormat, type, NULL );
+			else
+				glTexImage2D( t, level, format, this->width(level), this->height(level), 0, pixelFormat, type, NULL );
+		}
+		glTexParameteri( t, GL_TEXTURE_BASE_LEVEL, 0 );
+		glTexParameteri( t, GL_TEXTURE_MAX_LEVEL, numLevels - 1 );
+		glTexParameteri( t, GL_TEXTURE_MIN_FILTER, numLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR );
+		glTexParameteri( t, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+		glTexParameteri( t, GL_TEXTURE_WRAP_S, GL_REPEAT );
+		glTexParameteri( t, GL_TEXTURE_WRAP_T, GL_REPEAT );
+		glBindTexture( t, 0 );
+		trackMemory( MEMORY_TEXTURES, (long long)gpuBytes() );
+	}
+
+	inline Texture::Texture( Texture && other ) :
+		texID(other.texID), w(other.w), h(other.h), numLevels(other.numLevels), numLayers(other.numLayers), format(other.format)
+	{
+		other.texID = 0;
+	}
+
+	inline Texture & Texture::operator = ( Texture && other ) {
+		if( this != &other ) {
+			release();
+			texID = other.texID;
+			w = other.w;
+			h = other.h;
+			numLevels = other.numLevels;
+			numLayers = other.numLayers;
+			format = other.format;
+			other.texID = 0;
+		}
+		return *this;
+	}
+
+	inline Texture::~Texture() {
+		release();
+	}
+
+	inline void Texture::release() {
+		if( texID == 0 ) return;
+		glDeleteTextures( 1, &texID );
+		trackMemory( MEMORY_TEXTURES, -(long long)gpuBytes() );
+		texID = 0;
+	}
+
+	inline GLsizei Texture::width( int level ) const {
+		return std::max( 1, w >> level );
+	}
+
+	inline GLsizei Texture::height( int level ) const {
+		return std::max( 1, h >> level );
+	}
+
+	inline size_t Texture::levelBytes( int level ) const {
+		GLenum pixelFormat, type;
+		return textureFormatInfo( format, pixelFormat, type ) * width(level) * height(level) * std::max( numLayers, 1 );
+	}
+
+	inline size_t Texture::gpuBytes() const {
+		size_t total = 0;
+		for( int level = 0; level < numLevels; level++ ) total += levelBytes( level );
+		return total;
+	}
+
+	inline int Texture::fullLevels( GLsizei width, GLsizei height ) {
+		int levels = 1;
+		for( GLsizei size = std::max( width, height ); size > 1; size >>= 1 ) levels++;
+		return levels;
+	}
+
+	inline void Texture::copyImageData( int level, const void * data, GLenum pixelFormat, GLenum type ) {
+		if( level < 0 || level >= numLevels ) {
+			cerr << "Error in Texture.copyImageData: the texture has no level " << level << "." << endl;
+			return;
+		}
+		GLTW_TRACE_INTERNAL( "Texture::copyImageData" );
+		glBindTexture( target(), texID );
+		if( numLayers > 0 )
+			glTexSubImage3D( target(), level, 0, 0, 0, width(level), height(level), numLayers, pixelFormat, type, data );
+		else
+			glTexSubImage2D( target(), level, 0, 0, width(level), height(level), pixelFormat, type, data );
+		glBindTexture( target(), 0 );
+		GLTW_TRACE_COUNT( COUNTER_BYTES_UPLOADED, levelBytes( level ) );
+	}
+
+	inline void Texture::copyLayerData( int layer, int level, const void * data, GLenum pixelFormat, GLenum type ) {
+		if( layer < 0 || layer >= numLayers || level < 0 || level >= numLevels ) {
+			cerr << "Error in Texture.copyLayerData: the texture has no layer " << layer << " at level " << level << "." << endl;
+			return;
+		}
+		GLTW_TRACE_INTERNAL( "Texture::copyLayerData" );
+		glBindTexture( GL_TEXTURE_2D_ARRAY, texID );
+		glTexSubImage3D( GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width(level), height(level), 1, pixelFormat, type, data );
+		glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+		GLTW_TRACE_COUNT( COUNTER_BYTES_UPLOADED, levelBytes( level ) / numLayers );
+	}
+
+	inline void Texture::generateMipmaps() {
+		GLTW_TRACE_INTERNAL( "Texture::generateMipmaps" );
+		glBindTexture( target(), texID );
+		glGenerateMipmap( target() );
+		glBindTexture( target(), 0 );
+	}
+
+	inline void Texture::setBaseLevel( int level ) {
+		glBindTexture( target(), texID );
+		glTexParameteri( target(), GL_TEXTURE_BASE_LEVEL, std::min( std::max( level, 0 ), numLevels - 1 ) );
+		glBindTexture( target(), 0 );
+	}
+
+	inline void Texture::setFilter( GLenum minFilter, GLenum magFilter ) {
+		glBindTexture( target(), texID );
+		glTexParameteri( target(), GL_TEXTURE_MIN_FILTER, minFilter );
+		glTexParameteri( target(), GL_TEXTURE_MAG_FILTER, magFilter );
+		glBindTexture( target(), 0 );
+	}
+
+	inline void Texture::setWrap( GLenum wrapS, GLenum wrapT ) {
+		glBindTexture( target(), texID );
+		glTexParameteri( target(), GL_TEXTURE_WRAP_S, wrapS );
+		glTexParameteri( target(), GL_TEXTURE_WRAP_T, wrapT );
+		glBindTexture( target(), 0 );
+	}
+
+	inline void Texture::bind( int unit ) const {
+		glActiveTexture( GL_TEXTURE0 + unit );
+		glBindTexture( target(), texID );
+		if( unit != 0 ) glActiveTexture( GL_TEXTURE0 );
+	}
+
+	inline PendingTexture::PendingTexture( std::vector<unsigned char> && pixels, GLsizei w, GLsizei h, bool mipmaps ) :
+		width(w), height(h), numLevels(mipmaps ? Texture::fullLevels( w, h ) : 1), nextLevel(numLevels - 1),
+		baseLevel(numLevels), loaded(numLevels, false), isReady(false)
+	{
+		data.resize( numLevels );
+		data[0] = std::move( pixels );
+	}
+
+	inline TextureUploader::TextureUploader( size_t bytesPerFrame, int numThreads ) :
+		quit(false), budget(bytesPerFrame), numPending(0)
+	{
+		for( int i = 0; i < std::max( numThreads, 1 ); i++ ) {
+			workers.push_back( std::thread( &TextureUploader::workerLoop, this ) );
+		}
+	}
+
+	inline TextureUploader::~TextureUploader() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for( size_t i = 0; i < workers.size(); i++ ) workers[i].join();
+
+		for( size_t i = 0; i < staging.size(); i++ ) {
+			Staging & s = staging[i];
+			if( s.mapped ) {
+				glBindBuffer( GL_PIXEL_UNPACK_BUFFER, s.pbo );
+				glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+			}
+			if( s.fence != 0 ) glDeleteSync( s.fence );
+			glDeleteBuffers( 1, &s.pbo );
+			trackMemory( MEMORY_TEXTURES, -(long long)s.size );
+		}
+		glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+	}
+
+	inline PendingTexturePtr TextureUploader::upload( std::vector<unsigned char> pixels, GLsizei width, GLsizei height, bool mipmaps ) {
+		if( width <= 0 || height <= 0 || pixels.size() != 4 * (size_t)width * height ) {
+			cerr << "Error in TextureUploader.upload: the image must hold 4 bytes for each of its pixels." << endl;
+			return PendingTexturePtr();
+		}
+		PendingTexturePtr pending = std::make_shared<PendingTexture>( std::move(pixels), width, height, mipmaps );
+		pending->result.reset( new Texture( width, height, pending->numLevels, GL_RGBA8 ) );
+		Task task = { pending, -1, 0, NULL };
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.push_back( task );
+		}
+		numPending++;
+		wake.notify_one();
+		return pending;
+	}
+
+	inline void TextureUploader::workerLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			while( !quit && tasks.empty() ) wake.wait(lock);
+			if( quit ) break;
+			Task task = tasks.front();
+			tasks.pop_front();
+			lock.unlock();
+
+			if( task.level < 0 ) {
+				GLTW_TRACE_INTERNAL( "TextureUploader::generateLevels" );
+				generateLevels( *task.texture );
+			} else {
+				GLTW_TRACE_INTERNAL( "TextureUploader::copy" );
+				const std::vector<unsigned char> & level = task.texture->data[task.level];
+				memcpy( task.dest, level.data(), level.size() );
+			}
+
+			lock.lock();
+			if( task.level < 0 ) generated.push_back( task.texture );
+			else copied.push_back( task );
+		}
+	}
+
+	inline void TextureUploader::generateLevels( PendingTexture & texture ) {
+		// Each level averages 2x2 blocks of the one above, repeating the last row or column
+		// of a level with an odd size
+		for( int level = 1; level < texture.numLevels; level++ ) {
+			const GLsizei pw = std::max( 1, texture.width >> (level - 1) ), ph = std::max( 1, texture.height >> (level - 1) );
+			const GLsizei lw = std::max( 1, texture.width >> level ), lh = std::max( 1, texture.height >> level );
+			const unsigned char * src = texture.data[level - 1].data();
+			std::vector<unsigned char> & dest = texture.data[level];
+			dest.resize( 4 * (size_t)lw * lh );
+			for( GLsizei y = 0; y < lh; y++ ) {
+				const unsigned char * row0 = src + 4 * (size_t)pw * std::min( 2 * y, ph - 1 );
+				const unsigned char * row1 = src + 4 * (size_t)pw * std::min( 2 * y + 1, ph - 1 );
+				unsigned char * out = &dest[4 * (size_t)lw * y];
+				for( GLsizei x = 0; x < lw; x++ ) {
+					const size_t x0 = 4 * (size_t)std::min( 2 * x, pw - 1 ), x1 = 4 * (size_t)std::min( 2 * x + 1, pw - 1 );
+					for( int c = 0; c < 4; c++ ) {
+						out[4 * x + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+					}
+				}
+			}
+		}
+	}
+
+	inline size_t TextureUploader::acquireStaging( size_t bytes ) {
+		// The smallest free buffer that is large enough
+		size_t best = staging.size(), spare = staging.size();
+		for( size_t i = 0; i < staging.size(); i++ ) {
+			const Staging & s = staging[i];
+			if( s.mapped || s.fence != 0 ) continue;
+			if( s.size >= bytes ) {
+				if( best == staging.size() || s.size < staging[best].size ) best = i;
+			} else {
+				spare = i;
+			}
+		}
+		if( best != staging.size() ) return best;
+
+		// Grow a free buffer, or add one, rounding the size up to limit reallocation
+		size_t size = 64 << 10;
+		while( size < bytes ) size *= 2;
+		if( spare == staging.size() ) {
+			Staging s = { 0, 0, 0, false };
+			glGenBuffers( 1, &s.pbo );
+			staging.push_back( s );
+		}
+		Staging & s = staging[spare];
+		glBindBuffer( GL_PIXEL_UNPACK_BUFFER, s.pbo );
+		glBufferData( GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW );
+		trackMemory( MEMORY_TEXTURES, (long long)size - (long long)s.size );
+		s.size = size;
+		return spare;
+	}
+
+	inline size_t TextureUploader::update() {
+		GLTW_TRACE_INTERNAL( "TextureUploader::update" );
+		std::vector<Task> done;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			uploading.insert( uploading.end(), generated.begin(), generated.end() );
+			generated.clear();
+			done.swap( copied );
+		}
+
+		// Start the transfers of the levels the workers have copied, then restore the
+		// application's binding, which is queried only if there is something to transfer
+		size_t started = 0;
+		GLint boundTexture = -1;
+		for( size_t i = 0; i < done.size(); i++ ) {
+			PendingTexture & texture = *done[i].texture;
+			Staging & s = staging[done[i].staging];
+			const int level = done[i].level;
+			glBindBuffer( GL_PIXEL_UNPACK_BUFFER, s.pbo );
+			s.mapped = false;
+			if( !glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER ) ) {
+				// The buffer's contents were lost, so copy the level again
+				texture.nextLevel = std::max( texture.nextLevel, level );
+				continue;
+			}
+			if( boundTexture < 0 ) glGetIntegerv( GL_TEXTURE_BINDING_2D, &boundTexture );
+			glBindTexture( GL_TEXTURE_2D, texture.result->id() );
+			glTexSubImage2D( GL_TEXTURE_2D, level, 0, 0, texture.result->width(level), texture.result->height(level),
+				GL_RGBA, GL_UNSIGNED_BYTE, 0 );
+			s.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+			started += texture.data[level].size();
+			GLTW_TRACE_COUNT( COUNTER_BYTES_UPLOADED, texture.data[level].size() );
+			std::vector<unsigned char>().swap( texture.data[level] );
+
+			texture.loaded[level] = true;
+			int base = texture.baseLevel;
+			while( base > 0 && texture.loaded[base - 1] ) base--;
+			if( base != texture.baseLevel ) {
+				texture.baseLevel = base;
+				glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base );
+			}
+			if( base == 0 ) {
+				texture.isReady = true;
+				numPending--;
+			}
+		}
+		if( boundTexture >= 0 ) glBindTexture( GL_TEXTURE_2D, (GLuint)boundTexture );
+
+		// Recycle the buffers whose transfers have finished
+		for( size_t i = 0; i < staging.size(); i++ ) {
+			Staging & s = staging[i];
+			if( s.fence == 0 ) continue;
+			GLenum status = glClientWaitSync( s.fence, 0, 0 );
+			if( status == GL_TIMEOUT_EXPIRED ) continue;
+			if( status == GL_WAIT_FAILED ) {
+				cerr << "TextureUploader: waiting for an upload failed." << endl;
+			}
+			glDeleteSync( s.fence );
+			s.fence = 0;
+		}
+
+		// Map buffers for the next levels, smallest first, within the budget
+		size_t issued = 0;
+		bool full = false;
+		std::vector<Task> issue;
+		size_t kept = 0;
+		for( size_t i = 0; i < uploading.size(); i++ ) {
+			PendingTexture & texture = *uploading[i];
+			while( !full && texture.nextLevel >= 0 ) {
+				const int level = texture.nextLevel;
+				const size_t bytes = texture.data[level].size();
+				if( issued > 0 && issued + bytes > budget ) {
+					full = true;
+					break;
+				}
+				size_t index = acquireStaging( bytes );
+				glBindBuffer( GL_PIXEL_UNPACK_BUFFER, staging[index].pbo );
+				void * dest = glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+				if( dest == NULL ) {
+					cerr << "TextureUploader: unable to map a pixel unpack buffer." << endl;
+					full = true;
+					break;
+				}
+				staging[index].mapped = true;
+				Task task = { uploading[i], level, index, dest };
+				issue.push_back( task );
+				issued += bytes;
+				texture.nextLevel--;
+			}
+			if( !texture.isReady ) uploading[kept++] = uploading[i];
+		}
+		uploading.resize( kept );
+		glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+
+		if( !issue.empty() ) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				tasks.insert( tasks.end(), issue.begin(), issue.end() );
+			}
+			wake.notify_all();
+		}
+		return started;
+	}
+}
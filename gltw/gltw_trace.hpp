@@ -0,0 +1,181 @@
+#ifndef __gltw_trace_hpp
+#define __gltw_trace_hpp
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace gltw {
+
+	/// @defgroup trace Tracing
+	/// <p>GLTW can record where its CPU time goes: shader compilation and linking, the shape
+	/// builders, buffer uploads and draw calls are marked with scoped trace events, and
+	/// render counters are kept for each frame.  The trace is written in the Chrome
+	/// <code>trace_event</code> JSON format, which can be opened in chrome://tracing or
+	/// Perfetto.</p>
+	///
+	/// <p>The markers are only compiled in when <code>GLTW_TRACE</code> is defined before
+	/// including gltw.hpp; otherwise they cost nothing.  The functions below always
+	/// exist, but without GLTW_TRACE the trace only holds the application's own
+	/// GLTW_TRACE_SCOPE events, and the counters stay at zero.  Each thread records into its
+	/// own buffer without locking.</p>
+	///
+	/// <p><code>
+	///    #define GLTW_TRACE<br />
+	///    #include "gltw/gltw.hpp"<br />
+	///    <br />
+	///    gltw::startTrace();<br />
+	///    for( ... ) {<br />
+	///    &nbsp;&nbsp;GLTW_TRACE_SCOPE( "frame" );<br />
+	///    &nbsp;&nbsp;drawScene();<br />
+	///    &nbsp;&nbsp;gltw::RenderCounters counters = gltw::traceFrame();<br />
+	///    }<br />
+	///    gltw::stopTrace();<br />
+	///    gltw::writeChromeTrace( "trace.json" );<br />
+	/// </code></p>
+	/// @{
+
+	/** The render counters kept by the trace */
+	enum TraceCounter {
+		/** Draw calls */
+		COUNTER_DRAWS,
+		/** Vertices submitted by draw calls, counting each element of indexed draws */
+		COUNTER_VERTICES,
+		/** Bytes copied into buffer objects */
+		COUNTER_BYTES_UPLOADED,
+		/** Changes of the active shader program */
+		COUNTER_PROGRAM_SWITCHES,
+		NUM_TRACE_COUNTERS
+	};
+
+	/** The render counters of one frame, see ::traceFrame */
+	struct RenderCounters {
+		unsigned long long draws;
+		unsigned long long vertices;
+		unsigned long long bytesUploaded;
+		unsigned long long programSwitches;
+	};
+
+	/**
+	 * Start recording, discarding any earlier trace.  Call this while no traced work is
+	 * running on other threads.
+	 *
+	 * @param eventsPerThread the number of events each thread can record.  Later events
+	 *    are dropped, and counted.
+	 */
+	void startTrace( size_t eventsPerThread = 1 << 16 );
+
+	/** Stop recording.  The events recorded so far are kept for writeChromeTrace. */
+	void stopTrace();
+
+	/** @return whether events are being recorded */
+	bool tracing();
+
+	/**
+	 * End a frame: the counters are recorded in the trace as counter events, if it is
+	 * running, and reset to zero.
+	 *
+	 * @return the counters accumulated since the last call
+	 */
+	RenderCounters traceFrame();
+
+	/** Add to one of the render counters, if the trace is running */
+	void traceCount( TraceCounter counter, unsigned long long n );
+
+	/**
+	 * Write the recorded events and frame counters in the Chrome trace_event format.
+	 *
+	 * @param out the stream to write the JSON to
+	 */
+	void writeChromeTrace( std::ostream & out );
+
+	/**
+	 * Write the recorded events and frame counters to a file in the Chrome trace_event format.
+	 *
+	 * @param fileName the file to write
+	 * @return false if the file could not be written.
+	 */
+	bool writeChromeTrace( const char * fileName );
+
+	/**
+	 * Records the time from its construction to its destruction as one trace event.
+	 * Usually created with the GLTW_TRACE_SCOPE macro.
+	 */
+	class TraceScope : public NonCopyable {
+	public:
+		/** @param name the name of the event.  It must remain valid until the trace is written, as a string literal does. */
+		explicit TraceScope( const char * name );
+		~TraceScope();
+
+	private:
+		const char * name;
+		long long start;
+		bool active;
+	};
+	/// @}
+
+	/// @privatesection
+	struct TraceEvent {
+		const char * name;
+		long long start, duration;
+	};
+
+	/** The events of one thread.  Only that thread writes them; count is published with release. */
+	struct TraceBuffer {
+		std::unique_ptr<TraceEvent[]> events;
+		size_t capacity;
+		std::atomic<size_t> count, dropped;
+		int thread;
+	};
+
+	struct TraceFrame {
+		long long time;
+		RenderCounters counters;
+	};
+
+	struct TraceState {
+		std::atomic<bool> on;
+		std::chrono::steady_clock::time_point origin;
+		std::atomic<unsigned long long> counters[NUM_TRACE_COUNTERS];
+		std::mutex mutex;
+		// Guarded by mutex
+		std::vector<std::shared_ptr<TraceBuffer> > buffers;
+		std::vector<TraceFrame> frames;
+		size_t capacity;
+
+		TraceState();
+		static TraceState & state();
+	};
+
+	/** @return the calling thread's buffer, created and registered on first use */
+	TraceBuffer & threadTraceBuffer();
+	/** @return the time since startTrace, in nanoseconds */
+	long long traceNow();
+	/// @publicsection
+}
+
+#define GLTW_TRACE_CONCAT2(a, b) a##b
+#define GLTW_TRACE_CONCAT(a, b) GLTW_TRACE_CONCAT2(a, b)
+
+/**
+ * Record the rest of the enclosing scope as a trace event.  Application code may use
+ * this freely: it is always compiled in, and costs one relaxed atomic load when the trace
+ * is not running.
+ */
+#define GLTW_TRACE_SCOPE(name) gltw::TraceScope GLTW_TRACE_CONCAT(gltwTraceScope, __LINE__)( name )
+
+// The markers inside GLTW itself, compiled in only with GLTW_TRACE
+#ifdef GLTW_TRACE
+#define GLTW_TRACE_INTERNAL(name) GLTW_TRACE_SCOPE(name)
+#define GLTW_TRACE_COUNT(counter, n) gltw::traceCount( gltw::counter, (n) )
+#else
+#define GLTW_TRACE_INTERNAL(name) ((void)0)
+#define GLTW_TRACE_COUNT(counter, n) ((void)0)
+#endif
+
+#include "gltw_trace.inl"
+
+#endif
@@ -0,0 +1,175 @@
+#include <fstream>
+
+namespace gltw {
+
+	inline TraceState::TraceState() : on(false), origin(std::chrono::steady_clock::now()), capacity(0) {
+		for( int i = 0; i < NUM_TRACE_COUNTERS; i++ ) counters[i] = 0;
+	}
+
+	inline TraceState & TraceState::state() {
+		static TraceState state;
+		return state;
+	}
+
+	inline long long traceNow() {
+		return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - TraceState::state().origin ).count();
+	}
+
+	inline TraceBuffer & threadTraceBuffer() {
+		// The registry shares ownership, so the events outlive the thread
+		static thread_local std::shared_ptr<TraceBuffer> buffer;
+		if( !buffer ) {
+			TraceState & state = TraceState::state();
+			std::lock_guard<std::mutex> lock( state.mutex );
+			buffer.reset( new TraceBuffer() );
+			buffer->capacity = state.capacity;
+			buffer->events.reset( new TraceEvent[buffer->capacity] );
+			buffer->count = 0;
+			buffer->dropped = 0;
+			buffer->thread = (int)state.buffers.size() + 1;
+			state.buffers.push_back( buffer );
+		}
+		return *buffer;
+	}
+
+	inline void startTrace( size_t eventsPerThread ) {
+		TraceState & state = TraceState::state();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		state.capacity = eventsPerThread;
+		for( size_t i = 0; i < state.buffers.size(); i++ ) {
+			TraceBuffer & buffer = *state.buffers[i];
+			if( buffer.capacity != eventsPerThread ) {
+				buffer.events.reset( new TraceEvent[eventsPerThread] );
+				buffer.capacity = eventsPerThread;
+			}
+			buffer.count = 0;
+			buffer.dropped = 0;
+		}
+		state.frames.clear();
+		for( int i = 0; i < NUM_TRACE_COUNTERS; i++ ) state.counters[i] = 0;
+		state.origin = std::chrono::steady_clock::now();
+		state.on.store( true, std::memory_order_release );
+	}
+
+	inline void stopTrace() {
+		TraceState::state().on.store( false, std::memory_order_release );
+	}
+
+	inline bool tracing() {
+		return TraceState::state().on.load( std::memory_order_relaxed );
+	}
+
+	inline void traceCount( TraceCounter counter, unsigned long long n ) {
+		TraceState & state = TraceState::state();
+		if( state.on.load( std::memory_order_relaxed ) ) state.counters[counter].fetch_add( n, std::memory_order_relaxed );
+	}
+
+	inline RenderCounters traceFrame() {
+		TraceState & state = TraceState::state();
+		RenderCounters counters;
+		counters.draws = state.counters[COUNTER_DRAWS].exchange( 0, std::memory_order_relaxed );
+		counters.vertices = state.counters[COUNTER_VERTICES].exchange( 0, std::memory_order_relaxed );
+		counters.bytesUploaded = state.counters[COUNTER_BYTES_UPLOADED].exchange( 0, std::memory_order_relaxed );
+		counters.programSwitches = state.counters[COUNTER_PROGRAM_SWITCHES].exchange( 0, std::memory_order_relaxed );
+		if( state.on.load( std::memory_order_relaxed ) ) {
+			TraceFrame frame = { traceNow(), counters };
+			std::lock_guard<std::mutex> lock( state.mutex );
+			state.frames.push_back( frame );
+		}
+		return counters;
+	}
+
+	inline TraceScope::TraceScope( const char * eventName ) :
+		name(eventName), start(0), active(TraceState::state().on.load( std::memory_order_relaxed ))
+	{
+		if( active ) start = traceNow();
+	}
+
+	inline TraceScope::~TraceScope() {
+		if( !active ) return;
+		long long end = traceNow();
+		TraceBuffer & buffer = threadTraceBuffer();
+		size_t i = buffer.count.load( std::memory_order_relaxed );
+		if( i >= buffer.capacity ) {
+			buffer.dropped.fetch_add( 1, std::memory_order_relaxed );
+			return;
+		}
+		TraceEvent & event = buffer.events[i];
+		event.name = name;
+		event.start = start;
+		event.duration = end - start;
+		buffer.count.store( i + 1, std::memory_order_release );
+	}
+
+	/// @privatesection
+	inline void writeTraceString( std::ostream & out, const char * s ) {
+		out << '"';
+		for( ; *s; s++ ) {
+			if( *s == '"' || *s == '\\' ) out << '\\' << *s;
+			else if( (unsigned char)*s < 0x20 ) out << ' ';
+			else out << *s;
+		}
+		out << '"';
+	}
+
+	inline void writeTraceTime( std::ostream & out, long long ns ) {
+		// Microseconds, to the nanosecond
+		if( ns < 0 ) {
+			out << '-';
+			ns = -ns;
+		}
+		long long frac = ns % 1000;
+		out << ns / 1000 << '.' << (char)('0' + frac / 100) << (char)('0' + frac / 10 % 10) << (char)('0' + frac % 10);
+	}
+	/// @publicsection
+
+	inline void writeChromeTrace( std::ostream & out ) {
+		TraceState & state = TraceState::state();
+		std::lock_guard<std::mutex> lock( state.mutex );
+		size_t dropped = 0;
+		bool first = true;
+		out << "{\"traceEvents\":[\n";
+		for( size_t b = 0; b < state.buffers.size(); b++ ) {
+			const TraceBuffer & buffer = *state.buffers[b];
+			out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.thread
+				<< ",\"args\":{\"name\":\"thread " << buffer.thread << "\"}}";
+			first = false;
+			const size_t count = buffer.count.load( std::memory_order_acquire );
+			for( size_t i = 0; i < count; i++ ) {
+				const TraceEvent & event = buffer.events[i];
+				out << ",\n{\"name\":";
+				writeTraceString( out, event.name );
+				out << ",\"cat\":\"gltw\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.thread << ",\"ts\":";
+				writeTraceTime( out, event.start );
+				out << ",\"dur\":";
+				writeTraceTime( out, event.duration );
+				out << "}";
+			}
+			dropped += buffer.dropped.load( std::memory_order_relaxed );
+		}
+		for( size_t f = 0; f < state.frames.size(); f++ ) {
+			const TraceFrame & frame = state.frames[f];
+			out << (first ? "" : ",\n") << "{\"name\":\"frame\",\"ph\":\"C\",\"pid\":1,\"ts\":";
+			writeTraceTime( out, frame.time );
+			out << ",\"args\":{\"draws\":" << frame.counters.draws << ",\"vertices\":" << frame.counters.vertices
+				<< ",\"bytesUploaded\":" << frame.counters.bytesUploaded
+				<< ",\"programSwitches\":" << frame.counters.programSwitches << "}}";
+			first = false;
+		}
+		out << "\n]}\n";
+		if( dropped > 0 ) {
+			cerr << "writeChromeTrace: " << dropped << " events were dropped because the trace buffers were full." << endl;
+		}
+	}
+
+	inline bool writeChromeTrace( const char * fileName ) {
+		std::ofstream out( fileName );
+		if( !out ) {
+			cerr << "writeChromeTrace: unable to open " << fileName << endl;
+			return false;
+		}
+		writeChromeTrace( out );
+		return (bool)out;
+	}
+}
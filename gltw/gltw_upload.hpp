@@ -0,0 +1,124 @@
+#ifndef __gltw_upload_hpp
+#define __gltw_upload_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gltw {
+
+	/**
+	 * A mesh submitted to a MeshUploader.  The mesh becomes available once its upload
+	 * has completed on the GPU and MeshUploader::update has seen it.
+	 */
+	class PendingMesh : public NonCopyable {
+	public:
+		PendingMesh( MeshData && data, GLenum usage );
+		/** Deletes the fence, if the upload never completed */
+		~PendingMesh();
+
+		/** @return whether or not the mesh is ready to draw */
+		bool ready() const { return isReady; }
+
+		/**
+		 * @return the uploaded mesh, or NULL if it is not ready yet.  The mesh is owned by
+		 *    this object unless it is taken with release().
+		 */
+		TriangleMesh * mesh() const { return isReady ? result.get() : NULL; }
+
+		/** Take ownership of the uploaded mesh.  @return the mesh, or an empty pointer if it is not ready yet. */
+		TriangleMeshPtr release() { return isReady ? std::move(result) : TriangleMeshPtr(); }
+
+	private:
+		friend class MeshUploader;
+
+		MeshData data;
+		GLenum usage;
+		TriangleMeshPtr result;
+		GLsync fence;
+		bool isReady;
+	};
+
+	/** A PendingMesh shared between the caller and the MeshUploader */
+	typedef std::shared_ptr<PendingMesh> PendingMeshPtr;
+
+	/**
+	 * <p>Uploads meshes on a background thread, so that loading large meshes does not
+	 * stall rendering.  The thread has its own OpenGL context, which must share objects
+	 * with the rendering context.  Creating that context is up to the windowing library,
+	 * so the MeshUploader is given a function that makes it current on the upload thread.</p>
+	 *
+	 * <p>The upload thread creates and fills the buffers (computing normals if the data has
+	 * none), then inserts a fence.  Vertex array objects are not shared between contexts, so
+	 * update(), called on the rendering thread, waits for the fence without blocking and
+	 * builds the mesh's vertex array there (see VertexBatch::prepare).</p>
+	 *
+	 * <p><code>
+	 *    // Initialization, using GLFW with a hidden window sharing the main window's context<br />
+	 *    glfwWindowHint( GLFW_VISIBLE, GLFW_FALSE );<br />
+	 *    GLFWwindow * uploadWindow = glfwCreateWindow( 1, 1, "", NULL, mainWindow );<br />
+	 *    gltw::MeshUploader uploader( [=]() { glfwMakeContextCurrent( uploadWindow ); } );<br />
+	 *    gltw::PendingMeshPtr bunny = uploader.upload( std::move( bunnyData ) );<br />
+	 *    <br />
+	 *    // Within the draw function<br />
+	 *    uploader.update();<br />
+	 *    if( bunny->ready() ) bunny->mesh()->draw();<br />
+	 * </code></p>
+	 */
+	class MeshUploader : public NonCopyable {
+	public:
+		/**
+		 * Start the upload thread.
+		 *
+		 * @param makeCurrent called on the upload thread when it starts, to make its context current
+		 * @param doneCurrent called on the upload thread before it exits (optional)
+		 */
+		explicit MeshUploader( const std::function<void()> & makeCurrent,
+			const std::function<void()> & doneCurrent = std::function<void()>() );
+
+		/** Stops the upload thread.  Meshes that have not started uploading are dropped. */
+		~MeshUploader();
+
+		/**
+		 * Queue mesh data for upload.  Pass the data with std::move to avoid a copy; its
+		 * memory is freed once it has been copied into the buffers.
+		 *
+		 * @param data the mesh data
+		 * @param usage the buffer usage specifer to be used, defaults to GL_STATIC_DRAW.
+		 * @return a handle that becomes ready once the upload has completed
+		 */
+		PendingMeshPtr upload( MeshData data, GLenum usage = GL_STATIC_DRAW );
+
+		/**
+		 * Finish any uploads that have completed on the GPU.  This must be called on the
+		 * rendering thread, typically once per frame.  It never waits for the GPU.
+		 *
+		 * @return the number of meshes that became ready
+		 */
+		int update();
+
+		/** @return the number of meshes that have been queued but are not ready yet */
+		size_t pending() const { return numPending; }
+
+	private:
+		void workerLoop( std::function<void()> makeCurrent, std::function<void()> doneCurrent );
+
+		std::thread worker;
+		std::mutex mutex;
+		std::condition_variable wake;
+		// Waiting to upload, and uploaded but waiting for their fences
+		std::deque<PendingMeshPtr> queue;
+		std::vector<PendingMeshPtr> uploaded, fenced;
+		std::atomic<size_t> numPending;
+		bool quit;
+	};
+}
+
+#include "gltw_upload.inl"
+
+#endif
@@ -0,0 +1,97 @@
+namespace gltw {
+
+	inline PendingMesh::PendingMesh( MeshData && meshData, GLenum hint ) :
+		data(std::move(meshData)), usage(hint), fence(0), isReady(false)
+	{ }
+
+	inline PendingMesh::~PendingMesh() {
+		if( fence != 0 ) glDeleteSync( fence );
+	}
+
+	inline MeshUploader::MeshUploader( const std::function<void()> & makeCurrent, const std::function<void()> & doneCurrent ) :
+		numPending(0), quit(false)
+	{
+		worker = std::thread( &MeshUploader::workerLoop, this, makeCurrent, doneCurrent );
+	}
+
+	inline MeshUploader::~MeshUploader() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		worker.join();
+	}
+
+	inline PendingMeshPtr MeshUploader::upload( MeshData data, GLenum usage ) {
+		PendingMeshPtr pending = std::make_shared<PendingMesh>( std::move(data), usage );
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back( pending );
+			numPending++;
+		}
+		wake.notify_one();
+		return pending;
+	}
+
+	inline void MeshUploader::workerLoop( std::function<void()> makeCurrent, std::function<void()> doneCurrent ) {
+		makeCurrent();
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			while( !quit && queue.empty() ) wake.wait(lock);
+			if( quit ) break;
+			PendingMeshPtr pending = queue.front();
+			queue.pop_front();
+			lock.unlock();
+
+			GLTW_TRACE_INTERNAL( "MeshUploader::upload" );
+			MeshData &data = pending->data;
+			if( data.normals.empty() ) computeNormals( data );
+			pending->result.reset( new TriangleMesh( data, pending->usage ) );
+			// Make sure the fence reaches the GPU, so that the rendering thread sees it signalled
+			pending->fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+			glFlush();
+			MeshData().positions.swap( data.positions );
+			MeshData().normals.swap( data.normals );
+			MeshData().colors.swap( data.colors );
+			MeshData().texCoords.swap( data.texCoords );
+			MeshData().elements.swap( data.elements );
+
+			lock.lock();
+			uploaded.push_back( pending );
+		}
+		lock.unlock();
+		if( doneCurrent ) doneCurrent();
+	}
+
+	inline int MeshUploader::update() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			fenced.insert( fenced.end(), uploaded.begin(), uploaded.end() );
+			uploaded.clear();
+		}
+
+		int completed = 0;
+		size_t kept = 0;
+		for( size_t i = 0; i < fenced.size(); i++ ) {
+			PendingMesh &pending = *fenced[i];
+			GLenum status = glClientWaitSync( pending.fence, 0, 0 );
+			if( status == GL_TIMEOUT_EXPIRED ) {
+				fenced[kept++] = fenced[i];
+				continue;
+			}
+			if( status == GL_WAIT_FAILED ) {
+				cerr << "MeshUploader: waiting for an upload failed." << endl;
+			}
+			glDeleteSync( pending.fence );
+			pending.fence = 0;
+			// The vertex array object belongs to this context
+			pending.result->prepare();
+			pending.isReady = true;
+			numPending--;
+			completed++;
+		}
+		fenced.resize( kept );
+		return completed;
+	}
+}
@@ -1,8 +1,26 @@
 #ifndef __gltw_util_hpp
 #define __gltw_util_hpp
 
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 namespace gltw {
 
+	/** Inheriting from this should disallow copying via copy constructor or
+	 assignment operator. */
+	class NonCopyable {
+	private:
+		NonCopyable(const NonCopyable& other );
+		NonCopyable & operator = (const NonCopyable & other );
+	public:
+		NonCopyable() { }
+	};
+
 	/** 
 	 * Check for the presence of an OpenGL error by calling glGetError.
 	 * If any errors are present, it will display the error to standard error.
@@ -17,6 +35,117 @@ namespace gltw {
 	 */
 	void checkForOpenGLError(const char * fileName, int line);
 
+	/**
+	 * Identifies a particular version of a file on disk: its modification time
+	 * and its size.  Two stamps compare equal when the file has not changed.
+	 */
+	struct FileStamp {
+		/** The modification time, in nanoseconds where the platform supports it */
+		long long modTime;
+		/** The size of the file in bytes */
+		long long size;
+
+		bool operator==( const FileStamp &other ) const { return modTime == other.modTime && size == other.size; }
+		bool operator!=( const FileStamp &other ) const { return !(*this == other); }
+	};
+
+	/**
+	 * Retrieve the modification time and size of a file.
+	 *
+	 * @param fileName the name of the file
+	 * @param stamp (out) receives the stamp of the file
+	 * @return false if the file does not exist or cannot be accessed.
+	 */
+	bool getFileStamp( const char * fileName, FileStamp &stamp /*out*/ );
+
+	/**
+	 * A read-only view of the entire contents of a file.  On POSIX systems the
+	 * file is memory-mapped, otherwise it is loaded with a single bulk read.
+	 * The contents remain valid until the object is closed or destroyed.
+	 */
+	class MappedFile : public NonCopyable {
+	public:
+		/** Constructs an empty MappedFile.  Use open() to map a file. */
+		MappedFile();
+		/** Constructs a MappedFile and opens the given file.  Use isOpen() to check for success. */
+		explicit MappedFile( const char * fileName );
+		/** Unmaps the file */
+		~MappedFile();
+
+		/**
+		 * Map the contents of a file, closing any file that is currently open.
+		 *
+		 * @param fileName the name of the file
+		 * @return true if the file could be opened and mapped.
+		 */
+		bool open( const char * fileName );
+		/** Unmap the file (if any) */
+		void close();
+
+		/** @return whether or not a file is currently mapped */
+		bool isOpen() const { return opened; }
+		/** @return a pointer to the first byte of the file (not null terminated) */
+		const char * data() const { return bytes; }
+		/** @return the size of the file in bytes */
+		size_t size() const { return length; }
+
+	private:
+		const char * bytes;
+		size_t length;
+		bool opened;
+		bool mapped;
+	};
+
+
+	/**
+	 * A fixed set of worker threads for running loops in parallel.  Threads are
+	 * created once, so a parallelFor costs little more than waking the workers.
+	 */
+	class ThreadPool : public NonCopyable {
+	public:
+		/**
+		 * Starts the worker threads.
+		 *
+		 * @param numThreads the total number of threads to use, including the thread
+		 *    calling parallelFor.  Zero selects the number of hardware threads.
+		 */
+		explicit ThreadPool( int numThreads = 0 );
+		/** Stops the worker threads */
+		~ThreadPool();
+
+		/** @return the total number of threads used by parallelFor, including the caller */
+		int size() const { return (int)workers.size() + 1; }
+
+		/**
+		 * Call fn(i) for every i in [0, count), spread over the worker threads and the
+		 * calling thread, and wait for all calls to complete.  The order of the calls is
+		 * unspecified.  Called from within one of the pool's own jobs, the loop runs
+		 * serially on the calling thread.
+		 *
+		 * @param count the number of iterations
+		 * @param fn the loop body
+		 */
+		void parallelFor( size_t count, const std::function<void(size_t)> &fn );
+
+		/** @return a pool shared by all of GLTW, sized to the number of hardware threads */
+		static ThreadPool & shared();
+
+	private:
+		void workerLoop();
+		void runJob();
+		static bool & insideJob();
+
+		std::vector<std::thread> workers;
+		std::mutex callMutex;
+		std::mutex mutex;
+		std::condition_variable wake, done;
+		const std::function<void(size_t)> * job;
+		size_t jobCount;
+		std::atomic<size_t> next;
+		size_t busy;
+		unsigned int generation;
+		bool quit;
+	};
 }
 
 #include "gltw_util.inl"
@@ -1,3 +1,13 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 
 namespace gltw {
 
@@ -33,4 +43,179 @@ namespace gltw {
 		}
 	}
 
-}
\ No newline at end of file
+
+	inline bool getFileStamp( const char * fileName, FileStamp &stamp )
+	{
+		struct stat info;
+		if( stat( fileName, &info ) != 0 ) return false;
+#if defined(__linux__)
+		stamp.modTime = (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+		stamp.modTime = (long long)info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+		stamp.modTime = (long long)info.st_mtime * 1000000000LL;
+#endif
+		stamp.size = (long long)info.st_size;
+		return true;
+	}
+
+	inline MappedFile::MappedFile() : bytes(NULL), length(0), opened(false), mapped(false) { }
+
+	inline MappedFile::MappedFile( const char * fileName ) : bytes(NULL), length(0), opened(false), mapped(false) {
+		open(fileName);
+	}
+
+	inline MappedFile::~MappedFile() {
+		close();
+	}
+
+#ifndef _WIN32
+	inline bool MappedFile::open( const char * fileName ) {
+		close();
+
+		int fd = ::open( fileName, O_RDONLY );
+		if( fd < 0 ) return false;
+
+		struct stat info;
+		if( fstat( fd, &info ) != 0 || !S_ISREG(info.st_mode) ) {
+			::close(fd);
+			return false;
+		}
+
+		length = (size_t)info.st_size;
+		if( length > 0 ) {
+			void * ptr = mmap( NULL, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+			if( ptr == MAP_FAILED ) {
+				::close(fd);
+				length = 0;
+				return false;
+			}
+			madvise( ptr, length, MADV_SEQUENTIAL );
+			bytes = (const char *)ptr;
+			mapped = true;
+		}
+		// The mapping remains valid after the descriptor is closed
+		::close(fd);
+		opened = true;
+		return true;
+	}
+
+	inline void MappedFile::close() {
+		if( mapped ) munmap( (void *)bytes, length );
+		bytes = NULL;
+		length = 0;
+		opened = mapped = false;
+	}
+#else
+	inline bool MappedFile::open( const char * fileName ) {
+		close();
+
+		std::ifstream inFile( fileName, std::ios::in | std::ios::binary );
+		if( !inFile ) return false;
+		inFile.seekg( 0, std::ios::end );
+		std::streamoff len = inFile.tellg();
+		if( len < 0 ) return false;
+		inFile.seekg( 0, std::ios::beg );
+
+		length = (size_t)len;
+		if( length > 0 ) {
+			char * buf = new char[length];
+			if( !inFile.read( buf, len ) ) {
+				delete [] buf;
+				length = 0;
+				return false;
+			}
+			bytes = buf;
+			mapped = true;
+		}
+		opened = true;
+		return true;
+	}
+
+	inline void MappedFile::close() {
+		if( mapped ) delete [] bytes;
+		bytes = NULL;
+		length = 0;
+		opened = mapped = false;
+	}
+#endif
+
+
+	inline ThreadPool::ThreadPool( int numThreads ) :
+		job(NULL), jobCount(0), next(0), busy(0), generation(0), quit(false)
+	{
+		if( numThreads <= 0 ) numThreads = (int)std::thread::hardware_concurrency();
+		for( int i = 1; i < numThreads; i++ )
+			workers.push_back( std::thread( &ThreadPool::workerLoop, this ) );
+	}
+
+	inline ThreadPool::~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for( size_t i = 0; i < workers.size(); i++ ) workers[i].join();
+	}
+
+	inline bool & ThreadPool::insideJob() {
+		static thread_local bool inside = false;
+		return inside;
+	}
+
+	inline ThreadPool & ThreadPool::shared() {
+		static ThreadPool *pool = new ThreadPool();
+		return *pool;
+	}
+
+	inline void ThreadPool::runJob() {
+		bool &inside = insideJob();
+		bool wasInside = inside;
+		inside = true;
+		for( size_t i = next++; i < jobCount; i = next++ )
+			(*job)(i);
+		inside = wasInside;
+	}
+
+	inline void ThreadPool::workerLoop() {
+		unsigned int seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			while( !quit && generation == seen ) wake.wait(lock);
+			if( quit ) return;
+			seen = generation;
+
+			lock.unlock();
+			runJob();
+			lock.lock();
+
+			if( --busy == 0 ) done.notify_all();
+		}
+	}
+
+	inline void ThreadPool::parallelFor( size_t count, const std::function<void(size_t)> &fn ) {
+		if( count == 0 ) return;
+		if( workers.empty() || count == 1 || insideJob() ) {
+			for( size_t i = 0; i < count; i++ ) fn(i);
+			return;
+		}
+
+		// One loop at a time
+		std::lock_guard<std::mutex> call(callMutex);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &fn;
+			jobCount = count;
+			next = 0;
+			busy = workers.size();
+			generation++;
+		}
+		wake.notify_all();
+
+		runJob();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		while( busy != 0 ) done.wait(lock);
+		job = NULL;
+	}
+}